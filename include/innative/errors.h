@@ -53,6 +53,7 @@ enum IN_ERROR
   ERR_FATAL_NO_START_FUNCTION,
   ERR_FATAL_INVALID_INDEX,
   ERR_FATAL_SECTION_SIZE_MISMATCH,
+  ERR_FATAL_SNAPSHOT_FAILED,
 
   // Validation errors that prevent compiling the module
   ERR_VALIDATION_ERROR = -0xFFF,
@@ -114,6 +115,12 @@ enum IN_ERROR
   ERR_SIGNATURE_MISMATCH,
   ERR_EXPECTED_ELSE_INSTRUCTION,
   ERR_ILLEGAL_C_IMPORT,
+  ERR_INVALID_LANE_INDEX,
+  ERR_INVALID_DATA_INDEX,
+  ERR_INVALID_ELEMENT_INDEX,
+  ERR_DATA_COUNT_MISMATCH,
+  ERR_MISSING_DATA_COUNT,
+  ERR_MULTI_INSTANCE_IMPORT,
 
   // Compilation errors when parsing WAT
   ERR_WAT_INTERNAL_ERROR = -0xFFFFF,
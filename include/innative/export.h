@@ -27,6 +27,13 @@
 
 #define IN_INIT_FUNCTION "_innative_internal_start"
 #define IN_EXIT_FUNCTION "_innative_internal_exit"
+#define IN_TRAP_FUNCTION "_innative_internal_env_trap"
+#define IN_TRAP_INFO "_innative_internal_env_last_trap"
+#define IN_DETECT_CPU_FUNCTION "_innative_internal_env_detect_cpu"
+#define IN_CPU_LEVEL "_innative_internal_env_cpu_level"
+#define IN_INSTANCE_LAYOUT "_innative_internal_instance_layout"
+#define IN_POOL_CONFIGURE_FUNCTION "_innative_internal_env_pool_configure"
+#define IN_POOL_STATS_FUNCTION "_innative_internal_env_pool_stats"
 
 #ifdef __cplusplus
 extern "C" {
@@ -47,6 +54,51 @@ typedef struct IN__TABLE_ENTRY
   varuint32 type;
 } INTableEntry;
 
+// Tables store functions in the internal calling convention, so each one is paired with a wrapper that C can call
+typedef struct IN__TABLE_FUNCTION
+{
+  IN_Entrypoint internal;
+  IN_Entrypoint external;
+  uint32_t replaceable; // Nonzero if the internal convention passes every argument in a register, exactly like C does
+} INTableFunction;
+
+// Identifies which runtime check caused a trap. Every check of the same kind in a function shares one landing pad, which
+// passes one of these codes to the runtime before trapping.
+enum IN_TRAP_CODE
+{
+  IN_TRAP_NONE = 0,
+  IN_TRAP_UNREACHABLE,      // An unreachable instruction was executed
+  IN_TRAP_OUT_OF_BOUNDS,    // Out of bounds linear memory or table access. Has no location if a guard page caught it.
+  IN_TRAP_DIVIDE_BY_ZERO,   // Integer division or remainder by zero
+  IN_TRAP_INTEGER_OVERFLOW, // Signed division overflow, or a float truncation that can't be represented as an integer
+  IN_TRAP_BAD_SIGNATURE,    // Indirect call to a function with the wrong signature
+  IN_TRAP_NULL_TABLE_ENTRY, // Indirect call to a table index that is out of range or has no function
+  IN_TRAP_STACK_OVERFLOW,   // Call stack exhausted. Only reported by an environment that can detect it.
+  IN_TRAP_UNALIGNED_ATOMIC, // Atomic memory access that isn't naturally aligned
+  IN_TRAP_OUT_OF_MEMORY,    // A linear memory or table could not be allocated during initialization
+  IN_TRAP_COUNT
+};
+
+// x86-64 microarchitecture levels, as defined by the x86-64 psABI. A multiversioned program detects the highest level the
+// CPU supports when it starts, and every versioned function dispatches to the clone compiled for that level.
+enum IN_ISA_LEVEL
+{
+  IN_ISA_X86_64_V1 = 1, // Baseline x86-64: SSE2, the minimum every x86-64 CPU supports
+  IN_ISA_X86_64_V2,     // Adds CMPXCHG16B, LAHF/SAHF, POPCNT, SSE3, SSSE3, SSE4.1 and SSE4.2
+  IN_ISA_X86_64_V3,     // Adds AVX, AVX2, BMI1, BMI2, F16C, FMA, LZCNT, MOVBE and XSAVE
+  IN_ISA_X86_64_V4      // Adds AVX512F, AVX512BW, AVX512CD, AVX512DQ and AVX512VL
+};
+
+// Describes the most recent trap recorded by the runtime environment. The location is the line and column of the
+// instruction that failed the check, which for a binary module is always line 1 and the byte offset of the instruction.
+typedef struct IN__TRAP_INFO
+{
+  uint32_t code;     // One of the IN_TRAP_CODE values
+  uint32_t function; // Index of the WebAssembly function in its module, or ~0 if the trap happened outside of one
+  uint32_t line;
+  uint32_t column;
+} INTrapInfo;
+
 typedef struct IN__TABLE
 {
   INTableEntry* entries;
@@ -83,8 +135,35 @@ typedef struct IN__MODULE_METADATA
   INGlobal** globals;
   varuint32 n_functions;
   IN_Entrypoint* functions;
+  varuint32 n_table_functions;
+  INTableFunction* table_functions;
 } INModuleMetadata;
 
+// Describes the instances of an assembly compiled with ENV_MULTI_INSTANCE. Each module keeps its tables, memories and
+// mutable globals in its own block of the given size, and every function of that module finds its block through the
+// instance pointer it is passed. The module metadata then stores the offset of each table, memory and global within the
+// block instead of its address, which GetInstanceData resolves.
+typedef struct IN__INSTANCE_LAYOUT
+{
+  varuint32 n_modules;
+  const uint64_t** sizes; // Size in bytes of the block of each module
+} INInstanceLayout;
+
+// Statistics of one of the slot pools used by an assembly compiled with ENV_POOLED_MEMORY. Linear memories and tables
+// each have their own pool, which reserves every slot up front the first time a slot is needed, and gives the reservation
+// back when the assembly exits with no slot in use.
+typedef struct IN__POOL_STATS
+{
+  uint64_t slot_size; // Size of each slot in bytes
+  uint64_t n_slots;   // Number of slots, or 0 if the pool couldn't be reserved
+  uint64_t in_use;    // Number of slots currently handed out
+  uint64_t acquired;  // Total number of slots handed out
+  uint64_t released;  // Total number of slots returned to the pool
+  uint64_t fallbacks; // Allocations that were too large for a slot or found the pool empty, which fall back to mmap
+  uint64_t zeroed;    // Returned slots that were reset by zeroing the bytes they used
+  uint64_t advised;   // Returned slots that were reset by handing their pages back to the OS
+} INPoolStats;
+
 // Contains pointers to the actual runtime functions
 typedef struct IN__EXPORTS
 {
@@ -98,7 +177,8 @@ typedef struct IN__EXPORTS
   // 'err' won't be valid until FinalizeEnvironment() is called to resolve all pending module loads.
   /// \param env The environment to modify.
   /// \param data Either a pointer to the module in memory, if size is non-zero, or a UTF8 encoded null-terminated string
-  /// pointing to a file that contains the module.
+  /// pointing to a file that contains the module. Files are memory-mapped for the lifetime of the environment, and the
+  /// parsed module refers directly to the mapping for data segments and custom sections.
   /// \param size The length of the memory that the data pointer points to, or zero if the data pointer is actually a UTF8
   /// encoded null terminated string.
   /// \param name A name to use for the module. If the module data does not contain a name, this will be used.
@@ -156,7 +236,7 @@ typedef struct IN__EXPORTS
   void* (*LoadAssembly)(const char* file);
 
   /// Frees a WebAssembly binary, unloading it from memory and performing any cleanup required.
-  /// \param assembly A pointer to a WebAssembly binary loaded by LoadAssembly.
+  /// \param assembly A pointer to a WebAssembly binary loaded by LoadAssembly or compiled by CompileJIT.
   void (*FreeAssembly)(void* assembly);
 
   /// Gets a function from a WebAssembly binary that has been loaded into memory. This function cannot determine the type
@@ -185,20 +265,23 @@ typedef struct IN__EXPORTS
   /// \param module_index A zero-based index. If this is out-of-bounds, the function returns null.
   INModuleMetadata* (*GetModuleMetadata)(void* assembly, uint32_t module_index);
 
-  /// Gets a function pointer from a table, given the specified index. This function has bounds checking.
+  /// Gets a function pointer from a table, given the specified index. This function has bounds checking. For an assembly
+  /// compiled with ENV_MULTI_INSTANCE, use LoadInstanceTableIndex instead, because every instance has its own tables.
   /// \param assembly A pointer to a WebAssembly binary loaded by LoadAssembly.
   /// \param module_index The index of the module the table is exported from.
   /// \param table_index The index of the table the function pointer belongs to.
   /// \param function_index The index of the function pointer.
   IN_Entrypoint (*LoadTableIndex)(void* assembly, uint32_t module_index, uint32_t table_index, varuint32 function_index);
 
-  /// Gets a global value at the specified index, or returns null if the index is out of bounds.
+  /// Gets a global value at the specified index, or returns null if the index is out of bounds. For an assembly compiled
+  /// with ENV_MULTI_INSTANCE, this also returns null for a mutable global, which LoadInstanceGlobalIndex can resolve.
   /// \param assembly A pointer to a WebAssembly binary loaded by LoadAssembly.
   /// \param module_index The index of the module the table is exported from.
   /// \param global_index The index of the global to retrieve.
   INGlobal* (*LoadGlobalIndex)(void* assembly, uint32_t module_index, uint32_t global_index);
 
-  /// Gets a linear memory global at the specified index, or returns null if the index is out of bounds.
+  /// Gets a linear memory global at the specified index, or returns null if the index is out of bounds. For an assembly
+  /// compiled with ENV_MULTI_INSTANCE, use LoadInstanceMemoryIndex instead, because every instance has its own memories.
   /// \param assembly A pointer to a WebAssembly binary loaded by LoadAssembly.
   /// \param module_index The index of the module the table is exported from.
   /// \param global_index The index of the linear memory to retrieve.
@@ -209,7 +292,11 @@ typedef struct IN__EXPORTS
   /// \param module_index The index of the module the table is exported from.
   /// \param table_index The index of the table to search through.
   /// \param function Name of the exported function to search the table for.
-  /// \param replace function pointer to another function that should replace the function's table entry
+  /// \param replace function pointer to another function that should replace the function's table entry. Webassembly calls
+  /// it with the internal tail call convention, which only matches C when every argument is passed in a register, so this
+  /// fails with ERR_INVALID_FUNCTION_SIG if the function takes any argument that would be passed on the stack. For an
+  /// assembly compiled with ENV_MULTI_INSTANCE, this fails with ERR_FATAL_NULL_POINTER, because every instance has its own
+  /// tables, which ReplaceInstanceTableFuncPtr can change.
   int (*ReplaceTableFuncPtr)(void* assembly, uint32_t module_index, uint32_t table_index, const char* function,
                              IN_Entrypoint replace);
 
@@ -360,6 +447,88 @@ typedef struct IN__EXPORTS
   /// \param func The FunctionType object to remove the result value from.
   /// \param index The index of the result value that will be removed.
   int (*RemoveModuleReturn)(Environment* env, FunctionType* func, varuint32 index);
+
+  /// Gets the kind and location of the most recent trap in an assembly loaded by LoadAssembly, or null if the assembly
+  /// doesn't link to an environment that records traps. If nothing has trapped yet, the code is IN_TRAP_NONE. There is only
+  /// one record for the whole assembly, so if several threads trap at once, it could describe any one of them. An access
+  /// caught by a guard page under ENV_GUARD_PAGES only reports where it faulted, not which instruction made it, so its
+  /// function is ~0 and its line and column are 0.
+  /// \param assembly A pointer to a WebAssembly binary loaded by LoadAssembly.
+  const INTrapInfo* (*GetLastTrap)(void* assembly);
+
+  /// Allocates a new, zeroed instance of an assembly compiled with ENV_MULTI_INSTANCE, or returns null if the assembly
+  /// wasn't compiled with ENV_MULTI_INSTANCE. The instance must be initialized by InitInstance before any function is
+  /// called, and every function of the assembly must be passed the instance as its first argument.
+  /// \param assembly A pointer to a WebAssembly binary loaded by LoadAssembly or compiled by CompileJIT.
+  void* (*CreateInstance)(void* assembly);
+
+  /// Runs the init function of the assembly on an instance, which allocates its memories and tables, copies the data and
+  /// element segments into them and runs every start function.
+  /// \param assembly The assembly the instance was created from.
+  /// \param instance An instance returned by CreateInstance that hasn't been initialized yet.
+  int (*InitInstance)(void* assembly, void* instance);
+
+  /// Runs the exit function of the assembly on an instance if it was initialized, then frees it.
+  /// \param assembly The assembly the instance was created from.
+  /// \param instance An instance returned by CreateInstance.
+  void (*DestroyInstance)(void* assembly, void* instance);
+
+  /// Resolves a table, memory or global pointer from the metadata of a multi-instance assembly into its address inside
+  /// the given instance, or returns null if the module index is out of range.
+  /// \param assembly The assembly the instance was created from.
+  /// \param instance An instance returned by CreateInstance.
+  /// \param module_index The index of the module the pointer came from.
+  /// \param offset A pointer taken from the tables, memories or globals of that module's INModuleMetadata.
+  void* (*GetInstanceData)(void* assembly, void* instance, uint32_t module_index, const void* offset);
+
+  /// Same as LoadTableIndex, but looks the table up in the given instance of a multi-instance assembly.
+  /// \param assembly The assembly the instance was created from.
+  /// \param instance An instance returned by CreateInstance that was initialized by InitInstance.
+  IN_Entrypoint (*LoadInstanceTableIndex)(void* assembly, void* instance, uint32_t module_index, uint32_t table_index,
+                                          varuint32 function_index);
+
+  /// Same as LoadGlobalIndex, but resolves a mutable global of a multi-instance assembly inside the given instance.
+  /// \param assembly The assembly the instance was created from.
+  /// \param instance An instance returned by CreateInstance that was initialized by InitInstance.
+  INGlobal* (*LoadInstanceGlobalIndex)(void* assembly, void* instance, uint32_t module_index, uint32_t global_index);
+
+  /// Same as LoadMemoryIndex, but looks the linear memory up in the given instance of a multi-instance assembly.
+  /// \param assembly The assembly the instance was created from.
+  /// \param instance An instance returned by CreateInstance that was initialized by InitInstance.
+  INGlobal* (*LoadInstanceMemoryIndex)(void* assembly, void* instance, uint32_t module_index, uint32_t memory_index);
+
+  /// Same as ReplaceTableFuncPtr, but only replaces the function in the table of the given instance of a multi-instance
+  /// assembly. The replacement is passed the instance as its first argument, like every other function of the assembly.
+  /// \param assembly The assembly the instance was created from.
+  /// \param instance An instance returned by CreateInstance that was initialized by InitInstance.
+  int (*ReplaceInstanceTableFuncPtr)(void* assembly, void* instance, uint32_t module_index, uint32_t table_index,
+                                     const char* function, IN_Entrypoint replace);
+
+  /// Sets the number and size of the slots that an assembly compiled with ENV_POOLED_MEMORY hands out to its linear
+  /// memories and tables. This only works before the first memory or table is allocated, because every slot is reserved
+  /// at once. If either pool was already reserved, neither is changed. A count or size of 0 keeps the default.
+  /// \param assembly A pointer to a WebAssembly binary loaded by LoadAssembly or compiled by CompileJIT.
+  /// \param memory_slots Number of linear memory slots.
+  /// \param memory_slot_size Size of each linear memory slot in bytes, which is the most any pooled memory can grow to.
+  /// \param table_slots Number of table slots.
+  /// \param table_slot_size Size of each table slot in bytes.
+  int (*ConfigurePool)(void* assembly, uint32_t memory_slots, uint64_t memory_slot_size, uint32_t table_slots,
+                       uint64_t table_slot_size);
+
+  /// Gets the statistics of the linear memory and table pools of an assembly compiled with ENV_POOLED_MEMORY.
+  /// \param assembly A pointer to a WebAssembly binary loaded by LoadAssembly or compiled by CompileJIT.
+  /// \param memories Receives the statistics of the linear memory pool.
+  /// \param tables Receives the statistics of the table pool.
+  int (*GetPoolStats)(void* assembly, INPoolStats* memories, INPoolStats* tables);
+
+  /// Compiles all the modules in the environment straight into executable memory using LLVM's ORC JIT, without writing an
+  /// object file, invoking the linker or loading a dynamic library. Runtime symbols from the environment's embeddings are
+  /// resolved in-process. The generated code is handed over to the returned assembly, so this clears the environment's
+  /// compilation cache. Unless ENV_NO_INIT is set, the init function is called before this returns. Returns null on failure,
+  /// otherwise the returned handle can be used like any assembly loaded by LoadAssembly, and must be freed by FreeAssembly.
+  /// \param env The environment to compile.
+  /// \param err A pointer to an integer that receives an error code if the compilation fails. Can be null.
+  void* (*CompileJIT)(Environment* env, int* err);
 } INExports;
 
 /// Statically linked function that loads the runtime stub, which then loads the actual runtime functions into exports.
@@ -389,6 +558,14 @@ IN_COMPILER_DLLEXPORT extern int innative_uninstall();
 /// \param log A C FILE* stream that should be used for logging errors or warnings.
 IN_COMPILER_DLLEXPORT extern int innative_compile_llvm(const char** files, size_t n, int flags, const char* out, FILE* log);
 
+/// Merges raw profiles written by programs compiled with ENV_OPTIMIZE_PROFILE_GENERATE into a single profile, which can
+/// then be assigned to Environment::profile to optimize the program based on how it actually ran.
+/// \param files An array of UTF8 paths to raw profiles (.profraw) or previously merged profiles.
+/// \param n The length of the 'files' array.
+/// \param out The output file that will store the merged profile.
+/// \param log A C FILE* stream that should be used for logging errors or warnings.
+IN_COMPILER_DLLEXPORT extern int innative_merge_profiles(const char** files, size_t n, const char* out, FILE* log);
+
 #ifdef __cplusplus
 }
 #endif
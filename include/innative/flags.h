@@ -51,6 +51,13 @@ enum WASM_ENVIRONMENT_FLAGS
   // them from your code correctly.
   ENV_NO_INIT = (1 << 8),
 
+  // Runs the initialization of every module once at compile time, including data and element segments and start
+  // functions, then replaces each module's initial memories, tables and mutable globals with the state they ended up in
+  // and removes its start function. The compiled library then starts out fully initialized without running any of that
+  // code again. Anything a start function does outside of its module, like calling a C function, only happens at compile
+  // time. Only applies to ENV_LIBRARY, because the start function of an executable is its entry point.
+  ENV_SNAPSHOT = (1 << 9),
+
   // Some platforms, like windows, always require a stack probe if there is any possibility of skipping the stack guard
   // page. This option ensures that a stack probe is always done, even on linux, if a large stack space is requested. This
   // is critical for sandboxing, because otherwise the stack overflow can be used to break out of the program memory space.
@@ -78,14 +85,47 @@ enum WASM_ENVIRONMENT_FLAGS
   ENV_CHECK_INT_DIVISION = (1 << 14),
 
   // The webassembly standard currently does not allow tail calls to prevent stack overflows from turning into endless loops
-  // that lock up a web browser. This option is provided purely for compatibility with the standard.
+  // that lock up a web browser. This option is provided purely for compatibility with the standard. It only affects
+  // ordinary calls; return_call and return_call_indirect from ENV_FEATURE_TAIL_CALL are always tail calls.
   ENV_DISABLE_TAIL_CALL = (1 << 15),
 
+  // Reserves the entire 4 GiB address space of each 32-bit linear memory, plus a guard region large enough to cover any
+  // 32-bit offset, and relies on hardware page faults to catch out-of-bounds accesses instead of inserting explicit checks.
+  // Growing a memory only changes page protections and never moves it. Only applies to 64-bit linux targets, where it
+  // replaces the checks inserted by ENV_CHECK_MEMORY_ACCESS. It is ignored on all other platforms. The resulting traps
+  // carry no function or location, because only the faulting address is known.
+  ENV_GUARD_PAGES = (1 << 16),
+
+  // Reserves the maximum size of each linear memory up front (or 4 GiB if it has no maximum), so that growing a memory
+  // never moves it. This lets the compiler treat the base pointer as loop-invariant instead of reloading it after every
+  // call that might grow memory, at the cost of address space. ENV_GUARD_PAGES implies this.
+  ENV_STABLE_MEMORY = (1 << 17),
+
+  // Keeps every table, linear memory and mutable global in a per-instance block instead of a process-wide global, and
+  // passes a pointer to the instance as a hidden first parameter to every compiled function, including exported ones. One
+  // loaded assembly can then run any number of isolated instances, created with CreateInstance and initialized with
+  // InitInstance. Implies ENV_LIBRARY and ENV_NO_INIT. Modules can't import anything from each other in this mode.
+  ENV_MULTI_INSTANCE = (1 << 18),
+
+  // Hands out linear memories and tables from pools of fixed-size slots that the runtime reserves once, instead of
+  // mapping and unmapping memory for every instance. A freed slot is reset in place and reused, which makes creating and
+  // destroying instances cheap. Linear memories never move inside their slot, so this implies ENV_STABLE_MEMORY. Use
+  // ConfigurePool to change the number and size of the slots. ENV_GUARD_PAGES takes precedence over this.
+  ENV_POOLED_MEMORY = (1 << 19),
+
   // DWARF's "is_stmt" flag marks which assembly lines are actually source code statements, but it is not always reliable.
   ENV_DEBUG_DETECT_IS_STMT = 0, // By default, we check if there are is_stmt flags anywhere and if they exist we use them.
   ENV_DEBUG_USE_IS_STMT    = (1 << 20), // ONLY generates debug information for lines marked with is_stmt, no matter what.
   ENV_DEBUG_IGNORE_IS_STMT = (2 << 20), // ALWAYS generates debug information for all assembly lines, ignoring is_stmt.
 
+  // Stores the active data segments of each linear memory as page-aligned images in their own section of the binary, and
+  // maps them copy-on-write over the memory when it is initialized instead of copying them, so that pages the program
+  // never touches are never read or committed. Only memories whose data segments all have constant offsets and fit inside
+  // their initial size are mapped, the rest are copied as usual. Mapped memories can't be moved, so this implies
+  // ENV_STABLE_MEMORY, and it is ignored with ENV_POOLED_MEMORY. The images are only mapped on 64-bit linux, and copied
+  // everywhere else.
+  ENV_MAPPED_DATA = (1 << 22),
+
   // Strictly adheres to the standard, provided the optimization level does not exceed ENV_OPTIMIZE_STRICT.
   ENV_STRICT = ENV_CHECK_STACK_OVERFLOW | ENV_CHECK_FLOAT_TRUNC | ENV_CHECK_MEMORY_ACCESS | ENV_CHECK_INDIRECT_CALL |
                ENV_DISABLE_TAIL_CALL | ENV_CHECK_INT_DIVISION | ENV_WHITELIST,
@@ -116,12 +156,43 @@ enum WASM_OPTIMIZE_FLAGS
   ENV_OPTIMIZE_STRICT = ENV_OPTIMIZE_O3, // Only performs optimizations that cannot invalidate the standard
   ENV_OPTIMIZE_ALL    = ENV_OPTIMIZE_O3 |
                      ENV_OPTIMIZE_FAST_MATH, // Performs all optimizations, but will never compromise the sandbox.
+
+  // Only applies to CompileJIT. Every function is first compiled without optimizations and counts how often it is called.
+  // Functions that are called often enough are recompiled on a background thread with the optimization level selected by
+  // ENV_OPTIMIZE_OMASK and swapped in while the program keeps running. Calls between functions then go through an extra
+  // indirection, which trades a small amount of steady-state performance for a much faster startup.
+  ENV_OPTIMIZE_TIERED = (1 << 11),
+
+  // Merges every module into the first one before optimizing, so calls from one module into another's exports can be
+  // inlined. This forces every module to be recompiled, bypassing the object cache, and is ignored in debug builds.
+  ENV_OPTIMIZE_LTO = (1 << 12),
+
+  // Instruments every function with profile counters. When the program exits, the counters are written to a raw profile
+  // named after the output file, with a .profraw extension, in the working directory. Raw profiles can be merged with
+  // innative_merge_profiles, and the merged profile passed back in through Environment::profile. Requires an optimization
+  // level other than ENV_OPTIMIZE_O0, and is ignored by CompileJIT.
+  ENV_OPTIMIZE_PROFILE_GENERATE = (1 << 13),
+
+  // Only applies to x86-64. Compiles every function several times, once for each x86-64 microarchitecture level above
+  // the target CPU (see IN_ISA_LEVEL), and turns the original into a dispatcher that calls the clone matching the CPU
+  // detected when the program starts. Without an explicit Environment::cpu, the target CPU becomes baseline x86-64 instead
+  // of the host, so one binary runs on any x86-64 machine while still using AVX2 or AVX-512 where they are available.
+  ENV_OPTIMIZE_MULTIVERSION = (1 << 14),
+
+  // Like ENV_OPTIMIZE_MULTIVERSION, but only clones functions that contain a loop, which is where wider vectors and newer
+  // instructions pay off. Every other function is only compiled for the target CPU, which keeps the binary small.
+  ENV_OPTIMIZE_MULTIVERSION_HOT = (1 << 15),
 };
 
 enum WASM_FEATURE_FLAGS
 {
-  ENV_FEATURE_MUTABLE_GLOBALS = (1 << 0), // https://github.com/WebAssembly/mutable-global
-  ENV_FEATURE_ALL             = ~0,
+  ENV_FEATURE_MUTABLE_GLOBALS     = (1 << 0), // https://github.com/WebAssembly/mutable-global
+  ENV_FEATURE_SIMD                = (1 << 1), // https://github.com/WebAssembly/simd
+  ENV_FEATURE_BULK_MEMORY         = (1 << 2), // https://github.com/WebAssembly/bulk-memory-operations
+  ENV_FEATURE_TAIL_CALL           = (1 << 3), // https://github.com/WebAssembly/tail-call
+  ENV_FEATURE_NONTRAPPING_FPTOINT = (1 << 4), // https://github.com/WebAssembly/nontrapping-float-to-int-conversions
+  ENV_FEATURE_SIGN_EXTENSION      = (1 << 5), // https://github.com/WebAssembly/sign-extension-ops
+  ENV_FEATURE_ALL                 = ~0,
 };
 
 #ifdef __cplusplus
@@ -26,8 +26,10 @@ enum WASM_INSTRUCTION_OPCODES
   OP_return      = 0x0f,
 
   // Call operators
-  OP_call          = 0x10,
-  OP_call_indirect = 0x11,
+  OP_call                 = 0x10,
+  OP_call_indirect        = 0x11,
+  OP_return_call          = 0x12,
+  OP_return_call_indirect = 0x13,
 
   // Parametric operators
   OP_drop   = 0x1a,
@@ -204,6 +206,33 @@ enum WASM_INSTRUCTION_OPCODES
   OP_f32_reinterpret_i32 = 0xbe,
   OP_f64_reinterpret_i64 = 0xbf,
 
+  // Sign extension
+  OP_i32_extend8_s  = 0xc0,
+  OP_i32_extend16_s = 0xc1,
+  OP_i64_extend8_s  = 0xc2,
+  OP_i64_extend16_s = 0xc3,
+  OP_i64_extend32_s = 0xc4,
+
+  // Non-trapping float to int conversions and bulk memory
+  OP_misc_prefix = 0xfc,
+
+  OP_i32_trunc_sat_f32_s = 0x00,
+  OP_i32_trunc_sat_f32_u = 0x01,
+  OP_i32_trunc_sat_f64_s = 0x02,
+  OP_i32_trunc_sat_f64_u = 0x03,
+  OP_i64_trunc_sat_f32_s = 0x04,
+  OP_i64_trunc_sat_f32_u = 0x05,
+  OP_i64_trunc_sat_f64_s = 0x06,
+  OP_i64_trunc_sat_f64_u = 0x07,
+
+  OP_memory_init = 0x08,
+  OP_data_drop   = 0x09,
+  OP_memory_copy = 0x0a,
+  OP_memory_fill = 0x0b,
+  OP_table_init  = 0x0c,
+  OP_elem_drop   = 0x0d,
+  OP_table_copy  = 0x0e,
+
   // Atomics
   OP_atomic_prefix = 0xfe,
 
@@ -284,6 +313,265 @@ enum WASM_INSTRUCTION_OPCODES
   OP_i64_atomic_rmw8_cmpxchg_u  = 0x4C,
   OP_i64_atomic_rmw16_cmpxchg_u = 0x4D,
   OP_i64_atomic_rmw32_cmpxchg_u = 0x4E,
+
+  // SIMD
+  OP_simd_prefix = 0xfd,
+
+  OP_v128_load         = 0x00,
+  OP_v128_load8x8_s    = 0x01,
+  OP_v128_load8x8_u    = 0x02,
+  OP_v128_load16x4_s   = 0x03,
+  OP_v128_load16x4_u   = 0x04,
+  OP_v128_load32x2_s   = 0x05,
+  OP_v128_load32x2_u   = 0x06,
+  OP_v128_load8_splat  = 0x07,
+  OP_v128_load16_splat = 0x08,
+  OP_v128_load32_splat = 0x09,
+  OP_v128_load64_splat = 0x0a,
+  OP_v128_store        = 0x0b,
+
+  OP_v128_const    = 0x0c,
+  OP_i8x16_shuffle = 0x0d,
+  OP_i8x16_swizzle = 0x0e,
+
+  OP_i8x16_splat = 0x0f,
+  OP_i16x8_splat = 0x10,
+  OP_i32x4_splat = 0x11,
+  OP_i64x2_splat = 0x12,
+  OP_f32x4_splat = 0x13,
+  OP_f64x2_splat = 0x14,
+
+  OP_i8x16_extract_lane_s = 0x15,
+  OP_i8x16_extract_lane_u = 0x16,
+  OP_i8x16_replace_lane   = 0x17,
+  OP_i16x8_extract_lane_s = 0x18,
+  OP_i16x8_extract_lane_u = 0x19,
+  OP_i16x8_replace_lane   = 0x1a,
+  OP_i32x4_extract_lane   = 0x1b,
+  OP_i32x4_replace_lane   = 0x1c,
+  OP_i64x2_extract_lane   = 0x1d,
+  OP_i64x2_replace_lane   = 0x1e,
+  OP_f32x4_extract_lane   = 0x1f,
+  OP_f32x4_replace_lane   = 0x20,
+  OP_f64x2_extract_lane   = 0x21,
+  OP_f64x2_replace_lane   = 0x22,
+
+  OP_i8x16_eq   = 0x23,
+  OP_i8x16_ne   = 0x24,
+  OP_i8x16_lt_s = 0x25,
+  OP_i8x16_lt_u = 0x26,
+  OP_i8x16_gt_s = 0x27,
+  OP_i8x16_gt_u = 0x28,
+  OP_i8x16_le_s = 0x29,
+  OP_i8x16_le_u = 0x2a,
+  OP_i8x16_ge_s = 0x2b,
+  OP_i8x16_ge_u = 0x2c,
+
+  OP_i16x8_eq   = 0x2d,
+  OP_i16x8_ne   = 0x2e,
+  OP_i16x8_lt_s = 0x2f,
+  OP_i16x8_lt_u = 0x30,
+  OP_i16x8_gt_s = 0x31,
+  OP_i16x8_gt_u = 0x32,
+  OP_i16x8_le_s = 0x33,
+  OP_i16x8_le_u = 0x34,
+  OP_i16x8_ge_s = 0x35,
+  OP_i16x8_ge_u = 0x36,
+
+  OP_i32x4_eq   = 0x37,
+  OP_i32x4_ne   = 0x38,
+  OP_i32x4_lt_s = 0x39,
+  OP_i32x4_lt_u = 0x3a,
+  OP_i32x4_gt_s = 0x3b,
+  OP_i32x4_gt_u = 0x3c,
+  OP_i32x4_le_s = 0x3d,
+  OP_i32x4_le_u = 0x3e,
+  OP_i32x4_ge_s = 0x3f,
+  OP_i32x4_ge_u = 0x40,
+
+  OP_f32x4_eq = 0x41,
+  OP_f32x4_ne = 0x42,
+  OP_f32x4_lt = 0x43,
+  OP_f32x4_gt = 0x44,
+  OP_f32x4_le = 0x45,
+  OP_f32x4_ge = 0x46,
+
+  OP_f64x2_eq = 0x47,
+  OP_f64x2_ne = 0x48,
+  OP_f64x2_lt = 0x49,
+  OP_f64x2_gt = 0x4a,
+  OP_f64x2_le = 0x4b,
+  OP_f64x2_ge = 0x4c,
+
+  OP_v128_not       = 0x4d,
+  OP_v128_and       = 0x4e,
+  OP_v128_andnot    = 0x4f,
+  OP_v128_or        = 0x50,
+  OP_v128_xor       = 0x51,
+  OP_v128_bitselect = 0x52,
+  OP_v128_any_true  = 0x53,
+
+  OP_v128_load8_lane   = 0x54,
+  OP_v128_load16_lane  = 0x55,
+  OP_v128_load32_lane  = 0x56,
+  OP_v128_load64_lane  = 0x57,
+  OP_v128_store8_lane  = 0x58,
+  OP_v128_store16_lane = 0x59,
+  OP_v128_store32_lane = 0x5a,
+  OP_v128_store64_lane = 0x5b,
+  OP_v128_load32_zero  = 0x5c,
+  OP_v128_load64_zero  = 0x5d,
+
+  OP_f32x4_demote_f64x2_zero = 0x5e,
+  OP_f64x2_promote_low_f32x4 = 0x5f,
+
+  OP_i8x16_abs            = 0x60,
+  OP_i8x16_neg            = 0x61,
+  OP_i8x16_popcnt         = 0x62,
+  OP_i8x16_all_true       = 0x63,
+  OP_i8x16_bitmask        = 0x64,
+  OP_i8x16_narrow_i16x8_s = 0x65,
+  OP_i8x16_narrow_i16x8_u = 0x66,
+  OP_f32x4_ceil           = 0x67,
+  OP_f32x4_floor          = 0x68,
+  OP_f32x4_trunc          = 0x69,
+  OP_f32x4_nearest        = 0x6a,
+  OP_i8x16_shl            = 0x6b,
+  OP_i8x16_shr_s          = 0x6c,
+  OP_i8x16_shr_u          = 0x6d,
+  OP_i8x16_add            = 0x6e,
+  OP_i8x16_add_sat_s      = 0x6f,
+  OP_i8x16_add_sat_u      = 0x70,
+  OP_i8x16_sub            = 0x71,
+  OP_i8x16_sub_sat_s      = 0x72,
+  OP_i8x16_sub_sat_u      = 0x73,
+  OP_f64x2_ceil           = 0x74,
+  OP_f64x2_floor          = 0x75,
+  OP_i8x16_min_s          = 0x76,
+  OP_i8x16_min_u          = 0x77,
+  OP_i8x16_max_s          = 0x78,
+  OP_i8x16_max_u          = 0x79,
+  OP_f64x2_trunc          = 0x7a,
+  OP_i8x16_avgr_u         = 0x7b,
+
+  OP_i16x8_extadd_pairwise_i8x16_s = 0x7c,
+  OP_i16x8_extadd_pairwise_i8x16_u = 0x7d,
+  OP_i32x4_extadd_pairwise_i16x8_s = 0x7e,
+  OP_i32x4_extadd_pairwise_i16x8_u = 0x7f,
+
+  OP_i16x8_abs                 = 0x80,
+  OP_i16x8_neg                 = 0x81,
+  OP_i16x8_q15mulr_sat_s       = 0x82,
+  OP_i16x8_all_true            = 0x83,
+  OP_i16x8_bitmask             = 0x84,
+  OP_i16x8_narrow_i32x4_s      = 0x85,
+  OP_i16x8_narrow_i32x4_u      = 0x86,
+  OP_i16x8_extend_low_i8x16_s  = 0x87,
+  OP_i16x8_extend_high_i8x16_s = 0x88,
+  OP_i16x8_extend_low_i8x16_u  = 0x89,
+  OP_i16x8_extend_high_i8x16_u = 0x8a,
+  OP_i16x8_shl                 = 0x8b,
+  OP_i16x8_shr_s               = 0x8c,
+  OP_i16x8_shr_u               = 0x8d,
+  OP_i16x8_add                 = 0x8e,
+  OP_i16x8_add_sat_s           = 0x8f,
+  OP_i16x8_add_sat_u           = 0x90,
+  OP_i16x8_sub                 = 0x91,
+  OP_i16x8_sub_sat_s           = 0x92,
+  OP_i16x8_sub_sat_u           = 0x93,
+  OP_f64x2_nearest             = 0x94,
+  OP_i16x8_mul                 = 0x95,
+  OP_i16x8_min_s               = 0x96,
+  OP_i16x8_min_u               = 0x97,
+  OP_i16x8_max_s               = 0x98,
+  OP_i16x8_max_u               = 0x99,
+  OP_i16x8_avgr_u              = 0x9b,
+  OP_i16x8_extmul_low_i8x16_s  = 0x9c,
+  OP_i16x8_extmul_high_i8x16_s = 0x9d,
+  OP_i16x8_extmul_low_i8x16_u  = 0x9e,
+  OP_i16x8_extmul_high_i8x16_u = 0x9f,
+
+  OP_i32x4_abs                 = 0xa0,
+  OP_i32x4_neg                 = 0xa1,
+  OP_i32x4_all_true            = 0xa3,
+  OP_i32x4_bitmask             = 0xa4,
+  OP_i32x4_extend_low_i16x8_s  = 0xa7,
+  OP_i32x4_extend_high_i16x8_s = 0xa8,
+  OP_i32x4_extend_low_i16x8_u  = 0xa9,
+  OP_i32x4_extend_high_i16x8_u = 0xaa,
+  OP_i32x4_shl                 = 0xab,
+  OP_i32x4_shr_s               = 0xac,
+  OP_i32x4_shr_u               = 0xad,
+  OP_i32x4_add                 = 0xae,
+  OP_i32x4_sub                 = 0xb1,
+  OP_i32x4_mul                 = 0xb5,
+  OP_i32x4_min_s               = 0xb6,
+  OP_i32x4_min_u               = 0xb7,
+  OP_i32x4_max_s               = 0xb8,
+  OP_i32x4_max_u               = 0xb9,
+  OP_i32x4_dot_i16x8_s         = 0xba,
+  OP_i32x4_extmul_low_i16x8_s  = 0xbc,
+  OP_i32x4_extmul_high_i16x8_s = 0xbd,
+  OP_i32x4_extmul_low_i16x8_u  = 0xbe,
+  OP_i32x4_extmul_high_i16x8_u = 0xbf,
+
+  OP_i64x2_abs                 = 0xc0,
+  OP_i64x2_neg                 = 0xc1,
+  OP_i64x2_all_true            = 0xc3,
+  OP_i64x2_bitmask             = 0xc4,
+  OP_i64x2_extend_low_i32x4_s  = 0xc7,
+  OP_i64x2_extend_high_i32x4_s = 0xc8,
+  OP_i64x2_extend_low_i32x4_u  = 0xc9,
+  OP_i64x2_extend_high_i32x4_u = 0xca,
+  OP_i64x2_shl                 = 0xcb,
+  OP_i64x2_shr_s               = 0xcc,
+  OP_i64x2_shr_u               = 0xcd,
+  OP_i64x2_add                 = 0xce,
+  OP_i64x2_sub                 = 0xd1,
+  OP_i64x2_mul                 = 0xd5,
+  OP_i64x2_eq                  = 0xd6,
+  OP_i64x2_ne                  = 0xd7,
+  OP_i64x2_lt_s                = 0xd8,
+  OP_i64x2_gt_s                = 0xd9,
+  OP_i64x2_le_s                = 0xda,
+  OP_i64x2_ge_s                = 0xdb,
+  OP_i64x2_extmul_low_i32x4_s  = 0xdc,
+  OP_i64x2_extmul_high_i32x4_s = 0xdd,
+  OP_i64x2_extmul_low_i32x4_u  = 0xde,
+  OP_i64x2_extmul_high_i32x4_u = 0xdf,
+
+  OP_f32x4_abs  = 0xe0,
+  OP_f32x4_neg  = 0xe1,
+  OP_f32x4_sqrt = 0xe3,
+  OP_f32x4_add  = 0xe4,
+  OP_f32x4_sub  = 0xe5,
+  OP_f32x4_mul  = 0xe6,
+  OP_f32x4_div  = 0xe7,
+  OP_f32x4_min  = 0xe8,
+  OP_f32x4_max  = 0xe9,
+  OP_f32x4_pmin = 0xea,
+  OP_f32x4_pmax = 0xeb,
+
+  OP_f64x2_abs  = 0xec,
+  OP_f64x2_neg  = 0xed,
+  OP_f64x2_sqrt = 0xef,
+  OP_f64x2_add  = 0xf0,
+  OP_f64x2_sub  = 0xf1,
+  OP_f64x2_mul  = 0xf2,
+  OP_f64x2_div  = 0xf3,
+  OP_f64x2_min  = 0xf4,
+  OP_f64x2_max  = 0xf5,
+  OP_f64x2_pmin = 0xf6,
+  OP_f64x2_pmax = 0xf7,
+
+  OP_i32x4_trunc_sat_f32x4_s      = 0xf8,
+  OP_i32x4_trunc_sat_f32x4_u      = 0xf9,
+  OP_f32x4_convert_i32x4_s        = 0xfa,
+  OP_f32x4_convert_i32x4_u        = 0xfb,
+  OP_i32x4_trunc_sat_f64x2_s_zero = 0xfc,
+  OP_i32x4_trunc_sat_f64x2_u_zero = 0xfd,
+  OP_f64x2_convert_low_i32x4_s    = 0xfe,
+  OP_f64x2_convert_low_i32x4_u    = 0xff,
 };
 
 #ifdef __cplusplus
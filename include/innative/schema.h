@@ -49,6 +49,7 @@ enum WASM_TYPE_ENCODING
   TE_i64     = -0x02,
   TE_f32     = -0x03,
   TE_f64     = -0x04,
+  TE_v128    = -0x05,
   TE_funcref = -0x10,
   TE_cref    = -0x19,
   TE_func    = -0x20,
@@ -79,8 +80,18 @@ enum WASM_SECTION_OPCODE
   WASM_SECTION_EXPORT   = 0x07,
   WASM_SECTION_START    = 0x08,
   WASM_SECTION_ELEMENT  = 0x09,
-  WASM_SECTION_CODE     = 0x0A,
-  WASM_SECTION_DATA     = 0x0B
+  WASM_SECTION_CODE       = 0x0A,
+  WASM_SECTION_DATA       = 0x0B,
+  WASM_SECTION_DATA_COUNT = 0x0C, // Appears between the element and code sections
+};
+
+// Segment flags introduced by the bulk memory proposal for element and data segments
+enum WASM_SEGMENT_FLAGS
+{
+  WASM_SEGMENT_ACTIVE         = 0x00,
+  WASM_SEGMENT_PASSIVE        = 0x01, // Only initialized by memory.init or table.init
+  WASM_SEGMENT_EXPLICIT_INDEX = 0x02, // Active segment with an explicit memory or table index
+  WASM_SEGMENT_DECLARATIVE    = 0x03, // Element segments only, never initialized and dropped at instantiation
 };
 
 // Export or import kind enumeration.
@@ -264,8 +275,16 @@ typedef struct IN_WASM_TABLE_INIT
   Instruction offset;
   varuint32 n_elements;
   varuint32* elements;
+  varuint7 flags; // WASM_SEGMENT_FLAGS, passive and declarative segments have no index or offset
 } TableInit;
 
+// Source location of a single instruction, kept in an optional side table next to a function's instruction stream
+typedef struct IN_WASM_SOURCE_LOCATION
+{
+  unsigned int line;
+  unsigned int column;
+} SourceLocation;
+
 // Stores a local declaration, which includes the count and debug information.
 typedef struct IN_WASM_FUNCTION_LOCAL
 {
@@ -280,9 +299,11 @@ typedef struct IN_WASM_FUNCTION_BODY
   FunctionLocal* locals;
   varuint32 n_locals;
   varuint32 local_size; // total number of individual locals (sum of all counts)
-  Instruction* body;
-  varuint32 n_body;    // track actual number of instructions
-  varuint32 body_size; // track number of bytes used by instruction section
+  uint8_t* code;             // Compact instruction stream, decode it with an InstructionIterator
+  varuint32 code_size;       // number of bytes in the compact instruction stream
+  varuint32 n_body;          // track actual number of instructions
+  varuint32 body_size;       // track number of bytes used by instruction section
+  SourceLocation* locations; // line/column of each instruction, or NULL if they weren't kept
   unsigned int line;
   unsigned int column;
 } FunctionBody;
@@ -293,6 +314,7 @@ typedef struct IN_WASM_DATA_INIT
   varuint32 index;
   Instruction offset;
   ByteArray data;
+  varuint7 flags; // WASM_SEGMENT_FLAGS, passive segments have no index or offset
 } DataInit;
 
 // Represents any custom section defined in the module
@@ -392,6 +414,7 @@ typedef struct IN_WASM_MODULE
 
   struct DataSection
   {
+    varuint32 datacount; // Only meaningful if the data count section is known
     varuint32 n_data;
     DataInit* data;
   } data;
@@ -402,6 +425,7 @@ typedef struct IN_WASM_MODULE
 
   struct kh_exports_s* exports;
   const char* filepath;   // For debugging purposes, store path to the original file, if it exists
+  uint8_t digest[20];     // SHA1 hash of the source this module was loaded from, or all zeros if it is unknown.
   IN_CODE_compiler* cache; // If non-zero, points to a cached compilation of this module
 } Module;
 
@@ -425,6 +449,16 @@ typedef struct IN_WASM_EMBEDDING
   struct IN_WASM_EMBEDDING* next;
 } Embedding;
 
+// A private, copy-on-write file mapping owned by the environment. Writes to it never reach the file. Modules loaded from
+// a file path keep views into this memory instead of copying data segments and custom sections, so it is only released
+// by DestroyEnvironment.
+typedef struct IN_WASM_FILE_MAPPING
+{
+  void* data;
+  size_t size;
+  struct IN_WASM_FILE_MAPPING* next;
+} FileMapping;
+
 enum IN_LOG_LEVEL
 {
   LOG_NONE  = -1, // Suppress all log output no matter what
@@ -438,6 +472,7 @@ enum IN_LOG_LEVEL
 KHASH_DECLARE(modulepair, kh_cstr_t, FunctionType);
 
 struct IN_WASM_ALLOCATOR;
+struct IN_WASM_LOADER;
 
 // Represents a collection of webassembly modules and configuration options that will be compiled into a single binary
 typedef struct IN_WASM_ENVIRONMENT
@@ -447,11 +482,12 @@ typedef struct IN_WASM_ENVIRONMENT
   size_t capacity;         // Capacity of the modules array
   Module* modules;         // Use AddModule() to manage this list
   Embedding* embeddings;   // Use AddEmbedding to manage this list
+  FileMapping* mappings;   // Module files mapped by AddModule, which parsed modules may point into
   ValidationError* errors; // A linked list of non-fatal validation errors that prevent proper execution.
   uint64_t flags;          // WASM_ENVIRONMENT_FLAGS
   uint64_t features;       // WASM_FEATURE_FLAGS
   uint64_t optimize;       // WASM_OPTIMIZE_FLAGS
-  unsigned int maxthreads; // Max number of threads for any multithreaded action. If 0, there is no limit.
+  unsigned int maxthreads; // Max number of threads for any multithreaded action. If 0, defaults to logical cores.
   const char* rootpath;    // Internal buffer for storing the root directory of the EXE to help with directory searches
   const char* libpath;     // Path to look for default environment libraries
   const char* objpath; // Path to store intermediate results. If NULL, intermediate results are stored in the output folder
@@ -459,11 +495,18 @@ typedef struct IN_WASM_ENVIRONMENT
   const char* system;  // prefix for the "system" module, which simply attempts to link the function name as a C function.
                        // Defaults to a blank string.
   struct IN_WASM_ALLOCATOR* alloc; // Stores a pointer to the internal allocator
+  struct IN_WASM_LOADER* loader;   // Internal worker pool that loads added modules, created by the first AddModule call
   int loglevel;                    // IN_LOG_LEVEL
   FILE* log;                       // Output stream for log messages
   void (*wasthook)(void*);         // Optional hook for WAST debugging cases
   const char** exports;            // Use AddCustomExport() to manage this list
   varuint32 n_exports;
+  uint64_t cachelimit; // Maximum size in bytes of the object cache in the object directory. If 0, the cache is disabled.
+  size_t cachehits;    // Number of modules the last compilation found in the object cache
+  size_t cachemisses;  // Number of cacheable modules the last compilation had to compile from scratch
+  const char* profile; // If nonzero, path to a merged profile that guides optimizations like inlining and block layout
+  const char* cpu;     // If nonzero, the LLVM name of the CPU to compile for, like "skylake". Defaults to the host CPU.
+  const char* cpufeatures; // If nonzero, LLVM features added to or removed from the target CPU, like "+avx2,-avx512f"
 
   struct kh_modules_s* modulemap;
   struct kh_modulepair_s* whitelist;
@@ -61,11 +61,19 @@ const static std::initializer_list<std::pair<const char*, unsigned int>> FLAG_MA
   { "check_indirect_call", ENV_CHECK_INDIRECT_CALL },
   { "check_int_division", ENV_CHECK_INT_DIVISION },
   { "disable_tail_call", ENV_DISABLE_TAIL_CALL },
+  { "guard_pages", ENV_GUARD_PAGES },
+  { "stable_memory", ENV_STABLE_MEMORY },
+  { "multi_instance", ENV_MULTI_INSTANCE },
+  { "pooled_memory", ENV_POOLED_MEMORY },
+  { "snapshot", ENV_SNAPSHOT },
+  { "mapped_data", ENV_MAPPED_DATA },
 };
 
 const static std::initializer_list<std::pair<const char*, unsigned int>> OPTIMIZE_MAP = {
   { "o0", ENV_OPTIMIZE_O0 }, { "o1", ENV_OPTIMIZE_O1 }, { "o2", ENV_OPTIMIZE_O2 },
   { "o3", ENV_OPTIMIZE_O3 }, { "os", ENV_OPTIMIZE_Os }, { "fastmath", ENV_OPTIMIZE_FAST_MATH },
+  { "lto", ENV_OPTIMIZE_LTO }, { "instrument", ENV_OPTIMIZE_PROFILE_GENERATE },
+  { "multiversion", ENV_OPTIMIZE_MULTIVERSION }, { "multiversion_hot", ENV_OPTIMIZE_MULTIVERSION_HOT },
 };
 
 struct OptBase
@@ -264,7 +272,15 @@ struct CommandLine
     uninstall("Uninstalls and deregisters this SDK from the host operating system."),
     library_dir("Sets the directory that contains the SDK library and data files.", "<DIR>"),
     object_dir("Sets the directory for temporary object files and intermediate compilation results.", "<DIR>"),
-    compile_llvm("Assumes the input files are LLVM IR files and compiles them into a single webassembly module.")
+    cache_size(
+      "Sets the maximum size of the object cache in the object directory in megabytes. A size of 0 disables the cache.",
+      "<MB>"),
+    compile_llvm("Assumes the input files are LLVM IR files and compiles them into a single webassembly module."),
+    profile("Optimizes the output using a profile created by -merge-profiles.", "<FILE>"),
+    merge_profiles(
+      "Assumes the input files are profiles written by programs compiled with '-f instrument', and merges them into a single profile."),
+    cpu("Compiles for the given CPU, like 'skylake' or 'x86-64', instead of the host CPU.", "<NAME>"),
+    cpu_features("Enables or disables CPU features on top of the target CPU, like '+avx2,-avx512f'.", "<LIST>")
   {
     flags.value    = ENV_ENABLE_WAT;
     flags.optimize = ENV_OPTIMIZE_O3;
@@ -306,7 +322,12 @@ struct CommandLine
     Register("obj-dir", &object_dir);
     Register("object-dir", &object_dir);
     Register("intermediate-dir", &object_dir);
+    Register("cache-size", &cache_size);
     Register("compile-llvm", &compile_llvm);
+    Register("profile", &profile);
+    Register("merge-profiles", &merge_profiles);
+    Register("cpu", &cpu);
+    Register("cpu-features", &cpu_features);
 
     usage += "\n\n  Example usage: innative-cmd -r your-module.wasm";
   }
@@ -373,6 +394,8 @@ struct CommandLine
 
       if(compile_llvm.value)
         output_file.value.replace_extension(".wasm");
+      else if(merge_profiles.value)
+        output_file.value.replace_extension(".profdata");
       else if(build_sourcemap.value)
         output_file.value += ".map";
       else if(flags.value & ENV_LIBRARY)
@@ -398,7 +421,12 @@ struct CommandLine
   Opt<bool> uninstall;
   Opt<std::string> library_dir;
   Opt<std::string> object_dir;
+  Opt<std::string> cache_size;
   Opt<bool> compile_llvm;
+  Opt<std::string> profile;
+  Opt<bool> merge_profiles;
+  Opt<std::string> cpu;
+  Opt<std::string> cpu_features;
 
   std::vector<const char*> inputs;
   std::vector<const char*> wast; // WAST files will be executed in the order they are specified, after all other modules are
@@ -495,6 +523,10 @@ int main(int argc, char* argv[])
     return innative_compile_llvm(commandline.inputs.data(), commandline.inputs.size(), commandline.flags.value,
                                  commandline.output_file.value.u8string().c_str(), stdout);
 
+  if(commandline.merge_profiles.value)
+    return innative_merge_profiles(commandline.inputs.data(), commandline.inputs.size(),
+                                   commandline.output_file.value.u8string().c_str(), stdout);
+
   INExports exports = { 0 };
 
   // If we are generating a loader, we replace all of the normal functions to reroute the resources into the EXE file
@@ -645,8 +677,16 @@ int main(int argc, char* argv[])
     env->libpath = commandline.library_dir.value.c_str();
   if(!commandline.object_dir.value.empty())
     env->objpath = commandline.object_dir.value.c_str();
+  if(!commandline.cache_size.value.empty())
+    env->cachelimit = strtoull(commandline.cache_size.value.c_str(), nullptr, 10) << 20;
   if(!commandline.linker.value.empty())
     env->linker = commandline.linker.value.c_str();
+  if(!commandline.profile.value.empty())
+    env->profile = commandline.profile.value.c_str();
+  if(!commandline.cpu.value.empty())
+    env->cpu = commandline.cpu.value.c_str();
+  if(!commandline.cpu_features.value.empty())
+    env->cpufeatures = commandline.cpu_features.value.c_str();
   if(!commandline.system.value.empty())
     env->system = commandline.system.value.c_str();
 
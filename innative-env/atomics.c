@@ -8,7 +8,8 @@
 #ifdef IN_PLATFORM_WIN32
   #include "../innative/win32.h"
 #elif defined(IN_PLATFORM_POSIX)
-// TODO: POSIX
+  #include <errno.h>
+  #include <time.h>
 #else
   #error unknown platform!
 #endif
@@ -77,6 +78,113 @@ IN_COMPILER_DLLEXPORT uint32_t _innative_internal_env_atomic_notify(void* addres
 
 #elif defined(IN_PLATFORM_POSIX)
 
+// On linux the kernel keeps the queue of waiters for every address, so instead of the wait map, waits and notifications
+// go straight to futex system calls. Futexes are private to the process, because linear memories are never shared with
+// another process.
+static const int SYSCALL_FUTEX         = 202;
+static const int SYSCALL_CLOCK_GETTIME = 228;
+static const int FUTEX_WAIT_PRIVATE    = 0 | 128;
+static const int FUTEX_WAKE_PRIVATE    = 1 | 128;
+
+// A futex only compares 32 bits, so a 64-bit wait sleeps in slices of this many nanoseconds and checks the entire value
+// in between. That bounds how long it can miss a notification for a change that only touched the other 32 bits.
+static const int64_t IN_FUTEX_SLICE = 10000000;
+
+// Number of threads that are currently blocked in a wait, so that a notify can skip the system call if there are none.
+static size_t _innative_futex_waiters = 0;
+
+static int64_t _innative_futex_now()
+{
+  struct timespec now = { 0, 0 };
+  _innative_syscall(SYSCALL_CLOCK_GETTIME, (void*)(size_t)CLOCK_MONOTONIC, (size_t)&now, 0, 0, 0, 0);
+  return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+// Blocks on the 32-bit word at address until it's woken, the timeout expires, or the word no longer holds expected.
+// Returns 0 if it was woken, 1 if the word didn't match, or 2 if it timed out. A negative timeout never expires.
+static int32_t _innative_futex_wait(void* address, int32_t expected, int64_t timeoutns)
+{
+  int64_t deadline  = timeoutns > 0 ? _innative_futex_now() + timeoutns : 0;
+  int64_t remaining = timeoutns;
+  int32_t result    = 2;
+
+  // Registering as a waiter is a full barrier, which pairs with the fence in notify. Either notify sees this waiter, or
+  // the kernel sees the new value that was stored before the notify and refuses to sleep.
+  __atomic_add_fetch(&_innative_futex_waiters, 1, __ATOMIC_SEQ_CST);
+  while(timeoutns < 0 || remaining > 0)
+  {
+    struct timespec timeout = { remaining / 1000000000, remaining % 1000000000 };
+    ptrdiff_t r = (ptrdiff_t)_innative_syscall(SYSCALL_FUTEX, address, FUTEX_WAIT_PRIVATE, (size_t)(uint32_t)expected,
+                                               timeoutns < 0 ? 0 : (size_t)&timeout, 0, 0);
+    if(r == -EINTR) // A signal interrupted the wait, so go back to sleep for whatever time is left
+    {
+      if(timeoutns >= 0)
+        remaining = deadline - _innative_futex_now();
+      continue;
+    }
+
+    result = (r == -EAGAIN) ? 1 : (r == -ETIMEDOUT) ? 2 : 0;
+    break;
+  }
+  __atomic_sub_fetch(&_innative_futex_waiters, 1, __ATOMIC_SEQ_CST);
+
+  return result;
+}
+
+IN_COMPILER_DLLEXPORT int32_t _innative_internal_env_atomic_wait32(void* address, int32_t expected, int64_t timeoutns)
+{
+  // If the value already changed, there's nothing to wait for and no reason to enter the kernel
+  if(_innative_internal_env_atomic_load32(address) != expected)
+    return 1; // "not-equal"
+
+  return _innative_futex_wait(address, expected, timeoutns);
+}
+
+IN_COMPILER_DLLEXPORT int32_t _innative_internal_env_atomic_wait64(void* address, int64_t expected, int64_t timeoutns)
+{
+  if(_innative_internal_env_atomic_load64(address) != expected)
+    return 1; // "not-equal"
+
+  // Notify wakes the futex at the address itself, which is the first 32 bits of the value regardless of endianness
+  int32_t word;
+  _innative_internal_env_memcpy((char*)&word, (const char*)&expected, sizeof(word));
+  int64_t deadline = timeoutns > 0 ? _innative_futex_now() + timeoutns : 0;
+  int64_t slice    = IN_FUTEX_SLICE;
+  for(;;)
+  {
+    if(timeoutns >= 0)
+    {
+      int64_t remaining = !timeoutns ? 0 : deadline - _innative_futex_now();
+      if(remaining <= 0)
+        return 2; // "timed-out"
+      if(remaining < slice)
+        slice = remaining;
+    }
+
+    // Only the kernel waking us up counts as a notification. If the value changed without one, nothing has counted this
+    // thread as woken yet, so it can still report the mismatch as if it had only compared the value now. Treating that as
+    // "ok" would let a single notification release every waiter, and going back to sleep could miss a notification that
+    // arrived between two slices, because the futex compares a different value than the one that changed.
+    int32_t r = _innative_futex_wait(address, word, slice);
+    if(!r)
+      return 0; // "ok"
+    if(r == 1 || _innative_internal_env_atomic_load64(address) != expected)
+      return 1; // "not-equal"
+  }
+}
+
+IN_COMPILER_DLLEXPORT uint32_t _innative_internal_env_atomic_notify(void* address, uint32_t count)
+{
+  // If nobody is waiting on any address, there is nobody to wake up
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  if(!count || !__atomic_load_n(&_innative_futex_waiters, __ATOMIC_RELAXED))
+    return 0;
+
+  ptrdiff_t r = (ptrdiff_t)_innative_syscall(SYSCALL_FUTEX, address, FUTEX_WAKE_PRIVATE,
+                                             count > INT32_MAX ? INT32_MAX : count, 0, 0, 0);
+  return r < 0 ? 0 : (uint32_t)r;
+}
+
 #endif
 
 // Atomic helpers
@@ -113,7 +221,7 @@ int64_t _innative_internal_env_atomic_load64(int64_t* address)
   return value;
 }
 
-#elif defined(POSIX)
+#elif defined(IN_PLATFORM_POSIX)
 
 int32_t _innative_internal_env_atomic_load32(int32_t* address) { return __atomic_load_n(address, __ATOMIC_SEQ_CST); }
 int64_t _innative_internal_env_atomic_load64(int64_t* address) { return __atomic_load_n(address, __ATOMIC_SEQ_CST); }
@@ -12,14 +12,29 @@
   #error unknown platform!
 #endif
 
+#if defined(IN_CPU_x86_64) || defined(__SSE2__) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+  #define IN_ENV_SSE2
+  #include <emmintrin.h>
+#endif
+
+#ifdef IN_CPU_x86_64
+  #ifdef IN_COMPILER_MSC
+    #include <intrin.h>
+  #else
+    #include <cpuid.h>
+  #endif
+#endif
+
 #ifdef IN_PLATFORM_WIN32
 #elif defined(IN_PLATFORM_POSIX)
-const int SYSCALL_WRITE  = 1;
-const int SYSCALL_MMAP   = 9;
-const int SYSCALL_MUNMAP = 11;
-const int SYSCALL_MREMAP = 25;
-const int SYSCALL_EXIT   = 60;
-const int MREMAP_MAYMOVE = 1;
+const int SYSCALL_WRITE        = 1;
+const int SYSCALL_MMAP         = 9;
+const int SYSCALL_MPROTECT     = 10;
+const int SYSCALL_MUNMAP       = 11;
+const int SYSCALL_RT_SIGACTION = 13;
+const int SYSCALL_MREMAP       = 25;
+const int SYSCALL_EXIT         = 60;
+const int MREMAP_MAYMOVE       = 1;
 
   #ifdef IN_CPU_x86_64
 IN_COMPILER_DLLEXPORT extern IN_COMPILER_NAKED void* _innative_syscall(size_t syscall_number, const void* p1, size_t p2,
@@ -192,6 +207,92 @@ IN_COMPILER_DLLEXPORT extern void _innative_internal_abort()
 #endif
 }
 
+// Records the most recent trap, so a host that catches it can find out which check failed and where. This is a plain
+// global instead of a thread-local, because freestanding binaries have no TLS, so with several threads it only reliably
+// describes a trap if no other thread trapped at the same time.
+IN_COMPILER_DLLEXPORT INTrapInfo _innative_internal_env_last_trap = { IN_TRAP_NONE, 0, 0, 0 };
+
+// Every trap landing pad emitted by the compiler calls this with the kind of check that failed, the index of the function
+// it was in, and the location of the failing instruction packed as (line << 32) | column.
+IN_COMPILER_DLLEXPORT extern void _innative_internal_env_trap(uint32_t code, uint32_t function, uint64_t location)
+{
+  _innative_internal_env_last_trap.code     = code;
+  _innative_internal_env_last_trap.function = function;
+  _innative_internal_env_last_trap.line     = (uint32_t)(location >> 32);
+  _innative_internal_env_last_trap.column   = (uint32_t)location;
+  _innative_internal_abort();
+}
+
+// Highest IN_ISA_LEVEL supported by this CPU. Multiversioned functions switch on this to pick which clone to run, so it
+// defaults to the baseline until _innative_internal_env_detect_cpu runs.
+IN_COMPILER_DLLEXPORT uint32_t _innative_internal_env_cpu_level = IN_ISA_X86_64_V1;
+
+#ifdef IN_CPU_x86_64
+static void _innative_internal_env_cpuid(uint32_t leaf, uint32_t sub, uint32_t regs[4])
+{
+  #ifdef IN_COMPILER_MSC
+  __cpuidex((int*)regs, (int)leaf, (int)sub);
+  #else
+  __cpuid_count(leaf, sub, regs[0], regs[1], regs[2], regs[3]);
+  #endif
+}
+
+static uint64_t _innative_internal_env_xgetbv()
+{
+  #ifdef IN_COMPILER_MSC
+  return _xgetbv(0);
+  #else
+  uint32_t eax, edx;
+  __asm__ volatile("xgetbv" : "=a"(eax), "=d"(edx) : "c"(0));
+  return ((uint64_t)edx << 32) | eax;
+  #endif
+}
+
+  #define IN_HAS_BITS(reg, mask) (((reg) & (mask)) == (mask))
+#endif
+
+// Called at the start of the entry point of a multiversioned program to find the highest ISA level this CPU supports.
+// AVX and AVX-512 also require the operating system to save their registers on a context switch, which XCR0 reports.
+IN_COMPILER_DLLEXPORT extern void _innative_internal_env_detect_cpu()
+{
+#ifdef IN_CPU_x86_64
+  uint32_t basic[4], ext[4], leaf7[4] = { 0 }, extended[4] = { 0 };
+  _innative_internal_env_cpuid(0, 0, basic);
+  uint32_t max = basic[0];
+  _innative_internal_env_cpuid(1, 0, basic);
+  if(max >= 7)
+    _innative_internal_env_cpuid(7, 0, leaf7);
+  _innative_internal_env_cpuid(0x80000000, 0, ext);
+  if(ext[0] >= 0x80000001)
+    _innative_internal_env_cpuid(0x80000001, 0, extended);
+
+  uint32_t level = IN_ISA_X86_64_V1;
+  uint64_t xcr0  = IN_HAS_BITS(basic[2], (1 << 27)) ? _innative_internal_env_xgetbv() : 0; // Requires OSXSAVE
+
+  // SSE3, SSSE3, CMPXCHG16B, SSE4.1, SSE4.2, POPCNT and LAHF/SAHF
+  if(IN_HAS_BITS(basic[2], (1 << 0) | (1 << 9) | (1 << 13) | (1 << 19) | (1 << 20) | (1 << 23)) &&
+     IN_HAS_BITS(extended[2], (1 << 0)))
+  {
+    level = IN_ISA_X86_64_V2;
+
+    // FMA, MOVBE, AVX and F16C, then BMI1, AVX2 and BMI2, then LZCNT. XCR0 must enable the SSE and AVX state.
+    if(IN_HAS_BITS(basic[2], (1 << 12) | (1 << 22) | (1 << 28) | (1 << 29)) &&
+       IN_HAS_BITS(leaf7[1], (1 << 3) | (1 << 5) | (1 << 8)) && IN_HAS_BITS(extended[2], (1 << 5)) &&
+       IN_HAS_BITS(xcr0, 0x6))
+    {
+      level = IN_ISA_X86_64_V3;
+
+      // AVX512F, AVX512DQ, AVX512CD, AVX512BW and AVX512VL, with the opmask and ZMM state enabled in XCR0
+      if(IN_HAS_BITS(leaf7[1], (1u << 16) | (1u << 17) | (1u << 28) | (1u << 30) | (1u << 31)) &&
+         IN_HAS_BITS(xcr0, 0xE6))
+        level = IN_ISA_X86_64_V4;
+    }
+  }
+
+  _innative_internal_env_cpu_level = level;
+#endif
+}
+
 // Writes a buffer to the standard output using system calls
 IN_COMPILER_DLLEXPORT extern void _innative_internal_write_out(const void* buf, size_t num)
 {
@@ -241,7 +342,125 @@ IN_COMPILER_DLLEXPORT extern void _innative_internal_env_memdump(const unsigned
   _innative_internal_write_out("\n", 1);
 }
 
-// Very simple memcpy implementation because we don't have access to the C library
+// We don't have access to the C library, so these are our own implementations of memcpy, memmove and memset. They are
+// used to copy data segments during initialization and by the bulk memory instructions, so they copy 64 bytes at a time
+// using SSE2 when it's available, which is always true on x86-64.
+#ifdef IN_ENV_SSE2
+IN_COMPILER_DLLEXPORT extern void _innative_internal_env_memcpy(char* dest, const char* src, uint64_t sz)
+{
+  // Align dest pointer so all stores are aligned
+  while((size_t)dest % sizeof(__m128i) && sz)
+  {
+    *dest++ = *src++;
+    --sz;
+  }
+
+  // Load an entire block before storing any of it, so a forward memmove can safely call this
+  while(sz >= sizeof(__m128i) * 4)
+  {
+    __m128i a = _mm_loadu_si128((const __m128i*)src);
+    __m128i b = _mm_loadu_si128((const __m128i*)src + 1);
+    __m128i c = _mm_loadu_si128((const __m128i*)src + 2);
+    __m128i d = _mm_loadu_si128((const __m128i*)src + 3);
+    _mm_store_si128((__m128i*)dest, a);
+    _mm_store_si128((__m128i*)dest + 1, b);
+    _mm_store_si128((__m128i*)dest + 2, c);
+    _mm_store_si128((__m128i*)dest + 3, d);
+    dest += sizeof(__m128i) * 4;
+    src += sizeof(__m128i) * 4;
+    sz -= sizeof(__m128i) * 4;
+  }
+
+  while(sz >= sizeof(__m128i))
+  {
+    _mm_store_si128((__m128i*)dest, _mm_loadu_si128((const __m128i*)src));
+    dest += sizeof(__m128i);
+    src += sizeof(__m128i);
+    sz -= sizeof(__m128i);
+  }
+
+  while(sz)
+  {
+    *dest++ = *src++;
+    --sz;
+  }
+}
+
+static void _innative_internal_env_memcpy_backward(char* dest, const char* src, uint64_t sz)
+{
+  dest += sz;
+  src += sz;
+
+  while((size_t)dest % sizeof(__m128i) && sz)
+  {
+    *--dest = *--src;
+    --sz;
+  }
+
+  while(sz >= sizeof(__m128i) * 4)
+  {
+    dest -= sizeof(__m128i) * 4;
+    src -= sizeof(__m128i) * 4;
+    sz -= sizeof(__m128i) * 4;
+    __m128i a = _mm_loadu_si128((const __m128i*)src);
+    __m128i b = _mm_loadu_si128((const __m128i*)src + 1);
+    __m128i c = _mm_loadu_si128((const __m128i*)src + 2);
+    __m128i d = _mm_loadu_si128((const __m128i*)src + 3);
+    _mm_store_si128((__m128i*)dest, a);
+    _mm_store_si128((__m128i*)dest + 1, b);
+    _mm_store_si128((__m128i*)dest + 2, c);
+    _mm_store_si128((__m128i*)dest + 3, d);
+  }
+
+  while(sz >= sizeof(__m128i))
+  {
+    dest -= sizeof(__m128i);
+    src -= sizeof(__m128i);
+    sz -= sizeof(__m128i);
+    _mm_store_si128((__m128i*)dest, _mm_loadu_si128((const __m128i*)src));
+  }
+
+  while(sz)
+  {
+    *--dest = *--src;
+    --sz;
+  }
+}
+
+IN_COMPILER_DLLEXPORT extern void _innative_internal_env_memset(char* dest, int value, uint64_t sz)
+{
+  __m128i v = _mm_set1_epi8((char)value);
+
+  while((size_t)dest % sizeof(__m128i) && sz)
+  {
+    *dest++ = (char)value;
+    --sz;
+  }
+
+  while(sz >= sizeof(__m128i) * 4)
+  {
+    _mm_store_si128((__m128i*)dest, v);
+    _mm_store_si128((__m128i*)dest + 1, v);
+    _mm_store_si128((__m128i*)dest + 2, v);
+    _mm_store_si128((__m128i*)dest + 3, v);
+    dest += sizeof(__m128i) * 4;
+    sz -= sizeof(__m128i) * 4;
+  }
+
+  while(sz >= sizeof(__m128i))
+  {
+    _mm_store_si128((__m128i*)dest, v);
+    dest += sizeof(__m128i);
+    sz -= sizeof(__m128i);
+  }
+
+  while(sz)
+  {
+    *dest++ = (char)value;
+    --sz;
+  }
+}
+#else
 IN_COMPILER_DLLEXPORT extern void _innative_internal_env_memcpy(char* dest, const char* src, uint64_t sz)
 {
   // Align dest pointer
@@ -270,6 +489,35 @@ IN_COMPILER_DLLEXPORT extern void _innative_internal_env_memcpy(char* dest, cons
   }
 }
 
+static void _innative_internal_env_memcpy_backward(char* dest, const char* src, uint64_t sz)
+{
+  while(sz)
+  {
+    sz -= 1;
+    dest[sz] = src[sz];
+  }
+}
+
+IN_COMPILER_DLLEXPORT extern void _innative_internal_env_memset(char* dest, int value, uint64_t sz)
+{
+  while(sz)
+  {
+    *dest = (char)value;
+    dest += 1;
+    sz -= 1;
+  }
+}
+#endif
+
+// The forward copy never reads a byte after it has overwritten it, so it only goes backwards if dest lies inside src
+IN_COMPILER_DLLEXPORT extern void _innative_internal_env_memmove(char* dest, const char* src, uint64_t sz)
+{
+  if((uint64_t)((size_t)dest - (size_t)src) >= sz)
+    _innative_internal_env_memcpy(dest, src, sz);
+  else
+    _innative_internal_env_memcpy_backward(dest, src, sz);
+}
+
 // Platform-specific memory free, called by the exit function to clean up memory allocations
 IN_COMPILER_DLLEXPORT extern void _innative_internal_env_free_memory(void* p, uint64_t size)
 {
@@ -380,6 +628,244 @@ IN_COMPILER_DLLEXPORT extern void* _innative_internal_env_grow_memory(void* p, u
   return info;
 }
 
+// Reserves address space for a linear memory that is never moved, without making any of it accessible yet.
+static char* _innative_reserve_memory(uint64_t reserve)
+{
+#ifdef IN_PLATFORM_WIN32
+  return VirtualAlloc(0, (size_t)reserve, MEM_RESERVE, PAGE_NOACCESS);
+#elif defined(IN_PLATFORM_POSIX)
+  char* info =
+    _innative_syscall(SYSCALL_MMAP, NULL, reserve, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if((void*)info >= (void*)0xfffffffffffff001) // This is a syscall error from -4095 to -1
+    return 0;
+  return info;
+#else
+  #error unknown platform!
+#endif
+}
+
+static void _innative_release_memory(char* p, uint64_t reserve)
+{
+#ifdef IN_PLATFORM_WIN32
+  VirtualFree(p, 0, MEM_RELEASE);
+#elif defined(IN_PLATFORM_POSIX)
+  _innative_syscall(SYSCALL_MUNMAP, p, reserve, 0, 0, 0, 0);
+#else
+  #error unknown platform!
+#endif
+}
+
+// Grows a linear memory inside an existing reservation by making more of it accessible, which never moves it.
+static void* _innative_grow_reserved(char* p, uint64_t i, uint64_t max, uint64_t* size)
+{
+  if(!i)
+    return p;
+  if(i + *size > 0xFFFFFFFF) // Invalid for wasm32
+    return 0;
+  if(max > 0 && (i + *size) > max)
+    return 0;
+
+#ifdef IN_PLATFORM_WIN32
+  if(!VirtualAlloc(p + *size, (size_t)i, MEM_COMMIT, PAGE_READWRITE))
+    return 0;
+#elif defined(IN_PLATFORM_POSIX)
+  if(_innative_syscall(SYSCALL_MPROTECT, p + *size, i, PROT_READ | PROT_WRITE, 0, 0, 0) != 0)
+    return 0;
+#else
+  #error unknown platform!
+#endif
+
+  *size += i;
+  return p;
+}
+
+// Stable memories reserve their maximum size, or the entire 32-bit address space if they have no maximum.
+static uint64_t _innative_stable_reserve(uint64_t max) { return !max ? (1ULL << 32) : max; }
+
+// Equivalent of _innative_internal_env_grow_memory that reserves the entire memory on the first call, so that growing it
+// never changes the base pointer.
+IN_COMPILER_DLLEXPORT extern void* _innative_internal_env_grow_memory_stable(void* p, uint64_t i, uint64_t max,
+                                                                             uint64_t* size)
+{
+  if(!size)
+    return 0;
+
+  char* info = (char*)p;
+  if(!info)
+  {
+    if(!(info = _innative_reserve_memory(_innative_stable_reserve(max))))
+      return 0;
+    *size = 0;
+  }
+
+  return _innative_grow_reserved(info, i, max, size);
+}
+
+// Releases the entire reservation of a stable linear memory, which depends only on its maximum size.
+IN_COMPILER_DLLEXPORT extern void _innative_internal_env_free_memory_stable(void* p, uint64_t max)
+{
+  if(p)
+    _innative_release_memory((char*)p, _innative_stable_reserve(max));
+}
+
+#if defined(IN_PLATFORM_LINUX) && defined(IN_CPU_x86_64)
+// A guarded linear memory reserves the entire 32-bit address space, plus another 4 GiB so that any 32-bit offset added
+// to any 32-bit address still lands inside the reservation, plus one extra page for the width of the access itself.
+static const uint64_t GUARD_RESERVE = (2ULL << 32) + 0x10000;
+
+static const int SIGNAL_BUS         = 7;
+static const int SIGNAL_SEGV        = 11;
+static const int SIGACTION_SIGINFO  = 0x00000004;
+static const int SIGACTION_RESTORER = 0x04000000;
+static const int SYSCALL_SIGSET     = 8; // Size of the kernel's sigset_t, which is not the same as glibc's sigset_t
+
+struct _innative_siginfo
+{
+  int signo;
+  int error;
+  int code;
+  int pad;
+  void* addr; // Faulting address for SIGSEGV and SIGBUS
+};
+
+typedef void (*_innative_sighandler)(int, struct _innative_siginfo*, void*);
+
+struct _innative_sigaction
+{
+  _innative_sighandler handler;
+  uint64_t flags;
+  void (*restorer)(void);
+  uint64_t mask;
+};
+
+static char* volatile _innative_guard_regions[64];
+static struct _innative_sigaction _innative_guard_prev[2]; // Previous SIGSEGV and SIGBUS handlers
+
+enum IN_GUARD_STATE
+{
+  IN_GUARD_EMPTY = 0,
+  IN_GUARD_BUSY,
+  IN_GUARD_READY,
+  IN_GUARD_FAILED,
+};
+
+static int _innative_guard_state = IN_GUARD_EMPTY;
+
+// The kernel requires us to provide our own trampoline that returns from a signal handler on x86-64.
+static IN_COMPILER_NAKED void _innative_guard_restorer()
+{
+  __asm volatile("movq $15, %rax\n\t"
+                 "syscall");
+}
+
+static void _innative_guard_handler(int sig, struct _innative_siginfo* info, void* context)
+{
+  for(int i = 0; i < (int)(sizeof(_innative_guard_regions) / sizeof(char*)); ++i)
+  {
+    char* region = __atomic_load_n(&_innative_guard_regions[i], __ATOMIC_ACQUIRE);
+    if(region != 0 && (char*)info->addr >= region && (char*)info->addr < region + GUARD_RESERVE)
+    {
+      // Out-of-bounds linear memory access, so trap normally. Only the faulting address is known here, not which function
+      // or instruction caused it, so the trap has no location.
+      _innative_internal_env_trap(IN_TRAP_OUT_OF_BOUNDS, ~0u, 0);
+    }
+  }
+
+  // Otherwise, this fault has nothing to do with us, so forward it to whoever was handling it before.
+  struct _innative_sigaction* prev = &_innative_guard_prev[sig == SIGNAL_BUS];
+  if((size_t)prev->handler > 1)
+  {
+    if(prev->flags & SIGACTION_SIGINFO)
+      prev->handler(sig, info, context);
+    else
+      ((void (*)(int))prev->handler)(sig);
+  }
+  else // Restore the default action and return, which re-executes the faulting instruction.
+    _innative_syscall(SYSCALL_RT_SIGACTION, (void*)(size_t)sig, (size_t)prev, 0, SYSCALL_SIGSET, 0, 0);
+}
+
+// Installs the fault handler the first time it's needed. Only the thread that wins the race installs it, and every other
+// thread waits until both handlers are in place, so no guarded memory is ever handed out before faults in it can trap.
+static int _innative_guard_install()
+{
+  int state = __atomic_load_n(&_innative_guard_state, __ATOMIC_ACQUIRE);
+  int empty = IN_GUARD_EMPTY;
+  if(state == IN_GUARD_EMPTY &&
+     __atomic_compare_exchange_n(&_innative_guard_state, &empty, IN_GUARD_BUSY, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+  {
+    // The handler runs on the stack of the faulting thread, because the runtime never installs an alternate signal stack
+    struct _innative_sigaction action = { &_innative_guard_handler, SIGACTION_SIGINFO | SIGACTION_RESTORER,
+                                          &_innative_guard_restorer, 0 };
+    state = IN_GUARD_FAILED;
+    if(_innative_syscall(SYSCALL_RT_SIGACTION, (void*)(size_t)SIGNAL_SEGV, (size_t)&action,
+                         (size_t)&_innative_guard_prev[0], SYSCALL_SIGSET, 0, 0) == 0)
+    {
+      if(_innative_syscall(SYSCALL_RT_SIGACTION, (void*)(size_t)SIGNAL_BUS, (size_t)&action,
+                           (size_t)&_innative_guard_prev[1], SYSCALL_SIGSET, 0, 0) == 0)
+        state = IN_GUARD_READY;
+      else // Put the previous SIGSEGV handler back, so we never leave half of the handler installed
+        _innative_syscall(SYSCALL_RT_SIGACTION, (void*)(size_t)SIGNAL_SEGV, (size_t)&_innative_guard_prev[0], 0,
+                          SYSCALL_SIGSET, 0, 0);
+    }
+
+    __atomic_store_n(&_innative_guard_state, state, __ATOMIC_RELEASE);
+    return state == IN_GUARD_READY;
+  }
+
+  // Another thread is installing the handler, which only takes two system calls
+  while((state = __atomic_load_n(&_innative_guard_state, __ATOMIC_ACQUIRE)) == IN_GUARD_BUSY)
+    ;
+  return state == IN_GUARD_READY;
+}
+
+// Guarded equivalent of _innative_internal_env_grow_memory. The first call reserves the entire guarded region as
+// inaccessible memory and installs the fault handler, after which growing the memory only makes more pages accessible,
+// so the base pointer never changes.
+IN_COMPILER_DLLEXPORT extern void* _innative_internal_env_grow_memory_guarded(void* p, uint64_t i, uint64_t max,
+                                                                              uint64_t* size)
+{
+  if(!size)
+    return 0;
+
+  char* info = (char*)p;
+  if(!info)
+  {
+    if(!_innative_guard_install())
+      return 0;
+    if(!(info = _innative_reserve_memory(GUARD_RESERVE)))
+      return 0;
+
+    *size = 0;
+
+    // If we run out of slots, out-of-bounds accesses still fault, they just aren't reported as webassembly traps.
+    for(int k = 0; k < (int)(sizeof(_innative_guard_regions) / sizeof(char*)); ++k)
+    {
+      char* empty = 0;
+      if(__atomic_compare_exchange_n(&_innative_guard_regions[k], &empty, info, 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+        break;
+    }
+  }
+
+  return _innative_grow_reserved(info, i, max, size);
+}
+
+// Releases the entire reservation of a guarded linear memory, regardless of how much of it was accessible.
+IN_COMPILER_DLLEXPORT extern void _innative_internal_env_free_memory_guarded(void* p, uint64_t max)
+{
+  if(!p)
+    return;
+
+  for(int k = 0; k < (int)(sizeof(_innative_guard_regions) / sizeof(char*)); ++k)
+  {
+    char* region = (char*)p;
+    if(__atomic_compare_exchange_n(&_innative_guard_regions[k], &region, 0, 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+      break;
+  }
+
+  _innative_release_memory((char*)p, GUARD_RESERVE);
+}
+#endif
+
 // You cannot return from the entry point of a program, you must instead call a platform-specific syscall to terminate it.
 IN_COMPILER_DLLEXPORT extern void _innative_internal_env_exit(int status)
 {
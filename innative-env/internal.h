@@ -3,8 +3,23 @@
 
 IN_COMPILER_DLLEXPORT extern void _innative_internal_write_out(const void* buf, size_t num);
 IN_COMPILER_DLLEXPORT extern void _innative_internal_abort();
+IN_COMPILER_DLLEXPORT extern void _innative_internal_env_trap(uint32_t code, uint32_t function, uint64_t location);
+IN_COMPILER_DLLEXPORT extern void _innative_internal_env_detect_cpu();
+IN_COMPILER_DLLEXPORT extern void _innative_internal_env_memcpy(char* dest, const char* src, uint64_t sz);
+IN_COMPILER_DLLEXPORT extern void _innative_internal_env_memmove(char* dest, const char* src, uint64_t sz);
+IN_COMPILER_DLLEXPORT extern void _innative_internal_env_memset(char* dest, int value, uint64_t sz);
+IN_COMPILER_DLLEXPORT extern void* _innative_internal_env_grow_memory(void* p, uint64_t i, uint64_t max, uint64_t* size);
+IN_COMPILER_DLLEXPORT extern void _innative_internal_env_free_memory(void* p, uint64_t size);
+IN_COMPILER_DLLEXPORT extern void* _innative_internal_env_grow_memory_stable(void* p, uint64_t i, uint64_t max,
+                                                                             uint64_t* size);
+IN_COMPILER_DLLEXPORT extern void _innative_internal_env_free_memory_stable(void* p, uint64_t max);
 
 #ifdef IN_PLATFORM_POSIX
 IN_COMPILER_DLLEXPORT extern void* _innative_syscall(size_t syscall_number, const void* p1, size_t p2, size_t p3, size_t p4,
                                                      size_t p5, size_t p6);
+#endif
+
+#if defined(IN_PLATFORM_LINUX) && defined(IN_CPU_x86_64)
+IN_COMPILER_DLLEXPORT extern int _innative_internal_env_map_parse_line(const char* line, const char* end, const char* p,
+                                                                       char* path, size_t n_path, uint64_t* offset);
 #endif
\ No newline at end of file
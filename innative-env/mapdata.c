@@ -0,0 +1,159 @@
+// Copyright (c)2020 Black Sphere Studios
+// For conditions of distribution and use, see copyright notice in innative.h
+
+#include "internal.h"
+
+#ifdef IN_PLATFORM_WIN32
+#elif defined(IN_PLATFORM_POSIX)
+  #include <fcntl.h>
+  #include <sys/mman.h>
+#else
+  #error unknown platform!
+#endif
+
+// Assemblies compiled with ENV_MAPPED_DATA store the initial contents of a linear memory as one page-aligned image in the
+// binary. Instead of copying the image, the init function asks the runtime to map the pages of the file that hold it
+// directly over the memory as a private copy-on-write mapping, so pages the module never touches are never read from the
+// disk and never take up memory. Whenever the image can't be mapped, like when it lives in JIT memory, it is copied.
+
+#define IN_MAP_PAGE_SIZE 0x1000ULL
+
+#if defined(IN_PLATFORM_LINUX) && defined(IN_CPU_x86_64)
+static const int SYSCALL_READ  = 0;
+static const int SYSCALL_OPEN  = 2;
+static const int SYSCALL_CLOSE = 3;
+static const int SYSCALL_MMAP  = 9;
+
+static const char* _innative_map_parse_hex(const char* s, const char* end, uint64_t* out)
+{
+  uint64_t v = 0;
+  for(; s < end; ++s)
+  {
+    if(*s >= '0' && *s <= '9')
+      v = (v << 4) | (uint64_t)(*s - '0');
+    else if(*s >= 'a' && *s <= 'f')
+      v = (v << 4) | (uint64_t)(*s - 'a' + 10);
+    else
+      break;
+  }
+
+  *out = v;
+  return s;
+}
+
+static const char* _innative_map_find(const char* s, const char* end, char c)
+{
+  while(s < end && *s != c)
+    ++s;
+  return s;
+}
+
+static const char* _innative_map_skip(const char* s, const char* end, char c)
+{
+  s = _innative_map_find(s, end, c);
+  while(s < end && *s == c)
+    ++s;
+  return s;
+}
+
+// Parses a single line of /proc/self/maps, which looks like "start-end perms offset dev inode path". If the mapping
+// contains p and is backed by a file, copies the file path into path and returns the offset of p in that file. Returns 0
+// if the mapping doesn't contain p, and -1 if it does but can't be opened again. Only exported so the tests can feed it
+// lines that /proc/self/maps can't be made to produce on demand.
+IN_COMPILER_DLLEXPORT extern int _innative_internal_env_map_parse_line(const char* line, const char* end, const char* p,
+                                                                       char* path, size_t n_path, uint64_t* offset)
+{
+  uint64_t start, stop, base, inode;
+  line = _innative_map_parse_hex(line, end, &start);
+  if(line >= end || *line++ != '-')
+    return 0;
+  line = _innative_map_parse_hex(line, end, &stop);
+  if((uint64_t)p < start || (uint64_t)p >= stop)
+    return 0;
+
+  line = _innative_map_skip(_innative_map_skip(line, end, ' '), end, ' '); // Skip the permissions
+  line = _innative_map_parse_hex(line, end, &base);
+  line = _innative_map_skip(_innative_map_skip(line, end, ' '), end, ' '); // Skip the device
+  for(inode = 0; line < end && *line >= '0' && *line <= '9'; ++line)
+    inode = inode * 10 + (uint64_t)(*line - '0');
+  line = _innative_map_skip(line, end, ' ');
+
+  // Anonymous mappings have no inode, and a file that was replaced since it was mapped can't be opened again
+  size_t n = (size_t)(end - line);
+  if(!inode || line >= end || *line != '/' || n >= n_path || end[-1] == ')')
+    return -1;
+
+  _innative_internal_env_memcpy(path, line, n);
+  path[n] = 0;
+  *offset = base + ((uint64_t)p - start);
+  return 1;
+}
+
+// Finds the file that backs the mapping containing p, and the offset of p in that file.
+static int _innative_map_find_file(const char* p, char* path, size_t n_path, uint64_t* offset)
+{
+  size_t fd = (size_t)_innative_syscall(SYSCALL_OPEN, "/proc/self/maps", O_RDONLY | O_CLOEXEC, 0, 0, 0, 0);
+  if((ptrdiff_t)fd < 0)
+    return 0;
+
+  char buf[4096 + 256];
+  size_t len = 0;
+  int found  = 0;
+  while(!found)
+  {
+    ptrdiff_t r = (ptrdiff_t)_innative_syscall(SYSCALL_READ, (void*)fd, (size_t)(buf + len), sizeof(buf) - len, 0, 0, 0);
+    if(r <= 0)
+      break;
+    len += (size_t)r;
+
+    // Only complete lines are parsed, and whatever is left over is moved to the front of the buffer
+    const char* line = buf;
+    const char* end  = buf + len;
+    for(const char* eol; !found && (eol = _innative_map_find(line, end, '\n')) < end; line = eol + 1)
+      found = _innative_internal_env_map_parse_line(line, eol, p, path, n_path, offset);
+
+    len = (size_t)(end - line);
+    if(len == sizeof(buf)) // No line is ever this long unless the path is, which we couldn't open anyway
+      break;
+    _innative_internal_env_memmove(buf, line, len);
+  }
+
+  _innative_syscall(SYSCALL_CLOSE, (void*)fd, 0, 0, 0, 0, 0);
+  return found > 0;
+}
+
+static int _innative_map_file(char* dest, const char* src, uint64_t sz)
+{
+  char path[4096];
+  uint64_t offset;
+  if(!_innative_map_find_file(src, path, sizeof(path), &offset) || (offset % IN_MAP_PAGE_SIZE) != 0)
+    return 0;
+
+  size_t fd = (size_t)_innative_syscall(SYSCALL_OPEN, path, O_RDONLY | O_CLOEXEC, 0, 0, 0, 0);
+  if((ptrdiff_t)fd < 0)
+    return 0;
+
+  // The mapping replaces the pages that were already committed for the memory. The file stays mapped after it's closed.
+  void* p = _innative_syscall(SYSCALL_MMAP, dest, sz, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, offset);
+  _innative_syscall(SYSCALL_CLOSE, (void*)fd, 0, 0, 0, 0, 0);
+  return p == dest;
+}
+#endif
+
+// Initializes sz bytes of a linear memory at dest with the image at src. Both have to be aligned to a page, and the memory
+// must never be moved by mremap, because the mapping splits it into several regions.
+IN_COMPILER_DLLEXPORT extern void _innative_internal_env_map_data(char* dest, const char* src, uint64_t sz)
+{
+  uint64_t mapped = 0;
+#if defined(IN_PLATFORM_LINUX) && defined(IN_CPU_x86_64)
+  if(!((size_t)dest % IN_MAP_PAGE_SIZE) && !((size_t)src % IN_MAP_PAGE_SIZE))
+  {
+    mapped = sz & ~(IN_MAP_PAGE_SIZE - 1);
+    if(mapped > 0 && !_innative_map_file(dest, src, mapped))
+      mapped = 0;
+  }
+#endif
+
+  if(mapped < sz)
+    _innative_internal_env_memcpy(dest + mapped, src + mapped, sz - mapped);
+}
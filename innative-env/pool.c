@@ -0,0 +1,420 @@
+// Copyright (c)2020 Black Sphere Studios
+// For conditions of distribution and use, see copyright notice in innative.h
+
+#include "internal.h"
+
+#ifdef IN_PLATFORM_WIN32
+  #include "../innative/win32.h"
+#elif defined(IN_PLATFORM_POSIX)
+  #include <sys/mman.h>
+#else
+  #error unknown platform!
+#endif
+
+// Assemblies compiled with ENV_POOLED_MEMORY allocate their linear memories and tables from these pools. Each pool
+// reserves all of its slots as one region the first time a slot is needed, and keeps the free slots in a lock-free stack.
+// A returned slot keeps its pages accessible and only has the bytes it used reset, so handing it out again costs no
+// system calls at all. Allocations that don't fit fall back to the ordinary allocation functions. The exit function gives
+// the reservation back once no slot is in use anymore, and the next allocation reserves it again.
+
+#define IN_POOL_GRANULE    0x10000ULL // Slots are made accessible in webassembly pages, which also covers page alignment
+#define IN_POOL_ZERO_LIMIT 0x40000ULL // Slots that used at most this many bytes are zeroed instead of advised
+
+#if defined(IN_CPU_x86_64) || defined(IN_CPU_ARM64)
+  #define IN_POOL_MEMORY_SLOTS     16
+  #define IN_POOL_MEMORY_SLOT_SIZE (1ULL << 32) // The largest possible 32-bit linear memory
+#else
+  #define IN_POOL_MEMORY_SLOTS     4
+  #define IN_POOL_MEMORY_SLOT_SIZE (1ULL << 26)
+#endif
+#define IN_POOL_TABLE_SLOTS     16
+#define IN_POOL_TABLE_SLOT_SIZE (1ULL << 20)
+
+#ifdef IN_PLATFORM_POSIX
+static const int SYSCALL_MMAP     = 9;
+static const int SYSCALL_MPROTECT = 10;
+static const int SYSCALL_MUNMAP   = 11;
+static const int SYSCALL_MADVISE  = 28;
+#endif
+
+enum IN_POOL_STATE
+{
+  IN_POOL_EMPTY = 0,
+  IN_POOL_BUSY,
+  IN_POOL_READY,
+  IN_POOL_FAILED,
+};
+
+typedef struct in_pool
+{
+  char* base;          // Start of the reservation that holds every slot
+  uint32_t* next;      // For each free slot, the index of the next free slot plus one, or 0 at the end of the list
+  uint64_t* used;      // For each slot, how many bytes it has used since it was last reset
+  uint64_t* available; // For each slot, how many bytes at its start are accessible
+  uint64_t head;       // Index of the first free slot plus one, with a counter in the upper 32 bits to prevent ABA
+  uint64_t popping;    // Number of threads currently popping a slot off the stack, which keeps the pool from being freed
+  int state;
+  INPoolStats stats;
+} in_pool;
+
+static in_pool _innative_pool_memories = { 0, 0, 0, 0, 0, 0, IN_POOL_EMPTY,
+                                           { IN_POOL_MEMORY_SLOT_SIZE, IN_POOL_MEMORY_SLOTS } };
+static in_pool _innative_pool_tables   = { 0, 0, 0, 0, 0, 0, IN_POOL_EMPTY,
+                                         { IN_POOL_TABLE_SLOT_SIZE, IN_POOL_TABLE_SLOTS } };
+
+static int in_pool_cas32(int* p, int expected, int desired)
+{
+#ifdef IN_PLATFORM_WIN32
+  return InterlockedCompareExchange((volatile LONG*)p, desired, expected) == expected;
+#else
+  return __atomic_compare_exchange_n(p, &expected, desired, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+#endif
+}
+
+// Returns the value p held before the exchange, which equals expected if it succeeded
+static uint64_t in_pool_cas64(uint64_t* p, uint64_t expected, uint64_t desired)
+{
+#ifdef IN_PLATFORM_WIN32
+  return (uint64_t)InterlockedCompareExchange64((volatile LONG64*)p, (LONG64)desired, (LONG64)expected);
+#else
+  __atomic_compare_exchange_n(p, &expected, desired, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+  return expected;
+#endif
+}
+
+static void in_pool_add(uint64_t* p, int64_t value)
+{
+#ifdef IN_PLATFORM_WIN32
+  InterlockedExchangeAdd64((volatile LONG64*)p, value);
+#else
+  __atomic_fetch_add(p, value, __ATOMIC_RELAXED);
+#endif
+}
+
+// Unlike in_pool_add, this is sequentially consistent, because it pairs a thread announcing itself with it checking the
+// state of the pool, while in_pool_free changes the state and then checks for announced threads
+static uint64_t in_pool_count(uint64_t* p, int64_t value)
+{
+#ifdef IN_PLATFORM_WIN32
+  return (uint64_t)InterlockedExchangeAdd64((volatile LONG64*)p, value) + value;
+#else
+  return __atomic_add_fetch(p, value, __ATOMIC_SEQ_CST);
+#endif
+}
+
+static int in_pool_load(int* p)
+{
+#ifdef IN_PLATFORM_WIN32
+  return InterlockedCompareExchange((volatile LONG*)p, 0, 0);
+#else
+  return __atomic_load_n(p, __ATOMIC_SEQ_CST);
+#endif
+}
+
+static char* in_pool_reserve(uint64_t size, int accessible)
+{
+#ifdef IN_PLATFORM_WIN32
+  return VirtualAlloc(0, (size_t)size, accessible ? MEM_COMMIT | MEM_RESERVE : MEM_RESERVE,
+                      accessible ? PAGE_READWRITE : PAGE_NOACCESS);
+#elif defined(IN_PLATFORM_POSIX)
+  char* p = _innative_syscall(SYSCALL_MMAP, NULL, size, accessible ? PROT_READ | PROT_WRITE : PROT_NONE,
+                              MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if((void*)p >= (void*)0xfffffffffffff001) // This is a syscall error from -4095 to -1
+    return 0;
+  return p;
+#else
+  #error unknown platform!
+#endif
+}
+
+static int in_pool_commit(char* p, uint64_t size)
+{
+#ifdef IN_PLATFORM_WIN32
+  return VirtualAlloc(p, (size_t)size, MEM_COMMIT, PAGE_READWRITE) != 0;
+#elif defined(IN_PLATFORM_POSIX)
+  return _innative_syscall(SYSCALL_MPROTECT, p, size, PROT_READ | PROT_WRITE, 0, 0, 0) == 0;
+#else
+  #error unknown platform!
+#endif
+}
+
+static void in_pool_unreserve(char* p, uint64_t size)
+{
+#ifdef IN_PLATFORM_WIN32
+  VirtualFree(p, 0, MEM_RELEASE);
+#elif defined(IN_PLATFORM_POSIX)
+  _innative_syscall(SYSCALL_MUNMAP, p, size, 0, 0, 0, 0);
+#else
+  #error unknown platform!
+#endif
+}
+
+// Resets a slot that used more bytes than are worth zeroing by hand. On POSIX, the pages stay accessible and the kernel
+// hands out fresh zero pages the next time they are touched. Windows can only do that by decommitting them.
+static void in_pool_advise(in_pool* pool, uint32_t slot)
+{
+  char* p = pool->base + slot * pool->stats.slot_size;
+#ifdef IN_PLATFORM_WIN32
+  VirtualFree(p, (size_t)pool->available[slot], MEM_DECOMMIT);
+  pool->available[slot] = 0;
+#elif defined(IN_PLATFORM_POSIX)
+  uint64_t size = (pool->used[slot] + IN_POOL_GRANULE - 1) & ~(IN_POOL_GRANULE - 1);
+  _innative_syscall(SYSCALL_MADVISE, p, size, MADV_DONTNEED, 0, 0, 0);
+#else
+  #error unknown platform!
+#endif
+}
+
+static int in_pool_init(in_pool* pool)
+{
+  int state = in_pool_load(&pool->state);
+  if(state == IN_POOL_EMPTY && in_pool_cas32(&pool->state, IN_POOL_EMPTY, IN_POOL_BUSY))
+  {
+    uint64_t n    = pool->stats.n_slots;
+    char* slots   = in_pool_reserve(n * pool->stats.slot_size, 0);
+    char* entries = slots ? in_pool_reserve(n * (sizeof(uint32_t) + 2 * sizeof(uint64_t)), 1) : 0;
+    if(!entries)
+    {
+      pool->stats.n_slots = 0;
+      in_pool_cas32(&pool->state, IN_POOL_BUSY, IN_POOL_FAILED);
+      return 0;
+    }
+
+    pool->base      = slots;
+    pool->used      = (uint64_t*)entries;
+    pool->available = pool->used + n;
+    pool->next      = (uint32_t*)(pool->available + n);
+    for(uint32_t i = 0; i < n; ++i)
+      pool->next[i] = (i + 1 < n) ? i + 2 : 0;
+    pool->head = 1;
+
+    in_pool_cas32(&pool->state, IN_POOL_BUSY, IN_POOL_READY);
+    return 1;
+  }
+
+  // Another thread is reserving the pool, which never takes long
+  while((state = in_pool_load(&pool->state)) == IN_POOL_BUSY)
+    ;
+  return state == IN_POOL_READY;
+}
+
+// Pops a free slot off the stack and returns its index plus one, or 0 if there is none
+static uint32_t in_pool_acquire(in_pool* pool, uint64_t size)
+{
+  if(size <= pool->stats.slot_size && in_pool_init(pool))
+  {
+    // The pool could have been freed since it was initialized, and it can't be freed while this thread is announced
+    in_pool_count(&pool->popping, 1);
+    uint64_t head = in_pool_load(&pool->state) == IN_POOL_READY ? pool->head : 0;
+    while((uint32_t)head != 0)
+    {
+      uint64_t next = (((head >> 32) + 1) << 32) | pool->next[(uint32_t)head - 1];
+      uint64_t prev = in_pool_cas64(&pool->head, head, next);
+      if(prev == head)
+      {
+        in_pool_add(&pool->stats.in_use, 1);
+        in_pool_add(&pool->stats.acquired, 1);
+        in_pool_count(&pool->popping, -1);
+        return (uint32_t)head;
+      }
+      head = prev;
+    }
+    in_pool_count(&pool->popping, -1);
+  }
+
+  in_pool_add(&pool->stats.fallbacks, 1);
+  return 0;
+}
+
+static void in_pool_release(in_pool* pool, uint32_t slot)
+{
+  if(pool->used[slot] <= IN_POOL_ZERO_LIMIT)
+  {
+    _innative_internal_env_memset(pool->base + slot * pool->stats.slot_size, 0, pool->used[slot]);
+    in_pool_add(&pool->stats.zeroed, 1);
+  }
+  else
+  {
+    in_pool_advise(pool, slot);
+    in_pool_add(&pool->stats.advised, 1);
+  }
+  pool->used[slot] = 0;
+
+  uint64_t head = pool->head;
+  for(;;)
+  {
+    pool->next[slot] = (uint32_t)head;
+    uint64_t prev    = in_pool_cas64(&pool->head, head, (((head >> 32) + 1) << 32) | (slot + 1));
+    if(prev == head)
+      break;
+    head = prev;
+  }
+
+  in_pool_add(&pool->stats.in_use, -1);
+  in_pool_add(&pool->stats.released, 1);
+}
+
+// Returns the index of the slot that p points to plus one, or 0 if p doesn't belong to this pool
+static uint32_t in_pool_find(in_pool* pool, void* p)
+{
+  if(in_pool_load(&pool->state) != IN_POOL_READY || (char*)p < pool->base)
+    return 0;
+  uint64_t offset = (uint64_t)((char*)p - pool->base);
+  if(offset >= pool->stats.n_slots * pool->stats.slot_size || offset % pool->stats.slot_size)
+    return 0;
+  return (uint32_t)(offset / pool->stats.slot_size) + 1;
+}
+
+// Grows an allocation inside its slot, which never moves it. Only bytes beyond what the slot ever used before need to be
+// made accessible.
+static void* in_pool_grow(in_pool* pool, uint32_t slot, uint64_t i, uint64_t max, uint64_t* size)
+{
+  char* p         = pool->base + slot * pool->stats.slot_size;
+  uint64_t target = *size + i;
+  if(target > 0xFFFFFFFF || target > pool->stats.slot_size) // Invalid for wasm32, or doesn't fit in the slot
+    return 0;
+  if(max > 0 && target > max)
+    return 0;
+
+  uint64_t available = (target + IN_POOL_GRANULE - 1) & ~(IN_POOL_GRANULE - 1);
+  if(available > pool->available[slot])
+  {
+    if(!in_pool_commit(p + pool->available[slot], available - pool->available[slot]))
+      return 0;
+    pool->available[slot] = available;
+  }
+
+  if(target > pool->used[slot])
+    pool->used[slot] = target;
+  *size = target;
+  return p;
+}
+
+// Makes the first i bytes of a freshly acquired slot accessible, or returns the slot to the pool if that fails
+static void* in_pool_start(in_pool* pool, uint32_t slot, uint64_t i, uint64_t max, uint64_t* size)
+{
+  *size   = 0;
+  void* p = in_pool_grow(pool, slot, i, max, size);
+  if(!p)
+    in_pool_release(pool, slot);
+  return p;
+}
+
+// Gives the reservation of a pool back to the system if none of its slots are in use, which puts the pool back into the
+// state it started out in
+static void in_pool_free(in_pool* pool)
+{
+  if(!in_pool_cas32(&pool->state, IN_POOL_READY, IN_POOL_BUSY))
+    return;
+
+  // Threads that saw the pool was ready before it became busy might still be reading the free list
+  while(in_pool_count(&pool->popping, 0) != 0)
+    ;
+
+  if(in_pool_count(&pool->stats.in_use, 0) != 0)
+  {
+    in_pool_cas32(&pool->state, IN_POOL_BUSY, IN_POOL_READY);
+    return;
+  }
+
+  uint64_t n = pool->stats.n_slots;
+  in_pool_unreserve(pool->base, n * pool->stats.slot_size);
+  in_pool_unreserve((char*)pool->used, n * (sizeof(uint32_t) + 2 * sizeof(uint64_t)));
+  pool->base      = 0;
+  pool->used      = 0;
+  pool->available = 0;
+  pool->next      = 0;
+  pool->head      = 0;
+  in_pool_cas32(&pool->state, IN_POOL_BUSY, IN_POOL_EMPTY);
+}
+
+static void in_pool_configure(in_pool* pool, uint32_t slots, uint64_t slot_size)
+{
+  if(slots > 0)
+    pool->stats.n_slots = slots;
+  if(slot_size > 0)
+    pool->stats.slot_size = (slot_size + IN_POOL_GRANULE - 1) & ~(IN_POOL_GRANULE - 1);
+}
+
+// Either both pools are configured or neither is, so a pool that was already reserved leaves the other one untouched
+IN_COMPILER_DLLEXPORT extern int _innative_internal_env_pool_configure(uint32_t memory_slots, uint64_t memory_slot_size,
+                                                                       uint32_t table_slots, uint64_t table_slot_size)
+{
+  if(!in_pool_cas32(&_innative_pool_memories.state, IN_POOL_EMPTY, IN_POOL_BUSY))
+    return 0;
+  if(!in_pool_cas32(&_innative_pool_tables.state, IN_POOL_EMPTY, IN_POOL_BUSY))
+  {
+    in_pool_cas32(&_innative_pool_memories.state, IN_POOL_BUSY, IN_POOL_EMPTY);
+    return 0;
+  }
+
+  in_pool_configure(&_innative_pool_memories, memory_slots, memory_slot_size);
+  in_pool_configure(&_innative_pool_tables, table_slots, table_slot_size);
+  in_pool_cas32(&_innative_pool_tables.state, IN_POOL_BUSY, IN_POOL_EMPTY);
+  in_pool_cas32(&_innative_pool_memories.state, IN_POOL_BUSY, IN_POOL_EMPTY);
+  return 1;
+}
+
+// Called by the exit function of an assembly compiled with ENV_POOLED_MEMORY, after it freed its memories and tables
+IN_COMPILER_DLLEXPORT extern void _innative_internal_env_pool_teardown()
+{
+  in_pool_free(&_innative_pool_memories);
+  in_pool_free(&_innative_pool_tables);
+}
+
+IN_COMPILER_DLLEXPORT extern void _innative_internal_env_pool_stats(INPoolStats* memories, INPoolStats* tables)
+{
+  if(memories)
+    *memories = _innative_pool_memories.stats;
+  if(tables)
+    *tables = _innative_pool_tables.stats;
+}
+
+// Pooled equivalent of _innative_internal_env_grow_memory_stable, which it falls back to if no slot is available
+IN_COMPILER_DLLEXPORT extern void* _innative_internal_env_grow_memory_pooled(void* p, uint64_t i, uint64_t max,
+                                                                             uint64_t* size)
+{
+  if(!size)
+    return 0;
+
+  uint32_t slot = !p ? in_pool_acquire(&_innative_pool_memories, i) : in_pool_find(&_innative_pool_memories, p);
+  if(!slot)
+    return _innative_internal_env_grow_memory_stable(p, i, max, size);
+  if(!p)
+    return in_pool_start(&_innative_pool_memories, slot - 1, i, max, size);
+  return in_pool_grow(&_innative_pool_memories, slot - 1, i, max, size);
+}
+
+IN_COMPILER_DLLEXPORT extern void _innative_internal_env_free_memory_pooled(void* p, uint64_t max)
+{
+  uint32_t slot = in_pool_find(&_innative_pool_memories, p);
+  if(slot)
+    in_pool_release(&_innative_pool_memories, slot - 1);
+  else
+    _innative_internal_env_free_memory_stable(p, max);
+}
+
+// Pooled equivalent of _innative_internal_env_grow_memory for tables, which it falls back to if no slot is available
+IN_COMPILER_DLLEXPORT extern void* _innative_internal_env_grow_table_pooled(void* p, uint64_t i, uint64_t max,
+                                                                            uint64_t* size)
+{
+  if(!size)
+    return 0;
+
+  // Empty tables don't need a slot, because the fallback never allocates anything for them
+  uint32_t slot = !p ? (i > 0 ? in_pool_acquire(&_innative_pool_tables, i) : 0) : in_pool_find(&_innative_pool_tables, p);
+  if(!slot)
+    return _innative_internal_env_grow_memory(p, i, max, size);
+  if(!p)
+    return in_pool_start(&_innative_pool_tables, slot - 1, i, max, size);
+  return in_pool_grow(&_innative_pool_tables, slot - 1, i, max, size);
+}
+
+IN_COMPILER_DLLEXPORT extern void _innative_internal_env_free_table_pooled(void* p, uint64_t size)
+{
+  uint32_t slot = in_pool_find(&_innative_pool_tables, p);
+  if(slot)
+    in_pool_release(&_innative_pool_tables, slot - 1);
+  else
+    _innative_internal_env_free_memory(p, size);
+}
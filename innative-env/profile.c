@@ -0,0 +1,361 @@
+// Copyright (c)2020 Black Sphere Studios
+// For conditions of distribution and use, see copyright notice in innative.h
+
+#include "internal.h"
+
+#ifdef IN_PLATFORM_WIN32
+  #include "../innative/win32.h"
+#elif defined(IN_PLATFORM_POSIX)
+  #include <fcntl.h>
+#else
+  #error unknown platform!
+#endif
+
+// LLVM's profile instrumentation places counters and per-function records in dedicated sections and normally relies on
+// compiler-rt to write them out when the program exits. We don't have a C library, so this is a minimal replacement for
+// that runtime which writes the same raw profile format. Only version 5 of the format, used by LLVM 10, is supported.
+
+#define IN_PROFILE_MAGIC                                                                                               \
+  ((uint64_t)255 << 56 | (uint64_t)'l' << 48 | (uint64_t)'p' << 40 | (uint64_t)'r' << 32 | (uint64_t)'o' << 24 | \
+   (uint64_t)'f' << 16 | (uint64_t)'r' << 8 | (uint64_t)129)
+#define IN_PROFILE_VERSION    5
+#define IN_PROFILE_VALUE_KINDS 2  // Indirect call targets and memory operation sizes
+#define IN_PROFILE_MAX_VALUES  16 // Maximum number of distinct values tracked per call site, same as compiler-rt
+
+typedef struct in_profile_node
+{
+  uint64_t value;
+  uint64_t count;
+  struct in_profile_node* next;
+} in_profile_node;
+
+// Must exactly match the records LLVM emits into the profile data section
+typedef struct in_profile_data
+{
+  uint64_t name;
+  uint64_t hash;
+  uint64_t* counters;
+  void* function;
+  in_profile_node** values;
+  uint32_t n_counters;
+  uint16_t n_sites[IN_PROFILE_VALUE_KINDS];
+} in_profile_data;
+
+#ifdef IN_PLATFORM_WIN32
+  // The linker sorts grouped sections alphabetically, so these markers end up on either side of everything LLVM emits
+  #pragma section(".lprfd$A", read, write)
+  #pragma section(".lprfd$Z", read, write)
+  #pragma section(".lprfc$A", read, write)
+  #pragma section(".lprfc$Z", read, write)
+  #pragma section(".lprfn$A", read, write)
+  #pragma section(".lprfn$Z", read, write)
+  #pragma section(".lprfnd$A", read, write)
+  #pragma section(".lprfnd$Z", read, write)
+
+__declspec(allocate(".lprfd$A")) in_profile_data _innative_profile_data_begin = { 0 };
+__declspec(allocate(".lprfd$Z")) in_profile_data _innative_profile_data_end = { 0 };
+__declspec(allocate(".lprfc$A")) uint64_t _innative_profile_counters_begin = 0;
+__declspec(allocate(".lprfc$Z")) uint64_t _innative_profile_counters_end = 0;
+__declspec(allocate(".lprfn$A")) char _innative_profile_names_begin = 0;
+__declspec(allocate(".lprfn$Z")) char _innative_profile_names_end = 0;
+__declspec(allocate(".lprfnd$A")) in_profile_node _innative_profile_nodes_begin = { 0 };
+__declspec(allocate(".lprfnd$Z")) in_profile_node _innative_profile_nodes_end = { 0 };
+
+  #define IN_PROFILE_DATA_BEGIN     (&_innative_profile_data_begin + 1)
+  #define IN_PROFILE_DATA_END       (&_innative_profile_data_end)
+  #define IN_PROFILE_COUNTERS_BEGIN (&_innative_profile_counters_begin + 1)
+  #define IN_PROFILE_COUNTERS_END   (&_innative_profile_counters_end)
+  #define IN_PROFILE_NAMES_BEGIN    (&_innative_profile_names_begin + 1)
+  #define IN_PROFILE_NAMES_END      (&_innative_profile_names_end)
+  #define IN_PROFILE_NODES_BEGIN    (&_innative_profile_nodes_begin + 1)
+  #define IN_PROFILE_NODES_END      (&_innative_profile_nodes_end)
+
+// Instrumented code is only ever linked with this file if it was compiled with ENV_OPTIMIZE_PROFILE_GENERATE, which always
+// emits both of these.
+extern uint64_t __llvm_profile_raw_version;
+extern char __llvm_profile_filename[];
+#elif defined(IN_PLATFORM_POSIX)
+// The linker defines start and stop symbols for every section whose name is a valid C identifier
+  #define IN_PROFILE_SECTION_BOUNDS(type, name)                                                \
+    extern type __start_##name[] __attribute__((weak, visibility("hidden"))); \
+    extern type __stop_##name[] __attribute__((weak, visibility("hidden")));
+
+IN_PROFILE_SECTION_BOUNDS(in_profile_data, __llvm_prf_data)
+IN_PROFILE_SECTION_BOUNDS(uint64_t, __llvm_prf_cnts)
+IN_PROFILE_SECTION_BOUNDS(char, __llvm_prf_names)
+IN_PROFILE_SECTION_BOUNDS(in_profile_node, __llvm_prf_vnds)
+
+  #define IN_PROFILE_DATA_BEGIN     (__start___llvm_prf_data)
+  #define IN_PROFILE_DATA_END       (__stop___llvm_prf_data)
+  #define IN_PROFILE_COUNTERS_BEGIN (__start___llvm_prf_cnts)
+  #define IN_PROFILE_COUNTERS_END   (__stop___llvm_prf_cnts)
+  #define IN_PROFILE_NAMES_BEGIN    (__start___llvm_prf_names)
+  #define IN_PROFILE_NAMES_END      (__stop___llvm_prf_names)
+  #define IN_PROFILE_NODES_BEGIN    (__start___llvm_prf_vnds)
+  #define IN_PROFILE_NODES_END      (__stop___llvm_prf_vnds)
+
+extern uint64_t __llvm_profile_raw_version __attribute__((weak));
+extern char __llvm_profile_filename[] __attribute__((weak));
+
+static const int SYSCALL_WRITE = 1;
+static const int SYSCALL_OPEN  = 2;
+static const int SYSCALL_CLOSE = 3;
+#endif
+
+// Referenced by instrumented code on platforms that don't pull in the profile runtime through a linker flag
+IN_COMPILER_DLLEXPORT int __llvm_profile_runtime = 0;
+
+// Value profiles are stored as linked lists of nodes that are handed out from a section LLVM sizes for us
+static size_t _innative_profile_next_node = 0;
+
+static in_profile_node* _innative_profile_alloc_node()
+{
+#ifdef IN_PLATFORM_WIN32
+  size_t i = (size_t)InterlockedExchangeAdd64((volatile LONG64*)&_innative_profile_next_node, 1);
+#else
+  size_t i = __atomic_fetch_add(&_innative_profile_next_node, 1, __ATOMIC_RELAXED);
+#endif
+  in_profile_node* node = IN_PROFILE_NODES_BEGIN + i;
+  return (IN_PROFILE_NODES_BEGIN != 0 && node < IN_PROFILE_NODES_END) ? node : 0;
+}
+
+static int _innative_profile_link_node(in_profile_node** slot, in_profile_node* node)
+{
+#ifdef IN_PLATFORM_WIN32
+  return InterlockedCompareExchangePointer((PVOID volatile*)slot, node, 0) == 0;
+#else
+  in_profile_node* expected = 0;
+  return __atomic_compare_exchange_n(slot, &expected, node, 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+#endif
+}
+
+// Called by instrumented code at every indirect call site with the target that is about to be called
+IN_COMPILER_DLLEXPORT void __llvm_profile_instrument_target(uint64_t value, void* data, uint32_t index)
+{
+  in_profile_data* d = (in_profile_data*)data;
+  if(!d || !d->values)
+    return;
+
+  in_profile_node** slot = &d->values[index];
+  int n                  = 0;
+  for(in_profile_node* cur = *slot; cur != 0; cur = cur->next, ++n)
+  {
+    if(cur->value == value)
+    {
+      ++cur->count; // Losing the occasional increment to a race is fine, compiler-rt doesn't bother either
+      return;
+    }
+    slot = &cur->next;
+  }
+
+  if(n >= IN_PROFILE_MAX_VALUES)
+    return;
+
+  in_profile_node* node = _innative_profile_alloc_node();
+  if(!node)
+    return;
+
+  node->value = value;
+  node->count = 1;
+  node->next  = 0;
+  _innative_profile_link_node(slot, node); // If another thread won the race, this value is simply dropped
+}
+
+// Memory operation sizes are bucketed so that only sizes that are worth specializing for are tracked individually
+IN_COMPILER_DLLEXPORT void __llvm_profile_instrument_range(uint64_t value, void* data, uint32_t index, int64_t start,
+                                                           int64_t last, int64_t large)
+{
+  if(large != INT64_MIN && (int64_t)value >= large)
+    value = large;
+  else if((int64_t)value < start || (int64_t)value > last)
+    value = last + 1;
+
+  __llvm_profile_instrument_target(value, data, index);
+}
+
+typedef struct in_profile_writer
+{
+#ifdef IN_PLATFORM_WIN32
+  HANDLE file;
+#else
+  size_t file;
+#endif
+  size_t n;
+  int failed;
+  uint8_t buffer[4096];
+} in_profile_writer;
+
+static void _innative_profile_flush(in_profile_writer* w)
+{
+  for(size_t i = 0; i < w->n && !w->failed;)
+  {
+#ifdef IN_PLATFORM_WIN32
+    DWORD written = 0;
+    if(!WriteFile(w->file, w->buffer + i, (DWORD)(w->n - i), &written, NULL) || !written)
+      w->failed = 1;
+#else
+    size_t written =
+      (size_t)_innative_syscall(SYSCALL_WRITE, (void*)w->file, (size_t)(w->buffer + i), w->n - i, 0, 0, 0);
+    if((ptrdiff_t)written <= 0)
+      w->failed = 1;
+#endif
+    i += written;
+  }
+  w->n = 0;
+}
+
+static void _innative_profile_write(in_profile_writer* w, const void* data, size_t size)
+{
+  const uint8_t* p = (const uint8_t*)data;
+  while(size > 0)
+  {
+    if(w->n == sizeof(w->buffer))
+      _innative_profile_flush(w);
+
+    size_t n = sizeof(w->buffer) - w->n;
+    if(n > size)
+      n = size;
+
+    for(size_t i = 0; i < n; ++i)
+      w->buffer[w->n + i] = p[i];
+
+    w->n += n;
+    p += n;
+    size -= n;
+  }
+}
+
+static void _innative_profile_write64(in_profile_writer* w, uint64_t v) { _innative_profile_write(w, &v, sizeof(v)); }
+
+static void _innative_profile_pad(in_profile_writer* w, size_t size)
+{
+  static const uint8_t zeros[8] = { 0 };
+  _innative_profile_write(w, zeros, (8 - (size % 8)) % 8);
+}
+
+static uint32_t _innative_profile_count_values(in_profile_node* node)
+{
+  uint32_t n = 0;
+  for(; node != 0; node = node->next)
+    ++n;
+  return n;
+}
+
+// Writes the value profile of a single function, which is required for every function that has value sites, even if
+// nothing was recorded.
+static void _innative_profile_write_values(in_profile_writer* w, const in_profile_data* d)
+{
+  uint32_t total = 8;
+  uint32_t kinds = 0;
+  uint32_t site  = 0;
+
+  for(int k = 0; k < IN_PROFILE_VALUE_KINDS; ++k)
+  {
+    if(!d->n_sites[k])
+      continue;
+
+    uint32_t header = 8 + d->n_sites[k];
+    total += header + ((8 - (header % 8)) % 8);
+    for(uint32_t i = 0; i < d->n_sites[k]; ++i, ++site)
+      total += 16 * _innative_profile_count_values(d->values ? d->values[site] : 0);
+    ++kinds;
+  }
+
+  if(!kinds)
+    return;
+
+  uint32_t fields[2] = { total, kinds };
+  _innative_profile_write(w, fields, sizeof(fields));
+
+  site = 0;
+  for(uint32_t k = 0; k < IN_PROFILE_VALUE_KINDS; ++k)
+  {
+    if(!d->n_sites[k])
+      continue;
+
+    uint32_t record[2] = { k, d->n_sites[k] };
+    _innative_profile_write(w, record, sizeof(record));
+
+    for(uint32_t i = 0; i < d->n_sites[k]; ++i)
+    {
+      uint8_t count = (uint8_t)_innative_profile_count_values(d->values ? d->values[site + i] : 0);
+      _innative_profile_write(w, &count, 1);
+    }
+    _innative_profile_pad(w, 8 + d->n_sites[k]);
+
+    for(uint32_t i = 0; i < d->n_sites[k]; ++i, ++site)
+    {
+      for(in_profile_node* node = d->values ? d->values[site] : 0; node != 0; node = node->next)
+      {
+        _innative_profile_write64(w, node->value);
+        _innative_profile_write64(w, node->count);
+      }
+    }
+  }
+}
+
+// Called by the exit function of an instrumented program once every module has been cleaned up
+IN_COMPILER_DLLEXPORT void _innative_internal_env_write_profile()
+{
+  const in_profile_data* data_begin = IN_PROFILE_DATA_BEGIN;
+  const in_profile_data* data_end   = IN_PROFILE_DATA_END;
+  const uint64_t* counters_begin    = IN_PROFILE_COUNTERS_BEGIN;
+  const uint64_t* counters_end      = IN_PROFILE_COUNTERS_END;
+  const char* names_begin           = IN_PROFILE_NAMES_BEGIN;
+  const char* names_end             = IN_PROFILE_NAMES_END;
+
+  if(!data_begin || data_begin == data_end || !__llvm_profile_filename)
+    return;
+
+  if((uint32_t)__llvm_profile_raw_version != IN_PROFILE_VERSION)
+  {
+    static const char msg[] = "Profile was not written, because this version of LLVM uses an unsupported format.\n";
+    _innative_internal_write_out(msg, sizeof(msg) - 1);
+    return;
+  }
+
+  in_profile_writer w;
+  w.n      = 0;
+  w.failed = 0;
+
+#ifdef IN_PLATFORM_WIN32
+  w.file = CreateFileA(__llvm_profile_filename, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+  if(w.file == INVALID_HANDLE_VALUE)
+    return;
+#else
+  w.file = (size_t)_innative_syscall(SYSCALL_OPEN, __llvm_profile_filename, O_WRONLY | O_CREAT | O_TRUNC, 0666, 0, 0, 0);
+  if((ptrdiff_t)w.file < 0)
+    return;
+#endif
+
+  size_t names_size = (size_t)(names_end - names_begin);
+  uint64_t header[] = {
+    IN_PROFILE_MAGIC,
+    __llvm_profile_raw_version,
+    (uint64_t)(data_end - data_begin),
+    0, // Padding before counters
+    (uint64_t)(counters_end - counters_begin),
+    0, // Padding after counters
+    names_size,
+    (uint64_t)(size_t)counters_begin,
+    (uint64_t)(size_t)names_begin,
+    IN_PROFILE_VALUE_KINDS - 1,
+  };
+
+  _innative_profile_write(&w, header, sizeof(header));
+  _innative_profile_write(&w, data_begin, (size_t)(data_end - data_begin) * sizeof(in_profile_data));
+  _innative_profile_write(&w, counters_begin, (size_t)(counters_end - counters_begin) * sizeof(uint64_t));
+  _innative_profile_write(&w, names_begin, names_size);
+  _innative_profile_pad(&w, names_size);
+
+  for(const in_profile_data* d = data_begin; d < data_end; ++d)
+    _innative_profile_write_values(&w, d);
+
+  _innative_profile_flush(&w);
+
+#ifdef IN_PLATFORM_WIN32
+  CloseHandle(w.file);
+#else
+  _innative_syscall(SYSCALL_CLOSE, (void*)w.file, 0, 0, 0, 0, 0);
+#endif
+}
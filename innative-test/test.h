@@ -37,12 +37,35 @@ public:
   void test_variadic();
   void test_errors();
   void test_funcreplace();
+  void test_objectcache();
+  void test_jit();
+  void test_lto();
+  void test_pgo();
+  void test_bounds();
+  void test_tailcall();
+  void test_trap();
+  void test_nontrapping();
+  void test_multiversion();
+  void test_instance();
+  void test_pool();
+  void test_snapshot();
+  void test_mapped();
+  void test_bulk();
+  void test_memory();
+  void test_simd();
   int CompileWASM(const path& file, int (TestHarness::*fn)(void*), const char* system = nullptr,
                   std::function<int(Environment*)> preprocess = std::function<int(Environment*)>());
+  void* CompileWASM(const char* source, size_t size, const char* name,
+                    std::function<int(Environment*)> preprocess = std::function<int(Environment*)>());
+  bool CallTraps(const std::function<void()>& f);
+  Environment* PrepareEnvironment(const char* source, size_t size, const char* name, const char* system,
+                                  std::function<int(Environment*)> preprocess, int& err);
   int do_debug(void* assembly);
   int do_debug_2(void* assembly);
   int do_funcreplace(void* assembly);
   int do_embedding(void* assembly);
+  int do_snapshot(void* assembly);
+  int do_mapped(void* assembly);
   int do_variadic(void* assembly);
 
   inline std::pair<uint32_t, uint32_t> Results()
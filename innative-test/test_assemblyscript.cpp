@@ -58,6 +58,18 @@ void TestHarness::test_assemblyscript()
     err = (*_exports.FinalizeEnvironment)(env);
     TEST(!err);
 
+    // Modules loaded from a path should leave their data segments in the file mapping instead of copying them
+    TEST(env->mappings != nullptr);
+    if(env->mappings && env->n_modules > 0)
+    {
+      const uint8_t* begin  = reinterpret_cast<const uint8_t*>(env->mappings->data);
+      const auto& section = env->modules[0].data;
+      for(varuint32 k = 0; k < section.n_data; ++k)
+        TEST(section.data[k].data.size() == 0 ||
+             (section.data[k].data.get() >= begin &&
+              section.data[k].data.get() + section.data[k].data.size() <= begin + env->mappings->size));
+    }
+
     err = (*_exports.Compile)(env, dll_path.u8string().c_str());
     TEST(!err);
 
@@ -190,4 +190,35 @@ void TestHarness::test_atomic_waitnotify()
     std::this_thread::sleep_for(50ms);
 
   TEST(result == num_threads * increment);
+
+  // Waiting on a value that doesn't match returns immediately, and so does notifying an address nobody waits on
+  std::atomic<int64_t> value = 5;
+  TEST(_innative_internal_env_atomic_wait32(&value, 4, -1) == 1);
+  TEST(_innative_internal_env_atomic_wait64(&value, 4, -1) == 1);
+  TEST(_innative_internal_env_atomic_notify(&value, 1) == 0);
+
+  // Timeouts are in nanoseconds, and a timeout of zero never sleeps
+  TEST(_innative_internal_env_atomic_wait32(&value, 5, 0) == 2);
+  TEST(_innative_internal_env_atomic_wait64(&value, 5, 0) == 2);
+  TEST(_innative_internal_env_atomic_wait32(&value, 5, 1'000'000 /* 1ms */) == 2);
+  TEST(_innative_internal_env_atomic_wait64(&value, 5, 1'000'000 /* 1ms */) == 2);
+
+  // A 64-bit waiter must wake up even if only the upper half of the value changes
+  // The notification lands halfway through a sleep, rather than at the end of it.
+  std::atomic<int32_t> woken = -1;
+  std::thread wait64_thread([&]() { woken = _innative_internal_env_atomic_wait64(&value, 5, -1); });
+  std::this_thread::sleep_for(5ms);
+  value.store(5 + (1LL << 40));
+  _innative_internal_env_atomic_notify(&value, 1);
+  wait64_thread.join();
+  TEST(woken == 0);
+
+  // Changing the value without a notification isn't a wake-up, so the waiter must not report "ok"
+  value.store(5);
+  woken = -1;
+  std::thread store64_thread([&]() { woken = _innative_internal_env_atomic_wait64(&value, 5, 1'000'000'000 /* 1s */); });
+  std::this_thread::sleep_for(5ms);
+  value.store(5 + (1LL << 40));
+  store64_thread.join();
+  TEST(woken == 1);
 }
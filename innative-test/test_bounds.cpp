@@ -0,0 +1,168 @@
+// Copyright (c)2020 Black Sphere Studios
+// For conditions of distribution and use, see copyright notice in innative.h
+
+#include "test.h"
+#include "../innative/utility.h"
+
+using namespace innative;
+
+void TestHarness::test_bounds()
+{
+  const char wat[] = "(module $bounds\n"
+                     "  (memory 1)\n"
+                     "  (func (export \"fill\") (param $n i32) (local $i i32)\n"
+                     "    (block (loop\n"
+                     "      (br_if 1 (i32.ge_u (local.get $i) (local.get $n)))\n"
+                     "      (i32.store (i32.shl (local.get $i) (i32.const 2)) (local.get $i))\n"
+                     "      (local.set $i (i32.add (local.get $i) (i32.const 1)))\n"
+                     "      (br 0))))\n"
+                     "  (func (export \"sum\") (param $n i32) (result i32) (local $i i32) (local $s i32)\n"
+                     "    (block (loop\n"
+                     "      (br_if 1 (i32.ge_u (local.get $i) (local.get $n)))\n"
+                     "      (local.set $s (i32.add (local.get $s) (i32.load (i32.shl (local.get $i) (i32.const 2)))))\n"
+                     "      (local.set $i (i32.add (local.get $i) (i32.const 1)))\n"
+                     "      (br 0)))\n"
+                     "    (local.get $s))\n"
+                     "  (func (export \"quad\") (param $p i32) (result i32)\n"
+                     "    (i32.add (i32.add (i32.load offset=0 (local.get $p)) (i32.load offset=4 (local.get $p)))\n"
+                     "             (i32.add (i32.load offset=8 (local.get $p)) (i32.load offset=12 (local.get $p)))))\n"
+                     "  (func (export \"set\") (param $n i32) (param $v i32) (local $i i32)\n"
+                     "    (block (loop\n"
+                     "      (br_if 1 (i32.ge_u (local.get $i) (local.get $n)))\n"
+                     "      (i32.store (i32.shl (local.get $i) (i32.const 2)) (local.get $v))\n"
+                     "      (local.set $i (i32.add (local.get $i) (i32.const 1)))\n"
+                     "      (br 0))))\n"
+                     "  (func (export \"load\") (param i32) (result i32) (i32.load (local.get 0)))\n"
+                     "  (func (export \"poke\") (param $p i32)\n"
+                     "    (i32.store (local.get $p) (i32.const 9))\n"
+                     "    (drop (i32.load offset=12 (local.get $p))))\n"
+                     "  (func (export \"branch\") (param $p i32) (param $c i32) (result i32) (local $s i32)\n"
+                     "    (local.set $s (i32.add (i32.load (local.get $p)) (i32.load offset=4 (local.get $p))))\n"
+                     "    (if (local.get $c) (then\n"
+                     "      (local.set $s (i32.add (local.get $s) (i32.load (local.get $p))))\n"
+                     "      (local.set $s (i32.add (local.get $s) (i32.load offset=8 (local.get $p))))))\n"
+                     "    (local.get $s))\n"
+                     ")";
+
+  // Removing, merging or hoisting bounds checks must not change the result of any access that stays in bounds, right up
+  // to the last byte of the memory.
+  for(uint64_t optimize : { uint64_t(ENV_OPTIMIZE_O3), uint64_t(ENV_OPTIMIZE_Os) })
+  {
+    void* assembly = CompileWASM(wat, sizeof(wat) - 1, "bounds", [optimize](Environment* env) -> int {
+      env->flags |= ENV_CHECK_MEMORY_ACCESS;
+      env->optimize = optimize;
+      return ERR_SUCCESS;
+    });
+    TEST(assembly != nullptr);
+
+    if(assembly)
+    {
+      void (*fill)(int)       = (void (*)(int))(*_exports.LoadFunction)(assembly, "bounds", "fill");
+      int (*sum)(int)         = (int (*)(int))(*_exports.LoadFunction)(assembly, "bounds", "sum");
+      int (*quad)(int)        = (int (*)(int))(*_exports.LoadFunction)(assembly, "bounds", "quad");
+      void (*set)(int, int)   = (void (*)(int, int))(*_exports.LoadFunction)(assembly, "bounds", "set");
+      int (*load)(int)        = (int (*)(int))(*_exports.LoadFunction)(assembly, "bounds", "load");
+      void (*poke)(int)       = (void (*)(int))(*_exports.LoadFunction)(assembly, "bounds", "poke");
+      int (*branch)(int, int) = (int (*)(int, int))(*_exports.LoadFunction)(assembly, "bounds", "branch");
+      auto last               = (*_exports.GetLastTrap)(assembly);
+      TEST(fill != nullptr);
+      TEST(sum != nullptr);
+      TEST(quad != nullptr);
+      TEST(set != nullptr);
+      TEST(load != nullptr);
+      TEST(poke != nullptr);
+      TEST(branch != nullptr);
+      TEST(last != nullptr);
+      if(fill && sum && quad)
+      {
+        (*fill)(16384);
+        TEST((*sum)(100) == 4950);
+        TEST((*sum)(16384) == 134209536);
+        TEST((*quad)(0) == 6);
+        TEST((*quad)(65520) == 65526);
+      }
+
+      // Every access that was out of bounds before the pass must still trap, at the same point it would have without it
+      if(sum && quad && set && load && poke && branch && last)
+      {
+        auto traps = [&](const std::function<void()>& f) {
+          bool trapped = CallTraps(f);
+          return trapped && last->code == IN_TRAP_OUT_OF_BOUNDS;
+        };
+
+        // Only the last iteration of the loop is out of bounds, so the checked copy has to run and stop right there
+        TEST(traps([set] { (*set)(16385, 7); }));
+        TEST((*load)(0) == 7);
+        TEST((*load)(65532) == 7);
+        TEST(traps([sum] { (*sum)(16385); }));
+
+        // Only the last access is out of bounds, but after widening, it's the check in front of the first one that fails
+        TEST(traps([quad] { (*quad)(65524); }));
+
+        // A store can't be skipped by a check widened from after it
+        TEST(traps([poke] { (*poke)(65524); }));
+        TEST((*load)(65524) == 9);
+
+        // The repeated access in the branch loses its check to the one before the branch, but the wider one keeps its own
+        TEST((*branch)(65528, 0) == 14);
+        TEST(traps([branch] { (*branch)(65528, 1); }));
+        TEST(traps([branch] { (*branch)(65532, 0); }));
+      }
+      (*_exports.FreeAssembly)(assembly);
+    }
+  }
+
+#if defined(IN_PLATFORM_LINUX) && defined(IN_CPU_x86_64)
+  // Guard pages replace the checks with page faults, which the runtime turns into the same trap. Anything past the current
+  // size faults, even if the memory could still grow to cover it, and so does an offset that carries an address past 4 GiB.
+  const char guard[] = "(module $guard\n"
+                       "  (memory 1)\n"
+                       "  (func (export \"load\") (param i32) (result i32) (i32.load (local.get 0)))\n"
+                       "  (func (export \"far\") (param i32) (result i32) (i32.load offset=0xfffffff0 (local.get 0)))\n"
+                       "  (func (export \"grow\") (param i32) (result i32) (memory.grow (local.get 0)))\n"
+                       ")";
+
+  for(uint64_t optimize : { uint64_t(0), uint64_t(ENV_OPTIMIZE_O3) })
+  {
+    void* assembly = CompileWASM(guard, sizeof(guard) - 1, "guard", [optimize](Environment* env) -> int {
+      env->flags |= ENV_GUARD_PAGES;
+      env->optimize = optimize;
+      return ERR_SUCCESS;
+    });
+    TEST(assembly != nullptr);
+
+    if(assembly)
+    {
+      auto load = (int32_t(*)(int32_t))(*_exports.LoadFunction)(assembly, "guard", "load");
+      auto far  = (int32_t(*)(int32_t))(*_exports.LoadFunction)(assembly, "guard", "far");
+      auto grow = (int32_t(*)(int32_t))(*_exports.LoadFunction)(assembly, "guard", "grow");
+      auto last = (*_exports.GetLastTrap)(assembly);
+      TEST(load != nullptr);
+      TEST(far != nullptr);
+      TEST(grow != nullptr);
+      TEST(last != nullptr);
+
+      if(load && far && grow && last)
+      {
+        auto traps = [&](int32_t (*f)(int32_t), int32_t p) {
+          bool trapped = CallTraps([f, p] { (*f)(p); });
+          return trapped && last->code == IN_TRAP_OUT_OF_BOUNDS;
+        };
+
+        TEST(!traps(load, 0xfffc));
+        TEST(traps(load, 0xfffd));
+        TEST(traps(load, 0x10000));
+        TEST(last->function == ~0u); // A page fault doesn't know which instruction made the access
+        TEST(last->line == 0 && last->column == 0);
+        TEST(traps(load, -4));
+        TEST(traps(far, 0x20));
+        TEST((*grow)(1) == 1);
+        TEST(!traps(load, 0x1fffc));
+        TEST(traps(load, 0x20000));
+      }
+
+      (*_exports.FreeAssembly)(assembly);
+    }
+  }
+#endif
+}
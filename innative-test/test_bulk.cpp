@@ -0,0 +1,152 @@
+// Copyright (c)2020 Black Sphere Studios
+// For conditions of distribution and use, see copyright notice in innative.h
+
+#include "test.h"
+#include "../innative/utility.h"
+
+using namespace innative;
+
+void TestHarness::test_bulk()
+{
+  const char wat[] = "(module $bulk\n"
+                     "  (type $i (func (result i32)))\n"
+                     "  (memory 1)\n"
+                     "  (table 4 funcref)\n"
+                     "  (func $one (result i32) (i32.const 1))\n"
+                     "  (func $two (result i32) (i32.const 2))\n"
+                     "  (func (export \"load\") (param i32) (result i32) (i32.load8_u (local.get 0)))\n"
+                     "  (func (export \"call\") (param i32) (result i32) (call_indirect (type $i) (local.get 0)))\n"
+                     "  (func (export \"init\") (param i32 i32 i32)\n"
+                     "    (memory.init $hello (local.get 0) (local.get 1) (local.get 2)))\n"
+                     "  (func (export \"copy\") (param i32 i32 i32)\n"
+                     "    (memory.copy (local.get 0) (local.get 1) (local.get 2)))\n"
+                     "  (func (export \"fill\") (param i32 i32 i32)\n"
+                     "    (memory.fill (local.get 0) (local.get 1) (local.get 2)))\n"
+                     "  (func (export \"data_drop\") (param i32 i32 i32) (data.drop $hello))\n"
+                     "  (func (export \"table_init\") (param i32 i32 i32)\n"
+                     "    (table.init $fns (local.get 0) (local.get 1) (local.get 2)))\n"
+                     "  (func (export \"table_copy\") (param i32 i32 i32)\n"
+                     "    (table.copy (local.get 0) (local.get 1) (local.get 2)))\n"
+                     "  (func (export \"elem_drop\") (param i32 i32 i32) (elem.drop $fns))\n"
+                     "  (data $hello \"hello\")\n"
+                     "  (data (i32.const 100) \"abcdef\")\n"
+                     "  (elem $fns func $one $two)\n"
+                     ")";
+
+  // Every operation checks all of its ranges before writing anything, so an operation that traps must leave the memory and
+  // the table untouched. A zero-length operation right at the end of a memory, table or segment is still in bounds.
+  for(uint64_t optimize : { uint64_t(0), uint64_t(ENV_OPTIMIZE_O3) })
+  {
+    void* assembly = CompileWASM(wat, sizeof(wat) - 1, "bulk", [optimize](Environment* env) -> int {
+      env->flags |= ENV_CHECK_MEMORY_ACCESS | ENV_CHECK_INDIRECT_CALL;
+      env->optimize = optimize;
+      return ERR_SUCCESS;
+    });
+    TEST(assembly != nullptr);
+
+    if(assembly)
+    {
+      typedef void (*BulkOp)(int32_t, int32_t, int32_t);
+      auto load       = (int32_t(*)(int32_t))(*_exports.LoadFunction)(assembly, "bulk", "load");
+      auto call       = (int32_t(*)(int32_t))(*_exports.LoadFunction)(assembly, "bulk", "call");
+      auto init       = (BulkOp)(*_exports.LoadFunction)(assembly, "bulk", "init");
+      auto copy       = (BulkOp)(*_exports.LoadFunction)(assembly, "bulk", "copy");
+      auto fill       = (BulkOp)(*_exports.LoadFunction)(assembly, "bulk", "fill");
+      auto data_drop  = (BulkOp)(*_exports.LoadFunction)(assembly, "bulk", "data_drop");
+      auto table_init = (BulkOp)(*_exports.LoadFunction)(assembly, "bulk", "table_init");
+      auto table_copy = (BulkOp)(*_exports.LoadFunction)(assembly, "bulk", "table_copy");
+      auto elem_drop  = (BulkOp)(*_exports.LoadFunction)(assembly, "bulk", "elem_drop");
+      auto last       = (*_exports.GetLastTrap)(assembly);
+      TEST(load != nullptr);
+      TEST(call != nullptr);
+      TEST(init != nullptr);
+      TEST(copy != nullptr);
+      TEST(fill != nullptr);
+      TEST(data_drop != nullptr);
+      TEST(table_init != nullptr);
+      TEST(table_copy != nullptr);
+      TEST(elem_drop != nullptr);
+      TEST(last != nullptr);
+
+      auto traps = [&](BulkOp op, int32_t a, int32_t b, int32_t n) {
+        bool trapped = CallTraps([op, a, b, n] { (*op)(a, b, n); });
+        return trapped && last->code == IN_TRAP_OUT_OF_BOUNDS;
+      };
+
+      if(load && init && copy && fill && data_drop && last)
+      {
+        TEST(!traps(init, 0, 0, 5));
+        TEST(load(0) == 'h');
+        TEST(load(4) == 'o');
+        TEST(!traps(init, 10, 1, 3));
+        TEST(load(10) == 'e');
+        TEST(load(13) == 0);
+        TEST(!traps(init, 65536, 5, 0));
+        TEST(traps(init, 65537, 0, 0));
+        TEST(traps(init, 0, 6, 0));
+        TEST(traps(init, 65532, 0, 5));
+        TEST(load(65532) == 0);
+
+        // The copy overlaps its source, so it has to behave like memmove
+        TEST(!traps(copy, 101, 100, 5));
+        TEST(load(101) == 'a');
+        TEST(load(102) == 'b');
+        TEST(load(105) == 'e');
+        TEST(!traps(copy, 65536, 65536, 0));
+        TEST(traps(copy, 65535, 0, 2));
+        TEST(traps(copy, 0, 65535, 2));
+        TEST(load(0) == 'h');
+
+        // Only the low byte of the value is used. Long operations go through the runtime instead of inline code.
+        TEST(!traps(fill, 300, 0x1ff, 4));
+        TEST(load(303) == 255);
+        TEST(load(304) == 0);
+        TEST(!traps(fill, 1000, 7, 300));
+        TEST(!traps(copy, 2000, 1000, 300));
+        TEST(load(2299) == 7);
+        TEST(load(2300) == 0);
+        TEST(!traps(fill, 65536, 1, 0));
+        TEST(traps(fill, 65530, 1, 7));
+        TEST(load(65530) == 0);
+
+        // A dropped segment behaves like an empty one
+        TEST(!traps(data_drop, 0, 0, 0));
+        TEST(!traps(init, 0, 0, 0));
+        TEST(traps(init, 0, 0, 1));
+        TEST(load(0) == 'h');
+      }
+
+      if(call && table_init && table_copy && elem_drop && last)
+      {
+        TEST(CallTraps([call] { (*call)(0); }));
+        TEST(last->code == IN_TRAP_NULL_TABLE_ENTRY);
+        TEST(!traps(table_init, 0, 0, 2));
+        TEST(call(0) == 1);
+        TEST(call(1) == 2);
+        TEST(!traps(table_init, 3, 1, 1));
+        TEST(call(3) == 2);
+        TEST(!traps(table_init, 4, 2, 0));
+        TEST(traps(table_init, 3, 0, 2));
+        TEST(traps(table_init, 0, 3, 0));
+        TEST(call(3) == 2);
+
+        TEST(!traps(table_copy, 2, 0, 2));
+        TEST(call(2) == 1);
+        TEST(call(3) == 2);
+        TEST(!traps(table_copy, 1, 0, 3));
+        TEST(call(1) == 1);
+        TEST(call(2) == 2);
+        TEST(call(3) == 1);
+        TEST(!traps(table_copy, 4, 4, 0));
+        TEST(traps(table_copy, 3, 0, 2));
+
+        TEST(!traps(elem_drop, 0, 0, 0));
+        TEST(!traps(table_init, 0, 0, 0));
+        TEST(traps(table_init, 0, 0, 1));
+        TEST(call(0) == 1);
+      }
+
+      (*_exports.FreeAssembly)(assembly);
+    }
+  }
+}
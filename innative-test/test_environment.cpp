@@ -5,6 +5,8 @@
 
 extern "C" {
 extern void _innative_internal_env_memcpy(char* dest, const char* src, uint64_t sz);
+extern void _innative_internal_env_memmove(char* dest, const char* src, uint64_t sz);
+extern void _innative_internal_env_memset(char* dest, int value, uint64_t sz);
 extern void* _innative_internal_env_grow_memory(void* p, uint64_t i, uint64_t max, uint64_t* size);
 extern void _innative_internal_env_print(uint64_t a);
 }
@@ -57,6 +59,30 @@ void TestHarness::test_environment()
       TEST(!dest[i]);
   }
 
+  // Large enough to cover the unrolled block copies at every alignment
+  char big[300];
+  char ref[300];
+
+  for(int n = 0; n < 200; n += 7)
+  {
+    for(int d = 0; d < 40; d += 3)
+    {
+      for(int s = 0; s < 40; s += 5)
+      {
+        for(int i = 0; i < 300; ++i)
+          big[i] = ref[i] = (char)(i * 13);
+
+        _innative_internal_env_memmove(big + d, big + s, n);
+        memmove(ref + d, ref + s, n);
+        TEST(!memcmp(big, ref, sizeof(big)));
+
+        _innative_internal_env_memset(big + d, s, n);
+        memset(ref + d, s, n);
+        TEST(!memcmp(big, ref, sizeof(big)));
+      }
+    }
+  }
+
   uint64_t sz = 0;
   uint64_t* p = (uint64_t*)_innative_internal_env_grow_memory(0, 0, 0, &sz);
   TEST(p != 0);
@@ -2,6 +2,8 @@
 // For conditions of distribution and use, see copyright notice in innative.h
 
 #include "test.h"
+#include <stdlib.h>
+#include <string>
 
 void TestHarness::test_errors()
 {
@@ -21,4 +23,51 @@ void TestHarness::test_errors()
   TEST((*_exports.GetErrorString)(ERR_RUNTIME_INIT_ERROR) != nullptr);
   TEST((*_exports.GetErrorString)(ERR_RUNTIME_TRAP) != nullptr);
   TEST((*_exports.GetErrorString)(ERR_RUNTIME_ASSERT_FAILURE) != nullptr);
+
+  // Function bodies are validated in batches that can finish in any order, but the errors must always come out in the
+  // order of the functions they belong to. Each function sits on its own line, which every error message starts with.
+  const int n_funcs = 300;
+  std::string wat   = "(module $errors\n";
+  for(int i = 0; i < n_funcs; ++i)
+    wat += "  (func (result i32) (i32.add (i64.const 0) (i32.const 1)))\n";
+  wat += ")";
+
+  std::vector<std::string> order;
+  for(unsigned int threads : { 1u, 8u })
+  {
+    int err;
+    Environment* env = PrepareEnvironment(wat.c_str(), wat.size(), "errors", "env",
+                                          [threads](Environment* e) -> int {
+                                            e->flags |= ENV_MULTITHREADED;
+                                            e->maxthreads = threads;
+                                            e->loglevel   = LOG_NONE;
+                                            return ERR_SUCCESS;
+                                          },
+                                          err);
+    TEST(env != nullptr);
+    if(!env)
+      continue;
+
+    TEST((*_exports.Validate)(env) == ERR_VALIDATION_ERROR);
+
+    std::vector<std::string> errors;
+    unsigned long line = 0;
+    bool ordered       = true;
+    for(ValidationError* e = env->errors; e != nullptr; e = e->next)
+    {
+      TEST(e->code == ERR_INVALID_TYPE);
+      unsigned long next = (e->error && e->error[0] == '[') ? strtoul(e->error + 1, nullptr, 10) : 0;
+      ordered            = ordered && next > line;
+      line               = next;
+      errors.push_back(e->error ? e->error : "");
+    }
+
+    TEST(errors.size() == n_funcs);
+    TEST(ordered);
+    if(order.empty())
+      order = errors;
+    else
+      TEST(errors == order);
+    (*_exports.DestroyEnvironment)(env);
+  }
 }
\ No newline at end of file
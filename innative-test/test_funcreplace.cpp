@@ -25,4 +25,55 @@ int TestHarness::do_funcreplace(void* assembly)
   return err;
 }
 
-void TestHarness::test_funcreplace() { CompileWASM("../scripts/funcreplace.wasm", &TestHarness::do_funcreplace, "env"); }
+int many(int a, int b, int c, int d, int e, int f, int g, int h, int i, int j)
+{
+  return a + b + c + d + e + f + g + h + i + j;
+}
+
+void TestHarness::test_funcreplace()
+{
+  CompileWASM("../scripts/funcreplace.wasm", &TestHarness::do_funcreplace, "env");
+
+  const char wat[] = "(module $replace\n"
+                     "  (type $many (func (param i32 i32 i32 i32 i32 i32 i32 i32 i32 i32) (result i32)))\n"
+                     "  (type $two (func (param i32 i32) (result i32)))\n"
+                     "  (table 2 funcref)\n"
+                     "  (elem (i32.const 0) $many $two)\n"
+                     "  (func $many (export \"many\") (param i32 i32 i32 i32 i32 i32 i32 i32 i32 i32) (result i32)\n"
+                     "    (local.get 9))\n"
+                     "  (func $two (export \"two\") (param i32 i32) (result i32) (i32.sub (local.get 0) (local.get 1)))\n"
+                     "  (func (export \"call_many\") (result i32)\n"
+                     "    (call_indirect (type $many) (i32.const 1) (i32.const 2) (i32.const 3) (i32.const 4)\n"
+                     "      (i32.const 5) (i32.const 6) (i32.const 7) (i32.const 8) (i32.const 9) (i32.const 10)\n"
+                     "      (i32.const 0)))\n"
+                     "  (func (export \"call_two\") (result i32)\n"
+                     "    (call_indirect (type $two) (i32.const 4) (i32.const 2) (i32.const 1)))\n"
+                     ")";
+
+  // Ten arguments don't fit in the argument registers of any supported target, so some of them are passed on the stack,
+  // where the internal convention disagrees with C about who pops them. Replacing that function must fail and leave the
+  // table alone, while the C wrapper the runtime hands out for it must still work.
+  void* assembly = CompileWASM(wat, sizeof(wat) - 1, "replace");
+  TEST(assembly != nullptr);
+  if(assembly)
+  {
+    auto call_many = (int (*)())(*_exports.LoadFunction)(assembly, "replace", "call_many");
+    auto call_two  = (int (*)())(*_exports.LoadFunction)(assembly, "replace", "call_two");
+    auto entry     = (decltype(&many))(*_exports.LoadTableIndex)(assembly, 0, 0, 0);
+    TEST(call_many != nullptr);
+    TEST(call_two != nullptr);
+    TEST(entry != nullptr);
+
+    TEST((*_exports.ReplaceTableFuncPtr)(assembly, 0, 0, "many", (IN_Entrypoint)&many) == ERR_INVALID_FUNCTION_SIG);
+    TEST((*_exports.ReplaceTableFuncPtr)(assembly, 0, 0, "two", (IN_Entrypoint)&replacement) == ERR_SUCCESS);
+    if(call_many && call_two)
+    {
+      TEST((*call_many)() == 10);
+      TEST((*call_two)() == 6);
+    }
+    if(entry)
+      TEST((*entry)(1, 2, 3, 4, 5, 6, 7, 8, 9, 42) == 42);
+
+    (*_exports.FreeAssembly)(assembly);
+  }
+}
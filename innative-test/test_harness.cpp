@@ -3,6 +3,21 @@
 
 #include "test.h"
 #include <stdio.h>
+#include <signal.h>
+#include <setjmp.h>
+
+#ifdef IN_PLATFORM_POSIX
+  #define LONGJMP(x, i) siglongjmp(x, i)
+  #define SETJMP(x)     sigsetjmp(x, 1)
+static sigjmp_buf trap_location;
+#else
+  #include "../innative/win32.h"
+  #define LONGJMP(x, i) longjmp(x, i)
+  #define SETJMP(x)     setjmp(x)
+static jmp_buf trap_location;
+#endif
+
+static void TrapHandler(int) { LONGJMP(trap_location, 1); }
 
 TestHarness::TestHarness(const INExports& exports, const char* arg0, int loglevel, FILE* out, const path& folder) :
   _exports(exports), _arg0(arg0), _loglevel(loglevel), _target(out), _folder(folder), _testdata(0, 0)
@@ -31,6 +46,22 @@ size_t TestHarness::Run(FILE* out)
                                                               { "whitelist", &TestHarness::test_whitelist },
                                                               { "serializer", &TestHarness::test_serializer },
                                                               { "errors", &TestHarness::test_errors },
+                                                              { "object cache", &TestHarness::test_objectcache },
+                                                              { "jit", &TestHarness::test_jit },
+                                                              { "lto", &TestHarness::test_lto },
+                                                              { "pgo", &TestHarness::test_pgo },
+                                                              { "bounds", &TestHarness::test_bounds },
+                                                              { "tailcall", &TestHarness::test_tailcall },
+                                                              { "trap", &TestHarness::test_trap },
+                                                              { "nontrapping", &TestHarness::test_nontrapping },
+                                                              { "multiversion", &TestHarness::test_multiversion },
+                                                              { "instance", &TestHarness::test_instance },
+                                                              { "pool", &TestHarness::test_pool },
+                                                              { "snapshot", &TestHarness::test_snapshot },
+                                                              { "mapped", &TestHarness::test_mapped },
+                                                              { "bulk memory", &TestHarness::test_bulk },
+                                                              { "memory", &TestHarness::test_memory },
+                                                              { "simd", &TestHarness::test_simd },
                                                               { "atomic_waitnotify",
                                                                 &TestHarness::test_atomic_waitnotify } };
 
@@ -78,39 +109,19 @@ size_t TestHarness::Run(FILE* out)
 int TestHarness::CompileWASM(const path& file, int (TestHarness::*fn)(void*), const char* system,
                              std::function<int(Environment*)> preprocess)
 {
-  Environment* env = (*_exports.CreateEnvironment)(1, 0, 0);
-  env->flags       = ENV_ENABLE_WAT | ENV_LIBRARY;
-  env->optimize    = ENV_OPTIMIZE_O3;
-  env->features    = ENV_FEATURE_ALL;
-  env->log         = stdout;
-  env->loglevel    = _loglevel;
-  if(system)
-    env->system = system;
-
+  auto setup = [&preprocess](Environment* env) -> int {
 #ifdef IN_DEBUG
-  env->flags |= ENV_DEBUG;
-  env->optimize = ENV_OPTIMIZE_O0;
+    env->flags |= ENV_DEBUG;
+    env->optimize = ENV_OPTIMIZE_O0;
 #endif
+    return !preprocess ? ERR_SUCCESS : preprocess(env);
+  };
 
-  if(preprocess)
-    if(int err = preprocess(env); err < 0)
-      return err;
-
-  int err = (*_exports.AddEmbedding)(env, 0, (void*)INNATIVE_DEFAULT_ENVIRONMENT, 0, 0);
-  if(err < 0)
-  {
-    (*_exports.DestroyEnvironment)(env);
+  int err;
+  Environment* env = PrepareEnvironment(file.u8string().c_str(), 0, file.stem().u8string().c_str(), system, setup, err);
+  if(!env)
     return err;
-  }
 
-  (*_exports.AddModule)(env, file.u8string().c_str(), 0, file.stem().u8string().c_str(), &err);
-  if(err < 0)
-  {
-    (*_exports.DestroyEnvironment)(env);
-    return err;
-  }
-
-  (*_exports.FinalizeEnvironment)(env);
   path base = _folder / file.stem();
   path out  = base;
   out.replace_extension(IN_LIBRARY_EXTENSION);
@@ -135,3 +146,89 @@ int TestHarness::CompileWASM(const path& file, int (TestHarness::*fn)(void*), co
 
   return err;
 }
+
+// Compiles a single module in-process with the JIT. The source is either WAT text, or a file path if size is 0.
+void* TestHarness::CompileWASM(const char* source, size_t size, const char* name,
+                               std::function<int(Environment*)> preprocess)
+{
+  int err;
+  Environment* env = PrepareEnvironment(source, size, name, "env", preprocess, err);
+  if(!env)
+    return nullptr;
+
+  void* assembly = (*_exports.CompileJIT)(env, &err);
+
+  // The generated code belongs to the assembly, so the environment can be destroyed before it
+  (*_exports.DestroyEnvironment)(env);
+
+  if(assembly != nullptr && err != ERR_SUCCESS)
+  {
+    (*_exports.FreeAssembly)(assembly);
+    return nullptr;
+  }
+  return assembly;
+}
+
+// Creates a finalized environment holding the default runtime and one module. The preprocess function can change any
+// setting, or add other modules, before the module is added.
+Environment* TestHarness::PrepareEnvironment(const char* source, size_t size, const char* name, const char* system,
+                                             std::function<int(Environment*)> preprocess, int& err)
+{
+  Environment* env = (*_exports.CreateEnvironment)(1, 0, 0);
+  env->flags       = ENV_ENABLE_WAT | ENV_LIBRARY;
+  env->optimize    = ENV_OPTIMIZE_O3;
+  env->features    = ENV_FEATURE_ALL;
+  env->log         = stdout;
+  env->loglevel    = _loglevel;
+  if(system)
+    env->system = system;
+
+  if(preprocess && (err = preprocess(env)) < 0)
+  {
+    (*_exports.DestroyEnvironment)(env);
+    return nullptr;
+  }
+
+  err = (*_exports.AddEmbedding)(env, 0, (void*)INNATIVE_DEFAULT_ENVIRONMENT, 0, 0);
+  if(err >= 0)
+    (*_exports.AddModule)(env, source, size, name, &err);
+  if(err < 0)
+  {
+    (*_exports.DestroyEnvironment)(env);
+    return nullptr;
+  }
+
+  (*_exports.FinalizeEnvironment)(env);
+  return env;
+}
+
+// Calls the function and returns true if it trapped. The function must not own anything with a destructor, because longjmp
+// skips over them.
+bool TestHarness::CallTraps(const std::function<void()>& f)
+{
+  signal(SIGILL, TrapHandler);
+  signal(SIGFPE, TrapHandler);
+  bool trapped = false;
+
+  if(SETJMP(trap_location) != 0)
+    trapped = true;
+  else
+  {
+#ifdef IN_COMPILER_MSC
+    __try
+    {
+      f();
+    }
+    __except(GetExceptionCode() == EXCEPTION_ILLEGAL_INSTRUCTION)
+    {
+      trapped = true;
+    }
+#else
+    f();
+#endif
+  }
+
+  signal(SIGILL, SIG_DFL);
+  signal(SIGFPE, SIG_DFL);
+  return trapped;
+}
@@ -0,0 +1,100 @@
+// Copyright (c)2020 Black Sphere Studios
+// For conditions of distribution and use, see copyright notice in innative.h
+
+#include "test.h"
+#include "../innative/utility.h"
+
+using namespace innative;
+
+static int32_t seven(void*) { return 7; }
+
+void TestHarness::test_instance()
+{
+  const char wat[] = "(module $instance\n"
+                     "  (type $i (func (result i32)))\n"
+                     "  (memory 1)\n"
+                     "  (table 2 funcref)\n"
+                     "  (global $counter (mut i32) (i32.const 5))\n"
+                     "  (global $limit i32 (i32.const 9))\n"
+                     "  (elem (i32.const 0) $one)\n"
+                     "  (func $one (export \"one\") (result i32) (i32.const 1))\n"
+                     "  (func (export \"call\") (param i32) (result i32) (call_indirect (type $i) (local.get 0)))\n"
+                     "  (func $bump (i32.store (i32.const 16) (i32.add (i32.load (i32.const 16)) (i32.const 1))))\n"
+                     "  (func (export \"add\") (param i32) (result i32)\n"
+                     "    (call $bump)\n"
+                     "    (global.set $counter (i32.add (global.get $counter) (local.get 0)))\n"
+                     "    (global.get $counter))\n"
+                     "  (func (export \"calls\") (result i32) (i32.load (i32.const 16)))\n"
+                     ")";
+
+  // Every instance gets its own memory and globals, so calls into one instance must never be visible from another
+  for(uint64_t optimize : { uint64_t(0), uint64_t(ENV_OPTIMIZE_O3) })
+  {
+    void* assembly = CompileWASM(wat, sizeof(wat) - 1, "instance", [optimize](Environment* env) -> int {
+      env->flags    = ENV_ENABLE_WAT | ENV_MULTI_INSTANCE;
+      env->optimize = optimize;
+      return ERR_SUCCESS;
+    });
+    TEST(assembly != nullptr);
+
+    if(assembly)
+    {
+      auto add   = (int32_t(*)(void*, int32_t))(*_exports.LoadFunction)(assembly, "instance", "add");
+      auto calls = (int32_t(*)(void*))(*_exports.LoadFunction)(assembly, "instance", "calls");
+      TEST(add != nullptr);
+      TEST(calls != nullptr);
+
+      void* a = (*_exports.CreateInstance)(assembly);
+      void* b = (*_exports.CreateInstance)(assembly);
+      TEST(a != nullptr);
+      TEST(b != nullptr);
+
+      if(add && calls && a && b)
+      {
+        TEST((*_exports.InitInstance)(assembly, a) == ERR_SUCCESS);
+        TEST((*_exports.InitInstance)(assembly, b) == ERR_SUCCESS);
+        TEST((*_exports.InitInstance)(assembly, a) != ERR_SUCCESS);
+
+        TEST((*add)(a, 3) == 8);
+        TEST((*add)(a, 4) == 12);
+        TEST((*add)(b, 10) == 15);
+        TEST((*calls)(a) == 2);
+        TEST((*calls)(b) == 1);
+
+        // The metadata of a multi-instance assembly only holds offsets into an instance, so anything that doesn't take an
+        // instance can only resolve the immutable globals
+        auto call   = (int32_t(*)(void*, int32_t))(*_exports.LoadFunction)(assembly, "instance", "call");
+        auto one    = (*_exports.LoadFunction)(assembly, "instance", "one");
+        auto limit  = (*_exports.LoadGlobalIndex)(assembly, 0, 1);
+        auto memory = (*_exports.LoadInstanceMemoryIndex)(assembly, a, 0, 0);
+        auto global = (*_exports.LoadInstanceGlobalIndex)(assembly, b, 0, 0);
+        TEST(call != nullptr);
+        TEST(one != nullptr);
+        TEST((*_exports.LoadTableIndex)(assembly, 0, 0, 0) == nullptr);
+        TEST((*_exports.LoadMemoryIndex)(assembly, 0, 0) == nullptr);
+        TEST((*_exports.LoadGlobalIndex)(assembly, 0, 0) == nullptr);
+        TEST(limit != nullptr && limit->i32 == 9);
+        TEST((*_exports.ReplaceTableFuncPtr)(assembly, 0, 0, "one", (IN_Entrypoint)&seven) == ERR_FATAL_NULL_POINTER);
+
+        TEST(memory != nullptr && reinterpret_cast<int32_t*>(memory->memory.bytes)[4] == 2);
+        TEST(global != nullptr && global->i32 == 15);
+        TEST((*_exports.LoadInstanceGlobalIndex)(assembly, a, 0, 1) == limit);
+        TEST((*_exports.LoadInstanceTableIndex)(assembly, a, 0, 0, 0) == one);
+        TEST((*_exports.LoadInstanceTableIndex)(assembly, a, 0, 0, 1) == nullptr);
+        TEST((*_exports.LoadInstanceTableIndex)(assembly, a, 0, 0, 2) == nullptr);
+
+        // Replacing a table entry only affects the instance it was replaced in
+        TEST((*_exports.ReplaceInstanceTableFuncPtr)(assembly, a, 0, 0, "one", (IN_Entrypoint)&seven) == ERR_SUCCESS);
+        if(call)
+        {
+          TEST((*call)(a, 0) == 7);
+          TEST((*call)(b, 0) == 1);
+        }
+      }
+
+      (*_exports.DestroyInstance)(assembly, a);
+      (*_exports.DestroyInstance)(assembly, b);
+      (*_exports.FreeAssembly)(assembly);
+    }
+  }
+}
@@ -0,0 +1,84 @@
+// Copyright (c)2020 Black Sphere Studios
+// For conditions of distribution and use, see copyright notice in innative.h
+
+#include "test.h"
+#include "../innative/utility.h"
+#include <chrono>
+#include <thread>
+
+using namespace innative;
+
+void TestHarness::test_jit()
+{
+  // The tiered build starts out unoptimized, so keep calling into it while hot functions get swapped out from under us
+  for(uint64_t optimize : { uint64_t(ENV_OPTIMIZE_O3), uint64_t(ENV_OPTIMIZE_O3 | ENV_OPTIMIZE_TIERED) })
+  {
+    void* assembly = CompileWASM("../scripts/funcreplace.wasm", 0, "funcreplace", [optimize](Environment* env) -> int {
+      env->optimize = optimize;
+      return ERR_SUCCESS;
+    });
+    TEST(assembly != nullptr);
+
+    if(assembly)
+    {
+      INModuleMetadata* metadata = (*_exports.GetModuleMetadata)(assembly, 0);
+      TEST(metadata != nullptr);
+      TEST((*_exports.GetModuleMetadata)(assembly, 1) == nullptr);
+      TEST(do_funcreplace(assembly) == ERR_SUCCESS);
+
+      int (*test)(int, int) = (int (*)(int, int))(*_exports.LoadFunction)(assembly, "funcreplace", "test");
+      TEST(test != nullptr);
+      if(test)
+      {
+        int failures = 0;
+        for(int i = 0; i < 5000; ++i)
+        {
+          failures += (*test)(4, 2) != 6;
+          if(!(i % 1000))
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+        TEST(failures == 0);
+      }
+
+      (*_exports.FreeAssembly)(assembly);
+    }
+  }
+
+  // A hot function is swapped out in every table that holds it, which shows that it was actually promoted
+  const char wat[] = "(module $tier\n"
+                     "  (table 1 funcref)\n"
+                     "  (elem (i32.const 0) $hot)\n"
+                     "  (func $hot (export \"hot\") (param i32) (result i32) (i32.add (local.get 0) (i32.const 1)))\n"
+                     ")";
+
+  void* assembly = CompileWASM(wat, sizeof(wat) - 1, "tier", [](Environment* env) -> int {
+    env->optimize = ENV_OPTIMIZE_O3 | ENV_OPTIMIZE_TIERED;
+    return ERR_SUCCESS;
+  });
+  TEST(assembly != nullptr);
+
+  if(assembly)
+  {
+    INModuleMetadata* metadata = (*_exports.GetModuleMetadata)(assembly, 0);
+    auto hot                   = (int32_t(*)(int32_t))(*_exports.LoadFunction)(assembly, "tier", "hot");
+    TEST(metadata != nullptr);
+    TEST(hot != nullptr);
+
+    if(metadata && hot && metadata->n_tables > 0)
+    {
+      IN_Entrypoint baseline = metadata->tables[0]->entries[0].func;
+      int failures           = 0;
+      for(int i = 0; i < 2000; ++i)
+        failures += (*hot)(i) != i + 1;
+      TEST(failures == 0);
+
+      // Give the background thread plenty of time, because it only checks the call counters every so often
+      for(int i = 0; i < 500 && metadata->tables[0]->entries[0].func == baseline; ++i)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      TEST(metadata->tables[0]->entries[0].func != baseline);
+      TEST((*hot)(41) == 42);
+    }
+
+    (*_exports.FreeAssembly)(assembly);
+  }
+}
@@ -0,0 +1,49 @@
+// Copyright (c)2020 Black Sphere Studios
+// For conditions of distribution and use, see copyright notice in innative.h
+
+#include "test.h"
+#include "../innative/utility.h"
+
+using namespace innative;
+
+void TestHarness::test_lto()
+{
+  const char core[] = "(module $core\n"
+                      "  (func (export \"twice\") (param i32) (result i32) (i32.mul (local.get 0) (i32.const 2)))\n"
+                      ")";
+  const char glue[] = "(module $glue\n"
+                      "  (import \"core\" \"twice\" (func $twice (param i32) (result i32)))\n"
+                      "  (func (export \"sum\") (param $n i32) (result i32) (local $i i32) (local $s i32)\n"
+                      "    (block (loop\n"
+                      "      (br_if 1 (i32.ge_u (local.get $i) (local.get $n)))\n"
+                      "      (local.set $s (i32.add (local.get $s) (call $twice (local.get $i))))\n"
+                      "      (local.set $i (i32.add (local.get $i) (i32.const 1)))\n"
+                      "      (br 0)))\n"
+                      "    (local.get $s))\n"
+                      ")";
+
+  // Merging modules must not change what the program computes
+  for(uint64_t optimize : { uint64_t(ENV_OPTIMIZE_O3), uint64_t(ENV_OPTIMIZE_O3 | ENV_OPTIMIZE_LTO) })
+  {
+    void* assembly = CompileWASM(glue, sizeof(glue) - 1, "glue", [&](Environment* env) -> int {
+      int err;
+      env->optimize = optimize;
+      (*_exports.AddModule)(env, core, sizeof(core) - 1, "core", &err);
+      return err;
+    });
+    TEST(assembly != nullptr);
+
+    if(assembly)
+    {
+      // Both modules keep their own metadata even after they were merged together
+      TEST((*_exports.GetModuleMetadata)(assembly, 0) != nullptr);
+      TEST((*_exports.GetModuleMetadata)(assembly, 1) != nullptr);
+
+      int (*sum)(int) = (int (*)(int))(*_exports.LoadFunction)(assembly, "glue", "sum");
+      TEST(sum != nullptr);
+      if(sum)
+        TEST((*sum)(100) == 9900);
+      (*_exports.FreeAssembly)(assembly);
+    }
+  }
+}
@@ -197,8 +197,7 @@ void TestHarness::test_manual()
     auto tablefunc = (varsint32(*)(varsint32, varsint32))(*_exports.LoadTableIndex)(assembly, 0, 0, 0);
     TEST(tablefunc);
     if(tablefunc)
-      TEST(tablefunc !=
-           nullptr); // Note: This is the internal fastcc call, not the __cdecl exported wrapper, so it is not safe to call
+      TEST(tablefunc != nullptr); // The table itself holds the internal tail call function, but this is its C wrapper
 
     auto tablefunc2 = (varsint32(*)(varsint32, varsint32))(*_exports.LoadTable)(assembly, "manual", "table_test", 0);
     TEST(tablefunc2);
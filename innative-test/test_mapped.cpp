@@ -0,0 +1,104 @@
+// Copyright (c)2020 Black Sphere Studios
+// For conditions of distribution and use, see copyright notice in innative.h
+
+#include "test.h"
+#include <cstring>
+#include <fstream>
+#include <string>
+
+#if defined(IN_PLATFORM_LINUX) && defined(IN_CPU_x86_64)
+extern "C" {
+extern int _innative_internal_env_map_parse_line(const char* line, const char* end, const char* p, char* path,
+                                                 size_t n_path, uint64_t* offset);
+}
+
+// Returns the path of the file backing the mapping that contains p, or an empty string if it is anonymous
+static std::string MappedFile(const void* p)
+{
+  std::ifstream maps("/proc/self/maps");
+  for(std::string line; std::getline(maps, line);)
+  {
+    unsigned long long start, stop, inode;
+    int n = 0;
+    if(sscanf(line.c_str(), "%llx-%llx %*s %*s %*s %llu %n", &start, &stop, &inode, &n) < 3 ||
+       (uintptr_t)p < start || (uintptr_t)p >= stop)
+      continue;
+    return !inode ? std::string() : line.substr(n);
+  }
+  return std::string();
+}
+#endif
+
+int TestHarness::do_mapped(void* assembly)
+{
+  auto load  = (int32_t(*)(int32_t))(*_exports.LoadFunction)(assembly, "mapped", "load");
+  auto store = (void (*)(int32_t, int32_t))(*_exports.LoadFunction)(assembly, "mapped", "store");
+  auto grow  = (int32_t(*)(int32_t))(*_exports.LoadFunction)(assembly, "mapped", "grow");
+  TEST(load != nullptr);
+  TEST(store != nullptr);
+  TEST(grow != nullptr);
+
+  if(load && store && grow)
+  {
+    // Overlapping segments must still be applied in order, and the gap between the two images must stay zeroed
+    TEST((*load)(16) == 1);
+    TEST((*load)(18) == 5);
+    TEST((*load)(19) == 4);
+    TEST((*load)(0x1000) == 0);
+    TEST((*load)(0x30000) == 7);
+
+#if defined(IN_PLATFORM_LINUX) && defined(IN_CPU_x86_64)
+    // The first page of the memory holds a segment, so it must have been mapped from the assembly itself
+    INModuleMetadata* metadata = (*_exports.GetModuleMetadata)(assembly, 0);
+    TEST(metadata != nullptr);
+    if(metadata && metadata->n_memories)
+    {
+      path file = MappedFile(metadata->memories[0]->bytes);
+      TEST(file.filename().u8string() == std::string("mapped") + IN_LIBRARY_EXTENSION);
+    }
+#endif
+
+    // Mapped pages are private, so writing to them works like any other memory
+    (*store)(17, 9);
+    TEST((*load)(17) == 9);
+    TEST((*grow)(1) == 4);
+    TEST((*load)(17) == 9);
+    TEST((*load)(0x30000) == 7);
+    TEST((*load)(0x40000) == 0);
+  }
+
+  return ERR_SUCCESS;
+}
+
+void TestHarness::test_mapped()
+{
+  auto lambda = [](Environment* env) -> int {
+    env->flags |= ENV_MAPPED_DATA;
+    return ERR_SUCCESS;
+  };
+
+  TEST(CompileWASM("../scripts/mapped.wat", &TestHarness::do_mapped, "env", lambda) == ERR_SUCCESS);
+
+#if defined(IN_PLATFORM_LINUX) && defined(IN_CPU_x86_64)
+  // A line of /proc/self/maps is only used if it contains the address and names a file that can still be opened. The path
+  // runs to the end of the line, so it can contain spaces.
+  auto parse = [](const char* line, uintptr_t p, char* path, size_t n_path, uint64_t* offset) {
+    return _innative_internal_env_map_parse_line(line, line + strlen(line), (const char*)p, path, n_path, offset);
+  };
+
+  char file[64];
+  uint64_t offset    = 0;
+  const char* spaces = "00400000-00452000 r-xp 00001000 08:02 173521 /opt/my assemblies/mapped.so";
+  TEST(parse(spaces, 0x403000, file, sizeof(file), &offset) == 1);
+  TEST(!strcmp(file, "/opt/my assemblies/mapped.so"));
+  TEST(offset == 0x4000);
+  TEST(parse(spaces, 0x3fffff, file, sizeof(file), &offset) == 0);
+  TEST(parse(spaces, 0x452000, file, sizeof(file), &offset) == 0);
+  TEST(parse(spaces, 0x403000, file, 16, &offset) == -1);
+  TEST(parse("7f0000000000-7f0000001000 rw-p 00000000 00:00 0 ", 0x7f0000000000, file, sizeof(file), &offset) == -1);
+  TEST(parse("01e4c000-01e6d000 rw-p 00000000 00:00 0          [heap]", 0x1e4c000, file, sizeof(file), &offset) == -1);
+  TEST(parse("00400000-00452000 r-xp 00000000 08:02 173521 /tmp/mapped.so (deleted)", 0x400000, file, sizeof(file),
+             &offset) == -1);
+  TEST(offset == 0x4000); // Lines that are rejected never touch the offset
+#endif
+}
@@ -0,0 +1,152 @@
+// Copyright (c)2020 Black Sphere Studios
+// For conditions of distribution and use, see copyright notice in innative.h
+
+#include "test.h"
+#include "../innative/utility.h"
+#include <fstream>
+#include <map>
+#include <regex>
+#include <set>
+#include <string>
+
+using namespace innative;
+
+void TestHarness::test_memory()
+{
+  const char wat[] = "(module $stable\n"
+                     "  (memory 1)\n"
+                     "  (func $grow (param i32) (result i32) (memory.grow (local.get 0)))\n"
+                     "  (func $poke (param i32 i32) (i32.store (local.get 0) (local.get 1)))\n"
+                     "  (func $peek (param i32) (result i32) (i32.load (local.get 0)))\n"
+                     "  (func (export \"run\") (result i32)\n"
+                     "    (i32.store (i32.const 0) (i32.const 7))\n"
+                     "    (drop (call $grow (i32.const 3)))\n"
+                     "    (call $poke (i32.const 0x30000) (i32.const 5))\n"
+                     "    (i32.add (i32.load (i32.const 0x30000)) (i32.load (i32.const 0))))\n"
+                     "  (func (export \"loop\") (param $n i32) (result i32) (local $i i32) (local $p i32) (local $s i32)\n"
+                     "    (block (loop\n"
+                     "      (br_if 1 (i32.ge_u (local.get $i) (local.get $n)))\n"
+                     "      (local.set $p (i32.shl (call $grow (i32.const 1)) (i32.const 16)))\n"
+                     "      (call $poke (local.get $p) (local.get $i))\n"
+                     "      (local.set $s (i32.add (local.get $s) (call $peek (local.get $p))))\n"
+                     "      (local.set $s (i32.add (local.get $s) (i32.load (local.get $p))))\n"
+                     "      (local.set $i (i32.add (local.get $i) (i32.const 1)))\n"
+                     "      (br 0)))\n"
+                     "    (local.get $s))\n"
+                     "  (func (export \"size\") (result i32) (memory.size))\n"
+                     "  (func (export \"load\") (param i32) (result i32) (i32.load (local.get 0)))\n"
+                     ")";
+
+  // A stable memory never moves, so the base pointer is kept across calls that grow it. Memory grown by a callee must be
+  // accessible both to that callee's own callees and to the caller once the call returns, and nothing past it.
+  for(uint64_t flags : { uint64_t(0), uint64_t(ENV_STABLE_MEMORY) })
+    for(uint64_t optimize : { uint64_t(0), uint64_t(ENV_OPTIMIZE_O3) })
+    {
+      void* assembly = CompileWASM(wat, sizeof(wat) - 1, "stable", [flags, optimize](Environment* env) -> int {
+        env->flags |= ENV_CHECK_MEMORY_ACCESS | flags;
+        env->optimize = optimize;
+        return ERR_SUCCESS;
+      });
+      TEST(assembly != nullptr);
+
+      if(assembly)
+      {
+        auto run  = (int32_t(*)())(*_exports.LoadFunction)(assembly, "stable", "run");
+        auto loop = (int32_t(*)(int32_t))(*_exports.LoadFunction)(assembly, "stable", "loop");
+        auto size = (int32_t(*)())(*_exports.LoadFunction)(assembly, "stable", "size");
+        auto load = (int32_t(*)(int32_t))(*_exports.LoadFunction)(assembly, "stable", "load");
+        auto last = (*_exports.GetLastTrap)(assembly);
+        TEST(run != nullptr);
+        TEST(loop != nullptr);
+        TEST(size != nullptr);
+        TEST(load != nullptr);
+        TEST(last != nullptr);
+
+        if(run && loop && size && load && last)
+        {
+          TEST((*run)() == 12);
+          TEST((*size)() == 4);
+          TEST((*load)(0x3fffc) == 0);
+          TEST(CallTraps([load] { (*load)(0x40000); }));
+          TEST(last->code == IN_TRAP_OUT_OF_BOUNDS);
+
+          // Every iteration grows the memory by a page and then writes and reads the new page
+          TEST((*loop)(4) == 12);
+          TEST((*size)() == 8);
+          TEST((*load)(0x70000) == 3);
+          TEST(CallTraps([load] { (*load)(0x80000); }));
+        }
+
+        (*_exports.FreeAssembly)(assembly);
+      }
+    }
+
+  // Every kind of state gets its own TBAA type, so the emitted IR must tag each kind of access with the matching one
+  const char tbaa[] = "(module $tbaa\n"
+                      "  (type $i (func (result i32)))\n"
+                      "  (memory 1)\n"
+                      "  (table 1 funcref)\n"
+                      "  (global $g (mut i32) (i32.const 0))\n"
+                      "  (func (export \"memory\") (param i32) (i32.store (local.get 0) (i32.load (local.get 0))))\n"
+                      "  (func (export \"global\") (global.set $g (i32.add (global.get $g) (i32.const 1))))\n"
+                      "  (func (export \"call\") (param i32) (result i32) (call_indirect (type $i) (local.get 0)))\n"
+                      "  (func (export \"size\") (result i32) (memory.size))\n"
+                      ")";
+
+  path dir = _folder / "tbaa";
+  std::error_code ec;
+  remove_all(dir, ec);
+  create_directories(dir, ec);
+
+  int err;
+  Environment* env = PrepareEnvironment(tbaa, sizeof(tbaa) - 1, "tbaa", "env",
+                                        [](Environment* e) -> int {
+                                          e->flags |= ENV_EMIT_LLVM | ENV_CHECK_MEMORY_ACCESS | ENV_CHECK_INDIRECT_CALL;
+                                          e->optimize = 0;
+                                          return ERR_SUCCESS;
+                                        },
+                                        err);
+  TEST(env != nullptr);
+
+  if(env)
+  {
+    path out = dir / "tbaa";
+    out.replace_extension(IN_LIBRARY_EXTENSION);
+    TEST((*_exports.Compile)(env, out.u8string().c_str()) == ERR_SUCCESS);
+    (*_exports.DestroyEnvironment)(env);
+
+    // Type nodes look like !{!"name", !root, i64 0}, and access tags like !{!type, !type, i64 0}
+    std::regex type_node("^!(\\d+) = !\\{!\"([a-z ]+)\", !\\d+, i64 0\\}");
+    std::regex tag_node("^!(\\d+) = !\\{!(\\d+), !(\\d+), i64 0\\}");
+    std::regex access(" (load|store) .*!tbaa !(\\d+)");
+    std::map<std::string, std::string> types;
+    std::map<std::string, std::string> tags;
+    std::vector<std::string> used;
+    std::ifstream ir((dir / "tbaa.llvm").u8string());
+    TEST(ir.is_open());
+
+    std::smatch match;
+    for(std::string line; std::getline(ir, line);)
+    {
+      if(std::regex_search(line, match, type_node))
+        types[match[1]] = match[2];
+      else if(std::regex_search(line, match, tag_node) && match[2] == match[3])
+        tags[match[1]] = match[2];
+      else if(std::regex_search(line, match, access))
+        used.push_back(match[2]);
+    }
+
+    std::set<std::string> kinds;
+    for(auto& tag : used)
+      if(tags.count(tag) && types.count(tags[tag]))
+        kinds.insert(types[tags[tag]]);
+
+    TEST(kinds.count("linear memory"));
+    TEST(kinds.count("global"));
+    TEST(kinds.count("table"));
+    TEST(kinds.count("memory pair"));
+    TEST(kinds.count("table pair"));
+  }
+
+  remove_all(dir, ec);
+}
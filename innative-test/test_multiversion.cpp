@@ -0,0 +1,52 @@
+// Copyright (c)2020 Black Sphere Studios
+// For conditions of distribution and use, see copyright notice in innative.h
+
+#include "test.h"
+#include "../innative/utility.h"
+
+using namespace innative;
+
+void TestHarness::test_multiversion()
+{
+  const char wat[] = "(module $multiversion\n"
+                     "  (memory 1)\n"
+                     "  (func $square (param i32) (result i32) (i32.mul (local.get 0) (local.get 0)))\n"
+                     "  (func $sum (export \"sum\") (param i32) (result i32) (local i32 i32)\n"
+                     "    (block (loop\n"
+                     "      (br_if 1 (i32.ge_u (local.get 1) (local.get 0)))\n"
+                     "      (i32.store (i32.shl (local.get 1) (i32.const 2)) (call $square (local.get 1)))\n"
+                     "      (local.set 2 (i32.add (local.get 2) (i32.load (i32.shl (local.get 1) (i32.const 2)))))\n"
+                     "      (local.set 1 (i32.add (local.get 1) (i32.const 1)))\n"
+                     "      (br 0)))\n"
+                     "    (local.get 2))\n"
+                     "  (func (export \"square\") (param i32) (result i32) (call $square (local.get 0)))\n"
+                     ")";
+
+  // Whichever clone the dispatcher picks for this CPU, every clone must compute the same thing
+  for(uint64_t mode : { uint64_t(ENV_OPTIMIZE_MULTIVERSION), uint64_t(ENV_OPTIMIZE_MULTIVERSION_HOT) })
+    for(uint64_t optimize : { uint64_t(0), uint64_t(ENV_OPTIMIZE_O3) })
+    {
+      void* assembly = CompileWASM(wat, sizeof(wat) - 1, "multiversion", [optimize, mode](Environment* env) -> int {
+        env->optimize = optimize | mode;
+        return ERR_SUCCESS;
+      });
+      TEST(assembly != nullptr);
+
+      if(assembly)
+      {
+        auto sum    = (int32_t(*)(int32_t))(*_exports.LoadFunction)(assembly, "multiversion", "sum");
+        auto square = (int32_t(*)(int32_t))(*_exports.LoadFunction)(assembly, "multiversion", "square");
+        TEST(sum != nullptr);
+        TEST(square != nullptr);
+
+        if(sum && square)
+        {
+          TEST((*sum)(0) == 0);
+          TEST((*sum)(10) == 285);
+          TEST((*sum)(1000) == 332833500);
+          TEST((*square)(-12) == 144);
+        }
+        (*_exports.FreeAssembly)(assembly);
+      }
+    }
+}
@@ -0,0 +1,75 @@
+// Copyright (c)2020 Black Sphere Studios
+// For conditions of distribution and use, see copyright notice in innative.h
+
+#include "test.h"
+#include "../innative/utility.h"
+#include <limits>
+
+using namespace innative;
+
+void TestHarness::test_nontrapping()
+{
+  const char wat[] = "(module $nontrapping\n"
+                     "  (func (export \"i32_f64_s\") (param f64) (result i32) (i32.trunc_sat_f64_s (local.get 0)))\n"
+                     "  (func (export \"i32_f32_u\") (param f32) (result i32) (i32.trunc_sat_f32_u (local.get 0)))\n"
+                     "  (func (export \"i64_f64_s\") (param f64) (result i64) (i64.trunc_sat_f64_s (local.get 0)))\n"
+                     "  (func (export \"i64_f32_u\") (param f32) (result i64) (i64.trunc_sat_f32_u (local.get 0)))\n"
+                     "  (func (export \"i32_ext8\") (param i32) (result i32) (i32.extend8_s (local.get 0)))\n"
+                     "  (func (export \"i32_ext16\") (param i32) (result i32) (i32.extend16_s (local.get 0)))\n"
+                     "  (func (export \"i64_ext32\") (param i64) (result i64) (i64.extend32_s (local.get 0)))\n"
+                     ")";
+
+  // Saturating conversions never trap, even when trapping conversions are checked
+  for(uint64_t optimize : { uint64_t(0), uint64_t(ENV_OPTIMIZE_O3) })
+  {
+    void* assembly = CompileWASM(wat, sizeof(wat) - 1, "nontrapping", [optimize](Environment* env) -> int {
+      env->flags |= ENV_CHECK_FLOAT_TRUNC;
+      env->optimize = optimize;
+      return ERR_SUCCESS;
+    });
+    TEST(assembly != nullptr);
+
+    if(assembly)
+    {
+      auto i32_f64_s = (int32_t(*)(double))(*_exports.LoadFunction)(assembly, "nontrapping", "i32_f64_s");
+      auto i32_f32_u = (uint32_t(*)(float))(*_exports.LoadFunction)(assembly, "nontrapping", "i32_f32_u");
+      auto i64_f64_s = (int64_t(*)(double))(*_exports.LoadFunction)(assembly, "nontrapping", "i64_f64_s");
+      auto i64_f32_u = (uint64_t(*)(float))(*_exports.LoadFunction)(assembly, "nontrapping", "i64_f32_u");
+      auto i32_ext8  = (int32_t(*)(int32_t))(*_exports.LoadFunction)(assembly, "nontrapping", "i32_ext8");
+      auto i32_ext16 = (int32_t(*)(int32_t))(*_exports.LoadFunction)(assembly, "nontrapping", "i32_ext16");
+      auto i64_ext32 = (int64_t(*)(int64_t))(*_exports.LoadFunction)(assembly, "nontrapping", "i64_ext32");
+      TEST(i32_f64_s != nullptr);
+      TEST(i32_f32_u != nullptr);
+      TEST(i64_f64_s != nullptr);
+      TEST(i64_f32_u != nullptr);
+      TEST(i32_ext8 != nullptr);
+      TEST(i32_ext16 != nullptr);
+      TEST(i64_ext32 != nullptr);
+
+      if(i32_f64_s && i32_f32_u && i64_f64_s && i64_f32_u)
+      {
+        TEST((*i32_f64_s)(-3.9) == -3);
+        TEST((*i32_f64_s)(1e10) == std::numeric_limits<int32_t>::max());
+        TEST((*i32_f64_s)(-1e10) == std::numeric_limits<int32_t>::min());
+        TEST((*i32_f64_s)(std::numeric_limits<double>::quiet_NaN()) == 0);
+        TEST((*i32_f32_u)(-0.5f) == 0);
+        TEST((*i32_f32_u)(-5.0f) == 0);
+        TEST((*i32_f32_u)(4294967296.0f) == std::numeric_limits<uint32_t>::max());
+        TEST((*i64_f64_s)(-std::numeric_limits<double>::infinity()) == std::numeric_limits<int64_t>::min());
+        TEST((*i64_f64_s)(12345678901.5) == 12345678901LL);
+        TEST((*i64_f32_u)(1e30f) == std::numeric_limits<uint64_t>::max());
+        TEST((*i64_f32_u)(std::numeric_limits<float>::quiet_NaN()) == 0);
+      }
+
+      if(i32_ext8 && i32_ext16 && i64_ext32)
+      {
+        TEST((*i32_ext8)(0x7f) == 0x7f);
+        TEST((*i32_ext8)(0x180) == -128);
+        TEST((*i32_ext16)(0x12348000) == -32768);
+        TEST((*i64_ext32)(0x80000000LL) == -2147483648LL);
+        TEST((*i64_ext32)(0x7fffffffLL) == 0x7fffffffLL);
+      }
+      (*_exports.FreeAssembly)(assembly);
+    }
+  }
+}
@@ -0,0 +1,99 @@
+// Copyright (c)2020 Black Sphere Studios
+// For conditions of distribution and use, see copyright notice in innative.h
+
+#include "test.h"
+#include "../innative/utility.h"
+#include <thread>
+
+using namespace innative;
+
+void TestHarness::test_objectcache()
+{
+  path objdir = _folder / "objcache";
+  std::error_code ec;
+  remove_all(objdir, ec);
+  create_directories(objdir, ec);
+  std::string objpath = objdir.u8string();
+
+  size_t hits   = 0;
+  size_t misses = 0;
+  auto compile  = [&](uint64_t limit, uint64_t optimize) -> int {
+    auto setup = [&](Environment* env) -> int {
+      env->optimize   = optimize;
+      env->objpath    = objpath.c_str();
+      env->cachelimit = limit;
+      return ERR_SUCCESS;
+    };
+
+    int err;
+    Environment* env = PrepareEnvironment("../scripts/funcreplace.wasm", 0, "funcreplace", "env", setup, err);
+    if(!env)
+      return err;
+
+    path out = objdir / "funcreplace";
+    out.replace_extension(IN_LIBRARY_EXTENSION);
+    err = (*_exports.Compile)(env, out.u8string().c_str());
+
+    hits   = env->cachehits;
+    misses = env->cachemisses;
+    (*_exports.DestroyEnvironment)(env);
+    return err;
+  };
+
+  TEST(compile(1ULL << 30, ENV_OPTIMIZE_O3) == ERR_SUCCESS);
+  TEST(hits == 0 && misses == 1);
+  TEST(compile(1ULL << 30, ENV_OPTIMIZE_O3) == ERR_SUCCESS);
+  TEST(hits == 1 && misses == 0);
+
+  // Different optimization settings must never reuse the same object
+  TEST(compile(1ULL << 30, ENV_OPTIMIZE_O0) == ERR_SUCCESS);
+  TEST(hits == 0 && misses == 1);
+
+  // Every object is larger than 1 byte, so this compilation evicts every entry once it's finished
+  TEST(compile(1, ENV_OPTIMIZE_O3) == ERR_SUCCESS);
+  TEST(hits == 1 && misses == 0);
+  TEST(compile(1ULL << 30, ENV_OPTIMIZE_O3) == ERR_SUCCESS);
+  TEST(hits == 0 && misses == 1);
+
+  // Disabling the cache means there is nothing to hit or miss
+  TEST(compile(0, ENV_OPTIMIZE_O3) == ERR_SUCCESS);
+  TEST(hits == 0 && misses == 0);
+
+  // Two compilers sharing the cache at the same time must both keep the entries the other one added
+  remove_all(objdir, ec);
+  create_directories(objdir, ec);
+  auto shared = [&](const char* name, int& err, size_t& missed) {
+    std::string wat = std::string("(module $") + name + " (func (export \"" + name + "\") (result i32) (i32.const 1)))";
+    Environment* env = PrepareEnvironment(wat.c_str(), wat.size(), name, "env",
+                                          [&](Environment* e) -> int {
+                                            e->objpath    = objpath.c_str();
+                                            e->cachelimit = 1ULL << 30;
+                                            return ERR_SUCCESS;
+                                          },
+                                          err);
+    if(!env)
+      return;
+
+    path out = objdir / name;
+    out.replace_extension(IN_LIBRARY_EXTENSION);
+    err    = (*_exports.Compile)(env, out.u8string().c_str());
+    missed = env->cachemisses;
+    (*_exports.DestroyEnvironment)(env);
+  };
+
+  int errs[2]      = { ERR_SUCCESS, ERR_SUCCESS };
+  size_t missed[2] = { 0, 0 };
+  std::thread first([&] { shared("first", errs[0], missed[0]); });
+  shared("second", errs[1], missed[1]);
+  first.join();
+  TEST(errs[0] == ERR_SUCCESS && errs[1] == ERR_SUCCESS);
+  TEST(missed[0] == 1 && missed[1] == 1);
+  TEST(!exists(objdir / utility::IN_OBJECT_CACHE_DIR / utility::IN_OBJECT_CACHE_LOCK));
+
+  shared("first", errs[0], missed[0]);
+  shared("second", errs[1], missed[1]);
+  TEST(errs[0] == ERR_SUCCESS && errs[1] == ERR_SUCCESS);
+  TEST(missed[0] == 0 && missed[1] == 0);
+
+  remove_all(objdir, ec);
+}
@@ -0,0 +1,45 @@
+// Copyright (c)2020 Black Sphere Studios
+// For conditions of distribution and use, see copyright notice in innative.h
+
+#include "test.h"
+#include "../innative/utility.h"
+
+using namespace innative;
+using namespace utility;
+
+void TestHarness::test_pgo()
+{
+  path raw      = GetWorkingDir() / "funcreplace.profraw";
+  path profdata = _folder / "funcreplace.profdata";
+  std::error_code ec;
+  remove(raw, ec);
+
+  // The instrumented library writes its profile when it is unloaded
+  TEST(CompileWASM("../scripts/funcreplace.wasm", &TestHarness::do_funcreplace, "env", [](Environment* env) -> int {
+         env->optimize = ENV_OPTIMIZE_O3 | ENV_OPTIMIZE_PROFILE_GENERATE;
+         return ERR_SUCCESS;
+       }) == ERR_SUCCESS);
+  TEST(exists(raw));
+
+  std::string rawfile = raw.u8string();
+  const char* inputs[] = { rawfile.c_str() };
+  TEST(innative_merge_profiles(inputs, 1, profdata.u8string().c_str(), stdout) == ERR_SUCCESS);
+  TEST(exists(profdata));
+
+  std::string profile = profdata.u8string();
+  TEST(CompileWASM("../scripts/funcreplace.wasm", &TestHarness::do_funcreplace, "env", [&profile](Environment* env) -> int {
+         env->optimize = ENV_OPTIMIZE_O3;
+         env->profile  = profile.c_str();
+         return ERR_SUCCESS;
+       }) == ERR_SUCCESS);
+
+  // A profile that doesn't exist must be reported instead of taking down the process
+  TEST(CompileWASM("../scripts/funcreplace.wasm", nullptr, "env", [](Environment* env) -> int {
+         env->optimize = ENV_OPTIMIZE_O3;
+         env->profile  = "../scripts/does-not-exist.profdata";
+         return ERR_SUCCESS;
+       }) == ERR_FATAL_FILE_ERROR);
+
+  remove(raw, ec);
+  remove(profdata, ec);
+}
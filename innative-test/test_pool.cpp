@@ -0,0 +1,106 @@
+// Copyright (c)2020 Black Sphere Studios
+// For conditions of distribution and use, see copyright notice in innative.h
+
+#include "test.h"
+#include "../innative/utility.h"
+
+using namespace innative;
+
+void TestHarness::test_pool()
+{
+  const char wat[] = "(module $pool\n"
+                     "  (memory 1)\n"
+                     "  (table 4 funcref)\n"
+                     "  (func (export \"store\") (param i32 i32) (i32.store (local.get 0) (local.get 1)))\n"
+                     "  (func (export \"load\") (param i32) (result i32) (i32.load (local.get 0)))\n"
+                     "  (func (export \"grow\") (param i32) (result i32) (memory.grow (local.get 0)))\n"
+                     ")";
+
+  // Each JIT assembly links its own copy of the runtime, so every iteration starts with an empty pool
+  for(uint64_t optimize : { uint64_t(0), uint64_t(ENV_OPTIMIZE_O3) })
+  {
+    void* assembly = CompileWASM(wat, sizeof(wat) - 1, "pool", [optimize](Environment* env) -> int {
+      env->flags    = ENV_ENABLE_WAT | ENV_MULTI_INSTANCE | ENV_POOLED_MEMORY;
+      env->optimize = optimize;
+      return ERR_SUCCESS;
+    });
+    TEST(assembly != nullptr);
+
+    if(assembly)
+    {
+      auto store = (void (*)(void*, int32_t, int32_t))(*_exports.LoadFunction)(assembly, "pool", "store");
+      auto load  = (int32_t(*)(void*, int32_t))(*_exports.LoadFunction)(assembly, "pool", "load");
+      auto grow  = (int32_t(*)(void*, int32_t))(*_exports.LoadFunction)(assembly, "pool", "grow");
+      TEST(store != nullptr);
+      TEST(load != nullptr);
+      TEST(grow != nullptr);
+
+      // Two memory slots of 8 pages, so the third instance has to fall back to an ordinary allocation
+      TEST((*_exports.ConfigurePool)(assembly, 2, 8 * 0x10000, 2, 0) == ERR_SUCCESS);
+
+      void* instances[3];
+      for(auto& instance : instances)
+      {
+        instance = (*_exports.CreateInstance)(assembly);
+        TEST(instance != nullptr);
+        TEST((*_exports.InitInstance)(assembly, instance) == ERR_SUCCESS);
+      }
+
+      INPoolStats memories;
+      INPoolStats tables;
+      TEST((*_exports.GetPoolStats)(assembly, &memories, &tables) == ERR_SUCCESS);
+      TEST(memories.n_slots == 2);
+      TEST(memories.in_use == 2);
+      TEST(memories.fallbacks == 1);
+      TEST(tables.in_use == 2);
+      TEST((*_exports.ConfigurePool)(assembly, 4, 0, 4, 0) != ERR_SUCCESS);
+
+      if(store && load && grow)
+      {
+        (*store)(instances[0], 64, 1234);
+        TEST((*grow)(instances[0], 4) == 1);
+        (*store)(instances[0], 0x40000, 5678);
+        TEST((*grow)(instances[0], 8) == -1); // Doesn't fit in the slot anymore
+        TEST((*load)(instances[1], 64) == 0);
+      }
+
+      // A recycled slot must come back zeroed, including the pages grown into
+      (*_exports.DestroyInstance)(assembly, instances[0]);
+      instances[0] = (*_exports.CreateInstance)(assembly);
+      TEST((*_exports.InitInstance)(assembly, instances[0]) == ERR_SUCCESS);
+
+      TEST((*_exports.GetPoolStats)(assembly, &memories, &tables) == ERR_SUCCESS);
+      TEST(memories.acquired == 3);
+      TEST(memories.released == 1);
+      TEST(memories.zeroed + memories.advised == 1);
+
+      if(store && load && grow)
+      {
+        TEST((*load)(instances[0], 64) == 0);
+        TEST((*grow)(instances[0], 4) == 1);
+        TEST((*load)(instances[0], 0x40000) == 0);
+      }
+
+      for(auto instance : instances)
+        (*_exports.DestroyInstance)(assembly, instance);
+
+      TEST((*_exports.GetPoolStats)(assembly, &memories, &tables) == ERR_SUCCESS);
+      TEST(memories.in_use == 0);
+      TEST(tables.in_use == 0);
+
+      // The last instance to exit gives both pools back, so they can be configured again and are reserved anew
+      TEST((*_exports.ConfigurePool)(assembly, 3, 0, 3, 0) == ERR_SUCCESS);
+      void* instance = (*_exports.CreateInstance)(assembly);
+      TEST(instance != nullptr);
+      TEST((*_exports.InitInstance)(assembly, instance) == ERR_SUCCESS);
+      TEST((*_exports.GetPoolStats)(assembly, &memories, &tables) == ERR_SUCCESS);
+      TEST(memories.n_slots == 3);
+      TEST(memories.in_use == 1);
+      TEST(tables.n_slots == 3);
+      if(load)
+        TEST((*load)(instance, 64) == 0);
+      (*_exports.DestroyInstance)(assembly, instance);
+      (*_exports.FreeAssembly)(assembly);
+    }
+  }
+}
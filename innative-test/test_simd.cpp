@@ -0,0 +1,199 @@
+// Copyright (c)2020 Black Sphere Studios
+// For conditions of distribution and use, see copyright notice in innative.h
+
+#include "test.h"
+#include "../innative/utility.h"
+
+using namespace innative;
+
+void TestHarness::test_simd()
+{
+  // Vectors can't cross the C boundary, so every function reads its inputs from memory and either stores its results back
+  // into memory or returns a single lane. The inputs come from a data segment, so nothing can be folded at compile time.
+  //   0x00 bytes 0 to 31
+  //   0x20 f32x4 NaN, 3e9, -3e9, -1.5
+  //   0x30 f64x2 NaN, 1e10
+  //   0x40 swizzle indices, including ones that are out of range
+  const char wat[] = "(module $simd\n"
+                     "  (memory 1)\n"
+                     "  (data (i32.const 0)\n"
+                     "    \"\\00\\01\\02\\03\\04\\05\\06\\07\\08\\09\\0a\\0b\\0c\\0d\\0e\\0f\"\n"
+                     "    \"\\10\\11\\12\\13\\14\\15\\16\\17\\18\\19\\1a\\1b\\1c\\1d\\1e\\1f\"\n"
+                     "    \"\\00\\00\\c0\\7f\\5e\\d0\\32\\4f\\5e\\d0\\32\\cf\\00\\00\\c0\\bf\"\n"
+                     "    \"\\00\\00\\00\\00\\00\\00\\f8\\7f\\00\\00\\00\\20\\5f\\a0\\02\\42\"\n"
+                     "    \"\\0f\\00\\10\\ff\\01\\02\\03\\04\\05\\06\\07\\08\\09\\0a\\0b\\0c\")\n"
+                     "  (func (export \"shuffle\")\n"
+                     "    (v128.store (i32.const 0x100) (i8x16.shuffle 0 17 2 19 4 21 6 23 8 25 10 27 12 29 14 31\n"
+                     "      (v128.load (i32.const 0)) (v128.load (i32.const 0x10))))\n"
+                     "    (v128.store (i32.const 0x110)\n"
+                     "      (i8x16.swizzle (v128.load (i32.const 0)) (v128.load (i32.const 0x40)))))\n"
+                     "  (func (export \"trunc\")\n"
+                     "    (v128.store (i32.const 0x120) (i32x4.trunc_sat_f32x4_s (v128.load (i32.const 0x20))))\n"
+                     "    (v128.store (i32.const 0x130) (i32x4.trunc_sat_f32x4_u (v128.load (i32.const 0x20))))\n"
+                     "    (v128.store (i32.const 0x140) (i32x4.trunc_sat_f64x2_s_zero (v128.load (i32.const 0x30))))\n"
+                     "    (v128.store (i32.const 0x150) (i32x4.trunc_sat_f64x2_u_zero (v128.load (i32.const 0x30)))))\n"
+                     "  (func (export \"lanes\")\n"
+                     "    (v128.store (i32.const 0x160) (v128.load32_lane 2 (i32.const 4) (v128.load (i32.const 0x10))))\n"
+                     "    (v128.store (i32.const 0x170) (v128.load8_splat (i32.const 3)))\n"
+                     "    (v128.store (i32.const 0x180) (v128.load64_zero (i32.const 8)))\n"
+                     "    (v128.store64_lane 1 (i32.const 0x190) (v128.load (i32.const 0)))\n"
+                     "    (v128.store8_lane 15 (i32.const 0x198) (v128.load (i32.const 0x10))))\n"
+                     "  (func (export \"shape8\") (result i32) (i8x16.extract_lane_u 15 (v128.load (i32.const 0x20))))\n"
+                     "  (func (export \"shape16\") (result i32) (i16x8.extract_lane_s 2 (v128.load (i32.const 0x20))))\n"
+                     "  (func (export \"shape64\") (result i64) (i64x2.extract_lane 1 (v128.load (i32.const 0x20))))\n"
+                     "  (func (export \"shapef32\") (result f32)\n"
+                     "    (f32x4.extract_lane 3 (f32x4.mul (v128.load (i32.const 0x20)) (f32x4.splat (f32.const 2)))))\n"
+                     "  (func (export \"replace\") (result i64)\n"
+                     "    (i64x2.extract_lane 1 (i32x4.replace_lane 3 (v128.load (i32.const 0)) (i32.const -1))))\n"
+                     "  (func (export \"replacef64\") (result f64)\n"
+                     "    (f64x2.extract_lane 1 (f64x2.replace_lane 1 (v128.load (i32.const 0x30)) (f64.const 0.5))))\n"
+                     "  (func (export \"bitmask\") (result i32) (i8x16.bitmask (v128.load (i32.const 0x20))))\n"
+                     "  (func (export \"any_true\") (param i32) (result i32) (v128.any_true (v128.load (local.get 0))))\n"
+                     "  (func (export \"shl\") (result i32)\n"
+                     "    (i32x4.extract_lane 0 (i32x4.shl (v128.load (i32.const 0)) (i32.const 33))))\n"
+                     "  (func (export \"shr\") (result i32)\n"
+                     "    (i8x16.extract_lane_s 15 (i8x16.shr_s (v128.load (i32.const 0x20)) (i32.const 9))))\n"
+                     "  (func (export \"bitselect\") (result i64)\n"
+                     "    (i64x2.extract_lane 0 (v128.bitselect (v128.load (i32.const 0)) (v128.load (i32.const 0x10))\n"
+                     "      (v128.const i32x4 -1 0 0 0))))\n"
+                     ")";
+
+  // Every kind of SIMD instruction must give the same result whether LLVM selects vector instructions for it directly
+  // or optimizes it first
+  for(uint64_t optimize : { uint64_t(0), uint64_t(ENV_OPTIMIZE_O3) })
+  {
+    void* assembly = CompileWASM(wat, sizeof(wat) - 1, "simd", [optimize](Environment* env) -> int {
+      env->optimize = optimize;
+      return ERR_SUCCESS;
+    });
+    TEST(assembly != nullptr);
+    if(!assembly)
+      continue;
+
+    INModuleMetadata* metadata = (*_exports.GetModuleMetadata)(assembly, 0);
+    TEST(metadata != nullptr);
+    if(!metadata || !metadata->n_memories)
+    {
+      (*_exports.FreeAssembly)(assembly);
+      continue;
+    }
+
+    auto bytes = reinterpret_cast<const uint8_t*>(metadata->memories[0]->bytes);
+    auto i32   = [bytes](uint32_t offset) {
+      int32_t v;
+      memcpy(&v, bytes + offset, sizeof(v));
+      return v;
+    };
+
+    auto run = [&](const char* name) {
+      auto f = (void (*)())(*_exports.LoadFunction)(assembly, "simd", name);
+      TEST(f != nullptr);
+      if(f)
+        (*f)();
+      return f != nullptr;
+    };
+
+    // The shuffle takes even bytes from the first vector and odd bytes from the second, and a swizzle index past the end
+    // of the vector selects 0
+    if(run("shuffle"))
+    {
+      int failures = 0;
+      for(int i = 0; i < 16; ++i)
+        failures += bytes[0x100 + i] != ((i & 1) ? 0x10 + i : i);
+      TEST(failures == 0);
+      TEST(bytes[0x110] == 15);
+      TEST(bytes[0x111] == 0);
+      TEST(bytes[0x112] == 0);
+      TEST(bytes[0x113] == 0);
+      TEST(bytes[0x114] == 1);
+      TEST(bytes[0x11f] == 12);
+    }
+
+    // NaN becomes 0 and anything out of range saturates, and the f64x2 versions zero the upper two lanes
+    if(run("trunc"))
+    {
+      TEST(i32(0x120) == 0);
+      TEST(i32(0x124) == 2147483647);
+      TEST(i32(0x128) == -2147483647 - 1);
+      TEST(i32(0x12c) == -1);
+      TEST(i32(0x130) == 0);
+      TEST(uint32_t(i32(0x134)) == 3000000000u);
+      TEST(i32(0x138) == 0);
+      TEST(i32(0x13c) == 0);
+      TEST(i32(0x140) == 0);
+      TEST(i32(0x144) == 2147483647);
+      TEST(i32(0x148) == 0);
+      TEST(i32(0x14c) == 0);
+      TEST(i32(0x150) == 0);
+      TEST(uint32_t(i32(0x154)) == 0xffffffffu);
+      TEST(i32(0x158) == 0);
+      TEST(i32(0x15c) == 0);
+    }
+
+    // Lane loads only replace their own lane, and lane stores only write their own lane
+    if(run("lanes"))
+    {
+      TEST(i32(0x160) == 0x13121110);
+      TEST(i32(0x164) == 0x17161514);
+      TEST(i32(0x168) == 0x07060504);
+      TEST(i32(0x16c) == 0x1f1e1d1c);
+      TEST(i32(0x170) == 0x03030303);
+      TEST(i32(0x17c) == 0x03030303);
+      TEST(i32(0x180) == 0x0b0a0908);
+      TEST(i32(0x184) == 0x0f0e0d0c);
+      TEST(i32(0x188) == 0);
+      TEST(i32(0x18c) == 0);
+      TEST(i32(0x190) == 0x0b0a0908);
+      TEST(i32(0x194) == 0x0f0e0d0c);
+      TEST(bytes[0x198] == 0x1f);
+      TEST(bytes[0x199] == 0);
+    }
+
+    // Each instruction reinterprets the same 128 bits in its own shape, and lane indices go right up to the last lane
+    auto shape8     = (int32_t(*)())(*_exports.LoadFunction)(assembly, "simd", "shape8");
+    auto shape16    = (int32_t(*)())(*_exports.LoadFunction)(assembly, "simd", "shape16");
+    auto shape64    = (int64_t(*)())(*_exports.LoadFunction)(assembly, "simd", "shape64");
+    auto shapef32   = (float (*)())(*_exports.LoadFunction)(assembly, "simd", "shapef32");
+    auto replace    = (int64_t(*)())(*_exports.LoadFunction)(assembly, "simd", "replace");
+    auto replacef64 = (double (*)())(*_exports.LoadFunction)(assembly, "simd", "replacef64");
+    auto bitmask    = (int32_t(*)())(*_exports.LoadFunction)(assembly, "simd", "bitmask");
+    auto any_true   = (int32_t(*)(int32_t))(*_exports.LoadFunction)(assembly, "simd", "any_true");
+    auto shl        = (int32_t(*)())(*_exports.LoadFunction)(assembly, "simd", "shl");
+    auto shr        = (int32_t(*)())(*_exports.LoadFunction)(assembly, "simd", "shr");
+    auto bitselect  = (int64_t(*)())(*_exports.LoadFunction)(assembly, "simd", "bitselect");
+    TEST(shape8 != nullptr);
+    TEST(shape16 != nullptr);
+    TEST(shape64 != nullptr);
+    TEST(shapef32 != nullptr);
+    TEST(replace != nullptr);
+    TEST(replacef64 != nullptr);
+    TEST(bitmask != nullptr);
+    TEST(any_true != nullptr);
+    TEST(shl != nullptr);
+    TEST(shr != nullptr);
+    TEST(bitselect != nullptr);
+
+    if(shape8 && shape16 && shape64 && shapef32 && replace && replacef64)
+    {
+      TEST((*shape8)() == 0xbf);
+      TEST((*shape16)() == -12194);
+      TEST(uint64_t((*shape64)()) == 0xbfc00000cf32d05eULL);
+      TEST((*shapef32)() == -3.0f);
+      TEST(uint64_t((*replace)()) == 0xffffffff0b0a0908ULL);
+      TEST((*replacef64)() == 0.5);
+    }
+
+    // Tests and shifts, where the shift count is taken modulo the lane width
+    if(bitmask && any_true && shl && shr && bitselect)
+    {
+      TEST((*bitmask)() == 0xca24);
+      TEST((*any_true)(0) != 0);
+      TEST((*any_true)(0x200) == 0);
+      TEST((*shl)() == 0x06040200);
+      TEST((*shr)() == -33);
+      TEST(uint64_t((*bitselect)()) == 0x1716151403020100ULL);
+    }
+
+    (*_exports.FreeAssembly)(assembly);
+  }
+}
@@ -0,0 +1,51 @@
+// Copyright (c)2020 Black Sphere Studios
+// For conditions of distribution and use, see copyright notice in innative.h
+
+#include "test.h"
+
+int TestHarness::do_snapshot(void* assembly)
+{
+  auto counter = (int32_t(*)())(*_exports.LoadFunction)(assembly, "snapshot", "counter");
+  auto big     = (int64_t(*)())(*_exports.LoadFunction)(assembly, "snapshot", "big");
+  auto load    = (int32_t(*)(int32_t))(*_exports.LoadFunction)(assembly, "snapshot", "load");
+  auto size    = (int32_t(*)())(*_exports.LoadFunction)(assembly, "snapshot", "size");
+  auto call    = (int32_t(*)(int32_t))(*_exports.LoadFunction)(assembly, "snapshot", "call");
+  TEST(counter != nullptr);
+  TEST(big != nullptr);
+  TEST(load != nullptr);
+  TEST(size != nullptr);
+  TEST(call != nullptr);
+
+  // The start function ran once while compiling, and must not run again when the library is loaded
+  if(counter && big)
+  {
+    TEST((*counter)() == 1);
+    TEST((*big)() == 0x123456789);
+  }
+
+  if(load && size)
+  {
+    TEST((*size)() == 2);
+    TEST((*load)(16) == 0x0201);
+    TEST((*load)(0x18000) == 12345);
+    TEST((*load)(0x8000) == 0);
+  }
+
+  if(call)
+  {
+    TEST((*call)(0) == 7);
+    TEST((*call)(2) == 9);
+  }
+
+  return ERR_SUCCESS;
+}
+
+void TestHarness::test_snapshot()
+{
+  auto lambda = [](Environment* env) -> int {
+    env->flags |= ENV_SNAPSHOT;
+    return ERR_SUCCESS;
+  };
+
+  TEST(CompileWASM("../scripts/snapshot.wat", &TestHarness::do_snapshot, "env", lambda) == ERR_SUCCESS);
+}
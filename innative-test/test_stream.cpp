@@ -3,6 +3,7 @@
 
 #include "test.h"
 #include "../innative/stream.h"
+#include "../innative/instruction_stream.h"
 
 using namespace innative;
 
@@ -49,4 +50,43 @@ void TestHarness::test_stream()
   s.pos = 15;
   TEST(!s.End());
   TEST(s.ReadVarUInt32(err) == 9);
-}
\ No newline at end of file
+
+  // Function bodies pack their instructions into a compact stream, which must decode back to identical instructions
+  Environment* env   = (*_exports.CreateEnvironment)(1, 0, 0);
+  varuint32 table[3] = { 2, 1, 0 };
+  Instruction ins[5] = { { OP_i64_const }, { OP_br_table }, { OP_simd_prefix, OP_v128_const }, { OP_i32_add }, { OP_end } };
+
+  ins[0].immediates[0]._varsint64 = -3;
+  ins[0].line                     = 4;
+  ins[0].column                   = 9;
+  ins[1].immediates[0].n_table    = 3;
+  ins[1].immediates[0].table      = table;
+  ins[1].immediates[1]._varuint32 = 7;
+  ins[2].immediates[0]._varuint64 = 0x0123456789ABCDEF;
+  ins[2].immediates[1]._varuint64 = ~0ULL;
+
+  InstructionWriter writer(true);
+  for(auto& i : ins)
+    writer.Write(i);
+  FunctionBody body = { 0 };
+  TEST(writer.Finish(body, *env) == ERR_SUCCESS);
+  TEST(body.n_body == 5);
+  TEST(body.code_size < sizeof(ins));
+
+  auto same = [](const Instruction& x, const Instruction& y) {
+    bool jump = x.opcode[0] == OP_br_table;
+    for(int k = jump ? 1 : 0; k < MAX_IMMEDIATES; ++k)
+      if(x.immediates[k]._varuint64 != y.immediates[k]._varuint64)
+        return false;
+    if(jump && (x.immediates[0].n_table != y.immediates[0].n_table || x.immediates[0].table != y.immediates[0].table))
+      return false;
+    return x.opcode[0] == y.opcode[0] && x.opcode[1] == y.opcode[1] && x.line == y.line && x.column == y.column;
+  };
+
+  varuint32 count = 0;
+  for(Instruction& i : Instructions(body))
+    TEST(count < 5 && same(i, ins[count++]));
+  TEST(count == 5);
+
+  (*_exports.DestroyEnvironment)(env);
+}
@@ -0,0 +1,69 @@
+// Copyright (c)2020 Black Sphere Studios
+// For conditions of distribution and use, see copyright notice in innative.h
+
+#include "test.h"
+#include "../innative/utility.h"
+
+using namespace innative;
+
+void TestHarness::test_tailcall()
+{
+  const char wat[] = "(module $tailcall\n"
+                     "  (type $i (func (param i32) (result i32)))\n"
+                     "  (table 2 funcref)\n"
+                     "  (elem (i32.const 0) $even $odd)\n"
+                     "  (func $even (export \"even\") (param $n i32) (result i32)\n"
+                     "    (if (result i32) (i32.eqz (local.get $n))\n"
+                     "      (then (i32.const 1))\n"
+                     "      (else (return_call $odd (i32.sub (local.get $n) (i32.const 1))))))\n"
+                     "  (func $odd (export \"odd\") (param $n i32) (result i32)\n"
+                     "    (if (result i32) (i32.eqz (local.get $n))\n"
+                     "      (then (i32.const 0))\n"
+                     "      (else (return_call_indirect (type $i)\n"
+                     "        (i32.sub (local.get $n) (i32.const 1)) (i32.const 0)))))\n"
+                     "  (func $down (export \"down\") (param $n i32) (result i32)\n"
+                     "    (if (result i32) (i32.eqz (local.get $n))\n"
+                     "      (then (i32.const 7))\n"
+                     "      (else (return_call $step (local.get $n) (i64.const 1)))))\n"
+                     "  (func $step (param $n i32) (param $by i64) (result i32)\n"
+                     "    (return_call $down (i32.sub (local.get $n) (i32.wrap_i64 (local.get $by)))))\n"
+                     ")";
+
+  // A million calls deep is far more than the stack could hold if any of these weren't real tail calls, even though
+  // ordinary tail calls are disabled. The last case tail calls between functions with different prototypes, which only
+  // the tail call convention can guarantee.
+  for(uint64_t optimize : { uint64_t(0), uint64_t(ENV_OPTIMIZE_O3) })
+  {
+    void* assembly = CompileWASM(wat, sizeof(wat) - 1, "tailcall", [optimize](Environment* env) -> int {
+      env->flags |= ENV_CHECK_INDIRECT_CALL | ENV_DISABLE_TAIL_CALL;
+      env->optimize = optimize;
+      return ERR_SUCCESS;
+    });
+    TEST(assembly != nullptr);
+
+    if(assembly)
+    {
+      int (*even)(int) = (int (*)(int))(*_exports.LoadFunction)(assembly, "tailcall", "even");
+      int (*odd)(int)  = (int (*)(int))(*_exports.LoadFunction)(assembly, "tailcall", "odd");
+      int (*down)(int) = (int (*)(int))(*_exports.LoadFunction)(assembly, "tailcall", "down");
+      TEST(even != nullptr);
+      TEST(odd != nullptr);
+      TEST(down != nullptr);
+      if(even && odd && down)
+      {
+        TEST((*even)(10) == 1);
+        TEST((*odd)(10) == 0);
+        TEST((*even)(1000001) == 0);
+        TEST((*odd)(1000001) == 1);
+        TEST((*down)(1000000) == 7);
+      }
+
+      // The table holds the internal functions, but the runtime should still hand out something C can call
+      auto entry = (int (*)(int))(*_exports.LoadTableIndex)(assembly, 0, 0, 1);
+      TEST(entry != nullptr);
+      if(entry)
+        TEST((*entry)(3) == 1);
+      (*_exports.FreeAssembly)(assembly);
+    }
+  }
+}
@@ -0,0 +1,79 @@
+// Copyright (c)2020 Black Sphere Studios
+// For conditions of distribution and use, see copyright notice in innative.h
+
+#include "test.h"
+#include "../innative/utility.h"
+
+using namespace innative;
+
+void TestHarness::test_trap()
+{
+  const char wat[] = "(module $trap\n"
+                     "  (type $ii (func (param i32 i32) (result i32)))\n"
+                     "  (memory 1)\n"
+                     "  (table 3 funcref)\n"
+                     "  (elem (i32.const 0) $div $one)\n"
+                     "  (func $div (export \"div\") (param i32 i32) (result i32)\n"
+                     "    (i32.div_s (local.get 0) (local.get 1)))\n"
+                     "  (func $one (param i32) (result i32) (local.get 0))\n"
+                     "  (func $load (export \"load\") (param i32 i32) (result i32) (i32.load (local.get 0)))\n"
+                     "  (func $fail (export \"fail\") (param i32 i32) (result i32) (unreachable))\n"
+                     "  (func $call (export \"call\") (param i32 i32) (result i32)\n"
+                     "    (call_indirect (type $ii) (local.get 0) (local.get 0) (local.get 1)))\n"
+                     ")";
+
+  // Each check reports its own kind of trap and the function it came from, even though checks of the same kind share a
+  // single landing pad in each function. The division by zero and the overflow in $div go to two different pads.
+  for(uint64_t optimize : { uint64_t(0), uint64_t(ENV_OPTIMIZE_O3) })
+  {
+    void* assembly = CompileWASM(wat, sizeof(wat) - 1, "trap", [optimize](Environment* env) -> int {
+      env->flags |= ENV_CHECK_INDIRECT_CALL | ENV_CHECK_INT_DIVISION | ENV_CHECK_MEMORY_ACCESS;
+      env->optimize = optimize;
+      return ERR_SUCCESS;
+    });
+    TEST(assembly != nullptr);
+
+    if(assembly)
+    {
+      auto div  = (int (*)(int, int))(*_exports.LoadFunction)(assembly, "trap", "div");
+      auto load = (int (*)(int, int))(*_exports.LoadFunction)(assembly, "trap", "load");
+      auto fail = (int (*)(int, int))(*_exports.LoadFunction)(assembly, "trap", "fail");
+      auto call = (int (*)(int, int))(*_exports.LoadFunction)(assembly, "trap", "call");
+      auto last = (*_exports.GetLastTrap)(assembly);
+      TEST(div != nullptr);
+      TEST(load != nullptr);
+      TEST(fail != nullptr);
+      TEST(call != nullptr);
+      TEST(last != nullptr);
+
+      if(div && load && fail && call && last)
+      {
+        TEST(!CallTraps([=] { (*div)(7, 2); }));
+        TEST(CallTraps([=] { (*div)(7, 0); }));
+        TEST(last->code == IN_TRAP_DIVIDE_BY_ZERO);
+        TEST(last->function == 0);
+        TEST(last->line == 7);
+        TEST(CallTraps([=] { (*div)(-2147483647 - 1, -1); }));
+        TEST(last->code == IN_TRAP_INTEGER_OVERFLOW);
+        TEST(last->function == 0);
+
+        TEST(CallTraps([=] { (*load)(65536, 0); }));
+        TEST(last->code == IN_TRAP_OUT_OF_BOUNDS);
+
+        TEST(CallTraps([=] { (*fail)(0, 0); }));
+        TEST(last->code == IN_TRAP_UNREACHABLE);
+        TEST(last->function == 3);
+
+        TEST(!CallTraps([=] { (*call)(9, 0); }));
+        TEST(CallTraps([=] { (*call)(9, 1); }));
+        TEST(last->code == IN_TRAP_BAD_SIGNATURE);
+        TEST(last->function == 4);
+        TEST(CallTraps([=] { (*call)(9, 2); }));
+        TEST(last->code == IN_TRAP_NULL_TABLE_ENTRY);
+        TEST(CallTraps([=] { (*call)(9, 3); }));
+        TEST(last->code == IN_TRAP_NULL_TABLE_ENTRY);
+      }
+      (*_exports.FreeAssembly)(assembly);
+    }
+  }
+}
@@ -27,7 +27,7 @@ IN_ERROR Compiler::InsertAlignmentTrap(llvmVal* ptr, varuint32 memory, varuint32
   auto zero      = CInt::get(sizet, 0);
   auto mask      = CInt::get(sizet, alignment - 1);
   auto cond      = builder.CreateICmpNE(builder.CreateAnd(ptrtoint, mask), zero);
-  InsertConditionalTrap(cond);
+  InsertConditionalTrap(cond, IN_TRAP_UNALIGNED_ATOMIC);
 
   return ERR_SUCCESS;
 }
@@ -140,6 +140,7 @@ IN_ERROR Compiler::CompileAtomicLoad(Instruction& ins, WASM_TYPE_ENCODING varTy,
 
     auto load = builder.CreateAlignedLoad(ptr, align, name);
     load->setAtomic(SeqCst);
+    TagAccess(load, tbaa.memory);
 
     llvmVal* result = load;
     // All atomic loads zero-ext when the atomic variable is smaller than the WASM value
@@ -162,6 +163,7 @@ IN_ERROR Compiler::CompileAtomicStore(Instruction& ins, WASM_TYPE_ENCODING varTy
 
     auto store = builder.CreateAlignedStore(value, ptr, align);
     store->setAtomic(SeqCst);
+    TagAccess(store, tbaa.memory);
 
     return ERR_SUCCESS;
   });
@@ -180,6 +182,7 @@ IN_ERROR Compiler::CompileAtomicRMW(Instruction& ins, WASM_TYPE_ENCODING varTy,
 
     auto rmw = builder.CreateAtomicRMW(Op, ptr, newValue, SeqCst);
     rmw->setName(name);
+    TagAccess(rmw, tbaa.memory);
 
     llvmVal* oldValue = rmw;
     if(varsize > align)
@@ -204,6 +207,7 @@ IN_ERROR Compiler::CompileAtomicCmpXchg(Instruction& ins, WASM_TYPE_ENCODING var
 
     auto cmpxchg = builder.CreateAtomicCmpXchg(ptr, cmp, newVal, SeqCst, SeqCst);
     cmpxchg->setName(name);
+    TagAccess(cmpxchg, tbaa.memory);
 
     llvmVal* loaded = builder.CreateExtractValue(cmpxchg, 0);
     if(varsize > align)
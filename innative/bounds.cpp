@@ -0,0 +1,424 @@
+// Copyright (c)2020 Black Sphere Studios
+// For conditions of distribution and use, see copyright notice in innative.h
+
+#include "bounds.h"
+#pragma warning(push)
+#pragma warning(disable : 4146 4267 4141 4244 4624)
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/Analysis/ScalarEvolution.h"
+#include "llvm/Analysis/ScalarEvolutionExpander.h"
+#include "llvm/Analysis/ScalarEvolutionExpressions.h"
+#include "llvm/Analysis/ValueTracking.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/Transforms/Utils/BasicBlockUtils.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/Transforms/Utils/LoopSimplify.h"
+#include "llvm/Transforms/Utils/LoopUtils.h"
+#include "llvm/Transforms/Utils/ValueMapper.h"
+#pragma warning(pop)
+#include <map>
+
+using namespace innative;
+
+namespace innative {
+  namespace bounds {
+    // Versioning a loop duplicates it, so very large loops are left alone
+    static const size_t MAX_VERSIONED_LOOP_SIZE = 512;
+
+    // A bounds check, split into the address it checks against and the total constant extent past that address, so that
+    // checks of different constant offsets off the same address can be compared.
+    struct Check
+    {
+      llvm::CallInst* call;
+      llvm::Value* base;   // null if the address is a constant
+      llvm::Value* memory; // Identifies which memory is being checked
+      uint64_t offset;     // Constant that was folded into the base address of the call
+      uint64_t extent;
+    };
+
+    // Every check loads the memory size separately, so the memory is identified by the location of the size instead.
+    llvm::Value* GetMemory(llvm::Value* end)
+    {
+      if(auto load = llvm::dyn_cast<llvm::LoadInst>(end))
+        return load->getPointerOperand()->stripPointerCasts();
+      return end;
+    }
+
+    Check Decompose(llvm::CallInst* call)
+    {
+      Check check = { call, call->getArgOperand(0), GetMemory(call->getArgOperand(2)), 0,
+                      llvm::cast<llvm::ConstantInt>(call->getArgOperand(1))->getZExtValue() };
+
+      if(auto c = llvm::dyn_cast<llvm::ConstantInt>(check.base))
+      {
+        check.offset = c->getZExtValue();
+        check.base   = nullptr;
+      }
+      else if(auto add = llvm::dyn_cast<llvm::BinaryOperator>(check.base))
+      {
+        if(add->getOpcode() == llvm::Instruction::Add && add->hasNoUnsignedWrap() &&
+           llvm::isa<llvm::ConstantInt>(add->getOperand(1)))
+        {
+          check.offset = llvm::cast<llvm::ConstantInt>(add->getOperand(1))->getZExtValue();
+          check.base   = add->getOperand(0);
+        }
+      }
+
+      check.extent += check.offset;
+      return check;
+    }
+
+    bool IsCheck(llvm::Instruction& inst, llvm::Function* marker)
+    {
+      auto call = llvm::dyn_cast<llvm::CallInst>(&inst);
+      return call != nullptr && call->getCalledFunction() == marker;
+    }
+
+    std::vector<Check> GetChecks(llvm::Function& fn, llvm::Function* marker)
+    {
+      std::vector<Check> checks;
+      for(auto& block : fn)
+        for(auto& inst : block)
+          if(IsCheck(inst, marker))
+            checks.push_back(Decompose(llvm::cast<llvm::CallInst>(&inst)));
+      return checks;
+    }
+
+    // If nothing with a side effect happens between two checks on the same base, the second check can be merged into the
+    // first one by widening it. The only difference is that an out of bounds access traps slightly earlier, which nothing
+    // can observe.
+    size_t WidenChecks(llvm::Function& fn, llvm::Function* marker)
+    {
+      size_t eliminated = 0;
+      std::vector<Check> open;
+
+      for(auto& block : fn)
+      {
+        open.clear();
+        for(auto i = block.begin(); i != block.end();)
+        {
+          llvm::Instruction& inst = *i++;
+          if(IsCheck(inst, marker))
+          {
+            Check check = Decompose(llvm::cast<llvm::CallInst>(&inst));
+            auto prev   = std::find_if(open.begin(), open.end(), [&check](const Check& c) {
+              return c.base == check.base && c.memory == check.memory;
+            });
+
+            if(prev == open.end())
+              open.push_back(check);
+            else
+            {
+              if(check.extent > prev->extent)
+              {
+                prev->extent = check.extent;
+                prev->call->setArgOperand(
+                  1, llvm::ConstantInt::get(prev->call->getArgOperand(1)->getType(), prev->extent - prev->offset));
+              }
+              inst.eraseFromParent();
+              ++eliminated;
+            }
+          }
+          else if(inst.mayHaveSideEffects() || !llvm::isGuaranteedToTransferExecutionToSuccessor(&inst))
+            open.clear();
+        }
+      }
+
+      return eliminated;
+    }
+
+    // Removes any check that is dominated by a check on the same base that is at least as wide
+    size_t RemoveDominatedChecks(llvm::Function& fn, llvm::Function* marker, llvm::DominatorTree& tree)
+    {
+      size_t eliminated = 0;
+      llvm::DenseMap<std::pair<llvm::Value*, llvm::Value*>, std::vector<Check>> groups;
+
+      for(auto& check : GetChecks(fn, marker))
+        groups[{ check.base, check.memory }].push_back(check);
+
+      for(auto& group : groups)
+      {
+        std::vector<Check>& checks = group.second;
+        std::vector<bool> removed(checks.size(), false);
+
+        for(size_t i = 0; i < checks.size(); ++i)
+          for(size_t j = 0; j < checks.size(); ++j)
+          {
+            if(i == j || removed[j] || checks[j].extent < checks[i].extent ||
+               !tree.dominates(checks[j].call, checks[i].call))
+              continue;
+
+            checks[i].call->eraseFromParent();
+            removed[i] = true;
+            ++eliminated;
+            break;
+          }
+      }
+
+      return eliminated;
+    }
+
+    // Finds the largest value an address can take during any iteration of the loop, or returns null if it can't be bounded
+    const llvm::SCEV* GetMaxAddress(const llvm::SCEV* address, llvm::Loop* loop, const llvm::SCEV* backedges,
+                                    llvm::ScalarEvolution& evolution)
+    {
+      if(evolution.isLoopInvariant(address, loop))
+        return address;
+      if(llvm::isa<llvm::SCEVCouldNotCompute>(backedges))
+        return nullptr;
+
+      if(auto zext = llvm::dyn_cast<llvm::SCEVZeroExtendExpr>(address))
+      {
+        auto max = GetMaxAddress(zext->getOperand(), loop, backedges, evolution);
+        return !max ? nullptr : evolution.getZeroExtendExpr(max, address->getType());
+      }
+
+      // An address that starts at some point and increases by a fixed amount each iteration without wrapping is largest
+      // during the last iteration.
+      if(auto rec = llvm::dyn_cast<llvm::SCEVAddRecExpr>(address))
+      {
+        if(rec->getLoop() == loop && rec->isAffine() && rec->hasNoUnsignedWrap() &&
+           evolution.isKnownNonNegative(rec->getStepRecurrence(evolution)))
+          return rec->evaluateAtIteration(backedges, evolution);
+      }
+
+      return nullptr;
+    }
+
+    // Returns the memory size a check compares against, as it can be read from the preheader of the loop, or null if it
+    // can't be read there. Because memories only grow, reading the size before the loop never lets an access through that
+    // the check inside the loop would have caught.
+    llvm::Value* GetLoopInvariantEnd(llvm::Value* end, llvm::Loop* loop)
+    {
+      if(loop->isLoopInvariant(end))
+        return end;
+      if(auto load = llvm::dyn_cast<llvm::LoadInst>(end))
+        if(load->isSimple() && loop->isLoopInvariant(load->getPointerOperand()))
+          return load;
+      return nullptr;
+    }
+
+    // If every check in a loop can be proven to pass for the entire loop before entering it, the loop is duplicated. The
+    // original copy runs without those checks if a test in the preheader passes, otherwise the copy with all the checks
+    // runs instead, which preserves the exact point where the program would trap.
+    size_t VersionLoop(llvm::Loop* loop, llvm::Function* marker, llvm::DominatorTree& tree, llvm::LoopInfo& info,
+                       llvm::ScalarEvolution& evolution)
+    {
+      struct Covered
+      {
+        llvm::CallInst* call;
+        const llvm::SCEV* max;
+        llvm::Value* end;
+      };
+
+      if(!loop->getSubLoops().empty() ||
+         std::none_of(loop->block_begin(), loop->block_end(), [marker](llvm::BasicBlock* block) {
+           return std::any_of(block->begin(), block->end(), [marker](llvm::Instruction& i) { return IsCheck(i, marker); });
+         }))
+        return 0;
+
+      // This runs before loops are put into canonical form by the rest of the pipeline, so it has to do that itself
+      llvm::simplifyLoop(loop, &tree, &info, &evolution, nullptr, nullptr, false);
+      if(!loop->getSubLoops().empty() || !loop->isLoopSimplifyForm() || !loop->getExitingBlock() ||
+         !loop->getExitBlock())
+        return 0;
+
+      size_t size = 0;
+      for(auto block : loop->blocks())
+        size += block->size();
+      if(size > MAX_VERSIONED_LOOP_SIZE)
+        return 0;
+
+      llvm::BasicBlock* preheader = loop->getLoopPreheader();
+      const llvm::SCEV* backedges = evolution.getBackedgeTakenCount(loop);
+      std::vector<Covered> covered;
+
+      for(auto block : loop->blocks())
+        for(auto& inst : *block)
+        {
+          if(!IsCheck(inst, marker))
+            continue;
+
+          auto call = llvm::cast<llvm::CallInst>(&inst);
+          auto max  = GetMaxAddress(evolution.getSCEV(call->getArgOperand(0)), loop, backedges, evolution);
+          auto end  = GetLoopInvariantEnd(call->getArgOperand(2), loop);
+          if(max != nullptr && end != nullptr && evolution.isLoopInvariant(max, loop) &&
+             evolution.dominates(max, preheader) && llvm::isSafeToExpand(max, evolution))
+            covered.push_back({ call, max, end });
+        }
+
+      if(covered.empty())
+        return 0;
+
+      llvm::formLCSSA(*loop, tree, &info, &evolution);
+
+      // Split the preheader so the test gets its own block, then expand the largest address of each check into it
+      llvm::BasicBlock* test = preheader;
+      preheader              = llvm::SplitBlock(test, test->getTerminator(), &tree, &info);
+      preheader->setName(loop->getHeader()->getName() + ".unchecked");
+
+      llvm::SCEVExpander expander(evolution, test->getModule()->getDataLayout(), "bounds");
+      llvm::IRBuilder<> builder(test->getTerminator());
+      llvm::Value* fail = builder.getFalse();
+
+      for(auto& c : covered)
+      {
+        llvm::Value* end = c.end;
+        if(!loop->isLoopInvariant(end)) // Read the memory size again before the loop
+        {
+          auto load = llvm::cast<llvm::LoadInst>(end);
+          end       = builder.CreateLoad(load->getType(), load->getPointerOperand());
+        }
+
+        llvm::Value* max   = expander.expandCodeFor(c.max, c.call->getArgOperand(0)->getType(), test->getTerminator());
+        llvm::Value* upper = builder.CreateAdd(max, c.call->getArgOperand(1), "", true, true);
+        fail               = builder.CreateOr(fail, builder.CreateICmpUGT(upper, end), "bounds_check_fail");
+      }
+
+      // Clone the loop, which keeps all of its checks, and branch to it if any of the checks might fail
+      llvm::ValueToValueMapTy map;
+      llvm::SmallVector<llvm::BasicBlock*, 8> blocks;
+      llvm::BasicBlock* exit    = loop->getExitBlock();
+      llvm::BasicBlock* exiting = loop->getExitingBlock();
+
+      llvm::Loop* checked = llvm::cloneLoopWithPreheader(preheader, test, loop, map, ".checked", &info, &tree, blocks);
+      llvm::remapInstructionsInBlocks(blocks, map);
+
+      llvm::Instruction* branch = test->getTerminator();
+      llvm::BranchInst::Create(checked->getLoopPreheader(), preheader, fail, branch);
+      branch->eraseFromParent();
+      tree.changeImmediateDominator(exit, test);
+
+      // Because the loop is in LCSSA form, every value it defines that's used outside of it goes through a PHI node in the
+      // exit block, which now also needs the value from the cloned loop.
+      llvm::BasicBlock* exiting_clone = llvm::cast<llvm::BasicBlock>(static_cast<llvm::Value*>(map[exiting]));
+      for(auto& phi : exit->phis())
+      {
+        llvm::Value* v = phi.getIncomingValueForBlock(exiting);
+        auto mapped    = map.find(v);
+        phi.addIncoming(mapped != map.end() ? static_cast<llvm::Value*>(mapped->second) : v, exiting_clone);
+      }
+
+      for(auto& c : covered)
+        c.call->eraseFromParent();
+
+      evolution.forgetLoop(loop);
+      return covered.size();
+    }
+
+    // Shared trap landing pads, keyed by the function they're in and the webassembly function index the check came from,
+    // which can differ once functions have been inlined.
+    typedef std::map<std::pair<llvm::Function*, llvm::Value*>, llvm::PHINode*> TrapPads;
+
+    void LowerCheck(llvm::CallInst* call, TrapPads& pads)
+    {
+      llvm::IRBuilder<> builder(call);
+      llvm::Value* upper = builder.CreateAdd(call->getArgOperand(0), call->getArgOperand(1), "", true, true);
+      llvm::Value* cond  = builder.CreateICmpUGT(upper, call->getArgOperand(2), "invalid_mem_access_cond");
+
+      // Every check from the same function branches to one cold landing pad that reports the location it came from
+      llvm::Function* fn  = call->getFunction();
+      llvm::PHINode*& pad = pads[{ fn, call->getArgOperand(3) }];
+      if(!pad)
+      {
+        llvm::BasicBlock* block = llvm::BasicBlock::Create(fn->getContext(), "trap_out_of_bounds", fn);
+        builder.SetInsertPoint(block);
+        builder.SetCurrentDebugLocation(call->getDebugLoc());
+        pad = builder.CreatePHI(builder.getInt64Ty(), 2, "trap_location");
+        builder.CreateCall(GetTrapFunction(*fn->getParent()),
+                           { builder.getInt32(IN_TRAP_OUT_OF_BOUNDS), call->getArgOperand(3), pad })
+          ->setDoesNotReturn();
+        builder.CreateUnreachable();
+      }
+
+      llvm::BasicBlock* head = call->getParent();
+      llvm::BasicBlock* tail = head->splitBasicBlock(call, "trap_continue");
+      head->getTerminator()->eraseFromParent();
+      builder.SetInsertPoint(head);
+      builder.CreateCondBr(cond, pad->getParent(), tail,
+                           llvm::MDBuilder(fn->getContext()).createBranchWeights(1, TRAP_BRANCH_WEIGHT));
+      pad->addIncoming(call->getArgOperand(4), head);
+      call->eraseFromParent();
+    }
+  }
+}
+
+llvm::PreservedAnalyses BoundsCheckPass::run(llvm::Function& fn, llvm::FunctionAnalysisManager& analyses)
+{
+  llvm::Function* marker = fn.getParent()->getFunction(BOUNDS_CHECK_MARKER);
+  if(!marker || marker->use_empty())
+    return llvm::PreservedAnalyses::all();
+
+  size_t total = bounds::GetChecks(fn, marker).size();
+  if(!total)
+    return llvm::PreservedAnalyses::all();
+
+  _stats.total += total;
+  _stats.eliminated += bounds::WidenChecks(fn, marker);
+  _stats.eliminated += bounds::RemoveDominatedChecks(fn, marker, analyses.getResult<llvm::DominatorTreeAnalysis>(fn));
+
+  if(_hoist)
+  {
+    auto& tree      = analyses.getResult<llvm::DominatorTreeAnalysis>(fn);
+    auto& info      = analyses.getResult<llvm::LoopAnalysis>(fn);
+    auto& evolution = analyses.getResult<llvm::ScalarEvolutionAnalysis>(fn);
+
+    // Collect the loops first, because versioning adds new ones
+    auto loops = info.getLoopsInPreorder();
+    for(auto loop : loops)
+      _stats.eliminated += bounds::VersionLoop(loop, marker, tree, info, evolution);
+  }
+
+  bounds::TrapPads pads;
+  for(auto& check : bounds::GetChecks(fn, marker))
+    bounds::LowerCheck(check.call, pads);
+
+  return llvm::PreservedAnalyses::none();
+}
+
+llvm::Function* innative::GetBoundsCheckMarker(llvm::Module& mod)
+{
+  if(auto marker = mod.getFunction(BOUNDS_CHECK_MARKER))
+    return marker;
+
+  llvm::Type* i32        = llvm::Type::getInt32Ty(mod.getContext());
+  llvm::Type* i64        = llvm::Type::getInt64Ty(mod.getContext());
+  llvm::Function* marker = llvm::Function::Create(
+    llvm::FunctionType::get(llvm::Type::getVoidTy(mod.getContext()), { i64, i64, i64, i32, i64 }, false),
+    llvm::Function::ExternalLinkage, BOUNDS_CHECK_MARKER, &mod);
+
+  // The marker only touches memory the program can't see, so loads and stores can still be optimized around it, but it
+  // deliberately isn't marked as willreturn, so nothing is speculated above it.
+  marker->setDoesNotThrow();
+  marker->setOnlyAccessesInaccessibleMemory();
+  return marker;
+}
+
+llvm::Function* innative::GetTrapFunction(llvm::Module& mod)
+{
+  if(auto trap = mod.getFunction(IN_TRAP_FUNCTION))
+    return trap;
+
+  llvm::Type* i32      = llvm::Type::getInt32Ty(mod.getContext());
+  llvm::Type* i64      = llvm::Type::getInt64Ty(mod.getContext());
+  llvm::Function* trap = llvm::Function::Create(
+    llvm::FunctionType::get(llvm::Type::getVoidTy(mod.getContext()), { i32, i32, i64 }, false),
+    llvm::Function::ExternalLinkage, IN_TRAP_FUNCTION, &mod);
+
+  trap->setDoesNotReturn();
+  trap->setDoesNotThrow();
+  trap->addFnAttr(llvm::Attribute::Cold);
+  return trap;
+}
+
+void innative::LowerBoundsChecks(llvm::Module& mod)
+{
+  llvm::Function* marker = mod.getFunction(BOUNDS_CHECK_MARKER);
+  if(!marker)
+    return;
+
+  bounds::TrapPads pads;
+  while(!marker->use_empty())
+    bounds::LowerCheck(llvm::cast<llvm::CallInst>(marker->user_back()), pads);
+  marker->eraseFromParent();
+}
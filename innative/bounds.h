@@ -0,0 +1,55 @@
+// Copyright (c)2020 Black Sphere Studios
+// For conditions of distribution and use, see copyright notice in innative.h
+
+#ifndef IN__BOUNDS_H
+#define IN__BOUNDS_H
+
+#include "llvm.h"
+#include "innative/export.h"
+#pragma warning(push)
+#pragma warning(disable : 4146 4267 4141 4244 4624)
+#include "llvm/IR/PassManager.h"
+#pragma warning(pop)
+
+namespace innative {
+  // When a module is going to be optimized, memory accesses under ENV_CHECK_MEMORY_ACCESS call this marker instead of
+  // branching to a trap block. The marker traps if base + extent > end, where base is the zero-extended address, extent is
+  // the constant offset plus the access size, and end is the current size of the memory. The last two arguments are the
+  // function index and packed location reported to the trap handler. Because it isn't a branch, the marker keeps the
+  // control flow simple for the optimizer, and because it might not return, nothing gets hoisted above it.
+  static constexpr const char* BOUNDS_CHECK_MARKER = "_innative_internal_bounds_check";
+
+  // Branch weight given to the path that continues past a runtime check, against a weight of 1 for the trap
+  static constexpr uint32_t TRAP_BRANCH_WEIGHT = 2000;
+
+  struct BoundsCheckStats
+  {
+    size_t total;
+    size_t eliminated;
+  };
+
+  // A webassembly memory can only ever grow, so a bounds check that passed is still valid after any amount of other code
+  // runs. This pass takes advantage of that to remove checks dominated by a wider check on the same base address, merge
+  // checks of constant offsets off the same base, and version loops so that checks which can be proven for every iteration
+  // are performed once before the loop. The surviving checks are then lowered into conditional traps.
+  class BoundsCheckPass : public llvm::PassInfoMixin<BoundsCheckPass>
+  {
+  public:
+    BoundsCheckPass(BoundsCheckStats& stats, bool hoist) : _stats(stats), _hoist(hoist) {}
+    llvm::PreservedAnalyses run(llvm::Function& fn, llvm::FunctionAnalysisManager& analyses);
+
+  protected:
+    BoundsCheckStats& _stats;
+    bool _hoist; // Loop versioning duplicates the loop body, so it's skipped when optimizing for size
+  };
+
+  llvm::Function* GetBoundsCheckMarker(llvm::Module& mod);
+
+  // Declares the runtime handler that every trap landing pad calls with the IN_TRAP_CODE, function index and location
+  llvm::Function* GetTrapFunction(llvm::Module& mod);
+
+  // Lowers any markers that survived the optimization pipeline and removes the marker declaration from the module
+  void LowerBoundsChecks(llvm::Module& mod);
+}
+
+#endif
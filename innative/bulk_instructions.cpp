@@ -0,0 +1,269 @@
+// Copyright (c)2020 Black Sphere Studios
+// For conditions of distribution and use, see copyright notice in innative.h
+
+#include "llvm.h"
+#include "compile.h"
+#include "utility.h"
+#include "validate.h"
+
+using namespace innative;
+using namespace utility;
+
+using Func    = llvm::Function;
+using FuncTy  = llvm::FunctionType;
+using llvmTy  = llvm::Type;
+using llvmVal = llvm::Value;
+
+namespace innative::bulk_details {
+  // Constant lengths up to this many bytes are lowered to LLVM's memory intrinsics, which expand them inline. Anything
+  // larger or unknown would be turned into a libc call, which freestanding binaries can't link, so we call the runtime.
+  static constexpr uint64_t INLINE_LIMIT = 64;
+
+  inline bool CanInline(llvmVal* n)
+  {
+    auto c = llvm::dyn_cast<llvm::ConstantInt>(n);
+    return c != nullptr && c->getZExtValue() <= INLINE_LIMIT;
+  }
+}
+
+using namespace innative::bulk_details;
+
+llvmVal* Compiler::GetMemBase(varuint32 memory)
+{
+  return !memory ? static_cast<llvmVal*>(builder.CreateLoad(memlocal)) :
+                   LoadPair(memories[memory], 0, tbaa.mempair);
+}
+
+uint64_t Compiler::GetTableWidth(varuint32 table)
+{
+  return mod->getDataLayout().getTypeAllocSize(
+    tables[table]->getType()->getElementType()->getContainedType(0)->getPointerElementType());
+}
+
+llvmVal* Compiler::GetSegmentSize(const Segment& segment)
+{
+  return !segment.size ? static_cast<llvmVal*>(builder.getInt64(0)) : builder.CreateLoad(segment.size);
+}
+
+// Returns true if [offset, offset + n) elements of the given byte width don't fit inside size bytes. Both operands are
+// 32-bit, so doing the math in 64-bit can never overflow.
+llvmVal* Compiler::GetBulkRangeCheck(llvmVal* offset, llvmVal* n, llvmVal* size, uint64_t scale)
+{
+  llvmVal* end = builder.CreateAdd(builder.CreateZExt(offset, builder.getInt64Ty()),
+                                   builder.CreateZExt(n, builder.getInt64Ty()), "", true, true);
+  if(scale != 1)
+    end = builder.CreateMul(end, builder.getInt64(scale), "", true, true);
+  return builder.CreateICmpUGT(end, size);
+}
+
+void Compiler::CompileBulkCopy(llvmVal* dest, llvmVal* src, llvmVal* n, bool overlap)
+{
+  if(CanInline(n))
+  {
+    if(overlap)
+      builder.CreateMemMove(dest, llvm::MaybeAlign(1), src, llvm::MaybeAlign(1), n);
+    else
+      builder.CreateMemCpy(dest, llvm::MaybeAlign(1), src, llvm::MaybeAlign(1), n);
+    return;
+  }
+
+  Func* fn = overlap ? env_memmove : env_memcpy;
+  builder.CreateCall(fn, { dest, src, n })->setCallingConv(fn->getCallingConv());
+}
+
+IN_ERROR Compiler::CompileMemInit(varuint32 segment, varuint32 memory)
+{
+  if(memory >= memories.size())
+    return ERR_INVALID_MEMORY_INDEX;
+  if(segment >= datasegments.size())
+    return ERR_INVALID_DATA_INDEX;
+
+  IN_ERROR err;
+  llvmVal *dest, *src, *n;
+  if(err = PopType(TE_i32, n))
+    return err;
+  if(err = PopType(TE_i32, src))
+    return err;
+  if(err = PopType(TE_i32, dest))
+    return err;
+
+  // A single check covers both ranges, and the spec requires we trap before writing anything
+  Segment& seg = datasegments[segment];
+  if(env.flags & ENV_CHECK_MEMORY_ACCESS)
+    InsertConditionalTrap(builder.CreateOr(GetBulkRangeCheck(dest, n, GetMemSize(memories[memory]), 1),
+                                           GetBulkRangeCheck(src, n, GetSegmentSize(seg), 1), "memory_init_oob_check"),
+                          IN_TRAP_OUT_OF_BOUNDS);
+
+  if(!seg.data) // Dropped segments can only ever copy zero bytes
+    return ERR_SUCCESS;
+
+  llvmVal* data = builder.CreatePointerCast(seg.data, builder.getInt8PtrTy(0));
+  CompileBulkCopy(builder.CreateInBoundsGEP(GetMemBase(memory), builder.CreateZExt(dest, builder.getInt64Ty())),
+                  builder.CreateInBoundsGEP(data, builder.CreateZExt(src, builder.getInt64Ty())),
+                  builder.CreateZExt(n, builder.getInt64Ty()), false);
+  return ERR_SUCCESS;
+}
+
+IN_ERROR Compiler::CompileMemCopy(varuint32 dest, varuint32 src)
+{
+  if(dest >= memories.size() || src >= memories.size())
+    return ERR_INVALID_MEMORY_INDEX;
+
+  IN_ERROR err;
+  llvmVal *d, *s, *n;
+  if(err = PopType(TE_i32, n))
+    return err;
+  if(err = PopType(TE_i32, s))
+    return err;
+  if(err = PopType(TE_i32, d))
+    return err;
+
+  if(env.flags & ENV_CHECK_MEMORY_ACCESS)
+    InsertConditionalTrap(builder.CreateOr(GetBulkRangeCheck(d, n, GetMemSize(memories[dest]), 1),
+                                           GetBulkRangeCheck(s, n, GetMemSize(memories[src]), 1), "memory_copy_oob_check"),
+                          IN_TRAP_OUT_OF_BOUNDS);
+
+  CompileBulkCopy(builder.CreateInBoundsGEP(GetMemBase(dest), builder.CreateZExt(d, builder.getInt64Ty())),
+                  builder.CreateInBoundsGEP(GetMemBase(src), builder.CreateZExt(s, builder.getInt64Ty())),
+                  builder.CreateZExt(n, builder.getInt64Ty()), true);
+  return ERR_SUCCESS;
+}
+
+IN_ERROR Compiler::CompileMemFill(varuint32 memory)
+{
+  if(memory >= memories.size())
+    return ERR_INVALID_MEMORY_INDEX;
+
+  IN_ERROR err;
+  llvmVal *d, *val, *n;
+  if(err = PopType(TE_i32, n))
+    return err;
+  if(err = PopType(TE_i32, val))
+    return err;
+  if(err = PopType(TE_i32, d))
+    return err;
+
+  if(env.flags & ENV_CHECK_MEMORY_ACCESS)
+    InsertConditionalTrap(GetBulkRangeCheck(d, n, GetMemSize(memories[memory]), 1), IN_TRAP_OUT_OF_BOUNDS);
+
+  llvmVal* ptr = builder.CreateInBoundsGEP(GetMemBase(memory), builder.CreateZExt(d, builder.getInt64Ty()));
+  llvmVal* len = builder.CreateZExt(n, builder.getInt64Ty());
+  if(CanInline(len))
+    builder.CreateMemSet(ptr, builder.CreateTrunc(val, builder.getInt8Ty()), len, llvm::MaybeAlign(1));
+  else
+    builder.CreateCall(env_memset, { ptr, val, len })->setCallingConv(env_memset->getCallingConv());
+  return ERR_SUCCESS;
+}
+
+IN_ERROR Compiler::CompileTableInit(varuint32 segment, varuint32 table)
+{
+  if(table >= tables.size())
+    return ERR_INVALID_TABLE_INDEX;
+  if(segment >= elemsegments.size())
+    return ERR_INVALID_ELEMENT_INDEX;
+
+  IN_ERROR err;
+  llvmVal *dest, *src, *n;
+  if(err = PopType(TE_i32, n))
+    return err;
+  if(err = PopType(TE_i32, src))
+    return err;
+  if(err = PopType(TE_i32, dest))
+    return err;
+
+  // Tables and segments share the same element layout, so initializing a table is just a byte copy
+  uint64_t width = GetTableWidth(table);
+  Segment& seg   = elemsegments[segment];
+  if(env.flags & ENV_CHECK_INDIRECT_CALL)
+    InsertConditionalTrap(builder.CreateOr(GetBulkRangeCheck(dest, n, GetTableSize(tables[table]), width),
+                                           GetBulkRangeCheck(src, n, GetSegmentSize(seg), width), "table_init_oob_check"),
+                          IN_TRAP_OUT_OF_BOUNDS);
+
+  if(!seg.data)
+    return ERR_SUCCESS;
+
+  auto scale = [&](llvmVal* v) {
+    return builder.CreateMul(builder.CreateZExt(v, builder.getInt64Ty()), builder.getInt64(width), "", true, true);
+  };
+
+  llvmVal* base = builder.CreatePointerCast(LoadPair(tables[table], 0, tbaa.tablepair), builder.getInt8PtrTy(0));
+  llvmVal* data = builder.CreatePointerCast(seg.data, builder.getInt8PtrTy(0));
+  CompileBulkCopy(builder.CreateInBoundsGEP(base, scale(dest)), builder.CreateInBoundsGEP(data, scale(src)), scale(n),
+                  false);
+  return ERR_SUCCESS;
+}
+
+IN_ERROR Compiler::CompileTableCopy(varuint32 dest, varuint32 src)
+{
+  if(dest >= tables.size() || src >= tables.size())
+    return ERR_INVALID_TABLE_INDEX;
+
+  IN_ERROR err;
+  llvmVal *d, *s, *n;
+  if(err = PopType(TE_i32, n))
+    return err;
+  if(err = PopType(TE_i32, s))
+    return err;
+  if(err = PopType(TE_i32, d))
+    return err;
+
+  uint64_t width = GetTableWidth(dest);
+  if(width != GetTableWidth(src))
+    return ERR_INVALID_TABLE_ELEMENT_TYPE;
+
+  if(env.flags & ENV_CHECK_INDIRECT_CALL)
+    InsertConditionalTrap(builder.CreateOr(GetBulkRangeCheck(d, n, GetTableSize(tables[dest]), width),
+                                           GetBulkRangeCheck(s, n, GetTableSize(tables[src]), width),
+                                           "table_copy_oob_check"),
+                          IN_TRAP_OUT_OF_BOUNDS);
+
+  auto scale = [&](llvmVal* v) {
+    return builder.CreateMul(builder.CreateZExt(v, builder.getInt64Ty()), builder.getInt64(width), "", true, true);
+  };
+
+  llvmVal* dbase = builder.CreatePointerCast(LoadPair(tables[dest], 0, tbaa.tablepair), builder.getInt8PtrTy(0));
+  llvmVal* sbase = builder.CreatePointerCast(LoadPair(tables[src], 0, tbaa.tablepair), builder.getInt8PtrTy(0));
+  CompileBulkCopy(builder.CreateInBoundsGEP(dbase, scale(d)), builder.CreateInBoundsGEP(sbase, scale(s)), scale(n), true);
+  return ERR_SUCCESS;
+}
+
+IN_ERROR Compiler::CompileSegmentDrop(Segment& segment)
+{
+  if(segment.size) // Segments that were never passive are already dropped
+    builder.CreateStore(builder.getInt64(0), segment.size, false);
+  return ERR_SUCCESS;
+}
+
+IN_ERROR Compiler::CompileMiscInstruction(Instruction& ins)
+{
+  switch(ins.opcode[1])
+  {
+  case OP_i32_trunc_sat_f32_s:
+  case OP_i32_trunc_sat_f32_u:
+    return CompileTruncSatOp(TE_f32, builder.getInt32Ty(), ins.opcode[1] == OP_i32_trunc_sat_f32_s, OP::NAMES[ins.opcode]);
+  case OP_i32_trunc_sat_f64_s:
+  case OP_i32_trunc_sat_f64_u:
+    return CompileTruncSatOp(TE_f64, builder.getInt32Ty(), ins.opcode[1] == OP_i32_trunc_sat_f64_s, OP::NAMES[ins.opcode]);
+  case OP_i64_trunc_sat_f32_s:
+  case OP_i64_trunc_sat_f32_u:
+    return CompileTruncSatOp(TE_f32, builder.getInt64Ty(), ins.opcode[1] == OP_i64_trunc_sat_f32_s, OP::NAMES[ins.opcode]);
+  case OP_i64_trunc_sat_f64_s:
+  case OP_i64_trunc_sat_f64_u:
+    return CompileTruncSatOp(TE_f64, builder.getInt64Ty(), ins.opcode[1] == OP_i64_trunc_sat_f64_s, OP::NAMES[ins.opcode]);
+  case OP_memory_init: return CompileMemInit(ins.immediates[0]._varuint32, ins.immediates[1]._varuint32);
+  case OP_data_drop:
+    if(ins.immediates[0]._varuint32 >= datasegments.size())
+      return ERR_INVALID_DATA_INDEX;
+    return CompileSegmentDrop(datasegments[ins.immediates[0]._varuint32]);
+  case OP_memory_copy: return CompileMemCopy(ins.immediates[0]._varuint32, ins.immediates[1]._varuint32);
+  case OP_memory_fill: return CompileMemFill(ins.immediates[0]._varuint32);
+  case OP_table_init: return CompileTableInit(ins.immediates[0]._varuint32, ins.immediates[1]._varuint32);
+  case OP_elem_drop:
+    if(ins.immediates[0]._varuint32 >= elemsegments.size())
+      return ERR_INVALID_ELEMENT_INDEX;
+    return CompileSegmentDrop(elemsegments[ins.immediates[0]._varuint32]);
+  case OP_table_copy: return CompileTableCopy(ins.immediates[0]._varuint32, ins.immediates[1]._varuint32);
+  }
+
+  return ERR_FATAL_UNKNOWN_INSTRUCTION;
+}
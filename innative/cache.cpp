@@ -0,0 +1,453 @@
+// Copyright (c)2020 Black Sphere Studios
+// For conditions of distribution and use, see copyright notice in innative.h
+
+#include "llvm.h"
+#include "cache.h"
+#include "compile.h"
+#include "utility.h"
+#pragma warning(push)
+#pragma warning(disable : 4146 4267 4141 4244 4624)
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Config/llvm-config.h"
+#include "llvm/Support/SHA1.h"
+#pragma warning(pop)
+#include <algorithm>
+#include <random>
+#include <thread>
+
+using namespace innative;
+using namespace utility;
+
+namespace innative {
+  // Increment this whenever code generation changes in a way that makes previously cached objects invalid
+  static constexpr int IN_OBJECT_CACHE_VERSION = 1;
+
+  template<class T> inline void HashValue(llvm::SHA1& hash, const T& v)
+  {
+    hash.update(llvm::ArrayRef<uint8_t>(reinterpret_cast<const uint8_t*>(&v), sizeof(T)));
+  }
+
+  // Strings are length prefixed so that adjacent strings can't be confused with each other
+  inline void HashString(llvm::SHA1& hash, const char* s, size_t len)
+  {
+    HashValue(hash, len);
+    hash.update(llvm::StringRef(s, len));
+  }
+  inline void HashString(llvm::SHA1& hash, const ByteArray& s) { HashString(hash, s.str(), s.size()); }
+  inline void HashString(llvm::SHA1& hash, const std::string& s) { HashString(hash, s.data(), s.size()); }
+  inline void HashString(llvm::SHA1& hash, const char* s) { HashString(hash, !s ? "" : s, !s ? 0 : strlen(s)); }
+
+  inline bool IsDigestValid(const Module& m)
+  {
+    for(auto b : m.digest)
+      if(b != 0)
+        return true;
+    return false;
+  }
+}
+
+void innative::HashModuleSource(Module& m, const void* data, size_t size)
+{
+  auto digest = llvm::SHA1::hash(llvm::ArrayRef<uint8_t>(reinterpret_cast<const uint8_t*>(data), size));
+  static_assert(sizeof(m.digest) == sizeof(digest), "Module digest must be the size of a SHA1 hash");
+  std::copy(digest.begin(), digest.end(), m.digest);
+}
+
+ObjectCache::ObjectCache(Environment& env, const path& dir, const std::string& target) :
+  _env(env), _dir(dir), _target(target), _clock(0), _base(0), _enabled(env.cachelimit > 0), _dirty(false)
+{
+  _env.cachehits   = 0;
+  _env.cachemisses = 0;
+
+  if(!Enabled())
+    return;
+
+  // Modules can re-export things from other modules, which creates aliases inside the object file of the module that
+  // originally defined them. This means a module's object file depends on how every other module is linked together, so
+  // we hash the imports and exports of the entire environment and make it part of every key.
+  llvm::SHA1 hash;
+  HashString(hash, _env.system);
+
+  for(size_t i = 0; i < _env.n_modules; ++i)
+  {
+    const Module& m = _env.modules[i];
+    HashString(hash, m.name);
+    HashValue(hash, m.knownsections & (1 << WASM_SECTION_START));
+
+    for(varuint32 j = 0; j < m.importsection.n_import; ++j)
+    {
+      const Import& imp = m.importsection.imports[j];
+      HashString(hash, imp.module_name);
+      HashString(hash, imp.export_name);
+      HashValue(hash, imp.kind);
+      HashValue(hash, imp.alternate);
+      HashValue(hash, imp.ignore);
+    }
+
+    for(varuint32 j = 0; j < m.exportsection.n_exports; ++j)
+    {
+      const Export& e = m.exportsection.exports[j];
+      HashString(hash, e.name);
+      HashValue(hash, e.kind);
+      HashValue(hash, e.index);
+    }
+  }
+
+  // Embeddings decide which imports are resolved as C functions. The hash order is not stable, so we sort them first.
+  std::vector<std::string> cimports;
+  for(khiter_t iter = kh_begin(_env.cimports); iter != kh_end(_env.cimports); ++iter)
+    if(kh_exist(_env.cimports, iter))
+      cimports.emplace_back(kh_key(_env.cimports, iter).str(), kh_key(_env.cimports, iter).size());
+
+  std::sort(cimports.begin(), cimports.end());
+  for(auto& s : cimports)
+    HashString(hash, s);
+
+  // A profile changes how every module is optimized, so its contents are part of the key, not just its path
+  if(_env.profile)
+  {
+    size_t sz;
+    auto profile = LoadFile(GetPath(_env.profile), sz);
+    if(profile)
+      hash.update(llvm::ArrayRef<uint8_t>(profile.get(), sz));
+  }
+
+  _interface = llvm::toHex(hash.final(), true);
+
+  std::error_code ec;
+  create_directories(_dir, ec);
+  if(ec)
+  {
+    if(_env.loglevel >= LOG_WARNING)
+      fprintf(_env.log, "WARNING: Disabling object cache because %s could not be created: %s\n", _dir.u8string().c_str(),
+              ec.message().c_str());
+    _enabled = false;
+    return;
+  }
+
+  _clock = _base = ReadIndex(_entries);
+}
+
+ObjectCache::~ObjectCache() { Flush(); }
+
+std::string ObjectCache::GetKey(varuint32 index) const
+{
+  const Module& m = _env.modules[index];
+  if(!Enabled() || !IsDigestValid(m))
+    return std::string();
+
+  llvm::SHA1 hash;
+  HashValue(hash, IN_OBJECT_CACHE_VERSION);
+  HashValue(hash, INNATIVE_VERSION(INNATIVE_VERSION_MAJOR, INNATIVE_VERSION_MINOR, INNATIVE_VERSION_REVISION, 0));
+  HashString(hash, LLVM_VERSION_STRING);
+  HashString(hash, _target);
+  HashString(hash, _interface);
+  HashValue(hash, _env.flags);
+  HashValue(hash, _env.optimize);
+  HashValue(hash, _env.features);
+  HashString(hash, m.name);
+  HashString(hash, m.filepath); // Debug information references the source file
+  hash.update(llvm::ArrayRef<uint8_t>(m.digest));
+
+  // The first module also contains the entry point, which calls the init, exit and start functions of every module.
+  if(!index)
+  {
+    for(size_t i = 1; i < _env.n_modules; ++i)
+    {
+      if(!IsDigestValid(_env.modules[i]))
+        return std::string();
+      hash.update(llvm::ArrayRef<uint8_t>(_env.modules[i].digest));
+    }
+  }
+
+  return llvm::toHex(hash.final(), true);
+}
+
+bool ObjectCache::Fetch(Compiler& compiler)
+{
+  if(compiler.cachekey.empty() || compiler.objfile.empty())
+    return false;
+
+  std::unique_lock<std::mutex> lock(_lock);
+  auto iter = _entries.find(compiler.cachekey);
+  if(iter != _entries.end())
+  {
+    std::error_code ec;
+    copy_file(GetObjectPath(compiler.cachekey), compiler.objfile, copy_options::overwrite_existing, ec);
+    if(!ec)
+    {
+      if(exists(GetNatVisPath(compiler.cachekey)))
+      {
+        size_t sz;
+        auto natvis = LoadFile(GetNatVisPath(compiler.cachekey), sz);
+        if(natvis)
+          compiler.natvis.assign(reinterpret_cast<const char*>(natvis.get()), sz);
+      }
+
+      compiler.startsym  = iter->second.start;
+      compiler.fromcache = true;
+      iter->second.stamp = ++_clock;
+      _dirty             = true;
+      ++_env.cachehits;
+      return true;
+    }
+
+    // Another process evicted this entry before we could copy it, so we forget about it.
+    _entries.erase(iter);
+    _dirty = true;
+  }
+
+  ++_env.cachemisses;
+  return false;
+}
+
+IN_ERROR ObjectCache::Store(Compiler& compiler)
+{
+  if(compiler.cachekey.empty() || compiler.fromcache)
+    return ERR_SUCCESS;
+
+  std::error_code ec;
+  path target = GetObjectPath(compiler.cachekey);
+  path temp   = GetTempPath(target);
+
+  // Copy into a temporary file first and then rename it, so other processes can never observe a partial object file
+  uint64_t size = file_size(compiler.objfile, ec);
+  if(!ec)
+    copy_file(compiler.objfile, temp, copy_options::overwrite_existing, ec);
+  if(!ec && !compiler.natvis.empty())
+  {
+    path natvis = GetTempPath(GetNatVisPath(compiler.cachekey));
+    if(!DumpFile(natvis, compiler.natvis.data(), compiler.natvis.size()))
+      ec = std::make_error_code(std::errc::io_error);
+    else
+      rename(natvis, GetNatVisPath(compiler.cachekey), ec);
+  }
+  if(!ec)
+    rename(temp, target, ec);
+
+  if(ec)
+  {
+    remove(temp, ec);
+    if(_env.loglevel >= LOG_WARNING)
+      fprintf(_env.log, "WARNING: Failed to add %s to the object cache\n", compiler.objfile.u8string().c_str());
+    return ERR_FATAL_FILE_ERROR;
+  }
+
+  std::unique_lock<std::mutex> lock(_lock);
+  _entries[compiler.cachekey] = { size + compiler.natvis.size(), ++_clock, compiler.startsym };
+  _dirty                      = true;
+  return ERR_SUCCESS;
+}
+
+IN_ERROR ObjectCache::Flush()
+{
+  std::unique_lock<std::mutex> lock(_lock);
+  if(!Enabled() || !_dirty)
+    return ERR_SUCCESS;
+
+  // Other processes sharing the cache could have changed the index since we read it, so we merge their changes into ours
+  // right before writing it back, and hold the lock file until the new index is in place so nobody can write in between.
+  if(!LockIndex())
+  {
+    if(_env.loglevel >= LOG_WARNING)
+      fprintf(_env.log, "WARNING: Failed to lock the object cache index in %s\n", _dir.u8string().c_str());
+    return ERR_FATAL_FILE_ERROR;
+  }
+
+  MergeIndex();
+
+  uint64_t total = 0;
+  for(auto& e : _entries)
+    total += e.second.size;
+
+  if(total > _env.cachelimit)
+  {
+    std::vector<std::unordered_map<std::string, Entry>::iterator> lru;
+    for(auto iter = _entries.begin(); iter != _entries.end(); ++iter)
+      lru.push_back(iter);
+
+    std::sort(lru.begin(), lru.end(), [](auto& l, auto& r) { return l->second.stamp < r->second.stamp; });
+
+    for(size_t i = 0; i < lru.size() && total > _env.cachelimit; ++i)
+    {
+      std::error_code ec;
+      remove(GetObjectPath(lru[i]->first), ec);
+      remove(GetNatVisPath(lru[i]->first), ec);
+      total -= lru[i]->second.size;
+      _entries.erase(lru[i]);
+    }
+  }
+
+  // Entries are stored as "<key> <size> <stamp> <length>:<start symbol>", because the start symbol can contain spaces.
+  path index = _dir / IN_OBJECT_CACHE_INDEX;
+  path temp  = GetTempPath(index);
+  FILE* f;
+  FOPEN(f, temp.c_str(), "wb");
+  if(!f)
+  {
+    UnlockIndex();
+    return ERR_FATAL_FILE_ERROR;
+  }
+
+  fprintf(f, "innative-cache %i %llu\n", IN_OBJECT_CACHE_VERSION, static_cast<unsigned long long>(_clock));
+  for(auto& e : _entries)
+  {
+    fprintf(f, "%s %llu %llu %zu:", e.first.c_str(), static_cast<unsigned long long>(e.second.size),
+            static_cast<unsigned long long>(e.second.stamp), e.second.start.size());
+    fwrite(e.second.start.data(), 1, e.second.start.size(), f);
+    fputc('\n', f);
+  }
+
+  std::error_code ec;
+  if(fclose(f) != 0)
+    ec = std::make_error_code(std::errc::io_error);
+  else
+    rename(temp, index, ec);
+
+  UnlockIndex();
+  if(ec)
+  {
+    remove(temp, ec);
+    return ERR_FATAL_FILE_ERROR;
+  }
+
+  _base  = _clock;
+  _dirty = false;
+  if(_env.loglevel >= LOG_NOTICE)
+    fprintf(_env.log, "Object cache: %zu hits, %zu misses, %zu entries using %llu bytes.\n", _env.cachehits,
+            _env.cachemisses, _entries.size(), static_cast<unsigned long long>(total));
+  return ERR_SUCCESS;
+}
+
+// Reads every entry of the index on disk into entries, and returns the clock stored in it
+uint64_t ObjectCache::ReadIndex(std::unordered_map<std::string, Entry>& entries)
+{
+  size_t sz   = 0;
+  auto buffer = LoadFile(_dir / IN_OBJECT_CACHE_INDEX, sz);
+  if(!buffer)
+    return 0; // The cache is empty
+
+  std::string index(reinterpret_cast<const char*>(buffer.get()), sz);
+  const char* cur = index.c_str();
+  const char* end = cur + index.size();
+  int version     = 0;
+  int n           = 0;
+  unsigned long long clock;
+
+  if(sscanf(cur, "innative-cache %i %llu\n%n", &version, &clock, &n) < 2 || version != IN_OBJECT_CACHE_VERSION)
+  {
+    if(_env.loglevel >= LOG_NOTICE)
+      fprintf(_env.log, "Discarding object cache with unrecognized index %s\n",
+              (_dir / IN_OBJECT_CACHE_INDEX).u8string().c_str());
+    return 0;
+  }
+
+  cur += n;
+
+  while(cur < end)
+  {
+    char key[41];
+    unsigned long long size, stamp;
+    size_t len;
+    if(sscanf(cur, "%40s %llu %llu %zu:%n", key, &size, &stamp, &len, &n) < 4 || cur + n + len >= end)
+      break; // A corrupt entry means we can't trust anything after it
+
+    cur += n;
+    entries[key] = { size, stamp, std::string(cur, len) };
+    cur += len + 1;
+  }
+
+  return clock;
+}
+
+void ObjectCache::MergeIndex()
+{
+  std::unordered_map<std::string, Entry> disk;
+  uint64_t clock = ReadIndex(disk);
+
+  // Every entry we used since we last read the index was used after anything the index on disk recorded since then
+  if(clock > _base)
+  {
+    for(auto& e : _entries)
+      if(e.second.stamp > _base)
+        e.second.stamp += clock - _base;
+    _clock += clock - _base;
+  }
+
+  // An entry missing from one side was either added by that process or evicted by the other, which also removed its
+  // object file, so the object file tells us which one it was.
+  std::error_code ec;
+  for(auto iter = _entries.begin(); iter != _entries.end();)
+  {
+    if(!disk.count(iter->first) && !exists(GetObjectPath(iter->first), ec))
+      iter = _entries.erase(iter);
+    else
+      ++iter;
+  }
+
+  for(auto& e : disk)
+  {
+    auto iter = _entries.find(e.first);
+    if(iter != _entries.end())
+      iter->second.stamp = std::max(iter->second.stamp, e.second.stamp);
+    else if(exists(GetObjectPath(e.first), ec))
+      _entries.insert(e);
+  }
+
+  _clock = std::max(_clock, clock);
+}
+
+// The lock file is created exclusively, so only one process can hold it. If it's still there after a few seconds, the
+// process holding it most likely died before removing it, so we take it over.
+bool ObjectCache::LockIndex()
+{
+  path lock = _dir / IN_OBJECT_CACHE_LOCK;
+  for(int tries = 0; tries < 2; ++tries)
+  {
+    for(int i = 0; i < 500; ++i)
+    {
+      FILE* f;
+      FOPEN(f, lock.c_str(), "wx");
+      if(f)
+      {
+        fclose(f);
+        return true;
+      }
+
+      std::error_code ec;
+      if(!exists(lock, ec)) // We couldn't create the file for some other reason, so waiting won't help
+        return false;
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    std::error_code ec;
+    remove(lock, ec);
+  }
+
+  return false;
+}
+
+void ObjectCache::UnlockIndex()
+{
+  std::error_code ec;
+  remove(_dir / IN_OBJECT_CACHE_LOCK, ec);
+}
+
+path ObjectCache::GetObjectPath(const std::string& key) const
+{
+#ifdef IN_PLATFORM_WIN32
+  return _dir / (key + ".obj");
+#else
+  return _dir / (key + ".o");
+#endif
+}
+
+path ObjectCache::GetNatVisPath(const std::string& key) const { return _dir / (key + ".natvis"); }
+
+path ObjectCache::GetTempPath(const path& file) const
+{
+  static thread_local std::mt19937_64 rng(std::random_device{}());
+  path temp = file;
+  temp += "." + std::to_string(rng()) + ".tmp";
+  return temp;
+}
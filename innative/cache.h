@@ -0,0 +1,68 @@
+// Copyright (c)2020 Black Sphere Studios
+// For conditions of distribution and use, see copyright notice in innative.h
+
+#ifndef IN__CACHE_H
+#define IN__CACHE_H
+
+#include "innative/schema.h"
+#include "filesys.h"
+#include <string>
+#include <unordered_map>
+#include <mutex>
+
+namespace innative {
+  struct Compiler;
+
+  // Writes the SHA1 hash of a module's source into its digest, which is used as part of the object cache key
+  void HashModuleSource(Module& m, const void* data, size_t size);
+
+  // A persistent, content-addressed store of compiled object files. Each entry is keyed by a hash of the module source
+  // and everything else that can change the generated code, so a module whose key is found never has to be compiled
+  // again. Entries are written atomically, and once the cache grows past env.cachelimit, the least recently used entries
+  // are evicted. Several processes can share a cache, because each one merges its changes into the index on disk while
+  // holding a lock file.
+  class ObjectCache
+  {
+  public:
+    ObjectCache(Environment& env, const path& dir, const std::string& target);
+    ~ObjectCache();
+    // Returns an empty key if the module can't be cached
+    std::string GetKey(varuint32 index) const;
+    // Copies a cached object file to the compiler's object file path, and returns false on a cache miss
+    bool Fetch(Compiler& compiler);
+    // Adds a freshly compiled object file to the cache
+    IN_ERROR Store(Compiler& compiler);
+    // Merges in the index on disk, evicts entries until the cache fits inside the size limit, then writes the index back
+    IN_ERROR Flush();
+    inline bool Enabled() const { return _enabled; }
+
+  protected:
+    struct Entry
+    {
+      uint64_t size;
+      uint64_t stamp; // Value of the cache clock when this entry was last used
+      std::string start;
+    };
+
+    uint64_t ReadIndex(std::unordered_map<std::string, Entry>& entries);
+    void MergeIndex();
+    bool LockIndex();
+    void UnlockIndex();
+    path GetObjectPath(const std::string& key) const;
+    path GetNatVisPath(const std::string& key) const;
+    path GetTempPath(const path& file) const;
+
+    Environment& _env;
+    path _dir;
+    std::string _target; // Target triple, CPU and feature set the modules are being compiled for
+    std::string _interface;
+    std::unordered_map<std::string, Entry> _entries;
+    uint64_t _clock; // Incremented every time an entry is used, which lets us find the least recently used entries
+    uint64_t _base;  // Value of the clock in the index on disk when we last read or wrote it
+    bool _enabled;
+    bool _dirty;
+    std::mutex _lock;
+  };
+}
+
+#endif
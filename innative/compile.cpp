@@ -4,9 +4,15 @@
 #include "llvm.h"
 #include "utility.h"
 #include "optimize.h"
+#include "bounds.h"
+#include "multiversion.h"
+#include "instance.h"
+#include "snapshot.h"
 #include "compile.h"
 #include "debug.h"
 #include "link.h"
+#include "cache.h"
+#include "threadpool.h"
 #include "innative/export.h"
 
 #define DIVIDER ":"
@@ -34,6 +40,7 @@ llvmTy* Compiler::GetLLVMType(varsint7 type)
   case TE_i64: return llvmTy::getInt64Ty(ctx);
   case TE_f32: return llvmTy::getFloatTy(ctx);
   case TE_f64: return llvmTy::getDoubleTy(ctx);
+  case TE_v128: return llvm::VectorType::get(llvmTy::getInt32Ty(ctx), 4); // v128 values are canonically i32x4
   case TE_void: return llvmTy::getVoidTy(ctx);
   case TE_funcref:
     return FuncTy::get(llvmTy::getVoidTy(ctx), false)->getPointerTo(0); // placeholder (*void)() function pointer
@@ -50,6 +57,8 @@ WASM_TYPE_ENCODING Compiler::GetTypeEncoding(llvmTy* t)
     return TE_f32;
   if(t->isDoubleTy())
     return TE_f64;
+  if(t->isVectorTy() && t->getPrimitiveSizeInBits() == 128)
+    return TE_v128;
   if(t->isVoidTy())
     return TE_void;
   if(t->isIntegerTy() && static_cast<llvm::IntegerType*>(t)->getBitWidth() == 32)
@@ -146,7 +155,9 @@ Func* Compiler::HomogenizeFunction(Func* fn, llvm::StringRef name, const llvm::T
 Func* Compiler::PassFunction(Func* fn, llvm::StringRef name, const llvm::Twine& canonical,
                              llvm::GlobalValue::LinkageTypes linkage, llvm::CallingConv::ID callconv)
 {
-  // fn->setCallingConv(callconv);
+  if(fn->getCallingConv() != callconv) // Function bodies can only be passed through if they already use this convention
+    return WrapFunction(fn, name, canonical, linkage, callconv);
+
   fn->setLinkage(linkage);
   fn->setName(canonical);
   if(fn->getSubprogram())
@@ -197,6 +208,7 @@ bool Compiler::CheckType(varsint7 ty, llvmVal* v)
   case TE_i64: return t->isIntegerTy() && static_cast<llvm::IntegerType*>(t)->getBitWidth() == 64;
   case TE_f32: return t->isFloatTy();
   case TE_f64: return t->isDoubleTy();
+  case TE_v128: return t->isVectorTy() && t->getPrimitiveSizeInBits() == 128;
   case TE_void: return t->isVoidTy();
   case TE_cref: return t->isPointerTy() && t->getPointerElementType()->isIntegerTy();
   }
@@ -229,12 +241,13 @@ IN_ERROR Compiler::PopType(varsint7 ty, llvmVal*& v, bool peek)
     case TE_i64: v = builder.getInt64(0); break;
     case TE_f32: v = ConstantFP::get(builder.getFloatTy(), 0.0f); break;
     case TE_f64: v = ConstantFP::get(builder.getDoubleTy(), 0.0f); break;
+    case TE_v128: v = llvm::Constant::getNullValue(GetLLVMType(TE_v128)); break;
     default: return ERR_INVALID_TYPE;
     }
   }
   else if(ty == TE_cref && values.Peek()->getType()->isIntegerTy())
   { // If this is true, we need to do an int -> cref conversion
-    v = builder.CreatePtrToInt(builder.CreateLoad(GetPairPtr(memories[0], 0)), builder.getInt64Ty());
+    v = builder.CreatePtrToInt(LoadPair(memories[0], 0, tbaa.mempair), builder.getInt64Ty());
     v = builder.CreateAdd(builder.CreateZExt(peek ? values.Peek() : values.Pop(), builder.getInt64Ty()), v, "", true, true);
     v = builder.CreateIntToPtr(v, GetLLVMType(TE_cref));
     return ERR_SUCCESS;
@@ -261,6 +274,16 @@ llvmVal* Compiler::GetPairPtr(llvm::GlobalVariable* v, int index)
 {
   return builder.CreateInBoundsGEP(v, { builder.getInt32(0), builder.getInt32(index) });
 }
+
+llvm::LoadInst* Compiler::LoadPair(llvm::GlobalVariable* v, int index, llvm::MDNode* tag)
+{
+  return TagAccess(builder.CreateLoad(GetPairPtr(v, index)), tag);
+}
+
+llvm::StoreInst* Compiler::StorePair(llvmVal* value, llvm::GlobalVariable* v, int index, llvm::MDNode* tag)
+{
+  return TagAccess(builder.CreateStore(value, GetPairPtr(v, index), false), tag);
+}
 llvm::Constant* Compiler::GetPairNull(llvm::StructType* ty)
 {
   return llvm::ConstantStruct::get(ty, llvm::ConstantPointerNull::get(llvm::cast<llvm::PointerType>(ty->getElementType(0))),
@@ -382,16 +405,34 @@ void Compiler::PolymorphicStack()
   builder.SetInsertPoint(graveyard);
 }
 
-IN_ERROR Compiler::InsertConditionalTrap(llvmVal* cond)
+// Returns the landing pad for the given kind of trap in the current function, creating it if necessary, and registers the
+// current block as a predecessor that will branch to it from the current instruction. Sharing one cold pad per kind keeps
+// the checks themselves down to a compare and a branch, while still telling the runtime which instruction failed.
+Compiler::BB* Compiler::GetTrapBlock(IN_TRAP_CODE code)
 {
-  // Define a failure block that all errors jump to via a conditional branch which simply traps
-  auto trapblock = BB::Create(ctx, "trap_block", builder.GetInsertBlock()->getParent());
-  auto contblock = BB::Create(ctx, "trap_continue", builder.GetInsertBlock()->getParent());
+  Func* fn            = builder.GetInsertBlock()->getParent();
+  llvm::PHINode*& pad = trappads[code];
+  if(!pad || pad->getFunction() != fn)
+  {
+    BB* prev  = builder.GetInsertBlock();
+    BB* block = BB::Create(ctx, "trap_block", fn);
+    builder.SetInsertPoint(block);
+    pad = builder.CreatePHI(builder.getInt64Ty(), 2, "trap_location");
+    builder.CreateCall(trap, { builder.getInt32(code), builder.getInt32(trapfunction), pad })->setDoesNotReturn();
+    builder.CreateUnreachable();
+    builder.SetInsertPoint(prev);
+  }
+
+  pad->addIncoming(builder.getInt64(traplocation), builder.GetInsertBlock());
+  return pad->getParent();
+}
 
-  builder.CreateCondBr(cond, trapblock, contblock);
-  builder.SetInsertPoint(trapblock);
-  CompileTrap();
+IN_ERROR Compiler::InsertConditionalTrap(llvmVal* cond, IN_TRAP_CODE code)
+{
+  auto contblock = BB::Create(ctx, "trap_continue", builder.GetInsertBlock()->getParent());
 
+  builder.CreateCondBr(cond, GetTrapBlock(code), contblock,
+                       llvm::MDBuilder(ctx).createBranchWeights(1, TRAP_BRANCH_WEIGHT));
   builder.SetInsertPoint(contblock);
   return ERR_SUCCESS;
 }
@@ -399,7 +440,6 @@ IN_ERROR Compiler::InsertConditionalTrap(llvmVal* cond)
 llvmVal* Compiler::GetMemPointer(llvmVal* base, llvm::PointerType* pointer_type, varuint32 memory, varuint32 offset)
 {
   assert(memories.size() > 0);
-  llvmVal* src          = !memory ? memlocal : static_cast<llvmVal*>(GetPairPtr(memories[memory], 0));
   llvm::IntegerType* ty = machine->getPointerSizeInBits(memory) == 32 ? builder.getInt32Ty() : builder.getInt64Ty();
 
   // If our native integer size is larger than the webassembly memory pointer size, then overflow is not possible and we
@@ -408,13 +448,23 @@ llvmVal* Compiler::GetMemPointer(llvmVal* base, llvm::PointerType* pointer_type,
   base        = builder.CreateZExtOrTrunc(base, ty);
 
   llvmVal* loc;
-  if(env.flags & ENV_CHECK_MEMORY_ACCESS) // In strict mode, generate a check that traps if this is an invalid memory access
+  // In strict mode, generate a check that traps if this is an invalid memory access, unless guard pages already catch it
+  if((env.flags & ENV_CHECK_MEMORY_ACCESS) && !guardpages)
   {
     llvmVal* end = builder.CreateIntCast(GetMemSize(memories[memory]), ty, false);
     llvmVal* cond;
     Func* uadd_with_overflow = llvm::Intrinsic::getDeclaration(mod, llvm::Intrinsic::uadd_with_overflow, { ty });
 
-    if(bypass) // If we can bypass the overflow check because we have enough bits, only check the upper bound
+    if(bypass && bounds_check) // Let the optimizer eliminate or hoist the check before it gets lowered into a trap
+    {
+      loc = builder.CreateAdd(base, CInt::get(ty, offset, false), "", true, true);
+      builder.CreateCall(
+        bounds_check,
+        { base,
+          CInt::get(ty, uint64_t(offset) + pointer_type->getPointerElementType()->getPrimitiveSizeInBits() / 8, false),
+          end, builder.getInt32(trapfunction), builder.getInt64(traplocation) });
+    }
+    else if(bypass) // If we can bypass the overflow check because we have enough bits, only check the upper bound
     {
       loc = builder.CreateAdd(base, CInt::get(ty, offset, false), "", true, true);
       auto upper =
@@ -436,12 +486,15 @@ llvmVal* Compiler::GetMemPointer(llvmVal* base, llvm::PointerType* pointer_type,
                               "invalid_mem_access_cond");
     }
 
-    InsertConditionalTrap(cond);
+    if(!bypass || !bounds_check)
+      InsertConditionalTrap(cond, IN_TRAP_OUT_OF_BOUNDS);
   }
   else
     loc = builder.CreateAdd(base, CInt::get(ty, offset, false), "", true, true);
 
-  return builder.CreatePointerCast(builder.CreateInBoundsGEP(builder.CreateLoad(src), loc), pointer_type);
+  llvmVal* src =
+    !memory ? static_cast<llvmVal*>(builder.CreateLoad(memlocal)) : LoadPair(memories[memory], 0, tbaa.mempair);
+  return builder.CreatePointerCast(builder.CreateInBoundsGEP(src, loc), pointer_type);
 }
 
 IN_ERROR Compiler::InsertTruncTrap(double max, double min, llvm::Type* ty)
@@ -456,7 +509,8 @@ IN_ERROR Compiler::InsertTruncTrap(double max, double min, llvm::Type* ty)
                                                                 builder.getInt64(0x7FF0000000000000)),
                                               builder.getInt64(0x7FF0000000000000))),
       builder.CreateOr(builder.CreateFCmpOGT(values.Peek(), ConstantFP::get(ty, max)),
-                       builder.CreateFCmpOLT(values.Peek(), ConstantFP::get(ty, min)))));
+                       builder.CreateFCmpOLT(values.Peek(), ConstantFP::get(ty, min)))),
+      IN_TRAP_INTEGER_OVERFLOW);
   }
   return ERR_SUCCESS;
 };
@@ -480,6 +534,7 @@ void Compiler::DumpCompilerState()
       case TE_i64: fputs(" i64", out); break;
       case TE_f32: fputs(" f32", out); break;
       case TE_f64: fputs(" f64", out); break;
+      case TE_v128: fputs(" v128", out); break;
       }
   }
 
@@ -494,6 +549,7 @@ void Compiler::DumpCompilerState()
     case TE_i64: fputs(" i64", out); break;
     case TE_f32: fputs(" f32", out); break;
     case TE_f64: fputs(" f64", out); break;
+    case TE_v128: fputs(" v128", out); break;
     }
 
     FPRINTF(out, ":%i", (int)control[i].op);
@@ -559,9 +615,10 @@ const Compiler::Intrinsic* Compiler::GetIntrinsic(Import& imp)
   return nullptr;
 }
 
-Func* Compiler::TopLevelFunction(llvm::LLVMContext& context, llvm::IRBuilder<>& builder, const char* name, llvm::Module* m)
+Func* Compiler::TopLevelFunction(llvm::LLVMContext& context, llvm::IRBuilder<>& builder, const char* name, llvm::Module* m,
+                                 FuncTy* type)
 {
-  Func* fn = Func::Create(FuncTy::get(builder.getVoidTy(), false), Func::ExternalLinkage, name, m);
+  Func* fn = Func::Create(type ? type : FuncTy::get(builder.getVoidTy(), false), Func::ExternalLinkage, name, m);
 
   BB* initblock = BB::Create(context, "entry", fn);
   builder.SetInsertPoint(initblock);
@@ -612,6 +669,90 @@ int innative::GetCallingConvention(const Import& imp)
   return llvm::CallingConv::C;
 }
 
+// Merges the active data segments of every linear memory defined in this module into page-aligned images, which the init
+// function asks the runtime to map over the memory. A memory only qualifies if every segment that targets it has a
+// constant offset and fits inside its initial size, which guarantees the image is exactly what copying would produce.
+// Segments that are far apart get separate images, so the gaps between them don't take up space in the binary.
+IN_ERROR Compiler::CompileMappedData(Module& m, std::vector<bool>& mapped)
+{
+  static constexpr uint64_t PAGE = 0x1000;
+  static constexpr uint64_t GAP  = 0x10000; // Segments closer than this share an image
+  struct Extent
+  {
+    uint64_t begin;
+    uint64_t end;
+  };
+
+  IN_ERROR err;
+  std::vector<std::vector<Extent>> extents(memories.size());
+  std::vector<uint64_t> offsets(m.data.n_data, 0);
+  for(varuint32 i = 0; i < m.data.n_data; ++i)
+  {
+    DataInit& d = m.data.data[i];
+    if(d.flags == WASM_SEGMENT_PASSIVE || d.index >= mapped.size() || !mapped[d.index])
+      continue;
+
+    llvm::Constant* offset;
+    if(err = CompileInitConstant(d.offset, m, offset))
+      return err;
+
+    auto constant = llvm::dyn_cast<CInt>(offset);
+    uint64_t size = (uint64_t)m.memory.memories[d.index - (memories.size() - m.memory.n_memories)].limits.minimum << 16;
+    if(!constant || constant->getZExtValue() + d.data.size() > size)
+      mapped[d.index] = false;
+    else if(d.data.size() > 0)
+    {
+      offsets[i] = constant->getZExtValue();
+      extents[d.index].push_back({ offsets[i] & ~(PAGE - 1), (offsets[i] + d.data.size() + PAGE - 1) & ~(PAGE - 1) });
+    }
+  }
+
+  for(varuint32 k = 0; k < memories.size(); ++k)
+  {
+    if(!mapped[k] || extents[k].empty())
+      continue;
+
+    std::sort(extents[k].begin(), extents[k].end(), [](const Extent& l, const Extent& r) { return l.begin < r.begin; });
+    std::vector<Extent> merged = { extents[k][0] };
+    for(auto& e : extents[k])
+    {
+      if(e.begin <= merged.back().end + GAP)
+        merged.back().end = std::max(merged.back().end, e.end);
+      else
+        merged.push_back(e);
+    }
+
+    // Later segments overwrite earlier ones, so they are written into the images in order
+    for(size_t j = 0; j < merged.size(); ++j)
+    {
+      std::vector<uint8_t> image(merged[j].end - merged[j].begin, 0);
+      for(varuint32 i = 0; i < m.data.n_data; ++i)
+      {
+        DataInit& d = m.data.data[i];
+        if(d.flags != WASM_SEGMENT_PASSIVE && d.index == k && d.data.size() > 0 && offsets[i] >= merged[j].begin &&
+           offsets[i] < merged[j].end)
+          std::copy(d.data.get(), d.data.get() + d.data.size(), image.begin() + (offsets[i] - merged[j].begin));
+      }
+
+      auto data = llvm::ConstantDataArray::get(ctx, image);
+      auto val  = new llvm::GlobalVariable(*mod, data->getType(), true, llvm::GlobalValue::LinkageTypes::PrivateLinkage,
+                                          data, CanonicalName(StringSpan{ 0, 0 }, StringSpan::From("memoryimage"), k));
+      val->setAlignment(llvm::MaybeAlign(PAGE));
+      if(machine->getTargetTriple().isOSBinFormatELF())
+        val->setSection(".innative_data");
+
+      builder
+        .CreateCall(env_mapdata,
+                    { builder.CreateInBoundsGEP(LoadPair(memories[k], 0, tbaa.mempair), builder.getInt64(merged[j].begin)),
+                      builder.CreateInBoundsGEP(data->getType(), val, { builder.getInt32(0), builder.getInt32(0) }),
+                      builder.getInt64(image.size()) })
+        ->setCallingConv(env_mapdata->getCallingConv());
+    }
+  }
+
+  return ERR_SUCCESS;
+}
+
 IN_ERROR Compiler::CompileModule(varuint32 m_idx)
 {
   mod = new llvm::Module(m.name.str(), ctx);
@@ -619,6 +760,15 @@ IN_ERROR Compiler::CompileModule(varuint32 m_idx)
   mod->setDataLayout(machine->createDataLayout());
   intptrty = builder.getIntPtrTy(mod->getDataLayout(), 0);
 
+  // Every module uses the same type names, so the tags stay compatible when modules are merged for link-time optimization
+  llvm::MDBuilder mdbuilder(ctx);
+  llvm::MDNode* root = mdbuilder.createTBAARoot("innative TBAA");
+  auto tag           = [&](const char* name) {
+    llvm::MDNode* type = mdbuilder.createTBAAScalarTypeNode(name, root);
+    return mdbuilder.createTBAAStructTagNode(type, type, 0);
+  };
+  tbaa = { tag("linear memory"), tag("global"), tag("table"), tag("memory pair"), tag("table pair") };
+
   debugger.reset(Debugger::Create(*this));
   if(!debugger)
     return ERR_FATAL_FILE_ERROR;
@@ -627,13 +777,44 @@ IN_ERROR Compiler::CompileModule(varuint32 m_idx)
   init = TopLevelFunction(ctx, builder,
                           CanonicalName(StringSpan::From(m.name), StringSpan::From("innative_internal_init")).c_str(), mod);
 
+  // Guard pages rely on reserving the entire 32-bit address space and the runtime's fault handler, which only exists for
+  // 64-bit linux.
+  const llvm::Triple& triple = machine->getTargetTriple();
+  guardpages   = (env.flags & ENV_GUARD_PAGES) && triple.isOSLinux() && triple.getArch() == llvm::Triple::x86_64;
+  pooledmemory = (env.flags & ENV_POOLED_MEMORY) && !guardpages;
+  mappeddata   = (env.flags & ENV_MAPPED_DATA) && !pooledmemory;
+  stablememory = guardpages || pooledmemory || mappeddata || (env.flags & ENV_STABLE_MEMORY);
+
+  // Bounds checks are emitted as markers that the optimizer removes what it can of, then lowers into conditional traps
+  bounds_check = nullptr;
+  if((env.flags & ENV_CHECK_MEMORY_ACCESS) && !guardpages && (env.optimize & ENV_OPTIMIZE_OMASK))
+    bounds_check = GetBoundsCheckMarker(*mod);
+
+  // Every runtime check branches to a shared landing pad that reports why it trapped
+  trap         = GetTrapFunction(*mod);
+  trapfunction = ~0u;
+  traplocation = 0;
+  std::fill(std::begin(trappads), std::end(trappads), nullptr);
+
   // Declare C runtime function prototypes that we assume exist on the system
-  memgrow = Func::Create(FuncTy::get(builder.getInt8PtrTy(0),
-                                     { builder.getInt8PtrTy(0), builder.getInt64Ty(), builder.getInt64Ty(),
-                                       builder.getInt64Ty()->getPointerTo() },
-                                     false),
-                         Func::ExternalLinkage, "_innative_internal_env_grow_memory", mod);
-  memgrow->setReturnDoesNotAlias(); // This is a system memory allocation function, so the return value does not alias
+  FuncTy* memgrowty = FuncTy::get(
+    builder.getInt8PtrTy(0),
+    { builder.getInt8PtrTy(0), builder.getInt64Ty(), builder.getInt64Ty(), builder.getInt64Ty()->getPointerTo() }, false);
+  Func* fn_tablegrow = Func::Create(
+    memgrowty, Func::ExternalLinkage,
+    pooledmemory ? "_innative_internal_env_grow_table_pooled" : "_innative_internal_env_grow_memory", mod);
+  fn_tablegrow->setReturnDoesNotAlias(); // This is a system memory allocation function, so the return value does not alias
+
+  memgrow = fn_tablegrow;
+  if(stablememory)
+  {
+    memgrow = Func::Create(memgrowty, Func::ExternalLinkage,
+                           guardpages   ? "_innative_internal_env_grow_memory_guarded" :
+                           pooledmemory ? "_innative_internal_env_grow_memory_pooled" :
+                                          "_innative_internal_env_grow_memory_stable",
+                           mod);
+    memgrow->setReturnDoesNotAlias();
+  }
 
   atomic_notify = Func::Create(FuncTy::get(builder.getInt32Ty(), { builder.getInt8PtrTy(0), builder.getInt32Ty() }, false),
                                Func::ExternalLinkage, "_innative_internal_env_atomic_notify", mod);
@@ -649,13 +830,26 @@ IN_ERROR Compiler::CompileModule(varuint32 m_idx)
                                Func::ExternalLinkage, "_innative_internal_env_atomic_wait64", mod);
   atomic_wait64->setCallingConv(llvm::CallingConv::C);
 
-  Func* fn_memcpy = Func::Create(
-    FuncTy::get(builder.getVoidTy(), { builder.getInt8PtrTy(0), builder.getInt8PtrTy(0), builder.getInt64Ty() }, false),
-    Func::ExternalLinkage, "_innative_internal_env_memcpy", mod);
-
-  Func* fn_memfree =
-    Func::Create(FuncTy::get(builder.getVoidTy(), { builder.getInt8PtrTy(0), builder.getInt64Ty() }, false),
-                 Func::ExternalLinkage, "_innative_internal_env_free_memory", mod);
+  FuncTy* memcpyty =
+    FuncTy::get(builder.getVoidTy(), { builder.getInt8PtrTy(0), builder.getInt8PtrTy(0), builder.getInt64Ty() }, false);
+  env_memcpy  = Func::Create(memcpyty, Func::ExternalLinkage, "_innative_internal_env_memcpy", mod);
+  env_memmove = Func::Create(memcpyty, Func::ExternalLinkage, "_innative_internal_env_memmove", mod);
+  env_memset  = Func::Create(
+    FuncTy::get(builder.getVoidTy(), { builder.getInt8PtrTy(0), builder.getInt32Ty(), builder.getInt64Ty() }, false),
+    Func::ExternalLinkage, "_innative_internal_env_memset", mod);
+  env_mapdata = Func::Create(memcpyty, Func::ExternalLinkage, "_innative_internal_env_map_data", mod);
+
+  FuncTy* memfreety = FuncTy::get(builder.getVoidTy(), { builder.getInt8PtrTy(0), builder.getInt64Ty() }, false);
+  Func* fn_tablefree = Func::Create(
+    memfreety, Func::ExternalLinkage,
+    pooledmemory ? "_innative_internal_env_free_table_pooled" : "_innative_internal_env_free_memory", mod);
+  Func* fn_memfree = fn_tablefree;
+  if(stablememory) // These take the maximum size of the memory instead of the current size
+    fn_memfree = Func::Create(memfreety, Func::ExternalLinkage,
+                              guardpages   ? "_innative_internal_env_free_memory_guarded" :
+                              pooledmemory ? "_innative_internal_env_free_memory_pooled" :
+                                             "_innative_internal_env_free_memory_stable",
+                              mod);
 
   debugger->FunctionDebugInfo(init, "innative_internal_init" DIVIDER + std::string(m.name.str()), env.optimize != 0, true,
                               true, nullptr, 0, 0);
@@ -693,18 +887,24 @@ IN_ERROR Compiler::CompileModule(varuint32 m_idx)
       functions.back().internal->setMetadata(
         IN_MEMORY_GROW_METADATA, llvm::MDNode::get(ctx, {})); // Assume all external functions invalidate the memory cache
 
-      auto e = ResolveExport(env, imp);
-      if(!e.second)
-      {
-        functions.back().imported = functions.back().internal;
-        functions.back().imported->setLinkage(Func::ExternalLinkage);
-        functions.back().imported->setCallingConv(GetCallingConvention(imp));
+      // Every import is called through its C symbol, either a C function or the export wrapper of another module. Direct
+      // calls use it as-is, while tables and tail calls need the internal convention, so they use a wrapper around it.
+      functions.back().imported = functions.back().internal;
+      functions.back().imported->setLinkage(Func::ExternalLinkage);
+      functions.back().imported->setCallingConv(GetCallingConvention(imp));
 
+      auto prev = std::find_if(functions.begin(), functions.end() - 1,
+                               [this](FunctionSet& f) { return f.imported == functions.back().imported; });
+      if(prev != functions.end() - 1)
+        functions.back().internal = prev->internal;
+      else
+      {
         auto& debugname = imp.func_desc.debug.name;
         auto canonical  = !(debugname.get()) ? functions.back().imported->getName() + DIVIDER "internal" :
                                               debugname.str() + ("_" + std::to_string(i));
         auto name = !(debugname.get()) ? std::string(imp.export_name.str()) + DIVIDER "internal" : debugname.str();
-        WrapFunction(functions.back().imported, name, canonical, Func::ExternalLinkage, InternalConvention);
+        functions.back().internal =
+          WrapFunction(functions.back().imported, name, canonical, Func::InternalLinkage, InternalConvention);
       }
     }
   }
@@ -754,6 +954,8 @@ IN_ERROR Compiler::CompileModule(varuint32 m_idx)
       auto max = builder.getInt64(
         ((mem_desc->limits.flags & WASM_LIMIT_HAS_MAXIMUM) ? ((uint64_t)mem_desc->limits.maximum) : 0ULL) << 16);
       memories.back()->setMetadata(IN_MEMORY_MAX_METADATA, llvm::MDNode::get(ctx, { llvm::ConstantAsMetadata::get(max) }));
+      auto min = builder.getInt64(((uint64_t)mem_desc->limits.minimum) << 16);
+      memories.back()->setMetadata(IN_MEMORY_MIN_METADATA, llvm::MDNode::get(ctx, { llvm::ConstantAsMetadata::get(min) }));
 
       int r;
       iter                     = kh_put_importhash(importhash, memories.back()->getName().data(), &r);
@@ -842,17 +1044,18 @@ IN_ERROR Compiler::CompileModule(varuint32 m_idx)
       return ERR_INVALID_TABLE_TYPE;
 
     CallInst* call =
-      builder.CreateCall(memgrow, { llvm::ConstantPointerNull::get(builder.getInt8PtrTy(0)),
-                                    builder.getInt64(m.table.tables[i].resizable.minimum * bytewidth),
-                                    builder.getInt64((m.table.tables[i].resizable.flags & WASM_LIMIT_HAS_MAXIMUM) ?
-                                                       (m.table.tables[i].resizable.maximum * bytewidth) :
-                                                       0),
-                                    GetPairPtr(tables.back(), 1) });
-
-    call->setCallingConv(memgrow->getCallingConv());
-
-    InsertConditionalTrap(builder.CreateICmpEQ(builder.CreatePtrToInt(call, intptrty), CInt::get(intptrty, 0)));
-    builder.CreateStore(builder.CreatePointerCast(call, type), GetPairPtr(tables.back(), 0), false);
+      builder.CreateCall(fn_tablegrow, { llvm::ConstantPointerNull::get(builder.getInt8PtrTy(0)),
+                                         builder.getInt64(m.table.tables[i].resizable.minimum * bytewidth),
+                                         builder.getInt64((m.table.tables[i].resizable.flags & WASM_LIMIT_HAS_MAXIMUM) ?
+                                                            (m.table.tables[i].resizable.maximum * bytewidth) :
+                                                            0),
+                                         GetPairPtr(tables.back(), 1) });
+
+    call->setCallingConv(fn_tablegrow->getCallingConv());
+
+    InsertConditionalTrap(builder.CreateICmpEQ(builder.CreatePtrToInt(call, intptrty), CInt::get(intptrty, 0)),
+                          IN_TRAP_OUT_OF_MEMORY);
+    StorePair(builder.CreatePointerCast(call, type), tables.back(), 0, tbaa.tablepair);
   }
 
   // Declare linear memory spaces and allocate in init function
@@ -866,12 +1069,14 @@ IN_ERROR Compiler::CompileModule(varuint32 m_idx)
       builder.getInt64(((mem.limits.flags & WASM_LIMIT_HAS_MAXIMUM) ? ((uint64_t)mem.limits.maximum) : 0ULL) << 16);
     memories.push_back(DeclareGlobal(i, mem.debug, false, pair, "linearmemory", GetPairNull(pair)));
     memories.back()->setMetadata(IN_MEMORY_MAX_METADATA, llvm::MDNode::get(ctx, { llvm::ConstantAsMetadata::get(max) }));
+    memories.back()->setMetadata(IN_MEMORY_MIN_METADATA, llvm::MDNode::get(ctx, { llvm::ConstantAsMetadata::get(sz) }));
 
     CallInst* call =
       builder.CreateCall(memgrow, { llvm::ConstantPointerNull::get(type), sz, max, GetPairPtr(memories.back(), 1) });
     call->setCallingConv(memgrow->getCallingConv());
-    InsertConditionalTrap(builder.CreateICmpEQ(builder.CreatePtrToInt(call, intptrty), CInt::get(intptrty, 0)));
-    builder.CreateStore(call, GetPairPtr(memories.back(), 0), false);
+    InsertConditionalTrap(builder.CreateICmpEQ(builder.CreatePtrToInt(call, intptrty), CInt::get(intptrty, 0)),
+                          IN_TRAP_OUT_OF_MEMORY);
+    StorePair(call, memories.back(), 0, tbaa.mempair);
   }
 
   IN_ERROR err;
@@ -889,33 +1094,91 @@ IN_ERROR Compiler::CompileModule(varuint32 m_idx)
 
   debugger->SetSPLocation(builder, init->getSubprogram());
 
+  // Passive segments track their current size so drop instructions can discard them
+  auto DeclareSegmentSize = [this](const char* name, varuint32 i, uint64_t size) {
+    return new llvm::GlobalVariable(*mod, builder.getInt64Ty(), false, llvm::GlobalValue::LinkageTypes::PrivateLinkage,
+                                    builder.getInt64(size), CanonicalName(StringSpan{ 0, 0 }, StringSpan::From(name), i));
+  };
+
+  // Imported memories could belong to a module that grows them with mremap, so only our own memories can be mapped
+  std::vector<bool> mapped(memories.size(), mappeddata);
+  std::fill(mapped.begin(), mapped.begin() + (memories.size() - m.memory.n_memories), false);
+  if(mappeddata && (err = CompileMappedData(m, mapped)))
+    return err;
+
   // Process data section by appending to the init function
+  datasegments.reserve(m.data.n_data);
   for(varuint32 i = 0; i < m.data.n_data; ++i)
   {
     DataInit& d = m.data.data[i]; // First we declare a constant array that stores the data in the EXE
+    if(d.flags != WASM_SEGMENT_PASSIVE && d.index < mapped.size() && mapped[d.index])
+    {
+      datasegments.push_back({ nullptr, nullptr });
+      continue;
+    }
+
     auto data = llvm::ConstantDataArray::get(ctx, llvm::makeArrayRef<uint8_t>(d.data.get(), d.data.get() + d.data.size()));
     auto val  = new llvm::GlobalVariable(*mod, data->getType(), true, llvm::GlobalValue::LinkageTypes::PrivateLinkage, data,
                                         CanonicalName(StringSpan{ 0, 0 }, StringSpan::From("data"), i));
     debugger->DebugGlobal(val, val->getName(), 0);
 
+    if(d.flags == WASM_SEGMENT_PASSIVE) // Passive segments are only copied by memory.init
+    {
+      datasegments.push_back({ val, DeclareSegmentSize("datasize", i, d.data.size()) });
+      continue;
+    }
+    datasegments.push_back({ nullptr, nullptr });
+
     llvm::Constant* offset;
     if(err = CompileInitConstant(d.offset, m, offset))
       return err;
 
     // Then we create a memcpy call that copies this data to the appropriate location in the init function
     builder
-      .CreateCall(fn_memcpy,
-                  { builder.CreateInBoundsGEP(builder.CreateLoad(GetPairPtr(memories[d.index], 0)), offset),
+      .CreateCall(env_memcpy,
+                  { builder.CreateInBoundsGEP(LoadPair(memories[d.index], 0, tbaa.mempair), offset),
                     builder.CreateInBoundsGEP(data->getType(), val, { builder.getInt32(0), builder.getInt32(0) }),
                     builder.getInt64(GetTotalSize(data->getType())) })
-      ->setCallingConv(fn_memcpy->getCallingConv());
+      ->setCallingConv(env_memcpy->getCallingConv());
   }
 
   // Process element section by appending to the init function
+  elemsegments.reserve(m.element.n_elements);
   for(varuint32 i = 0; i < m.element.n_elements; ++i)
   {
-    TableInit& e = m.element.elements[i]; // First we declare a constant array that stores the data in the EXE
-    TableDesc* t = ModuleTable(m, e.index);
+    TableInit& e = m.element.elements[i];
+    elemsegments.push_back({ nullptr, nullptr });
+    if(e.flags == WASM_SEGMENT_DECLARATIVE)
+      continue;
+
+    if(e.flags == WASM_SEGMENT_PASSIVE) // Passive segments are stored in the same layout as a table for table.init
+    {
+      auto elemty = llvm::StructType::get(ctx, { GetLLVMType(TE_funcref), builder.getInt32Ty() });
+      std::vector<llvm::Constant*> elements;
+      elements.reserve(e.n_elements);
+
+      for(varuint32 j = 0; j < e.n_elements; ++j)
+      {
+        varuint32 index = (e.elements[j] < functions.size()) ? GetFirstType(ModuleFunctionType(m, e.elements[j])) :
+                                                                (varuint32)~0;
+        if(index == (varuint32)~0)
+          return ERR_INVALID_FUNCTION_INDEX;
+
+        elements.push_back(llvm::ConstantStruct::get(
+          elemty, { llvm::ConstantExpr::getPointerCast(functions[e.elements[j]].internal, GetLLVMType(TE_funcref)),
+                    builder.getInt32(index) }));
+      }
+
+      auto contents = llvm::ConstantArray::get(llvm::ArrayType::get(elemty, e.n_elements), elements);
+      elemsegments.back().data =
+        new llvm::GlobalVariable(*mod, contents->getType(), true, llvm::GlobalValue::LinkageTypes::PrivateLinkage,
+                                 contents, CanonicalName(StringSpan{ 0, 0 }, StringSpan::From("elem"), i));
+      elemsegments.back().size =
+        DeclareSegmentSize("elemsize", i, mod->getDataLayout().getTypeAllocSize(contents->getType()));
+      continue;
+    }
+
+    TableDesc* t = ModuleTable(m, e.index); // Active segments are written directly into the table
     if(!t)
       return ERR_INVALID_TABLE_INDEX;
 
@@ -934,18 +1197,19 @@ IN_ERROR Compiler::CompileModule(varuint32 m_idx)
 
         // Store function pointer in correct table memory location
         auto ptr =
-          builder.CreateGEP(builder.CreateLoad(GetPairPtr(tables[e.index], 0)),
+          builder.CreateGEP(LoadPair(tables[e.index], 0, tbaa.tablepair),
                             { builder.CreateAdd(offset, CInt::get(offset->getType(), j, true)), builder.getInt32(0) });
-        builder.CreateAlignedStore(builder.CreatePointerCast(functions[e.elements[j]].internal, target), ptr,
-                                   mod->getDataLayout().getPointerSize(), false);
+        TagAccess(builder.CreateAlignedStore(builder.CreatePointerCast(functions[e.elements[j]].internal, target), ptr,
+                                             mod->getDataLayout().getPointerSize(), false),
+                  tbaa.table);
 
         varuint32 index = GetFirstType(ModuleFunctionType(m, e.elements[j]));
         if(index == (varuint32)~0)
           return ERR_INVALID_FUNCTION_INDEX;
 
-        ptr = builder.CreateGEP(builder.CreateLoad(GetPairPtr(tables[e.index], 0)),
+        ptr = builder.CreateGEP(LoadPair(tables[e.index], 0, tbaa.tablepair),
                                 { builder.CreateAdd(offset, CInt::get(offset->getType(), j, true)), builder.getInt32(1) });
-        builder.CreateAlignedStore(builder.getInt32(index), ptr, 4, false);
+        TagAccess(builder.CreateAlignedStore(builder.getInt32(index), ptr, 4, false), tbaa.table);
       }
     }
   }
@@ -963,18 +1227,22 @@ IN_ERROR Compiler::CompileModule(varuint32 m_idx)
 
   for(size_t i = m.importsection.memories - m.importsection.tables; i < memories.size();
       ++i) // Don't accidentally delete imported linear memories
-    builder
-      .CreateCall(fn_memfree,
-                  { builder.CreateLoad(GetPairPtr(memories[i], 0)), builder.CreateLoad(GetPairPtr(memories[i], 1)) })
+  {
+    llvmVal* size = !stablememory ?
+                      static_cast<llvmVal*>(LoadPair(memories[i], 1, tbaa.mempair)) :
+                      llvm::cast<llvm::ConstantAsMetadata>(memories[i]->getMetadata(IN_MEMORY_MAX_METADATA)->getOperand(0))
+                        ->getValue();
+    builder.CreateCall(fn_memfree, { LoadPair(memories[i], 0, tbaa.mempair), size })
       ->setCallingConv(fn_memfree->getCallingConv());
+  }
 
   for(size_t i = m.importsection.tables - m.importsection.functions; i < tables.size();
       ++i) // Don't accidentally delete imported tables
     builder
-      .CreateCall(fn_memfree,
-                  { builder.CreatePointerCast(builder.CreateLoad(GetPairPtr(tables[i], 0)), builder.getInt8PtrTy(0)),
-                    builder.CreateLoad(GetPairPtr(tables[i], 1)) })
-      ->setCallingConv(fn_memfree->getCallingConv());
+      .CreateCall(fn_tablefree,
+                  { builder.CreatePointerCast(LoadPair(tables[i], 0, tbaa.tablepair), builder.getInt8PtrTy(0)),
+                    LoadPair(tables[i], 1, tbaa.tablepair) })
+      ->setCallingConv(fn_tablefree->getCallingConv());
 
   // Terminate cleanup function
   builder.CreateRetVoid();
@@ -999,8 +1267,10 @@ IN_ERROR Compiler::CompileModule(varuint32 m_idx)
   {
     if(m.start >= functions.size())
       return ERR_INVALID_START_FUNCTION;
-    assert(!functions[m.start].imported);
-    start = functions[m.start].internal;
+    // The entry point calls the start function from C, so it needs a wrapper just like an export
+    Func* fn = functions[m.start].internal;
+    start    = WrapFunction(fn, "start", fn->getName() + DIVIDER "start", Func::ExternalLinkage, llvm::CallingConv::C);
+    startsym = start->getName().str();
   }
 
   {
@@ -1017,11 +1287,37 @@ IN_ERROR Compiler::CompileModule(varuint32 m_idx)
     std::transform(globals.begin(), globals.end(), std::back_inserter(vglobals),
                    [ptrTy](llvm::GlobalVariable* v) { return llvm::ConstantExpr::getBitCast(v, ptrTy); });
 
+    // Every function an element segment can put in a table gets a C wrapper, which the runtime hands out instead
+    std::vector<llvm::Constant*> vtablefns;
+    std::vector<bool> seen(functions.size(), false);
+    auto pairTy = llvm::StructType::get(ctx, { ptrTy, ptrTy, builder.getInt32Ty() });
+    for(varuint32 i = 0; i < m.element.n_elements; ++i)
+    {
+      for(varuint32 j = 0; j < m.element.elements[i].n_elements; ++j)
+      {
+        varuint32 index = m.element.elements[i].elements[j];
+        if(index >= functions.size() || seen[index])
+          continue;
+
+        seen[index]     = true;
+        FunctionSet& fn = functions[index];
+        Func* external  = fn.imported ? fn.imported : fn.exported;
+        if(external->getFunctionType() != fn.internal->getFunctionType()) // Homogenized exports can't be used here
+          external = WrapFunction(fn.internal, fn.internal->getName(), fn.internal->getName() + DIVIDER "table",
+                                  Func::InternalLinkage, llvm::CallingConv::C);
+
+        vtablefns.push_back(llvm::ConstantStruct::get(
+          pairTy, { llvm::ConstantExpr::getBitCast(fn.internal, ptrTy), llvm::ConstantExpr::getBitCast(external, ptrTy),
+                    builder.getInt32(PassesInRegisters(fn.internal->getFunctionType())) }));
+      }
+    }
+
     auto gname     = llvm::ConstantDataArray::getString(ctx, llvm::StringRef(m.name.str(), m.name.size()));
     auto gtables   = llvm::ConstantArray::get(llvm::ArrayType::get(ptrTy, vtables.size()), vtables);
     auto gmemories = llvm::ConstantArray::get(llvm::ArrayType::get(ptrTy, vmemories.size()), vmemories);
     auto gglobals  = llvm::ConstantArray::get(llvm::ArrayType::get(ptrTy, vglobals.size()), vglobals);
-    std::array<llvm::Constant*, 10> values = {
+    auto gtablefns = llvm::ConstantArray::get(llvm::ArrayType::get(pairTy, vtablefns.size()), vtablefns);
+    std::array<llvm::Constant*, 12> values = {
       new llvm::GlobalVariable(*mod, gname->getType(), true, llvm::GlobalValue::PrivateLinkage, gname),
       builder.getInt32(m.version),
       builder.getInt32((uint32)tables.size()),
@@ -1032,6 +1328,8 @@ IN_ERROR Compiler::CompileModule(varuint32 m_idx)
       new llvm::GlobalVariable(*mod, gglobals->getType(), true, llvm::GlobalValue::PrivateLinkage, gglobals),
       builder.getInt32((uint32)functions.size()),
       exported_functions,
+      builder.getInt32((uint32)vtablefns.size()),
+      new llvm::GlobalVariable(*mod, gtablefns->getType(), false, llvm::GlobalValue::PrivateLinkage, gtablefns),
     };
     auto metadata = llvm::ConstantStruct::getAnon(values);
     auto v = new llvm::GlobalVariable(*mod, metadata->getType(), true, llvm::GlobalValue::LinkageTypes::ExternalLinkage,
@@ -1067,10 +1365,28 @@ void Compiler::PostOrderTraversal(llvm::Function* f)
   }
 }
 
+// Returns true if the internal convention passes every parameter of this function type in a register. Tail calls make
+// the callee pop its own stack arguments, so only then can a C function stand in for a function of this type.
+bool Compiler::PassesInRegisters(FuncTy* ty)
+{
+  size_t ints   = 0;
+  size_t floats = 0;
+  for(auto param : ty->params())
+    ++(param->isFloatingPointTy() || param->isVectorTy() ? floats : ints);
+
+  const llvm::Triple& triple = machine->getTargetTriple();
+  switch(triple.getArch())
+  {
+  case llvm::Triple::x86_64: return triple.isOSWindows() ? ints + floats <= 4 : ints <= 6 && floats <= 8;
+  case llvm::Triple::aarch64: return ints <= 8 && floats <= 8;
+  default: return !ints && !floats; // 32-bit x86 passes arguments to tail calls in different registers than C does
+  }
+}
+
 // Runs a pass to propagate all memory_grow metadata up the call graph, then adds store instructions where necessary
 void Compiler::AddMemLocalCaching()
 {
-  if(!memories.size())
+  if(!memories.size() || stablememory) // If the memory can never move, the cached base pointer can never go stale
     return;
 
   for(auto fn : functions) // Because it's crucial we cover the entire call graph, we just go through every single
@@ -1106,11 +1422,12 @@ void Compiler::AddMemLocalCaching()
         {
           if(auto called = cs.getCalledFunction())
           {
-            if(called->getMetadata(IN_MEMORY_GROW_METADATA) != nullptr)
+            // Nothing can come between a tail call and its return, and the cache is dead afterwards anyway
+            if(called->getMetadata(IN_MEMORY_GROW_METADATA) != nullptr && !cs.isTailCall())
             {
               builder.SetInsertPoint(
                 &i); // Setting the insert point doesn't actually gaurantee the instructions come after the call
-              auto load = builder.CreateLoad(GetPairPtr(memories[0], 0));
+              auto load = LoadPair(memories[0], 0, tbaa.mempair);
               load->moveAfter(&i); // So we manually move them after the call instruction just to be sure.
               builder.CreateStore(load, fn.memlocal, false)->moveAfter(load);
             }
@@ -1122,7 +1439,7 @@ void Compiler::AddMemLocalCaching()
 }
 
 // Resolve all exports in the module they originated from (in case any module is exporting an import)
-void Compiler::ResolveModuleExports(const Environment* env, Module* root, llvm::LLVMContext& context)
+void Compiler::ResolveModuleExports(const Environment* env, Module* root)
 {
   // Set ENV_HOMOGENIZE_FUNCTIONS flag appropriately.
   auto wrapperfn = (env->flags & ENV_HOMOGENIZE_FUNCTIONS) ? &Compiler::HomogenizeFunction : &Compiler::PassFunction;
@@ -1149,6 +1466,8 @@ void Compiler::ResolveModuleExports(const Environment* env, Module* root, llvm::
     }
 
     Compiler* compiler = m->cache;
+    if(compiler->fromcache) // The cached object file already contains this export
+      continue;
 
     switch(e->kind)
     {
@@ -1165,14 +1484,20 @@ void Compiler::ResolveModuleExports(const Environment* env, Module* root, llvm::
           ->setDLLStorageClass(llvm::GlobalValue::DLLStorageClassTypes::DLLExportStorageClass);
       break;
     case WASM_KIND_TABLE:
+      if(env->flags & ENV_MULTI_INSTANCE) // Tables, memories and mutable globals only exist inside an instance
+        break;
       llvm::GlobalAlias::create(llvm::GlobalValue::ExternalLinkage, canonical, compiler->tables[e->index])
         ->setDLLStorageClass(llvm::GlobalValue::DLLStorageClassTypes::DLLExportStorageClass);
       break;
     case WASM_KIND_MEMORY:
+      if(env->flags & ENV_MULTI_INSTANCE)
+        break;
       llvm::GlobalAlias::create(llvm::GlobalValue::ExternalLinkage, canonical, compiler->memories[e->index])
         ->setDLLStorageClass(llvm::GlobalValue::DLLStorageClassTypes::DLLExportStorageClass);
       break;
     case WASM_KIND_GLOBAL:
+      if((env->flags & ENV_MULTI_INSTANCE) && !compiler->globals[e->index]->isConstant())
+        break;
       llvm::GlobalAlias::create(llvm::GlobalValue::ExternalLinkage, canonical, compiler->globals[e->index])
         ->setDLLStorageClass(llvm::GlobalValue::DLLStorageClassTypes::DLLExportStorageClass);
       break;
@@ -1180,182 +1505,153 @@ void Compiler::ResolveModuleExports(const Environment* env, Module* root, llvm::
   }
 }
 
-IN_ERROR innative::CompileEnvironment(Environment* env, const char* outfile)
+// Replaces every function body with a dispatcher over clones compiled for each x86-64 ISA level. This must happen after
+// AddMemLocalCaching, so the clones inherit the cached memory pointers instead of having to be traversed again.
+void Compiler::AddMultiversioning()
 {
-  if(!outfile || !outfile[0])
-    return ERR_FATAL_NO_OUTPUT_FILE;
-
-  path file = utility::GetPath(outfile);
-
-  if(!file.is_absolute())
-    file = utility::GetWorkingDir() / file;
-
-  // Construct the LLVM environment and current working directories
-  if(!env->context)
-    env->context = new llvm::LLVMContext();
-
-  llvm::IRBuilder<> builder(*env->context);
-  bool has_start = false;
-  IN_ERROR err   = ERR_SUCCESS;
-
-  std::string triple = llvm::sys::getProcessTriple();
+  std::vector<Func*> bodies;
+  for(size_t i = m.importsection.functions; i < functions.size(); ++i)
+    bodies.push_back(functions[i].internal);
 
-  // Set up our target architecture, necessary up here so our code generation knows how big a pointer is
-  llvm::InitializeAllTargetInfos();
-  llvm::InitializeAllTargets();
-  llvm::InitializeAllTargetMCs();
-  llvm::InitializeAllAsmParsers();
-  llvm::InitializeAllAsmPrinters();
+  MultiversionFunctions(*mod, *machine, bodies, !(env.optimize & ENV_OPTIMIZE_MULTIVERSION));
+}
 
-  std::string llvm_err;
-  auto arch = llvm::TargetRegistry::lookupTarget(triple, llvm_err);
+// Moves every piece of mutable module state into a per-instance block and threads the instance through every function.
+// This must happen after every export wrapper has been created, but before multiversioning clones the function bodies.
+void Compiler::AddInstanceContext()
+{
+  std::vector<llvm::GlobalVariable*> state;
+  for(auto g : tables)
+    if(g->hasInitializer())
+      state.push_back(g);
+  for(auto g : memories)
+    if(g->hasInitializer())
+      state.push_back(g);
+  for(auto g : globals)
+    if(g->hasInitializer() && !g->isConstant())
+      state.push_back(g);
+  for(auto& segment : datasegments)
+    if(segment.size)
+      state.push_back(segment.size);
+  for(auto& segment : elemsegments)
+    if(segment.size)
+      state.push_back(segment.size);
+
+  std::unordered_map<Func*, Func*> replaced;
+  MoveStateIntoInstance(*mod, static_cast<varuint32>(&m - env.modules), state, init,
+                        CanonicalName(StringSpan::From(m.name), StringSpan::From("innative_internal_instance_size")),
+                        replaced);
+
+  auto update = [&](Func*& fn) {
+    if(auto i = replaced.find(fn); i != replaced.end())
+      fn = i->second;
+  };
 
-  if(!arch)
+  for(auto& fn : functions)
   {
-    llvm::errs() << llvm_err;
-    return ERR_FATAL_UNKNOWN_TARGET;
+    update(fn.internal);
+    update(fn.imported);
+    update(fn.exported);
   }
+  update(init);
+  update(exit);
+  update(start);
+}
 
-  for(varuint32 i = 0; i < env->n_modules; ++i)
-    if(env->modules[i].knownsections & (1 << WASM_SECTION_START))
-      has_start = true;
-
-  if((!has_start || env->flags & ENV_NO_INIT) && !(env->flags & ENV_LIBRARY))
-  {
-    env->flags |= ENV_LIBRARY; // Attempting to compile a library as an EXE is a common error, so we fix it for you.
-    fprintf(
-      env->log,
-      "WARNING: Compiling dynamic library because no start function was found! If this was intended, use '-f library' next time.\n");
-  }
+// Creates the init and exit functions that initialize or clean up every module, which also serve as the entry point
+void Compiler::CompileEntryPoint(Environment* env)
+{
+  // Create cleanup function
+  Compiler& mainctx          = *env->modules[0].cache;
+  llvm::IRBuilder<>& builder = mainctx.builder;
+  bool multi                 = (env->flags & ENV_MULTI_INSTANCE) != 0;
+  FuncTy* voidty             = FuncTy::get(builder.getVoidTy(), false);
+  // Init, exit and start functions are all void(), unless they take the instance as their only parameter
+  FuncTy* stubty = multi ? FuncTy::get(builder.getVoidTy(), { builder.getInt8PtrTy() }, false) : voidty;
+  Func* cleanup  = Compiler::TopLevelFunction(mainctx.ctx, builder, IN_EXIT_FUNCTION, mainctx.mod, stubty);
+  mainctx.debugger->FunctionDebugInfo(cleanup, IN_EXIT_FUNCTION, mainctx.env.optimize != 0, true, true, nullptr, 0, 0);
+  mainctx.debugger->SetSPLocation(mainctx.builder, cleanup->getSubprogram());
 
-  // Detect current CPU feature set and create machine target for LLVM
-  llvm::TargetOptions opt;
-  auto RM = llvm::Optional<llvm::Reloc::Model>();
-#ifdef IN_PLATFORM_POSIX
-  if(env->flags & ENV_LIBRARY)
-    RM = llvm::Optional<llvm::Reloc::Model>(llvm::Reloc::PIC_);
-#endif
-  llvm::SubtargetFeatures subtarget_features;
-  llvm::StringMap<bool> feature_map;
-  if(llvm::sys::getHostCPUFeatures(feature_map))
-  {
-    for(auto& feature : feature_map)
-    {
-      subtarget_features.AddFeature(feature.first(), feature.second);
-    }
-  }
-  auto machine =
-    arch->createTargetMachine(triple, llvm::sys::getHostCPUName(), subtarget_features.getString(), opt, RM, llvm::None);
+  std::vector<llvmVal*> args;
+  if(multi)
+    args.push_back(cleanup->arg_begin());
 
-  if(!env->n_modules)
-    return ERR_FATAL_NO_MODULES;
+  builder.CreateCall(mainctx.exit, args)->setCallingConv(mainctx.exit->getCallingConv());
 
-  if(env->optimize & ENV_OPTIMIZE_FAST_MATH)
+  // Other modules might have been loaded from the object cache, so we only refer to their functions by symbol name
+  for(size_t i = 1; i < env->n_modules; ++i)
   {
-    llvm::FastMathFlags fmf;
-    if(env->optimize & ENV_OPTIMIZE_FAST_MATH_REASSOCIATE)
-      fmf.setAllowReassoc();
-    if(env->optimize & ENV_OPTIMIZE_FAST_MATH_NO_NAN)
-      fmf.setNoNaNs();
-    if(env->optimize & ENV_OPTIMIZE_FAST_MATH_NO_INF)
-      fmf.setNoInfs();
-    if(env->optimize & ENV_OPTIMIZE_FAST_MATH_NO_SIGNED_ZERO)
-      fmf.setNoSignedZeros();
-    if(env->optimize & ENV_OPTIMIZE_FAST_MATH_ALLOW_RECIPROCAL)
-      fmf.setAllowReassoc();
-    if(env->optimize & ENV_OPTIMIZE_FAST_MATH_CONTRACT)
-      fmf.setAllowContract();
-    if(env->optimize & ENV_OPTIMIZE_FAST_MATH_ALLOW_APPROXIMATE_FUNCTIONS)
-      fmf.setApproxFunc();
-    builder.setFastMathFlags(fmf);
+    Func* stub =
+      Func::Create(stubty, Func::ExternalLinkage,
+                   CanonicalName(StringSpan::From(env->modules[i].name), StringSpan::From("innative_internal_exit")),
+                   mainctx.mod); // Create function prototype in main module
+    builder.CreateCall(stub, args)->setCallingConv(stub->getCallingConv());
   }
 
-  std::vector<Module*> new_modules;
-  has_start = false;
-
-  // Compile all modules
-  for(varuint32 i = 0; i < env->n_modules; ++i)
+  // Once every module freed its memories and tables, the slot pools can give their reservations back
+  if(mainctx.pooledmemory)
   {
-    if(!i || !env->modules[i].cache) // Always recompile the 0th module because it stores the main entry point.
-    {
-      if(env->modules[i].cache)
-        DeleteCache(*env, env->modules[i]);
-      env->modules[i].cache =
-        new Compiler{ *env,    env->modules[i], *env->context,        0,
-                      builder, machine,         kh_init_importhash(), GetLinkerObjectPath(*env, env->modules[i], file) };
-      if(!env->modules[i].cache->objfile.empty())
-        remove(env->modules[i].cache->objfile);
-
-      if((err = env->modules[i].cache->CompileModule(i)) < 0)
-        return err;
-      new_modules.push_back(env->modules + i);
-    }
-    has_start |= env->modules[i].cache->start != nullptr;
+    Func* fn_teardown = Func::Create(voidty, Func::ExternalLinkage, "_innative_internal_env_pool_teardown", mainctx.mod);
+    builder.CreateCall(fn_teardown, {});
   }
 
-  if((!has_start || env->flags & ENV_NO_INIT) && !(env->flags & ENV_LIBRARY))
-    return ERR_INVALID_START_FUNCTION;
-
-  for(auto m : new_modules)
-    Compiler::ResolveModuleExports(env, m, *env->context);
-
-  for(auto m : new_modules)
-    m->cache->AddMemLocalCaching();
-
-  // Create cleanup function
-  Compiler& mainctx = *env->modules[0].cache;
-  Func* cleanup     = Compiler::TopLevelFunction(*env->context, builder, IN_EXIT_FUNCTION, mainctx.mod);
-  mainctx.debugger->FunctionDebugInfo(cleanup, IN_EXIT_FUNCTION, mainctx.env.optimize != 0, true, true, nullptr, 0, 0);
-  mainctx.debugger->SetSPLocation(mainctx.builder, cleanup->getSubprogram());
-
-  builder.CreateCall(mainctx.exit, {})->setCallingConv(mainctx.exit->getCallingConv());
-
-  for(size_t i = 1; i < env->n_modules; ++i)
+  // Instrumented programs write out their profile once every module has been cleaned up
+  if((env->optimize & ENV_OPTIMIZE_PROFILE_GENERATE) && (env->optimize & ENV_OPTIMIZE_OMASK))
   {
-    Func* stub = Func::Create(env->modules[i].cache->exit->getFunctionType(), env->modules[i].cache->exit->getLinkage(),
-                              env->modules[i].cache->exit->getName(),
-                              mainctx.mod); // Create function prototype in main module
-    builder.CreateCall(stub, {})->setCallingConv(stub->getCallingConv());
+    Func* fn_profile = Func::Create(voidty, Func::ExternalLinkage, "_innative_internal_env_write_profile", mainctx.mod);
+    builder.CreateCall(fn_profile, {});
   }
 
   builder.CreateRetVoid();
 
   // Create main function that calls all init functions for all modules and all start functions
-  Func* main = Compiler::TopLevelFunction(*env->context, builder, IN_INIT_FUNCTION, nullptr);
+  Func* main = Compiler::TopLevelFunction(mainctx.ctx, builder, IN_INIT_FUNCTION, nullptr, stubty);
   mainctx.debugger->FunctionDebugInfo(main, IN_INIT_FUNCTION, mainctx.env.optimize != 0, true, true, nullptr, 0, 0);
   mainctx.debugger->SetSPLocation(mainctx.builder, main->getSubprogram());
 
-  builder.CreateCall(mainctx.init, {})->setCallingConv(mainctx.init->getCallingConv());
+  args.clear();
+  if(multi)
+    args.push_back(main->arg_begin());
+
+  // Multiversioned functions need to know the ISA level before any of them run, including the ones called by init
+  if(UsesMultiversioning(env->optimize, mainctx.machine->getTargetTriple()))
+  {
+    Func* fn_detect = Func::Create(voidty, Func::ExternalLinkage, IN_DETECT_CPU_FUNCTION, mainctx.mod);
+    builder.CreateCall(fn_detect, {});
+  }
+
+  builder.CreateCall(mainctx.init, args)->setCallingConv(mainctx.init->getCallingConv());
 
   for(size_t i = 1; i < env->n_modules; ++i)
   {
-    Func* stub = Func::Create(env->modules[i].cache->init->getFunctionType(), env->modules[i].cache->init->getLinkage(),
-                              env->modules[i].cache->init->getName(),
-                              mainctx.mod); // Create function prototype in main module
-    builder.CreateCall(stub, {})->setCallingConv(stub->getCallingConv());
+    Func* stub =
+      Func::Create(stubty, Func::ExternalLinkage,
+                   CanonicalName(StringSpan::From(env->modules[i].name), StringSpan::From("innative_internal_init")),
+                   mainctx.mod); // Create function prototype in main module
+    builder.CreateCall(stub, args)->setCallingConv(stub->getCallingConv());
   }
 
   // Call every single start function in all modules AFTER we initialize them.
   if(mainctx.start != nullptr)
-    builder.CreateCall(mainctx.start, {})->setCallingConv(mainctx.start->getCallingConv());
+    builder.CreateCall(mainctx.start, args)->setCallingConv(mainctx.start->getCallingConv());
 
   for(size_t i = 1; i < env->n_modules; ++i)
   {
-    if(env->modules[i].cache->start != nullptr)
+    const std::string& startsym = env->modules[i].cache->startsym;
+    if(!startsym.empty())
     {
       // Catch the case where an import from this module is being called from another module
-      Func* stub = mainctx.mod->getFunction(env->modules[i].cache->start->getName());
+      Func* stub = mainctx.mod->getFunction(startsym);
       if(!stub)
       {
-        auto alias = mainctx.mod->getNamedAlias(env->modules[i].cache->start->getName());
+        auto alias = mainctx.mod->getNamedAlias(startsym);
         if(alias)
-          stub = llvm::cast<Func>(alias->getAliasee());
+          stub = llvm::cast<Func>(alias->getAliasee()->stripPointerCasts());
         else
-          stub = Func::Create(env->modules[i].cache->start->getFunctionType(), env->modules[i].cache->start->getLinkage(),
-                              env->modules[i].cache->start->getName(),
+          stub = Func::Create(stubty, Func::ExternalLinkage, startsym,
                               mainctx.mod); // Create function prototype in main module
       }
-      builder.CreateCall(stub, {})->setCallingConv(stub->getCallingConv());
+      builder.CreateCall(stub, args)->setCallingConv(stub->getCallingConv());
     }
   }
 
@@ -1384,6 +1680,30 @@ IN_ERROR innative::CompileEnvironment(Environment* env, const char* outfile)
 
   mainctx.mod->getFunctionList().push_back(main);
 
+  // Tells the runtime how large the block of each module is, so it can allocate new instances
+  if(multi)
+  {
+    llvm::Type* sizety = builder.getInt64Ty();
+    std::vector<llvm::Constant*> sizes;
+    for(size_t i = 0; i < env->n_modules; ++i)
+    {
+      auto name =
+        CanonicalName(StringSpan::From(env->modules[i].name), StringSpan::From("innative_internal_instance_size"));
+      sizes.push_back(mainctx.mod->getOrInsertGlobal(name, sizety));
+    }
+
+    auto arrayty  = llvm::ArrayType::get(sizety->getPointerTo(), sizes.size());
+    auto array    = new llvm::GlobalVariable(*mainctx.mod, arrayty, true, llvm::GlobalValue::PrivateLinkage,
+                                          llvm::ConstantArray::get(arrayty, sizes), "instance_sizes");
+    auto layoutty = llvm::StructType::get(mainctx.ctx, { builder.getInt32Ty(), sizety->getPointerTo()->getPointerTo() });
+    auto layout   = new llvm::GlobalVariable(
+      *mainctx.mod, layoutty, true, llvm::GlobalValue::ExternalLinkage,
+      llvm::ConstantStruct::get(layoutty, { builder.getInt32(env->n_modules),
+                                            llvm::ConstantExpr::getPointerCast(array, layoutty->getElementType(1)) }),
+      IN_INSTANCE_LAYOUT);
+    layout->setDLLStorageClass(llvm::GlobalValue::DLLStorageClassTypes::DLLExportStorageClass);
+  }
+
 #ifdef IN_PLATFORM_WIN32
   // The windows linker requires this to be defined. It's not actually used, just... defined.
   new llvm::GlobalVariable(*mainctx.mod, builder.getInt32Ty(), false, llvm::GlobalValue::ExternalLinkage,
@@ -1398,7 +1718,7 @@ IN_ERROR innative::CompileEnvironment(Environment* env, const char* outfile)
                                { builder.getInt8PtrTy(), mainctx.builder.getInt32Ty(), builder.getInt8PtrTy() }, false),
                    Func::ExternalLinkage, IN_INIT_FUNCTION "-stub");
     mainstub->setCallingConv(llvm::CallingConv::X86_StdCall);
-    BB* entryblock = BB::Create(*env->context, "entry", mainstub);
+    BB* entryblock = BB::Create(mainctx.ctx, "entry", mainstub);
     builder.SetInsertPoint(entryblock);
     mainctx.debugger->FuncDecl(mainstub, 0, mainctx.m.start_line, mainctx.env.optimize != 0);
     mainctx.debugger->SetSPLocation(builder, mainstub->getSubprogram());
@@ -1406,9 +1726,9 @@ IN_ERROR innative::CompileEnvironment(Environment* env, const char* outfile)
     if(!(env->flags & ENV_NO_INIT)) // Only actually initialize things on DLL load if we actually want to, otherwise
                                     // create a stub function
     {
-      BB* endblock  = BB::Create(*env->context, "end", mainstub);
-      BB* initblock = BB::Create(*env->context, "init", mainstub);
-      BB* exitblock = BB::Create(*env->context, "exit", mainstub);
+      BB* endblock  = BB::Create(mainctx.ctx, "end", mainstub);
+      BB* initblock = BB::Create(mainctx.ctx, "init", mainstub);
+      BB* exitblock = BB::Create(mainctx.ctx, "exit", mainstub);
 
       llvm::SwitchInst* s = builder.CreateSwitch(mainstub->arg_begin() + 1, endblock, 2);
       s->addCase(mainctx.builder.getInt32(1), initblock); // DLL_PROCESS_ATTACH
@@ -1429,9 +1749,225 @@ IN_ERROR innative::CompileEnvironment(Environment* env, const char* outfile)
     mainctx.mod->getFunctionList().push_back(mainstub);
   }
 #endif
+}
+
+IN_ERROR innative::GenerateEnvironment(Environment* env, const path& file, ThreadPool& pool,
+                                       std::vector<Module*>& new_modules, std::optional<ObjectCache>* objcache)
+{
+  bool has_start = false;
+  bool lto       = UseLTO(env);
+  IN_ERROR err   = ERR_SUCCESS;
+
+  std::string triple = llvm::sys::getProcessTriple();
+
+  // Set up our target architecture, necessary up here so our code generation knows how big a pointer is
+  llvm::InitializeAllTargetInfos();
+  llvm::InitializeAllTargets();
+  llvm::InitializeAllTargetMCs();
+  llvm::InitializeAllAsmParsers();
+  llvm::InitializeAllAsmPrinters();
+
+  std::string llvm_err;
+  auto arch = llvm::TargetRegistry::lookupTarget(triple, llvm_err);
+
+  if(!arch)
+  {
+    llvm::errs() << llvm_err;
+    return ERR_FATAL_UNKNOWN_TARGET;
+  }
+
+  for(varuint32 i = 0; i < env->n_modules; ++i)
+    if(env->modules[i].knownsections & (1 << WASM_SECTION_START))
+      has_start = true;
 
-  if(env->optimize & ENV_OPTIMIZE_OMASK)
-    OptimizeModules(env);
+  // Instances are created and initialized by the host, so there is no entry point to run when the library is loaded
+  if(env->flags & ENV_MULTI_INSTANCE)
+    env->flags |= ENV_LIBRARY | ENV_NO_INIT;
 
-  return LinkEnvironment(env, outfile);
+  if((!has_start || env->flags & ENV_NO_INIT) && !(env->flags & ENV_LIBRARY))
+  {
+    env->flags |= ENV_LIBRARY; // Attempting to compile a library as an EXE is a common error, so we fix it for you.
+    fprintf(
+      env->log,
+      "WARNING: Compiling dynamic library because no start function was found! If this was intended, use '-f library' next time.\n");
+  }
+
+  // Detect current CPU feature set, unless a specific CPU was requested. A multiversioned program has to run on any x86-64
+  // CPU, so it starts from baseline x86-64 instead of the host. Every module gets its own machine target for LLVM, because
+  // a TargetMachine cannot be shared between threads.
+  llvm::TargetOptions opt;
+  auto RM = llvm::Optional<llvm::Reloc::Model>();
+#ifdef IN_PLATFORM_POSIX
+  if(env->flags & ENV_LIBRARY)
+    RM = llvm::Optional<llvm::Reloc::Model>(llvm::Reloc::PIC_);
+#endif
+  bool multiversion = UsesMultiversioning(env->optimize, llvm::Triple(triple));
+  llvm::SubtargetFeatures subtarget_features;
+  llvm::StringMap<bool> feature_map;
+  if(!env->cpu && !multiversion && llvm::sys::getHostCPUFeatures(feature_map))
+  {
+    for(auto& feature : feature_map)
+    {
+      subtarget_features.AddFeature(feature.first(), feature.second);
+    }
+  }
+  if(env->cpufeatures)
+  {
+    for(auto& feature : llvm::SubtargetFeatures(env->cpufeatures).getFeatures())
+      subtarget_features.AddFeature(feature);
+  }
+  std::string cpu      = env->cpu ? env->cpu : multiversion ? "x86-64" : llvm::sys::getHostCPUName().str();
+  std::string features = subtarget_features.getString();
+
+  if(!env->n_modules)
+    return ERR_FATAL_NO_MODULES;
+
+  llvm::FastMathFlags fmf;
+  if(env->optimize & ENV_OPTIMIZE_FAST_MATH)
+  {
+    if(env->optimize & ENV_OPTIMIZE_FAST_MATH_REASSOCIATE)
+      fmf.setAllowReassoc();
+    if(env->optimize & ENV_OPTIMIZE_FAST_MATH_NO_NAN)
+      fmf.setNoNaNs();
+    if(env->optimize & ENV_OPTIMIZE_FAST_MATH_NO_INF)
+      fmf.setNoInfs();
+    if(env->optimize & ENV_OPTIMIZE_FAST_MATH_NO_SIGNED_ZERO)
+      fmf.setNoSignedZeros();
+    if(env->optimize & ENV_OPTIMIZE_FAST_MATH_ALLOW_RECIPROCAL)
+      fmf.setAllowReassoc();
+    if(env->optimize & ENV_OPTIMIZE_FAST_MATH_CONTRACT)
+      fmf.setAllowContract();
+    if(env->optimize & ENV_OPTIMIZE_FAST_MATH_ALLOW_APPROXIMATE_FUNCTIONS)
+      fmf.setApproxFunc();
+  }
+
+  if(objcache)
+  {
+    path objpath = !env->objpath ? file.parent_path() : utility::GetPath(env->objpath);
+    objcache->emplace(*env, objpath / utility::IN_OBJECT_CACHE_DIR, triple + " " + cpu + " " + features);
+  }
+
+  // Create a compiler for every module that needs to be recompiled. Each one owns a separate LLVMContext, IRBuilder and
+  // TargetMachine, so modules never share any LLVM state and can be compiled independently of each other.
+  for(varuint32 i = 0; i < env->n_modules; ++i)
+  {
+    // Always recompile the 0th module because it stores the main entry point. Without an object cache, every module must
+    // be recompiled, because only freshly generated LLVM modules can be handed to the JIT. Link-time optimization also
+    // needs the IR of every module.
+    if(!i || !env->modules[i].cache || !objcache || lto)
+    {
+      if(env->modules[i].cache)
+        DeleteCache(*env, env->modules[i]);
+
+      auto context = new llvm::LLVMContext();
+      auto builder = new llvm::IRBuilder<>(*context);
+      builder->setFastMathFlags(fmf);
+      env->modules[i].cache =
+        new Compiler{ *env,
+                      env->modules[i],
+                      *context,
+                      0,
+                      *builder,
+                      arch->createTargetMachine(triple, cpu, features, opt, RM, llvm::None),
+                      kh_init_importhash(),
+                      objcache ? GetLinkerObjectPath(*env, env->modules[i], file) : path() };
+      if(!env->modules[i].cache->objfile.empty())
+        remove(env->modules[i].cache->objfile);
+
+      // If this exact module was compiled before, this copies the old object file instead of compiling it again
+      if(objcache && !lto)
+      {
+        env->modules[i].cache->cachekey = (*objcache)->GetKey(i);
+        (*objcache)->Fetch(*env->modules[i].cache);
+      }
+      new_modules.push_back(env->modules + i);
+    }
+  }
+
+  err = pool.Map(new_modules.size(), [&](size_t i) -> IN_ERROR {
+    if(new_modules[i]->cache->fromcache)
+      return ERR_SUCCESS;
+    return new_modules[i]->cache->CompileModule(static_cast<varuint32>(new_modules[i] - env->modules));
+  });
+  if(err < 0)
+    return err;
+
+  has_start = false;
+  for(varuint32 i = 0; i < env->n_modules; ++i)
+    has_start |= !env->modules[i].cache->startsym.empty();
+
+  if((!has_start || env->flags & ENV_NO_INIT) && !(env->flags & ENV_LIBRARY))
+    return ERR_INVALID_START_FUNCTION;
+
+  // Resolving exports can add aliases to any module, including ones compiled by a previous call, so this must be done
+  // serially
+  for(auto m : new_modules)
+    Compiler::ResolveModuleExports(env, m);
+
+  pool.Map(new_modules.size(), [&](size_t i) -> IN_ERROR {
+    if(!new_modules[i]->cache->fromcache)
+    {
+      new_modules[i]->cache->AddMemLocalCaching();
+      if(env->flags & ENV_MULTI_INSTANCE)
+        new_modules[i]->cache->AddInstanceContext();
+      if(multiversion)
+        new_modules[i]->cache->AddMultiversioning();
+    }
+    return ERR_SUCCESS;
+  });
+
+  // The entry point lives in the first module, so if it came from the object cache, the entry point already exists
+  if(!env->modules[0].cache->fromcache)
+    Compiler::CompileEntryPoint(env);
+
+  if(lto && (err = MergeModules(env)) < 0)
+    return err;
+
+  if((env->optimize & ENV_OPTIMIZE_OMASK) && (err = OptimizeModules(env, file, pool)) < 0)
+    return err;
+
+  return ERR_SUCCESS;
+}
+
+IN_ERROR innative::CompileEnvironment(Environment* env, const char* outfile)
+{
+  if(!outfile || !outfile[0])
+    return ERR_FATAL_NO_OUTPUT_FILE;
+
+  path file = utility::GetPath(outfile);
+
+  if(!file.is_absolute())
+    file = utility::GetWorkingDir() / file;
+
+  // The snapshot changes the initial state of every module, so it has to be taken before any of them are compiled
+  IN_ERROR err;
+  if(env->flags & ENV_SNAPSHOT)
+  {
+    if(!(env->flags & ENV_LIBRARY))
+    {
+      if(env->loglevel >= LOG_ERROR)
+        fprintf(env->log, "ERROR: Snapshots can only be taken of a library, use '-f library' to compile one.\n");
+      return ERR_FATAL_SNAPSHOT_FAILED;
+    }
+    if((err = SnapshotEnvironment(env)) < 0)
+      return err;
+  }
+
+  ThreadPool pool(ThreadPool::Concurrency(*env));
+  std::vector<Module*> new_modules;
+  std::optional<ObjectCache> objcache;
+
+  err = GenerateEnvironment(env, file, pool, new_modules, &objcache);
+  if(err < 0)
+    return err;
+
+  if((err = LinkEnvironment(env, outfile, pool)) < 0)
+    return err;
+
+  // Only add object files to the cache once we know they linked successfully
+  for(auto m : new_modules)
+    objcache->Store(*m->cache);
+
+  objcache->Flush(); // Failing to update the cache does not invalidate the output we just linked
+  return err;
 }
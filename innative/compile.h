@@ -5,6 +5,7 @@
 #define IN__COMPILE_H
 
 #include "innative/schema.h"
+#include "innative/export.h"
 #include "constants.h"
 #include "llvm.h"
 #include "filesys.h"
@@ -54,12 +55,31 @@ namespace innative {
       llvm::AllocaInst* memlocal;
     };
 
+    // Passive segments keep their contents in a constant global, along with a mutable size that drop instructions zero out.
+    // Active and declarative segments are dropped during instantiation, so both of their members are null.
+    struct Segment
+    {
+      llvm::GlobalVariable* data;
+      llvm::GlobalVariable* size; // in bytes
+    };
+
+    // Type-based alias analysis tags. They tell LLVM that linear memory, wasm globals, table entries and the memory and
+    // table pairs can never overlap, so a store to linear memory doesn't force a global or the memory base to be reloaded.
+    struct AliasTags
+    {
+      llvm::MDNode* memory;
+      llvm::MDNode* global;
+      llvm::MDNode* table;
+      llvm::MDNode* mempair;
+      llvm::MDNode* tablepair;
+    };
+
     Environment& env;
     Module& m;
-    llvm::LLVMContext& ctx;
+    llvm::LLVMContext& ctx; // Owned by this compiler, so each module can be compiled on a separate thread
     llvm::Module* mod;
-    llvm::IRBuilder<>& builder;
-    llvm::TargetMachine* machine;
+    llvm::IRBuilder<>& builder;   // Owned by this compiler
+    llvm::TargetMachine* machine; // Owned by this compiler
     kh_importhash_t* importhash;
     path objfile; // If this module has been compiled to a .obj file, stores the path so we can reliably delete it.
     llvm::IntegerType* intptrty;
@@ -72,6 +92,9 @@ namespace innative {
     std::vector<llvm::GlobalVariable*> memories;
     std::vector<llvm::GlobalVariable*> tables;
     std::vector<llvm::GlobalVariable*> globals;
+    std::vector<Segment> datasegments;
+    std::vector<Segment> elemsegments;
+    AliasTags tbaa;
     llvm::GlobalVariable* exported_functions;
     std::vector<FunctionSet> functions;
     llvm::Function* init;
@@ -81,7 +104,24 @@ namespace innative {
     llvm::Function* atomic_notify;
     llvm::Function* atomic_wait32;
     llvm::Function* atomic_wait64;
+    llvm::Function* env_memcpy;
+    llvm::Function* env_memmove;
+    llvm::Function* env_memset;
+    llvm::Function* env_mapdata;
+    llvm::Function* bounds_check; // Marker for memory bounds checks that the optimizer lowers, or null if not optimizing
+    llvm::Function* trap;         // Runtime handler called by every trap landing pad
+    varuint32 trapfunction;       // Function index reported to the trap handler, or ~0 outside of a function
+    uint64_t traplocation;        // Location of the instruction being compiled, packed as (line << 32) | column
+    // Location PHI of the shared landing pad for each kind of trap in the function currently being compiled
+    llvm::PHINode* trappads[IN_TRAP_COUNT];
     std::string natvis;
+    std::string cachekey; // Key of this module in the object cache, or empty if it can't be cached
+    std::string startsym; // Symbol name of the start function, which is all we know about it if fromcache is true
+    bool fromcache;       // If true, the object file was copied from the object cache, so there is no LLVM module
+    bool guardpages;      // If true, linear memories are surrounded by guard pages and need no explicit bounds checks
+    bool stablememory;    // If true, linear memories never move once allocated, so their base pointer is invariant
+    bool pooledmemory;    // If true, linear memories and tables are allocated from the runtime's slot pools
+    bool mappeddata;      // If true, the initial contents of linear memories are mapped from the binary, not copied
 
     using Func    = llvm::Function;
     using FuncTy  = llvm::FunctionType;
@@ -93,8 +133,16 @@ namespace innative {
     llvm::StructType* GetTableType(varsint7 element_type);
     llvm::StructType* GetPairType(llvmTy* ty);
     llvm::Value* GetPairPtr(llvm::GlobalVariable* v, int index);
+    llvm::LoadInst* LoadPair(llvm::GlobalVariable* v, int index, llvm::MDNode* tag);
+    llvm::StoreInst* StorePair(llvmVal* value, llvm::GlobalVariable* v, int index, llvm::MDNode* tag);
+    template<class T> inline T* TagAccess(T* access, llvm::MDNode* tag)
+    {
+      access->setMetadata(llvm::LLVMContext::MD_tbaa, tag);
+      return access;
+    }
     llvm::Constant* GetPairNull(llvm::StructType* ty);
-    IN_ERROR InsertConditionalTrap(llvmVal* cond);
+    BB* GetTrapBlock(IN_TRAP_CODE code);
+    IN_ERROR InsertConditionalTrap(llvmVal* cond, IN_TRAP_CODE code);
     llvmTy* GetLLVMType(varsint7 type);
     FuncTy* GetFunctionType(FunctionType& signature);
     Func* HomogenizeFunction(Func* fn, llvm::StringRef name, const llvm::Twine& canonical,
@@ -112,6 +160,7 @@ namespace innative {
     IN_ERROR PopLabel(BB* block);
     void PolymorphicStack();
     llvmVal* GetMemSize(llvm::GlobalVariable* target);
+    llvmVal* GetTableSize(llvm::GlobalVariable* target);
     varuint32 GetFirstType(varuint32 type);
     llvmVal* GetMemPointer(llvmVal* base, llvm::PointerType* pointer_type, varuint32 memory, varuint32 offset);
     IN_ERROR InsertTruncTrap(double max, double min, llvm::Type* ty);
@@ -124,7 +173,10 @@ namespace innative {
                         Func* (Compiler::*wrapper)(Func* fn, llvm::StringRef name, const llvm::Twine& canonical,
                                                    llvm::GlobalValue::LinkageTypes linkage, llvm::CallingConv::ID callconv),
                         llvm::StringRef name, const llvm::Twine& canonical);
+    bool PassesInRegisters(FuncTy* ty);
     void AddMemLocalCaching();
+    void AddMultiversioning();
+    void AddInstanceContext();
 
     Func* CompileFunction(FunctionType& signature, const llvm::Twine& name);
     IN_ERROR CompileSelectOp(const llvm::Twine& name, llvm::Instruction* from);
@@ -132,13 +184,14 @@ namespace innative {
     IN_ERROR CompileElseBlock();
     IN_ERROR CompileReturn(varsint7 sig);
     IN_ERROR CompileEndBlock();
-    void CompileTrap();
+    void CompileTrap(IN_TRAP_CODE code);
     IN_ERROR CompileBranch(varuint32 depth);
     IN_ERROR CompileIfBranch(varuint32 depth);
     IN_ERROR CompileBranchTable(varuint32 n_table, varuint32* table, varuint32 def);
-    IN_ERROR CompileCall(varuint32 index);
+    IN_ERROR CompileCall(varuint32 index, bool tail = false);
     IN_ERROR CompileConstant(Instruction& instruction, llvm::Constant*& constant);
-    IN_ERROR CompileIndirectCall(varuint32 index);
+    IN_ERROR CompileIndirectCall(varuint32 index, bool tail = false);
+    IN_ERROR CompileTailReturn(llvm::CallInst* call);
     llvmVal* CompileMemSize(llvm::GlobalVariable* target);
     IN_ERROR CompileMemGrow(varuint32 memory, const char* name);
     void DumpCompilerState();
@@ -147,6 +200,7 @@ namespace innative {
                                  FunctionBody& body);
     IN_ERROR CompileInitGlobal(Module& m, varuint32 index, llvm::Constant*& out);
     IN_ERROR CompileInitConstant(Instruction& instruction, Module& m, llvm::Constant*& out);
+    IN_ERROR CompileMappedData(Module& m, std::vector<bool>& mapped);
     IN_ERROR CompileModule(varuint32 m_idx);
 
     IN_ERROR IN_Intrinsic_ToC(llvm::Value** params, llvm::Value*& out);
@@ -159,13 +213,15 @@ namespace innative {
     static bool CheckType(varsint7 ty, llvmVal* v);
     static uint64_t GetLocalOffset(llvm::AllocaInst* p);
     static Func* TopLevelFunction(llvm::LLVMContext& context, llvm::IRBuilder<>& builder, const char* name,
-                                  llvm::Module* m);
+                                  llvm::Module* m, FuncTy* type = nullptr);
     static void PostOrderTraversal(llvm::Function* f);
-    static void ResolveModuleExports(const Environment* env, Module* root, llvm::LLVMContext& context);
+    static void ResolveModuleExports(const Environment* env, Module* root);
+    static void CompileEntryPoint(Environment* env);
 
-    // In order to directly call external functions we default to C
-    // static const llvm::CallingConv::ID InternalConvention = llvm::CallingConv::Fast;
-    static const llvm::CallingConv::ID InternalConvention = llvm::CallingConv::C;
+    // Function bodies use the tail call convention so that return_call can always be lowered to a real tail call. Anything
+    // that crosses into or out of webassembly code goes through a C wrapper (see ExportFunction and the imports in
+    // CompileModule).
+    static const llvm::CallingConv::ID InternalConvention = llvm::CallingConv::Tail;
     static const struct Intrinsic intrinsics[4];
 
     inline static std::string CppString(const char* str, size_t len)
@@ -345,6 +401,39 @@ namespace innative {
 
     IN_ERROR CompileAtomicRMW(Instruction& ins, WASM_TYPE_ENCODING varTy, llvm::AtomicRMWInst::BinOp Op, const char* name);
     IN_ERROR CompileAtomicCmpXchg(Instruction& ins, WASM_TYPE_ENCODING varTy, const char* name);
+
+    IN_ERROR CompileMiscInstruction(Instruction& ins);
+    IN_ERROR CompileSignExtend(varsint7 ty, llvmTy* from, const llvm::Twine& name);
+    IN_ERROR CompileTruncSatOp(varsint7 from, llvmTy* ty, bool sign, const llvm::Twine& name);
+
+    llvmVal* GetMemBase(varuint32 memory);
+    uint64_t GetTableWidth(varuint32 table);
+    llvmVal* GetSegmentSize(const Segment& segment);
+    llvmVal* GetBulkRangeCheck(llvmVal* offset, llvmVal* n, llvmVal* size, uint64_t scale);
+    void CompileBulkCopy(llvmVal* dest, llvmVal* src, llvmVal* n, bool overlap);
+
+    IN_ERROR CompileMemInit(varuint32 segment, varuint32 memory);
+    IN_ERROR CompileMemCopy(varuint32 dest, varuint32 src);
+    IN_ERROR CompileMemFill(varuint32 memory);
+    IN_ERROR CompileTableInit(varuint32 segment, varuint32 table);
+    IN_ERROR CompileTableCopy(varuint32 dest, varuint32 src);
+    IN_ERROR CompileSegmentDrop(Segment& segment);
+
+    IN_ERROR CompileSIMDInstruction(Instruction& ins);
+
+    llvm::VectorType* GetSIMDShape(WASM_TYPE_ENCODING scalar, unsigned lanes);
+    llvm::VectorType* GetSIMDOperandShape(uint8_t op);
+    IN_ERROR PopSIMD(llvmTy* shape, llvmVal*& v);
+    IN_ERROR PushSIMD(llvmVal* v);
+    llvmVal* CompileShuffleRange(llvmVal* a, llvmVal* b, unsigned first, unsigned count, unsigned stride = 1);
+    llvmVal* CompileTruncSat(llvmVal* v, llvmTy* ty, bool sign, const llvm::Twine& name);
+
+    IN_ERROR CompileSIMDMemory(Instruction& ins, const char* name);
+    IN_ERROR CompileSIMDLane(Instruction& ins, const char* name);
+    IN_ERROR CompileSIMDTest(Instruction& ins, const char* name);
+    IN_ERROR CompileSIMDShift(Instruction& ins, const char* name);
+    IN_ERROR CompileSIMDUnary(Instruction& ins, const char* name);
+    IN_ERROR CompileSIMDBinary(Instruction& ins, const char* name);
   };
 
   template<typename... Args> IN_FORCEINLINE std::string FormatString(bool xml, const char* format, Args&&... args)
@@ -66,6 +66,7 @@ namespace innative {
       { ERR_FATAL_UNKNOWN_INSTRUCTION, "ERR_FATAL_UNKNOWN_INSTRUCTION" },
       { ERR_FATAL_UNKNOWN_SECTION, "ERR_FATAL_UNKNOWN_SECTION" },
       { ERR_FATAL_SECTION_SIZE_MISMATCH, "ERR_FATAL_SECTION_SIZE_MISMATCH" },
+      { ERR_FATAL_SNAPSHOT_FAILED, "ERR_FATAL_SNAPSHOT_FAILED" },
       { ERR_FATAL_UNKNOWN_FUNCTION_SIGNATURE, "ERR_FATAL_UNKNOWN_FUNCTION_SIGNATURE" },
       { ERR_FATAL_UNKNOWN_TARGET, "ERR_FATAL_UNKNOWN_TARGET" },
       { ERR_FATAL_EXPECTED_END_INSTRUCTION, "ERR_FATAL_EXPECTED_END_INSTRUCTION" },
@@ -141,6 +142,12 @@ namespace innative {
       { ERR_SIGNATURE_MISMATCH, "ERR_SIGNATURE_MISMATCH" },
       { ERR_EXPECTED_ELSE_INSTRUCTION, "ERR_EXPECTED_ELSE_INSTRUCTION" },
       { ERR_ILLEGAL_C_IMPORT, "ERR_ILLEGAL_C_IMPORT" },
+      { ERR_INVALID_LANE_INDEX, "ERR_INVALID_LANE_INDEX" },
+      { ERR_INVALID_DATA_INDEX, "ERR_INVALID_DATA_INDEX" },
+      { ERR_INVALID_ELEMENT_INDEX, "ERR_INVALID_ELEMENT_INDEX" },
+      { ERR_DATA_COUNT_MISMATCH, "ERR_DATA_COUNT_MISMATCH" },
+      { ERR_MISSING_DATA_COUNT, "ERR_MISSING_DATA_COUNT" },
+      { ERR_MULTI_INSTANCE_IMPORT, "ERR_MULTI_INSTANCE_IMPORT" },
       { ERR_WAT_INTERNAL_ERROR, "ERR_WAT_INTERNAL_ERROR" },
       { ERR_WAT_EXPECTED_OPEN, "ERR_WAT_EXPECTED_OPEN" },
       { ERR_WAT_EXPECTED_CLOSE, "ERR_WAT_EXPECTED_CLOSE" },
@@ -196,6 +203,7 @@ namespace innative {
       { TE_i64, "TE_i64" },
       { TE_f32, "TE_f32" },
       { TE_f64, "TE_f64" },
+      { TE_v128, "TE_v128" },
       { TE_funcref, "TE_funcref" },
       { TE_cref, "TE_cref" },
       { TE_func, "TE_func" },
@@ -208,6 +216,11 @@ namespace innative {
     const kh_mapenum_s* WAST_ASSERTION_MAP = GenMapEnum({
       { ERR_WAT_INVALID_ALIGNMENT, "alignment" },
       { ERR_INVALID_MEMORY_ALIGNMENT, "alignment must not be larger than natural" },
+      { ERR_INVALID_LANE_INDEX, "invalid lane index" },
+      { ERR_INVALID_DATA_INDEX, "unknown data segment" },
+      { ERR_INVALID_ELEMENT_INDEX, "unknown elem segment" },
+      { ERR_DATA_COUNT_MISMATCH, "data count and data section have inconsistent lengths" },
+      { ERR_MISSING_DATA_COUNT, "data count section required" },
       { ERR_INVALID_MEMORY_OFFSET, "out of bounds memory access" },
       { ERR_END_MISMATCH, "unexpected end" },
       { ERR_PARSE_INVALID_MAGIC_COOKIE, "magic header not detected" },
@@ -107,8 +107,13 @@ namespace innative {
     constexpr char IN_GETCPUINFO[]           = "__innative_getcpuinfo";
     constexpr char IN_EXTENSION[]            = ".ir-cache";
     constexpr char IN_ENV_EXTENSION[]        = ".ir-env-cache";
+    constexpr char IN_OBJECT_CACHE_DIR[]     = "innative-cache";
+    constexpr char IN_OBJECT_CACHE_INDEX[]   = "index";
+    constexpr char IN_OBJECT_CACHE_LOCK[]    = "index.lock";
+    constexpr uint64_t IN_OBJECT_CACHE_LIMIT = 1ULL << 30; // Default maximum size of the object cache
     constexpr char IN_GLUE_STRING[]          = "_WASM_";
     constexpr char IN_MEMORY_MAX_METADATA[]  = "__IN_MEMORY_MAX_METADATA";
+    constexpr char IN_MEMORY_MIN_METADATA[]  = "__IN_MEMORY_MIN_METADATA";
     constexpr char IN_LOCAL_INDEX_METADATA[] = "__IN_LOCAL_INDEX";
     constexpr char IN_MEMORY_GROW_METADATA[] = "__IN_MEMORY_GROW_METADATA";
     constexpr char IN_FUNCTION_TRAVERSED[]   = "__IN_FUNCTION_TRAVERSED";
@@ -146,7 +151,7 @@ namespace innative {
       inline const char* operator[](const uint8_t (&x)[MAX_OPCODE_BYTES]) const { return Get(ToInt(x)); }
 
       kh_mapenum_s* MAP;
-      static constexpr std::array<std::pair<std::array<uint8_t, 2>, const char*>, 239> LIST = {
+      static constexpr std::array<std::pair<std::array<uint8_t, 2>, const char*>, 497> LIST = {
         // Control flow operators
         std::pair<std::array<uint8_t, 2>, const char*>{ { 0x00, 0x00 }, "unreachable" },
         { { 0x01, 0x00 }, "nop" },
@@ -163,6 +168,8 @@ namespace innative {
         // Call operators
         { { 0x10, 0x00 }, "call" },
         { { 0x11, 0x00 }, "call_indirect" },
+        { { 0x12, 0x00 }, "return_call" },
+        { { 0x13, 0x00 }, "return_call_indirect" },
 
         // Parametric operators
         { { 0x1a, 0x00 }, "drop" },
@@ -348,6 +355,32 @@ namespace innative {
         { { 0xbe, 0x00 }, "f32.reinterpret_i32" },
         { { 0xbf, 0x00 }, "f64.reinterpret_i64" },
 
+        // Sign extension
+        { { 0xc0, 0x00 }, "i32.extend8_s" },
+        { { 0xc1, 0x00 }, "i32.extend16_s" },
+        { { 0xc2, 0x00 }, "i64.extend8_s" },
+        { { 0xc3, 0x00 }, "i64.extend16_s" },
+        { { 0xc4, 0x00 }, "i64.extend32_s" },
+
+        // Non-trapping float to int conversions
+        { { 0xfc, 0x00 }, "i32.trunc_sat_f32_s" },
+        { { 0xfc, 0x01 }, "i32.trunc_sat_f32_u" },
+        { { 0xfc, 0x02 }, "i32.trunc_sat_f64_s" },
+        { { 0xfc, 0x03 }, "i32.trunc_sat_f64_u" },
+        { { 0xfc, 0x04 }, "i64.trunc_sat_f32_s" },
+        { { 0xfc, 0x05 }, "i64.trunc_sat_f32_u" },
+        { { 0xfc, 0x06 }, "i64.trunc_sat_f64_s" },
+        { { 0xfc, 0x07 }, "i64.trunc_sat_f64_u" },
+
+        // Bulk memory
+        { { 0xfc, 0x08 }, "memory.init" },
+        { { 0xfc, 0x09 }, "data.drop" },
+        { { 0xfc, 0x0a }, "memory.copy" },
+        { { 0xfc, 0x0b }, "memory.fill" },
+        { { 0xfc, 0x0c }, "table.init" },
+        { { 0xfc, 0x0d }, "elem.drop" },
+        { { 0xfc, 0x0e }, "table.copy" },
+
         // Atomics
         { { 0xfe, 0x00 }, "memory.atomic.notify" },
         { { 0xfe, 0x01 }, "memory.atomic.wait32" },
@@ -425,6 +458,263 @@ namespace innative {
         { { 0xfe, 0x4C }, "i64.atomic.rmw8.cmpxchg_u" },
         { { 0xfe, 0x4D }, "i64.atomic.rmw16.cmpxchg_u" },
         { { 0xfe, 0x4E }, "i64.atomic.rmw32.cmpxchg_u" },
+
+        // SIMD
+        { { 0xfd, 0x00 }, "v128.load" },
+        { { 0xfd, 0x01 }, "v128.load8x8_s" },
+        { { 0xfd, 0x02 }, "v128.load8x8_u" },
+        { { 0xfd, 0x03 }, "v128.load16x4_s" },
+        { { 0xfd, 0x04 }, "v128.load16x4_u" },
+        { { 0xfd, 0x05 }, "v128.load32x2_s" },
+        { { 0xfd, 0x06 }, "v128.load32x2_u" },
+        { { 0xfd, 0x07 }, "v128.load8_splat" },
+        { { 0xfd, 0x08 }, "v128.load16_splat" },
+        { { 0xfd, 0x09 }, "v128.load32_splat" },
+        { { 0xfd, 0x0a }, "v128.load64_splat" },
+        { { 0xfd, 0x0b }, "v128.store" },
+
+        { { 0xfd, 0x0c }, "v128.const" },
+        { { 0xfd, 0x0d }, "i8x16.shuffle" },
+        { { 0xfd, 0x0e }, "i8x16.swizzle" },
+
+        { { 0xfd, 0x0f }, "i8x16.splat" },
+        { { 0xfd, 0x10 }, "i16x8.splat" },
+        { { 0xfd, 0x11 }, "i32x4.splat" },
+        { { 0xfd, 0x12 }, "i64x2.splat" },
+        { { 0xfd, 0x13 }, "f32x4.splat" },
+        { { 0xfd, 0x14 }, "f64x2.splat" },
+
+        { { 0xfd, 0x15 }, "i8x16.extract_lane_s" },
+        { { 0xfd, 0x16 }, "i8x16.extract_lane_u" },
+        { { 0xfd, 0x17 }, "i8x16.replace_lane" },
+        { { 0xfd, 0x18 }, "i16x8.extract_lane_s" },
+        { { 0xfd, 0x19 }, "i16x8.extract_lane_u" },
+        { { 0xfd, 0x1a }, "i16x8.replace_lane" },
+        { { 0xfd, 0x1b }, "i32x4.extract_lane" },
+        { { 0xfd, 0x1c }, "i32x4.replace_lane" },
+        { { 0xfd, 0x1d }, "i64x2.extract_lane" },
+        { { 0xfd, 0x1e }, "i64x2.replace_lane" },
+        { { 0xfd, 0x1f }, "f32x4.extract_lane" },
+        { { 0xfd, 0x20 }, "f32x4.replace_lane" },
+        { { 0xfd, 0x21 }, "f64x2.extract_lane" },
+        { { 0xfd, 0x22 }, "f64x2.replace_lane" },
+
+        { { 0xfd, 0x23 }, "i8x16.eq" },
+        { { 0xfd, 0x24 }, "i8x16.ne" },
+        { { 0xfd, 0x25 }, "i8x16.lt_s" },
+        { { 0xfd, 0x26 }, "i8x16.lt_u" },
+        { { 0xfd, 0x27 }, "i8x16.gt_s" },
+        { { 0xfd, 0x28 }, "i8x16.gt_u" },
+        { { 0xfd, 0x29 }, "i8x16.le_s" },
+        { { 0xfd, 0x2a }, "i8x16.le_u" },
+        { { 0xfd, 0x2b }, "i8x16.ge_s" },
+        { { 0xfd, 0x2c }, "i8x16.ge_u" },
+
+        { { 0xfd, 0x2d }, "i16x8.eq" },
+        { { 0xfd, 0x2e }, "i16x8.ne" },
+        { { 0xfd, 0x2f }, "i16x8.lt_s" },
+        { { 0xfd, 0x30 }, "i16x8.lt_u" },
+        { { 0xfd, 0x31 }, "i16x8.gt_s" },
+        { { 0xfd, 0x32 }, "i16x8.gt_u" },
+        { { 0xfd, 0x33 }, "i16x8.le_s" },
+        { { 0xfd, 0x34 }, "i16x8.le_u" },
+        { { 0xfd, 0x35 }, "i16x8.ge_s" },
+        { { 0xfd, 0x36 }, "i16x8.ge_u" },
+
+        { { 0xfd, 0x37 }, "i32x4.eq" },
+        { { 0xfd, 0x38 }, "i32x4.ne" },
+        { { 0xfd, 0x39 }, "i32x4.lt_s" },
+        { { 0xfd, 0x3a }, "i32x4.lt_u" },
+        { { 0xfd, 0x3b }, "i32x4.gt_s" },
+        { { 0xfd, 0x3c }, "i32x4.gt_u" },
+        { { 0xfd, 0x3d }, "i32x4.le_s" },
+        { { 0xfd, 0x3e }, "i32x4.le_u" },
+        { { 0xfd, 0x3f }, "i32x4.ge_s" },
+        { { 0xfd, 0x40 }, "i32x4.ge_u" },
+
+        { { 0xfd, 0x41 }, "f32x4.eq" },
+        { { 0xfd, 0x42 }, "f32x4.ne" },
+        { { 0xfd, 0x43 }, "f32x4.lt" },
+        { { 0xfd, 0x44 }, "f32x4.gt" },
+        { { 0xfd, 0x45 }, "f32x4.le" },
+        { { 0xfd, 0x46 }, "f32x4.ge" },
+
+        { { 0xfd, 0x47 }, "f64x2.eq" },
+        { { 0xfd, 0x48 }, "f64x2.ne" },
+        { { 0xfd, 0x49 }, "f64x2.lt" },
+        { { 0xfd, 0x4a }, "f64x2.gt" },
+        { { 0xfd, 0x4b }, "f64x2.le" },
+        { { 0xfd, 0x4c }, "f64x2.ge" },
+
+        { { 0xfd, 0x4d }, "v128.not" },
+        { { 0xfd, 0x4e }, "v128.and" },
+        { { 0xfd, 0x4f }, "v128.andnot" },
+        { { 0xfd, 0x50 }, "v128.or" },
+        { { 0xfd, 0x51 }, "v128.xor" },
+        { { 0xfd, 0x52 }, "v128.bitselect" },
+        { { 0xfd, 0x53 }, "v128.any_true" },
+
+        { { 0xfd, 0x54 }, "v128.load8_lane" },
+        { { 0xfd, 0x55 }, "v128.load16_lane" },
+        { { 0xfd, 0x56 }, "v128.load32_lane" },
+        { { 0xfd, 0x57 }, "v128.load64_lane" },
+        { { 0xfd, 0x58 }, "v128.store8_lane" },
+        { { 0xfd, 0x59 }, "v128.store16_lane" },
+        { { 0xfd, 0x5a }, "v128.store32_lane" },
+        { { 0xfd, 0x5b }, "v128.store64_lane" },
+        { { 0xfd, 0x5c }, "v128.load32_zero" },
+        { { 0xfd, 0x5d }, "v128.load64_zero" },
+
+        { { 0xfd, 0x5e }, "f32x4.demote_f64x2_zero" },
+        { { 0xfd, 0x5f }, "f64x2.promote_low_f32x4" },
+
+        { { 0xfd, 0x60 }, "i8x16.abs" },
+        { { 0xfd, 0x61 }, "i8x16.neg" },
+        { { 0xfd, 0x62 }, "i8x16.popcnt" },
+        { { 0xfd, 0x63 }, "i8x16.all_true" },
+        { { 0xfd, 0x64 }, "i8x16.bitmask" },
+        { { 0xfd, 0x65 }, "i8x16.narrow_i16x8_s" },
+        { { 0xfd, 0x66 }, "i8x16.narrow_i16x8_u" },
+        { { 0xfd, 0x67 }, "f32x4.ceil" },
+        { { 0xfd, 0x68 }, "f32x4.floor" },
+        { { 0xfd, 0x69 }, "f32x4.trunc" },
+        { { 0xfd, 0x6a }, "f32x4.nearest" },
+        { { 0xfd, 0x6b }, "i8x16.shl" },
+        { { 0xfd, 0x6c }, "i8x16.shr_s" },
+        { { 0xfd, 0x6d }, "i8x16.shr_u" },
+        { { 0xfd, 0x6e }, "i8x16.add" },
+        { { 0xfd, 0x6f }, "i8x16.add_sat_s" },
+        { { 0xfd, 0x70 }, "i8x16.add_sat_u" },
+        { { 0xfd, 0x71 }, "i8x16.sub" },
+        { { 0xfd, 0x72 }, "i8x16.sub_sat_s" },
+        { { 0xfd, 0x73 }, "i8x16.sub_sat_u" },
+        { { 0xfd, 0x74 }, "f64x2.ceil" },
+        { { 0xfd, 0x75 }, "f64x2.floor" },
+        { { 0xfd, 0x76 }, "i8x16.min_s" },
+        { { 0xfd, 0x77 }, "i8x16.min_u" },
+        { { 0xfd, 0x78 }, "i8x16.max_s" },
+        { { 0xfd, 0x79 }, "i8x16.max_u" },
+        { { 0xfd, 0x7a }, "f64x2.trunc" },
+        { { 0xfd, 0x7b }, "i8x16.avgr_u" },
+
+        { { 0xfd, 0x7c }, "i16x8.extadd_pairwise_i8x16_s" },
+        { { 0xfd, 0x7d }, "i16x8.extadd_pairwise_i8x16_u" },
+        { { 0xfd, 0x7e }, "i32x4.extadd_pairwise_i16x8_s" },
+        { { 0xfd, 0x7f }, "i32x4.extadd_pairwise_i16x8_u" },
+
+        { { 0xfd, 0x80 }, "i16x8.abs" },
+        { { 0xfd, 0x81 }, "i16x8.neg" },
+        { { 0xfd, 0x82 }, "i16x8.q15mulr_sat_s" },
+        { { 0xfd, 0x83 }, "i16x8.all_true" },
+        { { 0xfd, 0x84 }, "i16x8.bitmask" },
+        { { 0xfd, 0x85 }, "i16x8.narrow_i32x4_s" },
+        { { 0xfd, 0x86 }, "i16x8.narrow_i32x4_u" },
+        { { 0xfd, 0x87 }, "i16x8.extend_low_i8x16_s" },
+        { { 0xfd, 0x88 }, "i16x8.extend_high_i8x16_s" },
+        { { 0xfd, 0x89 }, "i16x8.extend_low_i8x16_u" },
+        { { 0xfd, 0x8a }, "i16x8.extend_high_i8x16_u" },
+        { { 0xfd, 0x8b }, "i16x8.shl" },
+        { { 0xfd, 0x8c }, "i16x8.shr_s" },
+        { { 0xfd, 0x8d }, "i16x8.shr_u" },
+        { { 0xfd, 0x8e }, "i16x8.add" },
+        { { 0xfd, 0x8f }, "i16x8.add_sat_s" },
+        { { 0xfd, 0x90 }, "i16x8.add_sat_u" },
+        { { 0xfd, 0x91 }, "i16x8.sub" },
+        { { 0xfd, 0x92 }, "i16x8.sub_sat_s" },
+        { { 0xfd, 0x93 }, "i16x8.sub_sat_u" },
+        { { 0xfd, 0x94 }, "f64x2.nearest" },
+        { { 0xfd, 0x95 }, "i16x8.mul" },
+        { { 0xfd, 0x96 }, "i16x8.min_s" },
+        { { 0xfd, 0x97 }, "i16x8.min_u" },
+        { { 0xfd, 0x98 }, "i16x8.max_s" },
+        { { 0xfd, 0x99 }, "i16x8.max_u" },
+        { { 0xfd, 0x9b }, "i16x8.avgr_u" },
+        { { 0xfd, 0x9c }, "i16x8.extmul_low_i8x16_s" },
+        { { 0xfd, 0x9d }, "i16x8.extmul_high_i8x16_s" },
+        { { 0xfd, 0x9e }, "i16x8.extmul_low_i8x16_u" },
+        { { 0xfd, 0x9f }, "i16x8.extmul_high_i8x16_u" },
+
+        { { 0xfd, 0xa0 }, "i32x4.abs" },
+        { { 0xfd, 0xa1 }, "i32x4.neg" },
+        { { 0xfd, 0xa3 }, "i32x4.all_true" },
+        { { 0xfd, 0xa4 }, "i32x4.bitmask" },
+        { { 0xfd, 0xa7 }, "i32x4.extend_low_i16x8_s" },
+        { { 0xfd, 0xa8 }, "i32x4.extend_high_i16x8_s" },
+        { { 0xfd, 0xa9 }, "i32x4.extend_low_i16x8_u" },
+        { { 0xfd, 0xaa }, "i32x4.extend_high_i16x8_u" },
+        { { 0xfd, 0xab }, "i32x4.shl" },
+        { { 0xfd, 0xac }, "i32x4.shr_s" },
+        { { 0xfd, 0xad }, "i32x4.shr_u" },
+        { { 0xfd, 0xae }, "i32x4.add" },
+        { { 0xfd, 0xb1 }, "i32x4.sub" },
+        { { 0xfd, 0xb5 }, "i32x4.mul" },
+        { { 0xfd, 0xb6 }, "i32x4.min_s" },
+        { { 0xfd, 0xb7 }, "i32x4.min_u" },
+        { { 0xfd, 0xb8 }, "i32x4.max_s" },
+        { { 0xfd, 0xb9 }, "i32x4.max_u" },
+        { { 0xfd, 0xba }, "i32x4.dot_i16x8_s" },
+        { { 0xfd, 0xbc }, "i32x4.extmul_low_i16x8_s" },
+        { { 0xfd, 0xbd }, "i32x4.extmul_high_i16x8_s" },
+        { { 0xfd, 0xbe }, "i32x4.extmul_low_i16x8_u" },
+        { { 0xfd, 0xbf }, "i32x4.extmul_high_i16x8_u" },
+
+        { { 0xfd, 0xc0 }, "i64x2.abs" },
+        { { 0xfd, 0xc1 }, "i64x2.neg" },
+        { { 0xfd, 0xc3 }, "i64x2.all_true" },
+        { { 0xfd, 0xc4 }, "i64x2.bitmask" },
+        { { 0xfd, 0xc7 }, "i64x2.extend_low_i32x4_s" },
+        { { 0xfd, 0xc8 }, "i64x2.extend_high_i32x4_s" },
+        { { 0xfd, 0xc9 }, "i64x2.extend_low_i32x4_u" },
+        { { 0xfd, 0xca }, "i64x2.extend_high_i32x4_u" },
+        { { 0xfd, 0xcb }, "i64x2.shl" },
+        { { 0xfd, 0xcc }, "i64x2.shr_s" },
+        { { 0xfd, 0xcd }, "i64x2.shr_u" },
+        { { 0xfd, 0xce }, "i64x2.add" },
+        { { 0xfd, 0xd1 }, "i64x2.sub" },
+        { { 0xfd, 0xd5 }, "i64x2.mul" },
+        { { 0xfd, 0xd6 }, "i64x2.eq" },
+        { { 0xfd, 0xd7 }, "i64x2.ne" },
+        { { 0xfd, 0xd8 }, "i64x2.lt_s" },
+        { { 0xfd, 0xd9 }, "i64x2.gt_s" },
+        { { 0xfd, 0xda }, "i64x2.le_s" },
+        { { 0xfd, 0xdb }, "i64x2.ge_s" },
+        { { 0xfd, 0xdc }, "i64x2.extmul_low_i32x4_s" },
+        { { 0xfd, 0xdd }, "i64x2.extmul_high_i32x4_s" },
+        { { 0xfd, 0xde }, "i64x2.extmul_low_i32x4_u" },
+        { { 0xfd, 0xdf }, "i64x2.extmul_high_i32x4_u" },
+
+        { { 0xfd, 0xe0 }, "f32x4.abs" },
+        { { 0xfd, 0xe1 }, "f32x4.neg" },
+        { { 0xfd, 0xe3 }, "f32x4.sqrt" },
+        { { 0xfd, 0xe4 }, "f32x4.add" },
+        { { 0xfd, 0xe5 }, "f32x4.sub" },
+        { { 0xfd, 0xe6 }, "f32x4.mul" },
+        { { 0xfd, 0xe7 }, "f32x4.div" },
+        { { 0xfd, 0xe8 }, "f32x4.min" },
+        { { 0xfd, 0xe9 }, "f32x4.max" },
+        { { 0xfd, 0xea }, "f32x4.pmin" },
+        { { 0xfd, 0xeb }, "f32x4.pmax" },
+
+        { { 0xfd, 0xec }, "f64x2.abs" },
+        { { 0xfd, 0xed }, "f64x2.neg" },
+        { { 0xfd, 0xef }, "f64x2.sqrt" },
+        { { 0xfd, 0xf0 }, "f64x2.add" },
+        { { 0xfd, 0xf1 }, "f64x2.sub" },
+        { { 0xfd, 0xf2 }, "f64x2.mul" },
+        { { 0xfd, 0xf3 }, "f64x2.div" },
+        { { 0xfd, 0xf4 }, "f64x2.min" },
+        { { 0xfd, 0xf5 }, "f64x2.max" },
+        { { 0xfd, 0xf6 }, "f64x2.pmin" },
+        { { 0xfd, 0xf7 }, "f64x2.pmax" },
+
+        { { 0xfd, 0xf8 }, "i32x4.trunc_sat_f32x4_s" },
+        { { 0xfd, 0xf9 }, "i32x4.trunc_sat_f32x4_u" },
+        { { 0xfd, 0xfa }, "f32x4.convert_i32x4_s" },
+        { { 0xfd, 0xfb }, "f32x4.convert_i32x4_u" },
+        { { 0xfd, 0xfc }, "i32x4.trunc_sat_f64x2_s_zero" },
+        { { 0xfd, 0xfd }, "i32x4.trunc_sat_f64x2_u_zero" },
+        { { 0xfd, 0xfe }, "f64x2.convert_low_i32x4_s" },
+        { { 0xfd, 0xff }, "f64x2.convert_low_i32x4_u" },
       };
       static const OP NAMES;
     };
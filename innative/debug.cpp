@@ -232,6 +232,10 @@ std::string Debugger::GenFlagString(const Environment& env)
     f += " check_int_division";
   if(env.flags & ENV_DISABLE_TAIL_CALL)
     f += " disable_tail_call";
+  if(env.flags & ENV_GUARD_PAGES)
+    f += " guard_pages";
+  if(env.flags & ENV_STABLE_MEMORY)
+    f += " stable_memory";
 
   if(env.optimize & ENV_OPTIMIZE_FAST_MATH_REASSOCIATE)
     f += " fast_math_reassociate";
@@ -266,6 +270,16 @@ std::string Debugger::GenFlagString(const Environment& env)
   {
     if(env.features & ENV_FEATURE_MUTABLE_GLOBALS)
       f += " mutable_globals";
+    if(env.features & ENV_FEATURE_SIMD)
+      f += " simd";
+    if(env.features & ENV_FEATURE_BULK_MEMORY)
+      f += " bulk_memory";
+    if(env.features & ENV_FEATURE_TAIL_CALL)
+      f += " tail_call";
+    if(env.features & ENV_FEATURE_NONTRAPPING_FPTOINT)
+      f += " nontrapping_fptoint";
+    if(env.features & ENV_FEATURE_SIGN_EXTENSION)
+      f += " sign_extension";
   }
 
   return f;
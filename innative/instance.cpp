@@ -0,0 +1,214 @@
+// Copyright (c)2020 Black Sphere Studios
+// For conditions of distribution and use, see copyright notice in innative.h
+
+#include "instance.h"
+#pragma warning(push)
+#pragma warning(disable : 4146 4267 4141 4244 4624)
+#include "llvm/ADT/SetVector.h"
+#include "llvm/IR/InstIterator.h"
+#pragma warning(pop)
+#include <map>
+#include <unordered_set>
+
+using namespace innative;
+
+namespace innative {
+  namespace instancing {
+    // Turns every constant expression built on c into an instruction in front of each instruction that uses it, so that
+    // the uses inside each function can be replaced separately. Constant expressions used outside of functions are kept.
+    void ExpandConstantUsers(llvm::Constant* c)
+    {
+      llvm::SmallSetVector<llvm::User*, 8> users(c->user_begin(), c->user_end());
+      for(auto user : users)
+      {
+        auto expr = llvm::dyn_cast<llvm::ConstantExpr>(user);
+        if(!expr)
+          continue;
+
+        ExpandConstantUsers(expr);
+        llvm::SmallSetVector<llvm::User*, 8> uses(expr->user_begin(), expr->user_end());
+        for(auto use : uses)
+        {
+          if(auto phi = llvm::dyn_cast<llvm::PHINode>(use))
+          {
+            for(unsigned i = 0; i < phi->getNumIncomingValues(); ++i)
+              if(phi->getIncomingValue(i) == expr)
+              {
+                auto copy = expr->getAsInstruction();
+                copy->insertBefore(phi->getIncomingBlock(i)->getTerminator());
+                phi->setIncomingValue(i, copy);
+              }
+          }
+          else if(auto inst = llvm::dyn_cast<llvm::Instruction>(use))
+          {
+            auto copy = expr->getAsInstruction();
+            copy->insertBefore(inst);
+            inst->replaceUsesOfWith(expr, copy);
+          }
+        }
+
+        if(expr->use_empty())
+          expr->destroyConstant();
+      }
+    }
+
+    llvm::FunctionType* AddInstanceParam(llvm::FunctionType* type, llvm::Type* instance)
+    {
+      std::vector<llvm::Type*> params = { instance };
+      params.insert(params.end(), type->param_begin(), type->param_end());
+      return llvm::FunctionType::get(type->getReturnType(), params, type->isVarArg());
+    }
+
+    llvm::AttributeList AddInstanceAttributes(llvm::LLVMContext& ctx, const llvm::AttributeList& attributes,
+                                              unsigned params)
+    {
+      std::vector<llvm::AttributeSet> sets = { llvm::AttributeSet() };
+      for(unsigned i = 0; i < params; ++i)
+        sets.push_back(attributes.getParamAttributes(i));
+      return llvm::AttributeList::get(ctx, attributes.getFnAttributes(), attributes.getRetAttributes(), sets);
+    }
+  }
+}
+
+void innative::MoveStateIntoInstance(llvm::Module& mod, varuint32 index, llvm::ArrayRef<llvm::GlobalVariable*> state,
+                                     llvm::Function* init, const llvm::Twine& sizename,
+                                     std::unordered_map<llvm::Function*, llvm::Function*>& replaced)
+{
+  llvm::LLVMContext& ctx = mod.getContext();
+  llvm::Type* instance   = llvm::Type::getInt8PtrTy(ctx);
+  llvm::Type* i64        = llvm::Type::getInt64Ty(ctx);
+
+  std::vector<llvm::Type*> fields;
+  for(auto global : state)
+    fields.push_back(global->getValueType());
+
+  auto blockty = llvm::StructType::get(ctx, fields);
+  auto layout  = mod.getDataLayout().getStructLayout(blockty);
+  auto size    = new llvm::GlobalVariable(mod, i64, true, llvm::GlobalValue::ExternalLinkage,
+                                       llvm::ConstantInt::get(i64, layout->getSizeInBytes()), sizename);
+  size->setDLLStorageClass(llvm::GlobalValue::DLLExportStorageClass);
+
+  // Every function definition is replaced, including export wrappers, because the host has to pass in the instance too
+  std::vector<llvm::Function*> definitions;
+  for(auto& fn : mod)
+    if(!fn.isDeclaration())
+      definitions.push_back(&fn);
+
+  std::unordered_set<llvm::Function*> instanced;
+  for(auto fn : definitions)
+  {
+    auto replacement = llvm::Function::Create(instancing::AddInstanceParam(fn->getFunctionType(), instance),
+                                              fn->getLinkage(), "", &mod);
+    replacement->copyAttributesFrom(fn);
+    replacement->setAttributes(instancing::AddInstanceAttributes(ctx, fn->getAttributes(), fn->arg_size()));
+    replacement->copyMetadata(fn, 0);
+    replacement->takeName(fn);
+    replacement->getBasicBlockList().splice(replacement->begin(), fn->getBasicBlockList());
+
+    auto arg = replacement->arg_begin();
+    arg->setName("instance");
+    for(auto& original : fn->args())
+    {
+      (++arg)->takeName(&original);
+      original.replaceAllUsesWith(&*arg);
+    }
+
+    replaced[fn] = replacement;
+    instanced.insert(replacement);
+  }
+
+  // Anything that still refers to the old function, like a table entry or an alias, now points to the replacement
+  for(auto fn : definitions)
+  {
+    fn->replaceAllUsesWith(llvm::ConstantExpr::getBitCast(replaced[fn], fn->getType()));
+    fn->eraseFromParent();
+  }
+
+  // Indirect calls can only come from call_indirect, so they always target a webassembly function
+  for(auto fn : instanced)
+  {
+    std::vector<llvm::CallInst*> calls;
+    for(auto& i : llvm::instructions(fn))
+      if(auto call = llvm::dyn_cast<llvm::CallInst>(&i))
+      {
+        auto callee = call->getCalledOperand()->stripPointerCasts();
+        auto target = llvm::dyn_cast<llvm::Function>(callee);
+        if(!llvm::isa<llvm::InlineAsm>(callee) && (!target || instanced.count(target)))
+          calls.push_back(call);
+      }
+
+    for(auto call : calls)
+    {
+      auto type = instancing::AddInstanceParam(call->getFunctionType(), instance);
+      std::vector<llvm::Value*> args = { fn->arg_begin() };
+      args.insert(args.end(), call->arg_begin(), call->arg_end());
+
+      llvm::Value* callee = call->getCalledOperand();
+      if(auto constant = llvm::dyn_cast<llvm::Constant>(callee))
+        callee = llvm::ConstantExpr::getPointerCast(constant->stripPointerCasts(), type->getPointerTo());
+      else
+        callee = llvm::CastInst::CreatePointerCast(callee, type->getPointerTo(), "", call);
+
+      llvm::SmallVector<llvm::OperandBundleDef, 1> bundles;
+      call->getOperandBundlesAsDefs(bundles);
+      auto replacement = llvm::CallInst::Create(type, callee, args, bundles, "", call);
+      replacement->setCallingConv(call->getCallingConv());
+      replacement->setTailCallKind(call->getTailCallKind());
+      replacement->setAttributes(instancing::AddInstanceAttributes(ctx, call->getAttributes(), call->arg_size()));
+      replacement->copyMetadata(*call);
+      replacement->takeName(call);
+      call->replaceAllUsesWith(replacement);
+      call->eraseFromParent();
+    }
+  }
+
+  // Each function loads the address of its module's block once, at the top of its entry block. The block never moves
+  // while the instance exists, so the load is invariant and the optimizer is free to reuse it anywhere.
+  std::unordered_map<llvm::Function*, llvm::Instruction*> blocks;
+  std::map<std::pair<llvm::Function*, size_t>, llvm::Instruction*> pointers;
+  auto GetField = [&](llvm::Function* fn, size_t field) -> llvm::Instruction* {
+    auto& pointer = pointers[{ fn, field }];
+    if(pointer)
+      return pointer;
+
+    auto& block = blocks[fn];
+    llvm::IRBuilder<> builder(&fn->getEntryBlock(), fn->getEntryBlock().getFirstInsertionPt());
+    if(!block)
+    {
+      auto slot = builder.CreateConstInBoundsGEP1_32(
+        instance, builder.CreatePointerCast(fn->arg_begin(), instance->getPointerTo()), index);
+      auto load = builder.CreateLoad(instance, slot, "instance_block");
+      load->setMetadata(llvm::LLVMContext::MD_invariant_load, llvm::MDNode::get(ctx, {}));
+      load->setMetadata(llvm::LLVMContext::MD_nonnull, llvm::MDNode::get(ctx, {}));
+      block = llvm::cast<llvm::Instruction>(builder.CreatePointerCast(load, blockty->getPointerTo()));
+    }
+
+    builder.SetInsertPoint(block->getNextNode());
+    pointer = llvm::cast<llvm::Instruction>(builder.CreateStructGEP(blockty, block, static_cast<unsigned>(field)));
+    return pointer;
+  };
+
+  llvm::Function* initializer = replaced[init];
+  for(size_t i = 0; i < state.size(); ++i)
+  {
+    llvm::GlobalVariable* global = state[i];
+    instancing::ExpandConstantUsers(global);
+
+    llvm::SmallSetVector<llvm::User*, 8> users(global->user_begin(), global->user_end());
+    for(auto user : users)
+      if(auto inst = llvm::dyn_cast<llvm::Instruction>(user))
+        inst->replaceUsesOfWith(global, GetField(inst->getFunction(), i));
+
+    // New instances start out zeroed, so only nonzero initial values have to be copied in before anything else happens
+    if(global->hasInitializer() && !global->getInitializer()->isNullValue())
+    {
+      auto pointer = GetField(initializer, i);
+      new llvm::StoreInst(global->getInitializer(), pointer, pointer->getNextNode());
+    }
+
+    // Anything left, like the module metadata, gets the offset of the field into the block instead
+    global->replaceAllUsesWith(
+      llvm::ConstantExpr::getIntToPtr(llvm::ConstantInt::get(i64, layout->getElementOffset(i)), global->getType()));
+    global->eraseFromParent();
+  }
+}
@@ -0,0 +1,24 @@
+// Copyright (c)2020 Black Sphere Studios
+// For conditions of distribution and use, see copyright notice in innative.h
+
+#ifndef IN__INSTANCE_H
+#define IN__INSTANCE_H
+
+#include "llvm.h"
+#include "innative/export.h"
+#include <unordered_map>
+
+namespace innative {
+  // Moves the given global variables into a single block of per-instance state, which is exported as an i64 symbol called
+  // sizename that stores the size of the block. Every function defined in the module is replaced by one that takes a
+  // pointer to the instance as an extra first parameter, which points to the block pointer of each module, and passes it
+  // on to every other function defined in the module and every indirect call. init is the function that initializes the
+  // module, which copies the initial value of every global into the block. Any remaining uses of the globals outside of
+  // functions, like the module metadata, are replaced with their offset into the block. Returns the replacement of each
+  // function in replaced.
+  void MoveStateIntoInstance(llvm::Module& mod, varuint32 index, llvm::ArrayRef<llvm::GlobalVariable*> state,
+                             llvm::Function* init, const llvm::Twine& sizename,
+                             std::unordered_map<llvm::Function*, llvm::Function*>& replaced);
+}
+
+#endif
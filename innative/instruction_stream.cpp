@@ -0,0 +1,141 @@
+// Copyright (c)2020 Black Sphere Studios
+// For conditions of distribution and use, see copyright notice in innative.h
+
+#include "instruction_stream.h"
+#include "utility.h"
+
+using namespace innative;
+using namespace utility;
+using namespace stream_details;
+
+namespace innative::stream_details {
+  IN_FORCEINLINE void WriteLEB128(std::vector<uint8_t>& out, uint64_t x)
+  {
+    while(x >= 0x80)
+    {
+      out.push_back(static_cast<uint8_t>(x | 0x80));
+      x >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(x));
+  }
+
+  IN_FORCEINLINE uint64_t ReadLEB128(const uint8_t*& cur)
+  {
+    uint64_t x = 0;
+    for(unsigned int shift = 0;; shift += 7)
+    {
+      uint8_t byte = *cur++;
+      x |= static_cast<uint64_t>(byte & 0x7F) << shift;
+      if(!(byte & 0x80))
+        return x;
+    }
+  }
+
+  // Only br_table stores anything in the second half of an immediate
+  IN_FORCEINLINE bool IsTableImmediate(const Instruction& ins, int i) { return !i && ins.opcode[0] == OP_br_table; }
+}
+
+InstructionIterator::InstructionIterator(const FunctionBody& body) :
+  _cur(body.code), _end(body.code + body.code_size), _locations(body.locations), _index(0), _count(body.n_body)
+{
+  if(_index < _count)
+    Decode();
+}
+
+InstructionIterator& InstructionIterator::operator++()
+{
+  if(++_index < _count)
+    Decode();
+  return *this;
+}
+
+void InstructionIterator::Decode()
+{
+  assert(_cur < _end);
+  _ins           = Instruction{ 0 };
+  _ins.opcode[0] = *_cur++;
+  uint8_t header = *_cur++;
+  if(header & STREAM_OPCODE_EXTRA)
+    _ins.opcode[1] = *_cur++;
+
+  for(int i = 0; i < (header & STREAM_IMMEDIATE_MASK); ++i)
+  {
+    if(IsTableImmediate(_ins, i))
+    {
+      _ins.immediates[i].n_table = static_cast<varuint32>(ReadLEB128(_cur));
+      memcpy(&_ins.immediates[i].table, _cur, sizeof(varuint32*));
+      _cur += sizeof(varuint32*);
+    }
+    else
+      _ins.immediates[i]._varuint64 = ReadLEB128(_cur);
+  }
+
+  if(_locations)
+  {
+    _ins.line   = _locations[_index].line;
+    _ins.column = _locations[_index].column;
+  }
+  assert(_cur <= _end);
+}
+
+void InstructionWriter::Write(const Instruction& ins)
+{
+  int n = MAX_IMMEDIATES;
+  while(n > 0 && !ins.immediates[n - 1]._varuint64 && !IsTableImmediate(ins, n - 1))
+    --n;
+
+  _code.push_back(ins.opcode[0]);
+  _code.push_back(static_cast<uint8_t>(n | (ins.opcode[1] ? STREAM_OPCODE_EXTRA : 0)));
+  if(ins.opcode[1])
+    _code.push_back(ins.opcode[1]);
+
+  for(int i = 0; i < n; ++i)
+  {
+    if(IsTableImmediate(ins, i))
+    {
+      WriteLEB128(_code, ins.immediates[i].n_table);
+      const uint8_t* table = reinterpret_cast<const uint8_t*>(&ins.immediates[i].table);
+      _code.insert(_code.end(), table, table + sizeof(varuint32*));
+    }
+    else
+      WriteLEB128(_code, ins.immediates[i]._varuint64);
+  }
+
+  if(_keeplocations)
+    _locations.push_back(SourceLocation{ ins.line, ins.column });
+  ++_n_body;
+}
+
+IN_ERROR InstructionWriter::Finish(FunctionBody& body, const Environment& env)
+{
+  if(_code.size() > std::numeric_limits<varuint32>::max())
+    return ERR_FATAL_OUT_OF_MEMORY;
+
+  body.n_body    = _n_body;
+  body.code_size = static_cast<varuint32>(_code.size());
+  body.code      = nullptr;
+  body.locations = nullptr;
+
+  if(!_code.empty())
+  {
+    if(!(body.code = tmalloc<uint8_t>(env, _code.size())))
+      return ERR_FATAL_OUT_OF_MEMORY;
+    tmemcpy<uint8_t>(body.code, _code.size(), _code.data(), _code.size());
+  }
+
+  if(!_locations.empty())
+  {
+    if(!(body.locations = tmalloc<SourceLocation>(env, _locations.size())))
+      return ERR_FATAL_OUT_OF_MEMORY;
+    tmemcpy<SourceLocation>(body.locations, _locations.size(), _locations.data(), _locations.size());
+  }
+
+  return ERR_SUCCESS;
+}
+
+void InstructionWriter::Clear()
+{
+  _code.clear();
+  _locations.clear();
+  _n_body = 0;
+}
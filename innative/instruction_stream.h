@@ -0,0 +1,84 @@
+// Copyright (c)2020 Black Sphere Studios
+// For conditions of distribution and use, see copyright notice in innative.h
+
+#ifndef IN__INSTRUCTION_STREAM_H
+#define IN__INSTRUCTION_STREAM_H
+
+#include "innative/schema.h"
+#include <vector>
+
+namespace innative {
+  // A function body stores its instructions in a compact stream instead of an array of Instruction structs. Each
+  // instruction is encoded as:
+  //   opcode[0]
+  //   header byte: bits 0-1 hold the number of immediates stored, bit 2 is set if opcode[1] follows
+  //   opcode[1], if present
+  //   each stored immediate as an unsigned LEB128 of its 64-bit payload. br_table's first immediate instead stores
+  //   n_table as a LEB128, followed by the raw table pointer.
+  // Trailing immediates that are zero are never stored. Line and column information lives in a separate side table,
+  // because it is only needed for debug information and error messages.
+  namespace stream_details {
+    enum STREAM_HEADER
+    {
+      STREAM_IMMEDIATE_MASK = 0x03,
+      STREAM_OPCODE_EXTRA   = 0x04,
+    };
+
+    static_assert(MAX_IMMEDIATES <= STREAM_IMMEDIATE_MASK, "immediate count doesn't fit in the header byte!");
+  }
+
+  // Decodes one instruction at a time out of a function body's instruction stream
+  class InstructionIterator
+  {
+  public:
+    IN_COMPILER_DLLEXPORT explicit InstructionIterator(const FunctionBody& body);
+    InstructionIterator(const FunctionBody& body, varuint32 index) :
+      _cur(0), _end(0), _locations(0), _index(index), _count(body.n_body)
+    {}
+    inline Instruction& operator*() { return _ins; }
+    inline Instruction* operator->() { return &_ins; }
+    inline bool operator==(const InstructionIterator& r) const { return _index == r._index; }
+    inline bool operator!=(const InstructionIterator& r) const { return _index != r._index; }
+    IN_COMPILER_DLLEXPORT InstructionIterator& operator++();
+    inline varuint32 Index() const { return _index; }
+
+  protected:
+    void Decode();
+
+    const uint8_t* _cur;
+    const uint8_t* _end;
+    const SourceLocation* _locations;
+    varuint32 _index;
+    varuint32 _count;
+    Instruction _ins;
+  };
+
+  // Allows iterating over the instructions of a function body with a range-based for loop
+  struct Instructions
+  {
+    explicit Instructions(const FunctionBody& b) : body(b) {}
+    inline InstructionIterator begin() const { return InstructionIterator(body); }
+    inline InstructionIterator end() const { return InstructionIterator(body, body.n_body); }
+
+    const FunctionBody& body;
+  };
+
+  // Builds a compact instruction stream, which is then copied into the environment when it's complete
+  class InstructionWriter
+  {
+  public:
+    explicit InstructionWriter(bool locations) : _n_body(0), _keeplocations(locations) {}
+    IN_COMPILER_DLLEXPORT void Write(const Instruction& ins);
+    IN_COMPILER_DLLEXPORT IN_ERROR Finish(FunctionBody& body, const Environment& env);
+    IN_COMPILER_DLLEXPORT void Clear();
+    inline varuint32 Size() const { return _n_body; }
+
+  protected:
+    std::vector<uint8_t> _code;
+    std::vector<SourceLocation> _locations;
+    varuint32 _n_body;
+    bool _keeplocations;
+  };
+}
+
+#endif
@@ -5,6 +5,7 @@
 #include "compile.h"
 #include "utility.h"
 #include "validate.h"
+#include "instruction_stream.h"
 
 using namespace innative;
 using namespace utility;
@@ -267,13 +268,28 @@ IN_ERROR Compiler::CompileEndBlock()
   return err;
 }
 
-void Compiler::CompileTrap()
+// Truncating to the narrow type and sign extending back lowers to a single movsx on x86
+IN_ERROR Compiler::CompileSignExtend(varsint7 ty, llvmTy* from, const llvm::Twine& name)
 {
-  auto call = builder.CreateCall(llvm::Intrinsic::getDeclaration(mod, llvm::Intrinsic::trap), {});
-  call->setDoesNotReturn();
-  builder.CreateUnreachable();
+  IN_ERROR err;
+  llvmVal* v;
+  if(err = PopType(ty, v))
+    return err;
+  return PushReturn(builder.CreateSExt(builder.CreateTrunc(v, from), v->getType(), name));
 }
 
+// Unlike the trapping conversions, these never need InsertTruncTrap, even with ENV_CHECK_FLOAT_TRUNC
+IN_ERROR Compiler::CompileTruncSatOp(varsint7 from, llvmTy* ty, bool sign, const llvm::Twine& name)
+{
+  IN_ERROR err;
+  llvmVal* v;
+  if(err = PopType(from, v))
+    return err;
+  return PushReturn(CompileTruncSat(v, ty, sign, name));
+}
+
+void Compiler::CompileTrap(IN_TRAP_CODE code) { builder.CreateBr(GetTrapBlock(code)); }
+
 IN_ERROR Compiler::CompileBranch(varuint32 depth)
 {
   if(depth >= control.Size())
@@ -342,7 +358,24 @@ IN_ERROR Compiler::CompileBranchTable(varuint32 n_table, varuint32* table, varui
   return err;
 }
 
-IN_ERROR Compiler::CompileCall(varuint32 index)
+// The tail call convention guarantees that a call immediately followed by a return of its result becomes a jump, even if
+// the prototypes don't match. When they do match the call is also marked musttail, so the verifier enforces it.
+IN_ERROR Compiler::CompileTailReturn(CallInst* call)
+{
+  Func* caller = builder.GetInsertBlock()->getParent();
+  call->setTailCallKind((call->getFunctionType() == caller->getFunctionType()) ? CallInst::TCK_MustTail :
+                                                                                 CallInst::TCK_Tail);
+
+  if(call->getType()->isVoidTy())
+    builder.CreateRetVoid();
+  else
+    builder.CreateRet(call);
+
+  PolymorphicStack();
+  return ERR_SUCCESS;
+}
+
+IN_ERROR Compiler::CompileCall(varuint32 index, bool tail)
 {
   if(index >= functions.size())
     return ERR_INVALID_FUNCTION_INDEX;
@@ -366,14 +399,20 @@ IN_ERROR Compiler::CompileCall(varuint32 index)
     llvmVal* out = nullptr;
     err          = (this->*functions[index].intrinsic->fn)(ArgsV, out);
     if(err >= 0 && out != nullptr)
-      return PushReturn(out);
+      err = PushReturn(out);
+
+    if(err >= 0 && tail) // Intrinsics are inlined, so there is no call to turn into a jump
+    {
+      err = CompileReturn(control[control.Size() - 1].sig);
+      PolymorphicStack();
+    }
 
     return err;
   }
 
   // Because this is a static function call, we can call the imported C function directly with the appropriate calling
-  // convention.
-  Func* fn         = (!functions[index].imported) ? (functions[index].internal) : functions[index].imported;
+  // convention. A tail call has to stay in the internal convention, so it goes through the import's wrapper instead.
+  Func* fn         = (!functions[index].imported || tail) ? (functions[index].internal) : functions[index].imported;
   unsigned int num = fn->getFunctionType()->getNumParams();
 
   // Pop arguments in reverse order
@@ -394,13 +433,16 @@ IN_ERROR Compiler::CompileCall(varuint32 index)
   call->setCallingConv(fn->getCallingConv());
   call->setAttributes(fn->getAttributes());
 
+  if(tail)
+    return CompileTailReturn(call);
   if(!fn->getReturnType()->isVoidTy()) // Only push a value if there is one to push
     return PushReturn(call);
 
   return ERR_SUCCESS;
 }
 
-llvmVal* Compiler::GetMemSize(llvm::GlobalVariable* target) { return builder.CreateLoad(GetPairPtr(target, 1)); }
+llvmVal* Compiler::GetMemSize(llvm::GlobalVariable* target) { return LoadPair(target, 1, tbaa.mempair); }
+llvmVal* Compiler::GetTableSize(llvm::GlobalVariable* target) { return LoadPair(target, 1, tbaa.tablepair); }
 
 // Gets the first type index that matches the given type, used as a stable type hash
 varuint32 Compiler::GetFirstType(varuint32 type)
@@ -415,7 +457,7 @@ varuint32 Compiler::GetFirstType(varuint32 type)
   return type;
 }
 
-IN_ERROR Compiler::CompileIndirectCall(varuint32 index)
+IN_ERROR Compiler::CompileIndirectCall(varuint32 index, bool tail)
 {
   index = GetFirstType(index);
   if(index >= m.type.n_functypes)
@@ -447,19 +489,22 @@ IN_ERROR Compiler::CompileIndirectCall(varuint32 index)
   if(env.flags & ENV_CHECK_INDIRECT_CALL) // In strict mode, trap if index is out of bounds
   {
     InsertConditionalTrap(builder.CreateICmpUGE(builder.CreateIntCast(callee, builder.getInt64Ty(), false),
-                                                builder.CreateUDiv(GetMemSize(tables[0]), builder.getInt64(bytewidth)),
-                                                "indirect_call_oob_check"));
+                                                builder.CreateUDiv(GetTableSize(tables[0]), builder.getInt64(bytewidth)),
+                                                "indirect_call_oob_check"),
+                          IN_TRAP_NULL_TABLE_ENTRY);
   }
 
   // Deference global variable to get the actual array of function pointers, index into them, then dereference that array
   // index to get the actual function pointer
-  llvmVal* funcptr = builder.CreateLoad(builder.CreateInBoundsGEP(builder.CreateLoad(GetPairPtr(tables[0], 0)),
-                                                                  { callee, builder.getInt32(0) }),
-                                        "indirect_call_load_func_ptr");
+  llvmVal* funcptr = TagAccess(
+    builder.CreateLoad(builder.CreateInBoundsGEP(LoadPair(tables[0], 0, tbaa.tablepair), { callee, builder.getInt32(0) }),
+                       "indirect_call_load_func_ptr"),
+    tbaa.table);
 
   if(env.flags & ENV_CHECK_INDIRECT_CALL) // In strict mode, trap if function pointer is NULL
     InsertConditionalTrap(
-      builder.CreateICmpEQ(builder.CreatePtrToInt(funcptr, intptrty), CInt::get(intptrty, 0), "indirect_call_null_check"));
+      builder.CreateICmpEQ(builder.CreatePtrToInt(funcptr, intptrty), CInt::get(intptrty, 0), "indirect_call_null_check"),
+      IN_TRAP_NULL_TABLE_ENTRY);
 
   // Now that we have the function pointer we have to actually cast back to the function signature that we expect, instead
   // of void()
@@ -469,15 +514,17 @@ IN_ERROR Compiler::CompileIndirectCall(varuint32 index)
   if(env.flags &
      ENV_CHECK_INDIRECT_CALL) // In strict mode, trap if the expected type does not match the actual type of the function
   {
-    auto sig = builder.CreateLoad(
-      builder.CreateInBoundsGEP(builder.CreateLoad(GetPairPtr(tables[0], 0)), { callee, builder.getInt32(1) }));
-    InsertConditionalTrap(builder.CreateICmpNE(sig, builder.getInt32(index), "indirect_call_sig_check"));
+    auto sig = TagAccess(builder.CreateLoad(builder.CreateInBoundsGEP(LoadPair(tables[0], 0, tbaa.tablepair),
+                                                                      { callee, builder.getInt32(1) })),
+                         tbaa.table);
+    InsertConditionalTrap(builder.CreateICmpNE(sig, builder.getInt32(index), "indirect_call_sig_check"),
+                          IN_TRAP_BAD_SIGNATURE);
   }
 
   // CreateCall will then do the final dereference of the function pointer to make the indirect call
   CallInst* call = builder.CreateCall(funcptr, llvm::makeArrayRef(ArgsV, ftype.n_params));
-  if(memories.size() > 0)
-    builder.CreateStore(builder.CreateLoad(GetPairPtr(memories[0], 0)), memlocal, false);
+  if(memories.size() > 0 && !stablememory && !tail)
+    builder.CreateStore(LoadPair(memories[0], 0, tbaa.mempair), memlocal, false);
 
   builder.GetInsertBlock()->getParent()->setMetadata(IN_MEMORY_GROW_METADATA, llvm::MDNode::get(ctx, {}));
 
@@ -486,6 +533,8 @@ IN_ERROR Compiler::CompileIndirectCall(varuint32 index)
   call->setCallingConv(InternalConvention); // Always pick the fast convention, because the table is always set to
                                             // the internal wrapping function
 
+  if(tail)
+    return CompileTailReturn(call);
   if(!ty->getReturnType()->isVoidTy()) // Only push a value if there is one to push
     return PushReturn(call);
   return ERR_SUCCESS;
@@ -501,6 +550,15 @@ IN_ERROR Compiler::CompileConstant(Instruction& instruction, llvm::Constant*& co
   case OP_i64_const: constant = CInt::get(ctx, llvm::APInt(64, instruction.immediates[0]._varuint64, true)); break;
   case OP_f32_const: constant = ConstantFP::get(ctx, llvm::APFloat(instruction.immediates[0]._float32)); break;
   case OP_f64_const: constant = ConstantFP::get(ctx, llvm::APFloat(instruction.immediates[0]._float64)); break;
+  case OP_simd_prefix:
+    if(instruction.opcode[1] != OP_v128_const)
+      return ERR_INVALID_INITIALIZER;
+    constant = llvm::ConstantDataVector::get(
+      ctx, llvm::ArrayRef<uint32_t>{ static_cast<uint32_t>(instruction.immediates[0]._varuint64),
+                                     static_cast<uint32_t>(instruction.immediates[0]._varuint64 >> 32),
+                                     static_cast<uint32_t>(instruction.immediates[1]._varuint64),
+                                     static_cast<uint32_t>(instruction.immediates[1]._varuint64 >> 32) });
+    break;
   default: return ERR_INVALID_INITIALIZER;
   }
 
@@ -520,8 +578,9 @@ IN_ERROR Compiler::CompileLoad(varuint32 memory, varuint32 offset, varuint32 mem
     return err;
 
   // TODO: In strict mode, we may have to disregard the alignment hint
-  llvmVal* result =
-    builder.CreateAlignedLoad(GetMemPointer(base, ty->getPointerTo(0), memory, offset), (1 << memflags), false, name);
+  llvmVal* result = TagAccess(
+    builder.CreateAlignedLoad(GetMemPointer(base, ty->getPointerTo(0), memory, offset), (1 << memflags), false, name),
+    tbaa.memory);
 
   if(ext != nullptr)
     result = SIGNED ? builder.CreateSExt(result, ext) : builder.CreateZExt(result, ext);
@@ -547,7 +606,8 @@ IN_ERROR Compiler::CompileStore(varuint32 memory, varuint32 offset, varuint32 me
 
   // TODO: In strict mode, we may have to disregard the alignment hint
   llvmVal* ptr = GetMemPointer(base, PtrType->getPointerTo(0), memory, offset);
-  builder.CreateAlignedStore(!ext ? value : builder.CreateIntCast(value, ext, false), ptr, (1 << memflags), false);
+  llvmVal* store = !ext ? value : builder.CreateIntCast(value, ext, false);
+  TagAccess(builder.CreateAlignedStore(store, ptr, (1 << memflags), false), tbaa.memory);
 
   return ERR_SUCCESS;
 }
@@ -573,7 +633,7 @@ IN_ERROR Compiler::CompileMemGrow(varuint32 memory, const char* name)
   auto max =
     llvm::cast<llvm::ConstantAsMetadata>(memories[memory]->getMetadata(IN_MEMORY_MAX_METADATA)->getOperand(0))->getValue();
   CallInst* call = builder.CreateCall(memgrow,
-                                      { builder.CreateLoad(GetPairPtr(memories[memory], 0)),
+                                      { LoadPair(memories[memory], 0, tbaa.mempair),
                                         builder.CreateShl(builder.CreateZExt(delta, builder.getInt64Ty()), 16), max,
                                         GetPairPtr(memories[memory], 1) },
                                       name);
@@ -586,8 +646,13 @@ IN_ERROR Compiler::CompileMemGrow(varuint32 memory, const char* name)
 
   builder.CreateCondBr(success, successblock, contblock);
   builder.SetInsertPoint(successblock); // Only set new memory if call succeeded
-  builder.CreateAlignedStore(call, GetPairPtr(memories[memory], 0), builder.getInt64Ty()->getPrimitiveSizeInBits() / 8, false);
-  builder.CreateStore(builder.CreateLoad(GetPairPtr(memories[memory], 0)), memlocal, false);
+  if(!stablememory)                     // Stable memories always return the same pointer, so we skip the stores
+  {
+    TagAccess(builder.CreateAlignedStore(call, GetPairPtr(memories[memory], 0),
+                                         builder.getInt64Ty()->getPrimitiveSizeInBits() / 8, false),
+              tbaa.mempair);
+    builder.CreateStore(LoadPair(memories[memory], 0, tbaa.mempair), memlocal, false);
+  }
   builder.CreateBr(contblock);
 
   builder.SetInsertPoint(contblock);
@@ -613,7 +678,7 @@ IN_ERROR Compiler::CompileSRem(const llvm::Twine& name)
     return err;
 
   if(env.flags & ENV_CHECK_INT_DIVISION)
-    InsertConditionalTrap(builder.CreateICmpEQ(val2, CInt::get(val2->getType(), 0, true)));
+    InsertConditionalTrap(builder.CreateICmpEQ(val2, CInt::get(val2->getType(), 0, true)), IN_TRAP_DIVIDE_BY_ZERO);
 
   // The specific case of INT_MIN % -1 is undefined behavior in LLVM and crashes on x86, but WASM requires that it return
   // 0, so we branch on that specific case.
@@ -638,16 +703,17 @@ IN_ERROR Compiler::CompileDiv(bool overflow, llvmVal* (llvm::IRBuilder<>::*op)(l
   if(err = PopType(Ty1, val1))
     return err;
 
-  llvmVal* cond = builder.CreateICmpEQ(val2, CInt::get(val2->getType(), 0, true));
-  if(overflow)
-    cond =
-      builder.CreateOr(cond, builder.CreateAnd(builder.CreateICmpEQ(val1, (val1->getType()->getIntegerBitWidth() == 32) ?
-                                                                            builder.getInt32(0x80000000) :
-                                                                            builder.getInt64(0x8000000000000000)),
-                                               builder.CreateICmpEQ(val2, CInt::get(val2->getType(), ~0ULL, true))));
-
+  // Division by zero and signed overflow trap separately, so the runtime can tell which one happened
   if(env.flags & ENV_CHECK_INT_DIVISION)
-    InsertConditionalTrap(cond);
+  {
+    InsertConditionalTrap(builder.CreateICmpEQ(val2, CInt::get(val2->getType(), 0, true)), IN_TRAP_DIVIDE_BY_ZERO);
+    if(overflow)
+      InsertConditionalTrap(builder.CreateAnd(builder.CreateICmpEQ(val1, (val1->getType()->getIntegerBitWidth() == 32) ?
+                                                                           builder.getInt32(0x80000000) :
+                                                                           builder.getInt64(0x8000000000000000)),
+                                              builder.CreateICmpEQ(val2, CInt::get(val2->getType(), ~0ULL, true))),
+                            IN_TRAP_INTEGER_OVERFLOW);
+  }
   return PushReturn((builder.*op)(val1, val2, args...));
 }
 
@@ -678,7 +744,7 @@ IN_ERROR Compiler::CompileInstruction(Instruction& ins)
   switch(ins.opcode[0])
   {
   case OP_unreachable:
-    CompileTrap(); // Automatically terminates block as unreachable
+    CompileTrap(IN_TRAP_UNREACHABLE); // Automatically terminates block by branching to the trap landing pad
     PolymorphicStack();
     return ERR_SUCCESS;
   case OP_nop: return ERR_SUCCESS;
@@ -708,6 +774,8 @@ IN_ERROR Compiler::CompileInstruction(Instruction& ins)
   case OP_call: return CompileCall(ins.immediates[0]._varuint32);
   case OP_call_indirect:
     return CompileIndirectCall(ins.immediates[0]._varuint32);
+  case OP_return_call: return CompileCall(ins.immediates[0]._varuint32, true);
+  case OP_return_call_indirect: return CompileIndirectCall(ins.immediates[0]._varuint32, true);
 
     // Parametric operators
   case OP_drop:
@@ -750,16 +818,17 @@ IN_ERROR Compiler::CompileInstruction(Instruction& ins)
       return ERR_INVALID_GLOBAL_INDEX;
     if(values.Size() < 1)
       return ERR_INVALID_VALUE_STACK;
-    builder.CreateStore(!values.Peek() ? llvm::Constant::getAllOnesValue(
-                                           globals[ins.immediates[0]._varuint32]->getType()->getElementType()) :
-                                         values.Pop(),
-                        globals[ins.immediates[0]._varuint32], false);
+    TagAccess(builder.CreateStore(!values.Peek() ? llvm::Constant::getAllOnesValue(
+                                                     globals[ins.immediates[0]._varuint32]->getType()->getElementType()) :
+                                                   values.Pop(),
+                                  globals[ins.immediates[0]._varuint32], false),
+              tbaa.global);
     debugger->DebugSetGlobal(ins.immediates[0]._varuint32);
     return ERR_SUCCESS;
   case OP_global_get:
     if(ins.immediates[0]._varuint32 >= globals.size())
       return ERR_INVALID_GLOBAL_INDEX;
-    PushReturn(builder.CreateLoad(globals[ins.immediates[0]._varuint32]));
+    PushReturn(TagAccess(builder.CreateLoad(globals[ins.immediates[0]._varuint32]), tbaa.global));
     return ERR_SUCCESS;
 
     // Memory-related operators
@@ -1185,9 +1254,22 @@ IN_ERROR Compiler::CompileInstruction(Instruction& ins)
     return CompileUnaryOp<TE_i64, TE_f64, llvmTy*, const llvm::Twine&>(&llvm::IRBuilder<>::CreateBitCast,
                                                                        builder.getDoubleTy(), OP::NAMES[ins.opcode]);
 
+    // Sign extension
+  case OP_i32_extend8_s: return CompileSignExtend(TE_i32, builder.getInt8Ty(), OP::NAMES[ins.opcode]);
+  case OP_i32_extend16_s: return CompileSignExtend(TE_i32, builder.getInt16Ty(), OP::NAMES[ins.opcode]);
+  case OP_i64_extend8_s: return CompileSignExtend(TE_i64, builder.getInt8Ty(), OP::NAMES[ins.opcode]);
+  case OP_i64_extend16_s: return CompileSignExtend(TE_i64, builder.getInt16Ty(), OP::NAMES[ins.opcode]);
+  case OP_i64_extend32_s: return CompileSignExtend(TE_i64, builder.getInt32Ty(), OP::NAMES[ins.opcode]);
+
     // Atomic
   case OP_atomic_prefix: return CompileAtomicInstruction(ins);
 
+    // SIMD
+  case OP_simd_prefix: return CompileSIMDInstruction(ins);
+
+    // Bulk memory
+  case OP_misc_prefix: return CompileMiscInstruction(ins);
+
   default: return ERR_FATAL_UNKNOWN_INSTRUCTION;
   }
 
@@ -1209,6 +1291,8 @@ IN_ERROR Compiler::CompileFunctionBody(Func* fn, size_t indice, llvm::AllocaInst
   if(sig.n_params != fn->arg_size())
     return ERR_SIGNATURE_MISMATCH;
 
+  trapfunction = static_cast<varuint32>(indice);
+
   // Get return value
   varsint7 ret = TE_void;
   if(sig.n_returns > 0)
@@ -1270,7 +1354,14 @@ IN_ERROR Compiler::CompileFunctionBody(Func* fn, size_t indice, llvm::AllocaInst
   {
     memref = memlocal =
       builder.CreateAlloca(memories[0]->getType()->getElementType()->getContainedType(0), nullptr, "IN_!memlocal");
-    builder.CreateStore(builder.CreateLoad(GetPairPtr(memories[0], 0)), memlocal, false);
+    auto base = LoadPair(memories[0], 0, tbaa.mempair);
+    if(stablememory) // Tell LLVM the base is never null and at least the minimum memory size is always accessible
+    {
+      base->setMetadata(llvm::LLVMContext::MD_nonnull, llvm::MDNode::get(ctx, {}));
+      if(auto min = memories[0]->getMetadata(IN_MEMORY_MIN_METADATA))
+        base->setMetadata(llvm::LLVMContext::MD_dereferenceable, min);
+    }
+    builder.CreateStore(base, memlocal, false);
     stacksize += (memlocal->getType()->getElementType()->getPrimitiveSizeInBits() / 8);
   }
 
@@ -1281,18 +1372,23 @@ IN_ERROR Compiler::CompileFunctionBody(Func* fn, size_t indice, llvm::AllocaInst
     fn->addFnAttr("probe-stack");
 
   // Begin iterating through the instructions until there aren't any left
-  for(varuint32 i = 0; i < body.n_body; ++i)
+  uint8_t last = 0;
+  for(Instruction& ins : Instructions(body))
   {
-    debugger->DebugIns(fn, body.body[i]);
-    IN_ERROR err = CompileInstruction(body.body[i]);
+    last         = ins.opcode[0];
+    traplocation = (uint64_t(ins.line) << 32) | ins.column;
+    debugger->DebugIns(fn, ins);
+    IN_ERROR err = CompileInstruction(ins);
     if(err < 0)
       return err;
   }
 
-  memlocal = nullptr;
+  memlocal     = nullptr;
+  trapfunction = ~0u;
+  traplocation = 0;
   if(values.Size() > 0 && !values.Peek()) // Pop at most 1 polymorphic type off the stack. Any additional ones are an error.
     values.Pop();
-  if(body.body[body.n_body - 1].opcode[0] != OP_end)
+  if(last != OP_end)
     return ERR_FATAL_EXPECTED_END_INSTRUCTION;
   if(control.Size() > 0 || control.Limit() > 0)
     return ERR_END_MISMATCH;
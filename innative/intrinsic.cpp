@@ -18,7 +18,7 @@ IN_ERROR Compiler::IN_Intrinsic_ToC(llvm::Value** params, llvm::Value*& out)
   if(!memories.size())
     return ERR_INVALID_MEMORY_INDEX;
 
-  out = builder.CreateAdd(builder.CreatePtrToInt(builder.CreateLoad(GetPairPtr(memories[0], 0)), builder.getInt64Ty()),
+  out = builder.CreateAdd(builder.CreatePtrToInt(LoadPair(memories[0], 0, tbaa.mempair), builder.getInt64Ty()),
                           params[0], "", true, true);
   return ERR_SUCCESS;
 }
@@ -28,7 +28,7 @@ IN_ERROR Compiler::IN_Intrinsic_FromC(llvm::Value** params, llvm::Value*& out)
   if(!memories.size())
     return ERR_INVALID_MEMORY_INDEX;
 
-  out = builder.CreateSub(builder.CreatePtrToInt(builder.CreateLoad(GetPairPtr(memories[0], 0)), builder.getInt64Ty()),
+  out = builder.CreateSub(builder.CreatePtrToInt(LoadPair(memories[0], 0, tbaa.mempair), builder.getInt64Ty()),
                           params[0], "", true, true);
   return ERR_SUCCESS;
 }
@@ -48,7 +48,8 @@ IN_ERROR Compiler::IN_Intrinsic_FuncPtr(llvm::Value** params, llvm::Value*& out)
 
   InsertConditionalTrap(
     builder.CreateICmpUGE(builder.CreateIntCast(params[0], builder.getInt64Ty(), false),
-                          builder.getInt64(exported_functions->getType()->getElementType()->getArrayNumElements())));
+                          builder.getInt64(exported_functions->getType()->getElementType()->getArrayNumElements())),
+    IN_TRAP_OUT_OF_BOUNDS);
 
   // Deference global variable to get the actual array of function pointers, index into them, then dereference that array
   // index to get the actual function pointer
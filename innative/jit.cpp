@@ -0,0 +1,546 @@
+// Copyright (c)2020 Black Sphere Studios
+// For conditions of distribution and use, see copyright notice in innative.h
+
+#include "llvm.h"
+#include "jit.h"
+#include "link.h"
+#include "compile.h"
+#include "optimize.h"
+#include "threadpool.h"
+#include "tools.h"
+#include "utility.h"
+#include "innative/export.h"
+#pragma warning(push)
+#pragma warning(disable : 4146 4267 4141 4244 4624)
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/ExecutionEngine/Orc/ExecutionUtils.h"
+#include "llvm/ExecutionEngine/Orc/LLJIT.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/SmallVectorMemoryBuffer.h"
+#pragma warning(pop)
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+
+using namespace innative;
+using namespace utility;
+
+namespace innative {
+  // A function compiled by the baseline tier, which calls itself through a slot that can be pointed at an optimized version
+  struct TieredFunction
+  {
+    std::string name;
+    volatile uint32_t* counter;
+    void* volatile* slot;
+    bool promoted;
+  };
+
+  // Keeps the unoptimized IR of a module around as bitcode, so hot functions can be recompiled from it later
+  struct TieredModule
+  {
+    llvm::SmallVector<char, 0> bitcode;
+    std::vector<TieredFunction> functions;
+  };
+
+  struct JITAssembly
+  {
+    std::unique_ptr<llvm::orc::LLJIT> jit;
+    IN_Entrypoint exit; // Only set if the init function was called when the assembly was created
+    std::vector<TieredModule> tiers;
+    uint64_t optimize;
+    int loglevel;
+    FILE* log;
+    std::thread worker;
+    std::mutex lock;
+    std::condition_variable wake;
+    bool stop;
+  };
+
+  namespace jit {
+    // A JIT assembly handle looks exactly like a dynamic library handle, so we keep track of every handle we gave out
+    static std::mutex lock;
+    static std::unordered_set<void*> assemblies;
+
+    IN_ERROR LogError(const Environment& env, llvm::Error e, IN_ERROR code)
+    {
+      std::string msg = llvm::toString(std::move(e));
+      if(env.loglevel >= LOG_FATAL)
+        fprintf(env.log, "JIT error: %s\n", msg.c_str());
+      return code;
+    }
+
+    void* GetAddress(llvm::orc::LLJIT& jit, const char* name)
+    {
+      auto sym = jit.lookup(name);
+      if(!sym)
+      {
+        llvm::consumeError(sym.takeError());
+        return nullptr;
+      }
+      return reinterpret_cast<void*>(static_cast<uintptr_t>(sym->getAddress()));
+    }
+
+    static const uint32_t TIER_UP_THRESHOLD = 1000; // Calls before a function is recompiled with full optimizations
+    static const std::chrono::milliseconds TIER_UP_INTERVAL(10);
+
+    // Gives every local symbol an external name that is unique across the environment, so code that is recompiled in a
+    // separate module later can still refer to the globals and functions owned by the baseline module.
+    void ExposeSymbols(llvm::Module& mod, varuint32 index)
+    {
+      std::string prefix = "tier" + std::to_string(index) + ".";
+      auto expose        = [&prefix](llvm::GlobalValue& v) {
+        if(v.hasLocalLinkage())
+        {
+          v.setName(prefix + (v.hasName() ? v.getName().str() : std::string("anon")));
+          v.setLinkage(llvm::GlobalValue::ExternalLinkage);
+        }
+      };
+
+      for(auto& f : mod.functions())
+        expose(f);
+      for(auto& g : mod.globals())
+        expose(g);
+      for(auto& a : mod.aliases())
+        expose(a);
+    }
+
+    // Prepares a module for the baseline tier. Every direct call to a function body is redirected through a slot, which is
+    // what allows an optimized version to be swapped in later. The IR is then saved before call counters are added to the
+    // entry of every function, because the optimized tier has no need for them.
+    void PrepareTiers(Compiler& compiler, varuint32 index, TieredModule& tier)
+    {
+      llvm::Module& mod = *compiler.mod;
+      ExposeSymbols(mod, index);
+
+      std::vector<llvm::Function*> bodies;
+      for(size_t i = compiler.m.importsection.functions; i < compiler.functions.size(); ++i)
+        if(compiler.functions[i].internal && !compiler.functions[i].internal->isDeclaration())
+          bodies.push_back(compiler.functions[i].internal);
+
+      for(auto fn : bodies)
+      {
+        auto slot = new llvm::GlobalVariable(mod, fn->getType(), false, llvm::GlobalValue::ExternalLinkage, fn,
+                                             fn->getName() + "$slot");
+
+        std::vector<llvm::CallBase*> calls;
+        for(auto user : fn->users())
+          if(auto call = llvm::dyn_cast<llvm::CallBase>(user))
+            if(call->getCalledOperand() == fn)
+              calls.push_back(call);
+
+        // The slot is swapped by another thread, so it's read atomically to pair with the release store in Promote
+        for(auto call : calls)
+        {
+          auto load = new llvm::LoadInst(fn->getType(), slot, "", call);
+          load->setAlignment(llvm::MaybeAlign(mod.getDataLayout().getPointerABIAlignment(0)));
+          load->setAtomic(llvm::AtomicOrdering::Acquire);
+          call->setCalledOperand(load);
+        }
+
+        tier.functions.push_back({ fn->getName().str(), nullptr, nullptr, false });
+      }
+
+      llvm::raw_svector_ostream stream(tier.bitcode);
+      llvm::WriteBitcodeToFile(mod, stream);
+
+      for(auto fn : bodies)
+      {
+        auto counter = new llvm::GlobalVariable(mod, compiler.builder.getInt32Ty(), false,
+                                                llvm::GlobalValue::ExternalLinkage, compiler.builder.getInt32(0),
+                                                fn->getName() + "$count");
+        llvm::IRBuilder<> builder(&*fn->getEntryBlock().getFirstInsertionPt());
+        builder.CreateStore(builder.CreateAdd(builder.CreateLoad(counter), builder.getInt32(1)), counter);
+      }
+    }
+
+    // Recompiles a set of hot functions from a module's saved bitcode with full optimizations. Everything else in the
+    // module becomes a declaration that resolves to the baseline tier, and calls between the hot functions bypass their
+    // slots so they can be inlined into each other.
+    IN_ERROR Promote(JITAssembly& assembly, TieredModule& tier, const std::vector<size_t>& hot,
+                     llvm::TargetMachine& machine)
+    {
+      Environment env = { 0 }; // Only used for logging
+      env.loglevel    = assembly.loglevel;
+      env.log         = assembly.log;
+
+      llvm::LLVMContext ctx;
+      auto mod = llvm::parseBitcodeFile(
+        llvm::MemoryBufferRef(llvm::StringRef(tier.bitcode.data(), tier.bitcode.size()), "tier"), ctx);
+      if(!mod)
+        return LogError(env, mod.takeError(), ERR_FATAL_INVALID_MODULE);
+
+      std::vector<llvm::Function*> promoted;
+      for(size_t i : hot)
+        if(auto fn = (*mod)->getFunction(tier.functions[i].name))
+          promoted.push_back(fn);
+
+      for(auto& g : (*mod)->globals())
+        if(g.hasInitializer())
+        {
+          g.setInitializer(nullptr);
+          g.setLinkage(llvm::GlobalValue::ExternalLinkage);
+        }
+
+      for(auto& f : (*mod)->functions())
+        if(!f.isDeclaration() && std::find(promoted.begin(), promoted.end(), &f) == promoted.end())
+          f.deleteBody();
+
+      for(auto it = (*mod)->alias_begin(); it != (*mod)->alias_end();)
+      {
+        llvm::GlobalAlias& alias = *it++;
+        alias.replaceAllUsesWith(llvm::ConstantExpr::getPointerCast(alias.getAliasee(), alias.getType()));
+        alias.eraseFromParent();
+      }
+
+      for(auto fn : promoted)
+      {
+        if(auto slot = (*mod)->getNamedGlobal((fn->getName() + "$slot").str()))
+        {
+          std::vector<llvm::LoadInst*> loads;
+          for(auto user : slot->users())
+            if(auto load = llvm::dyn_cast<llvm::LoadInst>(user))
+              loads.push_back(load);
+
+          for(auto load : loads)
+          {
+            load->replaceAllUsesWith(fn);
+            load->eraseFromParent();
+          }
+        }
+
+        fn->setName(fn->getName() + "$tier1");
+      }
+
+      std::string errors;
+      llvm::raw_string_ostream verify(errors);
+      if(llvm::verifyModule(**mod, &verify))
+      {
+        if(env.loglevel >= LOG_ERROR)
+          fprintf(env.log, "ERROR: Recompiled module is invalid:\n%s\n", verify.str().c_str());
+        return ERR_FATAL_INVALID_MODULE;
+      }
+
+      OptimizeModule(**mod, &machine, assembly.optimize, assembly.loglevel, assembly.log);
+
+      llvm::SmallVector<char, 0> obj;
+      {
+        llvm::raw_svector_ostream stream(obj);
+        llvm::legacy::PassManager pass;
+        if(machine.addPassesToEmitFile(pass, stream, nullptr, llvm::CGFT_ObjectFile))
+          return ERR_FATAL_FILE_ERROR;
+        pass.run(**mod);
+      }
+
+      if(auto e = assembly.jit->addObjectFile(std::make_unique<llvm::SmallVectorMemoryBuffer>(std::move(obj))))
+        return LogError(env, std::move(e), ERR_FATAL_LINK_ERROR);
+
+      // Swap the optimized functions into their slots, then into any table entry that still points to the baseline tier and
+      // into the list the runtime uses to find the C wrapper of a table entry
+      for(size_t i : hot)
+      {
+        auto& f  = tier.functions[i];
+        void* fn = GetAddress(*assembly.jit, (f.name + "$tier1").c_str());
+        if(!fn)
+          continue;
+
+        // Other threads could be calling through the slot or the tables right now, so the new code must be visible to them
+        // before the pointer to it is
+        auto& slot     = reinterpret_cast<std::atomic<void*>&>(*const_cast<void**>(f.slot));
+        void* baseline = slot.load(std::memory_order_relaxed);
+        slot.store(fn, std::memory_order_release);
+
+        auto swap = [baseline, fn](IN_Entrypoint& entry) {
+          if(entry == reinterpret_cast<IN_Entrypoint>(baseline))
+            reinterpret_cast<std::atomic<IN_Entrypoint>&>(entry).store(reinterpret_cast<IN_Entrypoint>(fn),
+                                                                       std::memory_order_release);
+        };
+
+        for(varuint32 j = 0; j < assembly.tiers.size(); ++j)
+        {
+          auto metadata = reinterpret_cast<INModuleMetadata*>(GetAddress(
+            *assembly.jit, CanonicalName(StringSpan(), StringSpan::From(IN_METADATA_PREFIX), j).c_str()));
+          for(varuint32 k = 0; metadata != nullptr && k < metadata->n_tables; ++k)
+            for(uint64_t l = 0; l < metadata->tables[k]->size / sizeof(INTableEntry); ++l)
+              swap(metadata->tables[k]->entries[l].func);
+          for(varuint32 k = 0; metadata != nullptr && k < metadata->n_table_functions; ++k)
+            swap(metadata->table_functions[k].internal);
+        }
+      }
+
+      return ERR_SUCCESS;
+    }
+
+    // Background thread that periodically checks the call counters and recompiles any function that became hot. It exits
+    // once every function was promoted, because there is nothing left for it to do.
+    void TierUp(JITAssembly* assembly)
+    {
+      auto builder = llvm::orc::JITTargetMachineBuilder::detectHost();
+      if(!builder)
+        return llvm::consumeError(builder.takeError());
+      builder->setCodeGenOptLevel(llvm::CodeGenOpt::Aggressive);
+      auto machine = builder->createTargetMachine();
+      if(!machine)
+        return llvm::consumeError(machine.takeError());
+
+      std::unique_lock<std::mutex> guard(assembly->lock);
+      while(!assembly->stop)
+      {
+        assembly->wake.wait_for(guard, TIER_UP_INTERVAL);
+        if(assembly->stop)
+          break;
+
+        guard.unlock();
+        bool done = true;
+        for(auto& tier : assembly->tiers)
+        {
+          std::vector<size_t> hot;
+          for(size_t i = 0; i < tier.functions.size(); ++i)
+            if(!tier.functions[i].promoted && tier.functions[i].counter != nullptr &&
+               *tier.functions[i].counter >= TIER_UP_THRESHOLD)
+            {
+              tier.functions[i].promoted = true; // Even if this fails, there's no point trying again
+              hot.push_back(i);
+            }
+
+          if(!hot.empty() && Promote(*assembly, tier, hot, **machine) < 0 && assembly->loglevel >= LOG_WARNING)
+            fprintf(assembly->log, "WARNING: Failed to recompile %zu hot functions.\n", hot.size());
+
+          for(auto& f : tier.functions)
+            done = done && f.promoted;
+        }
+        guard.lock();
+
+        if(done)
+          break;
+      }
+    }
+
+    // Resolves runtime symbols from the environment's embeddings in-process instead of handing them to the linker. Static
+    // libraries are linked straight into the JIT, while shared libraries and any leftover C imports are resolved with the
+    // dynamic loader.
+    IN_ERROR AddEmbeddings(const Environment& env, llvm::orc::LLJIT& jit)
+    {
+      auto& dylib = jit.getMainJITDylib();
+      char prefix = jit.getDataLayout().getGlobalPrefix();
+
+      for(Embedding* cur = env.embeddings; cur != nullptr; cur = cur->next)
+      {
+        const char* data = reinterpret_cast<const char*>(cur->data);
+        switch(cur->tag)
+        {
+        case 0:
+          if(cur->size > 0) // The embedding could be freed before the assembly is, so we copy it
+          {
+            auto gen = llvm::orc::StaticLibraryDefinitionGenerator::Create(
+              jit.getObjLinkingLayer(), llvm::MemoryBuffer::getMemBufferCopy(llvm::StringRef(data, (size_t)cur->size)));
+            if(!gen)
+              return LogError(env, gen.takeError(), ERR_FATAL_LINK_ERROR);
+            dylib.addGenerator(std::move(*gen));
+          }
+          else
+          {
+            auto gen = llvm::orc::StaticLibraryDefinitionGenerator::Load(jit.getObjLinkingLayer(), data);
+            if(!gen)
+              return LogError(env, gen.takeError(), ERR_FATAL_LINK_ERROR);
+            dylib.addGenerator(std::move(*gen));
+          }
+          break;
+        case 2:
+          if(!cur->size)
+          {
+            auto gen = llvm::orc::DynamicLibrarySearchGenerator::Load(data, prefix);
+            if(!gen)
+              return LogError(env, gen.takeError(), ERR_FATAL_LINK_ERROR);
+            dylib.addGenerator(std::move(*gen));
+          }
+          break;
+        }
+      }
+
+      auto process = llvm::orc::DynamicLibrarySearchGenerator::GetForCurrentProcess(prefix);
+      if(!process)
+        return LogError(env, process.takeError(), ERR_FATAL_LINK_ERROR);
+      dylib.addGenerator(std::move(*process));
+      return ERR_SUCCESS;
+    }
+  }
+}
+
+void* innative::CompileJIT(Environment* env, int* err)
+{
+  int dummy;
+  if(!err)
+    err = &dummy;
+  if(!env)
+  {
+    *err = ERR_FATAL_NULL_POINTER;
+    return nullptr;
+  }
+
+  if((*err = Validate(env)) != ERR_SUCCESS)
+    return nullptr;
+
+  // The JIT assembly behaves like a library that was just loaded, so we can't generate a process entry point. Profile
+  // instrumentation is also disabled, because the profile runtime finds its counters through sections that only the linker
+  // can provide. The baseline tier of a tiered compilation skips the optimizer entirely, and recompiles functions by name,
+  // so it can't handle multiversioned or instanced functions. The JIT always generates code for the CPU it runs on.
+  auto flags       = env->flags;
+  auto optimize    = env->optimize;
+  auto cpu         = env->cpu;
+  auto cpufeatures = env->cpufeatures;
+  bool tiered      = (env->optimize & ENV_OPTIMIZE_TIERED) && (env->optimize & ENV_OPTIMIZE_OMASK) &&
+                     !(env->flags & ENV_MULTI_INSTANCE);
+  env->flags |= ENV_LIBRARY;
+  env->optimize &= ~ENV_OPTIMIZE_PROFILE_GENERATE;
+  env->cpu         = nullptr;
+  env->cpufeatures = nullptr;
+  if(tiered)
+    env->optimize &= ~(ENV_OPTIMIZE_OMASK | ENV_OPTIMIZE_MULTIVERSION | ENV_OPTIMIZE_MULTIVERSION_HOT);
+
+  ThreadPool pool(ThreadPool::Concurrency(*env));
+  std::vector<Module*> new_modules;
+
+  *err             = GenerateEnvironment(env, path(), pool, new_modules, nullptr);
+  env->flags       = flags;
+  env->optimize    = optimize;
+  env->cpu         = cpu;
+  env->cpufeatures = cpufeatures;
+  if(*err < 0)
+    return nullptr;
+  if((*err = VerifyModules(env, path(), pool)) < 0)
+    return nullptr;
+
+  std::vector<TieredModule> tiers(tiered ? env->n_modules : 0);
+  for(varuint32 i = 0; i < tiers.size(); ++i)
+    jit::PrepareTiers(*env->modules[i].cache, i, tiers[i]);
+
+  llvm::orc::LLJITBuilder builder;
+  builder.setNumCompileThreads(ThreadPool::Concurrency(*env));
+  if(tiered)
+  {
+    auto machine = llvm::orc::JITTargetMachineBuilder::detectHost();
+    if(!machine)
+    {
+      *err = jit::LogError(*env, machine.takeError(), ERR_FATAL_UNKNOWN_TARGET);
+      return nullptr;
+    }
+    machine->setCodeGenOptLevel(llvm::CodeGenOpt::None);
+    builder.setJITTargetMachineBuilder(std::move(*machine));
+  }
+
+  auto orc = builder.create();
+  if(!orc)
+  {
+    *err = jit::LogError(*env, orc.takeError(), ERR_FATAL_LINK_ERROR);
+    return nullptr;
+  }
+
+  if((*err = jit::AddEmbeddings(*env, **orc)) < 0)
+    return nullptr;
+
+  // Hand every module over to the JIT. Each module owns its own LLVMContext, which the JIT now takes ownership of, so this
+  // consumes the compilation cache of the environment.
+  std::vector<llvm::orc::ThreadSafeModule> modules;
+  for(varuint32 i = 0; i < env->n_modules; ++i)
+  {
+    llvm::Module* mod = nullptr;
+    DeleteCache(*env, env->modules[i], &mod);
+    modules.emplace_back(std::unique_ptr<llvm::Module>(mod), std::unique_ptr<llvm::LLVMContext>(&mod->getContext()));
+  }
+
+  for(auto& m : modules)
+    if(auto e = (*orc)->addIRModule(std::move(m)))
+    {
+      *err = jit::LogError(*env, std::move(e), ERR_FATAL_LINK_ERROR);
+      return nullptr;
+    }
+
+  // Looking up the init and exit functions forces every module to be compiled, which reports any unresolved symbols now
+  // instead of when a function is first loaded.
+  auto init    = reinterpret_cast<IN_Entrypoint>(jit::GetAddress(**orc, IN_INIT_FUNCTION));
+  auto cleanup = reinterpret_cast<IN_Entrypoint>(jit::GetAddress(**orc, IN_EXIT_FUNCTION));
+  if(!init || !cleanup)
+  {
+    *err = ERR_FATAL_LINK_ERROR;
+    return nullptr;
+  }
+
+  for(auto& tier : tiers)
+    for(auto& f : tier.functions)
+    {
+      f.counter = reinterpret_cast<volatile uint32_t*>(jit::GetAddress(**orc, (f.name + "$count").c_str()));
+      f.slot    = reinterpret_cast<void* volatile*>(jit::GetAddress(**orc, (f.name + "$slot").c_str()));
+      f.promoted = !f.counter || !f.slot;
+    }
+
+  auto assembly      = new JITAssembly();
+  assembly->jit      = std::move(*orc);
+  assembly->exit     = nullptr;
+  assembly->tiers    = std::move(tiers);
+  assembly->optimize = env->optimize;
+  assembly->loglevel = env->loglevel;
+  assembly->log      = env->log;
+  assembly->stop     = false;
+  {
+    std::lock_guard<std::mutex> guard(jit::lock);
+    jit::assemblies.insert(assembly);
+  }
+
+  // Mirrors a dynamic library, which runs the init function when loaded unless ENV_NO_INIT was specified. Multi-instance
+  // assemblies are only ever initialized through InitInstance.
+  if(!(env->flags & (ENV_NO_INIT | ENV_MULTI_INSTANCE)))
+  {
+    assembly->exit = cleanup;
+    (*init)();
+  }
+
+  if(!assembly->tiers.empty())
+    assembly->worker = std::thread(&jit::TierUp, assembly);
+
+  *err = ERR_SUCCESS;
+  return assembly;
+}
+
+void* innative::LoadAssemblySymbol(void* assembly, const char* name)
+{
+  bool jitted;
+  {
+    std::lock_guard<std::mutex> guard(jit::lock);
+    jitted = jit::assemblies.count(assembly) != 0;
+  }
+
+  // A lookup can materialize code, so it happens outside the lock. Like with a dynamic library, the assembly must not be
+  // freed while symbols are being loaded from it.
+  if(jitted)
+    return jit::GetAddress(*static_cast<JITAssembly*>(assembly)->jit, name);
+  return utility::LoadDLLFunction(assembly, name);
+}
+
+bool innative::FreeJIT(void* assembly)
+{
+  {
+    std::lock_guard<std::mutex> guard(jit::lock);
+    if(!jit::assemblies.erase(assembly))
+      return false;
+  }
+
+  auto p = static_cast<JITAssembly*>(assembly);
+  if(p->worker.joinable())
+  {
+    {
+      std::lock_guard<std::mutex> guard(p->lock);
+      p->stop = true;
+    }
+    p->wake.notify_all();
+    p->worker.join();
+  }
+
+  if(p->exit)
+    (*p->exit)();
+  delete p;
+  return true;
+}
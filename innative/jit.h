@@ -0,0 +1,21 @@
+// Copyright (c)2020 Black Sphere Studios
+// For conditions of distribution and use, see copyright notice in innative.h
+
+#ifndef IN__JIT_H
+#define IN__JIT_H
+
+#include "innative/schema.h"
+
+namespace innative {
+  // Compiles an environment straight into executable memory using LLVM's ORC JIT, skipping object files, the linker and the
+  // dynamic loader. The resulting handle can be used anywhere an assembly loaded by LoadAssembly is accepted.
+  void* CompileJIT(Environment* env, int* err);
+
+  // Looks up a symbol in either a JIT assembly or a dynamic library loaded by LoadAssembly
+  void* LoadAssemblySymbol(void* assembly, const char* name);
+
+  // Frees a JIT assembly and returns true, or returns false if the handle did not come from CompileJIT
+  bool FreeJIT(void* assembly);
+}
+
+#endif
@@ -66,6 +66,13 @@ namespace innative {
                                        "i64",
                                        "f32",
                                        "f64",
+                                       "v128",
+                                       "i8x16", // SIMD lane shapes
+                                       "i16x8",
+                                       "i32x4",
+                                       "i64x2",
+                                       "f32x4",
+                                       "f64x2",
                                        "funcref",
                                        "cref",
                                        "mut",
@@ -78,6 +85,7 @@ namespace innative {
                                        "shared",
                                        "unshared",
                                        "memidx",
+                                       "declare",
                                        "binary", // script expressions
                                        "quote",
                                        "register",
@@ -34,6 +34,13 @@ namespace innative {
     i64,
     f32,
     f64,
+    v128,
+    i8x16, // SIMD lane shapes
+    i16x8,
+    i32x4,
+    i64x2,
+    f32x4,
+    f64x2,
     FUNCREF,
     CREF,
     MUT,
@@ -46,6 +53,7 @@ namespace innative {
     SHARED,
     UNSHARED,
     MEMIDX,
+    DECLARE,
     BINARY, // Script extension tokens
     QUOTE,
     REGISTER,
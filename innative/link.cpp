@@ -5,6 +5,7 @@
 #include "utility.h"
 #include "link.h"
 #include "compile.h"
+#include "threadpool.h"
 #include "innative/export.h"
 
 using namespace innative;
@@ -67,25 +68,16 @@ path innative::GetLinkerObjectPath(const Environment& env, Module& m, const path
   return objpath;
 }
 
-IN_ERROR innative::GenerateLinkerObjects(const Environment& env, std::vector<std::string>& cache)
+IN_ERROR innative::GenerateLinkerObjects(const Environment& env, std::vector<std::string>& cache, ThreadPool& pool)
 {
+  std::vector<path> objfiles;
+
   for(size_t i = 0; i < env.n_modules; ++i)
   {
     assert(env.modules[i].cache != 0);
     assert(env.modules[i].name.get() != nullptr);
-    path objfile = GetLinkerObjectPath(env, env.modules[i], path());
-    cache.emplace_back(objfile.u8string());
-
-    FILE* f;
-    FOPEN(f, objfile.c_str(), "rb");
-    if(f)
-      fclose(f);
-    else
-    {
-      IN_ERROR err = OutputObjectFile(*env.modules[i].cache, objfile);
-      if(err < 0)
-        return err;
-    }
+    objfiles.push_back(GetLinkerObjectPath(env, env.modules[i], path()));
+    cache.emplace_back(objfiles.back().u8string());
 
 #ifdef IN_PLATFORM_POSIX
     if(i == 0)
@@ -102,7 +94,18 @@ IN_ERROR innative::GenerateLinkerObjects(const Environment& env, std::vector<std
 #endif
   }
 
-  return ERR_SUCCESS;
+  // Each module has its own target machine, so the object files can be emitted in parallel
+  return pool.Map(env.n_modules, [&](size_t i) -> IN_ERROR {
+    FILE* f;
+    FOPEN(f, objfiles[i].c_str(), "rb");
+    if(f)
+    {
+      fclose(f);
+      return ERR_SUCCESS;
+    }
+
+    return OutputObjectFile(*env.modules[i].cache, objfiles[i]);
+  });
 }
 
 int innative::CallLinker(const Environment* env, std::vector<const char*>& linkargs, LLD_FORMAT format)
@@ -183,7 +186,9 @@ int innative::CallLinker(const Environment* env, std::vector<const char*>& linka
   return err;
 }
 
-void innative::DeleteCache(const Environment& env, Module& m)
+// If release is not null, the LLVM module is handed to the caller instead of being deleted, along with the LLVMContext it
+// belongs to, which the caller then also owns.
+void innative::DeleteCache(const Environment& env, Module& m, llvm::Module** release)
 {
   // Certain error conditions can result in us clearing the cache of an invalid module.
   if(m.name.size() > 0)                          // Prevent an error from happening if the name is invalid.
@@ -192,8 +197,18 @@ void innative::DeleteCache(const Environment& env, Module& m)
   if(m.cache != nullptr)
   {
     auto context = static_cast<Compiler*>(m.cache);
+    auto ctx     = &context->ctx;
     kh_destroy_importhash(context->importhash);
-    delete context->mod;
+    context->debugger.reset();
+    delete &context->builder;
+    delete context->machine;
+    if(release != nullptr)
+      *release = context->mod;
+    else
+    {
+      delete context->mod;
+      delete ctx; // The LLVMContext must outlive everything that was created inside it
+    }
     delete context;
     m.cache = nullptr;
   }
@@ -272,6 +287,7 @@ int innative::GetParameterBytes(const IN_WASM_MODULE& m, const Import& imp)
       case TE_i32: total += 4; break;
       case TE_i64:
       case TE_f64: total += 8; break;
+      case TE_v128: total += 16; break;
       case TE_funcref:
       case TE_cref:
 #ifdef IN_32BIT
@@ -301,18 +317,13 @@ std::string innative::ABIMangle(const std::string& src, ABI abi, int convention,
   return src;
 }
 
-IN_ERROR innative::LinkEnvironment(const Environment* env, const path& file)
+IN_ERROR innative::VerifyModules(const Environment* env, const path& file, ThreadPool& pool)
 {
-  path workdir   = utility::GetWorkingDir();
-  path libpath   = utility::GetPath(env->libpath);
-  path objpath   = !env->objpath ? file.parent_path() : utility::GetPath(env->objpath);
-  bool UseNatVis = false;
+  return pool.Map(env->n_modules, [env, &file](size_t i) -> IN_ERROR {
+    if(env->modules[i].cache->fromcache) // Object files from the object cache were already verified
+      return ERR_SUCCESS;
 
-  // Finalize all modules
-  for(varuint32 i = 0; i < env->n_modules; ++i)
-  {
     env->modules[i].cache->debugger->Finalize();
-    UseNatVis = UseNatVis || !env->modules[i].cache->natvis.empty();
 
     if(env->flags & ENV_EMIT_LLVM)
     {
@@ -326,7 +337,24 @@ IN_ERROR innative::LinkEnvironment(const Environment* env, const path& file)
     llvm::raw_fd_ostream dest(1, false, true);
     if(llvm::verifyModule(*env->modules[i].cache->mod, &dest))
       return ERR_FATAL_INVALID_MODULE;
-  }
+    return ERR_SUCCESS;
+  });
+}
+
+IN_ERROR innative::LinkEnvironment(const Environment* env, const path& file, ThreadPool& pool)
+{
+  path workdir   = utility::GetWorkingDir();
+  path libpath   = utility::GetPath(env->libpath);
+  path objpath   = !env->objpath ? file.parent_path() : utility::GetPath(env->objpath);
+  bool UseNatVis = false;
+
+  for(varuint32 i = 0; i < env->n_modules; ++i)
+    UseNatVis = UseNatVis || !env->modules[i].cache->natvis.empty();
+
+  // Finalize all modules
+  IN_ERROR err = VerifyModules(env, file, pool);
+  if(err < 0)
+    return err;
 
   {
 #ifdef IN_PLATFORM_WIN32
@@ -421,7 +449,7 @@ IN_ERROR innative::LinkEnvironment(const Environment* env, const path& file)
     });
 
     // Generate object code
-    IN_ERROR err = GenerateLinkerObjects(*env, cache);
+    err = GenerateLinkerObjects(*env, cache, pool);
     if(err < 0)
       return err;
 
@@ -8,18 +8,29 @@
 #include "filesys.h"
 #include <vector>
 #include <string>
+#include <optional>
+
+namespace llvm {
+  class Module;
+}
 
 namespace innative {
-  IN_ERROR LinkEnvironment(const Environment* env, const path& file);
-  void DeleteCache(const Environment& env, Module& m);
+  class ThreadPool;
+  class ObjectCache;
+
+  IN_ERROR LinkEnvironment(const Environment* env, const path& file, ThreadPool& pool);
+  IN_ERROR VerifyModules(const Environment* env, const path& file, ThreadPool& pool);
+  void DeleteCache(const Environment& env, Module& m, llvm::Module** release = nullptr);
   void DeleteContext(Environment& env, bool shutdown);
   std::vector<std::string> GetSymbols(const char* file, size_t size, FILE* log, LLD_FORMAT format);
   void AppendIntrinsics(Environment& env);
   std::string ABIMangle(const std::string& src, ABI abi, int convention, int bytes);
   int GetParameterBytes(const IN_WASM_MODULE& m, const Import& imp);
-  IN_ERROR GenerateLinkerObjects(const Environment& env, std::vector<std::string>& cache);
+  IN_ERROR GenerateLinkerObjects(const Environment& env, std::vector<std::string>& cache, ThreadPool& pool);
   int CallLinker(const Environment* env, std::vector<const char*>& linkargs, LLD_FORMAT format);
   path GetLinkerObjectPath(const Environment& env, Module& m, const path& outfile);
+  IN_ERROR GenerateEnvironment(Environment* env, const path& file, ThreadPool& pool, std::vector<Module*>& new_modules,
+                               std::optional<ObjectCache>* objcache);
   IN_ERROR CompileEnvironment(Environment* env, const char* file);
   int GetCallingConvention(const Import& imp);
   IN_ERROR OutputObjectFile(Compiler& context, const path& out);
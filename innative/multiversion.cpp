@@ -0,0 +1,170 @@
+// Copyright (c)2020 Black Sphere Studios
+// For conditions of distribution and use, see copyright notice in innative.h
+
+#include "multiversion.h"
+#pragma warning(push)
+#pragma warning(disable : 4146 4267 4141 4244 4624)
+#include "llvm/Analysis/LoopInfo.h"
+#include "llvm/IR/Dominators.h"
+#include "llvm/MC/MCSubtargetInfo.h"
+#include "llvm/Transforms/Utils/Cloning.h"
+#include "llvm/Transforms/Utils/ValueMapper.h"
+#pragma warning(pop)
+#include <unordered_map>
+
+using namespace innative;
+
+namespace innative {
+  namespace multiversion {
+    // LLVM doesn't know the x86-64-v2, v3 and v4 CPU names yet, so each level is described by the features it adds to
+    // the previous one instead.
+    struct Level
+    {
+      IN_ISA_LEVEL level;
+      const char* name;
+      const char* features;
+    };
+
+    static const Level LEVELS[] = {
+      { IN_ISA_X86_64_V2, "v2", "+cx16,+sahf,+popcnt,+sse3,+sse4.1,+sse4.2,+ssse3" },
+      { IN_ISA_X86_64_V3, "v3", "+avx,+avx2,+bmi,+bmi2,+f16c,+fma,+lzcnt,+movbe,+xsave" },
+      { IN_ISA_X86_64_V4, "v4", "+avx512f,+avx512bw,+avx512cd,+avx512dq,+avx512vl" },
+    };
+
+    bool HasLoop(llvm::Function& fn)
+    {
+      llvm::DominatorTree tree(fn);
+      llvm::LoopInfo loops(tree);
+      return !loops.empty();
+    }
+
+    llvm::Function* Clone(llvm::Function* fn, const char* suffix)
+    {
+      llvm::Function* clone = llvm::Function::Create(fn->getFunctionType(), llvm::GlobalValue::InternalLinkage,
+                                                     fn->getName() + "." + suffix, fn->getParent());
+      llvm::ValueToValueMapTy map;
+      auto arg = clone->arg_begin();
+      for(auto& original : fn->args())
+      {
+        arg->setName(original.getName());
+        map[&original] = &*arg++;
+      }
+
+      llvm::SmallVector<llvm::ReturnInst*, 8> returns;
+      llvm::CloneFunctionInto(clone, fn, map, fn->getSubprogram() != nullptr, returns);
+
+      // The clone is only ever called by the dispatcher, so it must not be exported under the original's storage class
+      clone->setDLLStorageClass(llvm::GlobalValue::DefaultStorageClass);
+      clone->setVisibility(llvm::GlobalValue::DefaultVisibility);
+      return clone;
+    }
+
+    // Points every direct call to a versioned function at the clone of the same level, skipping the dispatcher
+    void RedirectCalls(llvm::Function* clone, const std::unordered_map<llvm::Function*, llvm::Function*>& versions)
+    {
+      for(auto& i : llvm::instructions(clone))
+        if(auto call = llvm::dyn_cast<llvm::CallBase>(&i))
+          if(auto target = versions.find(call->getCalledFunction()); target != versions.end())
+            call->setCalledFunction(target->second);
+    }
+
+    llvm::BasicBlock* DispatchBlock(llvm::IRBuilder<>& builder, llvm::Function* fn, llvm::Function* target,
+                                    const char* name)
+    {
+      auto block = llvm::BasicBlock::Create(fn->getContext(), name, fn);
+      builder.SetInsertPoint(block);
+
+      std::vector<llvm::Value*> args;
+      for(auto& arg : fn->args())
+        args.push_back(&arg);
+
+      // The clone has the exact same prototype, so the dispatcher never shows up in a stack trace
+      auto call = builder.CreateCall(target, args);
+      call->setCallingConv(target->getCallingConv());
+      call->setTailCallKind(llvm::CallInst::TCK_MustTail);
+      if(fn->getReturnType()->isVoidTy())
+        builder.CreateRetVoid();
+      else
+        builder.CreateRet(call);
+      return block;
+    }
+  }
+}
+
+bool innative::UsesMultiversioning(uint64_t optimize, const llvm::Triple& triple)
+{
+  return (optimize & (ENV_OPTIMIZE_MULTIVERSION | ENV_OPTIMIZE_MULTIVERSION_HOT)) != 0 &&
+         triple.getArch() == llvm::Triple::x86_64;
+}
+
+void innative::MultiversionFunctions(llvm::Module& mod, llvm::TargetMachine& machine,
+                                     llvm::ArrayRef<llvm::Function*> bodies, bool hot)
+{
+  std::vector<llvm::Function*> versioned;
+  for(auto fn : bodies)
+    if(fn && !fn->isDeclaration() && (!hot || multiversion::HasLoop(*fn)))
+      versioned.push_back(fn);
+
+  if(versioned.empty())
+    return;
+
+  // Levels are cumulative, and any level the target CPU already supports would just be a copy of the baseline
+  std::vector<std::pair<const multiversion::Level*, std::string>> levels;
+  std::string required;
+  std::string features = machine.getTargetFeatureString().str();
+  for(auto& level : multiversion::LEVELS)
+  {
+    required += (required.empty() ? "" : ",") + std::string(level.features);
+    features += (features.empty() ? "" : ",") + std::string(level.features);
+    if(!machine.getMCSubtargetInfo()->checkFeatures(required))
+      levels.push_back({ &level, features });
+  }
+
+  if(levels.empty())
+    return;
+
+  // Clone every function for every level before redirecting calls, so each clone can find its siblings
+  std::vector<std::unordered_map<llvm::Function*, llvm::Function*>> versions(levels.size() + 1);
+  for(auto fn : versioned)
+  {
+    versions[0][fn] = multiversion::Clone(fn, "base");
+    for(size_t i = 0; i < levels.size(); ++i)
+    {
+      llvm::Function* clone = multiversion::Clone(fn, levels[i].first->name);
+      clone->addFnAttr("target-cpu", machine.getTargetCPU());
+      clone->addFnAttr("target-features", levels[i].second);
+      versions[i + 1][fn] = clone;
+    }
+  }
+
+  for(auto& version : versions)
+    for(auto& clone : version)
+      multiversion::RedirectCalls(clone.second, version);
+
+  // The original function keeps its name, linkage and every reference to it, including exports and table entries, but
+  // its body is replaced with a switch on the detected ISA level. CPUs above the highest clone use the highest clone.
+  auto i32   = llvm::Type::getInt32Ty(mod.getContext());
+  auto level = mod.getOrInsertGlobal(IN_CPU_LEVEL, i32);
+  llvm::IRBuilder<> builder(mod.getContext());
+
+  for(auto fn : versioned)
+  {
+    auto linkage = fn->getLinkage();
+    fn->deleteBody();
+    fn->setLinkage(linkage);
+
+    auto entry = llvm::BasicBlock::Create(mod.getContext(), "entry", fn);
+    auto base  = multiversion::DispatchBlock(builder, fn, versions[0][fn], "base");
+    builder.SetInsertPoint(entry);
+    auto cpu    = builder.CreateLoad(i32, level, "cpu_level");
+    auto select = builder.CreateSwitch(cpu, base, IN_ISA_X86_64_V4 - IN_ISA_X86_64_V1);
+
+    for(size_t i = 0; i < levels.size(); ++i)
+    {
+      auto block = multiversion::DispatchBlock(builder, fn, versions[i + 1][fn], levels[i].first->name);
+      int last   = (i + 1 < levels.size()) ? levels[i + 1].first->level : IN_ISA_X86_64_V4 + 1;
+      for(int l = levels[i].first->level; l < last; ++l)
+        select->addCase(builder.getInt32(l), block);
+    }
+  }
+}
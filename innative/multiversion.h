@@ -0,0 +1,22 @@
+// Copyright (c)2020 Black Sphere Studios
+// For conditions of distribution and use, see copyright notice in innative.h
+
+#ifndef IN__MULTIVERSION_H
+#define IN__MULTIVERSION_H
+
+#include "llvm.h"
+#include "innative/export.h"
+
+namespace innative {
+  // Returns true if the optimization flags ask for multiversioning and the target supports it, which is only x86-64
+  bool UsesMultiversioning(uint64_t optimize, const llvm::Triple& triple);
+
+  // Clones each of the given function bodies once for every x86-64 ISA level that the target machine doesn't already
+  // support, plus once for the target machine itself, then turns the original functions into dispatchers that switch on
+  // the ISA level detected at startup. Clones of the same level call each other directly, so only calls coming from outside
+  // the versioned set pay for the dispatch. If hot is true, only functions containing a loop are versioned.
+  void MultiversionFunctions(llvm::Module& mod, llvm::TargetMachine& machine, llvm::ArrayRef<llvm::Function*> bodies,
+                             bool hot);
+}
+
+#endif
@@ -3,10 +3,16 @@
 
 #include "llvm.h"
 #include "optimize.h"
+#include "bounds.h"
 #include "compile.h"
+#include "threadpool.h"
+#include "utility.h"
 #pragma warning(push)
 #pragma warning(disable : 4146 4267 4141 4244 4624)
 #define _SCL_SECURE_NO_WARNINGS
+#include "llvm/Bitcode/BitcodeReader.h"
+#include "llvm/Bitcode/BitcodeWriter.h"
+#include "llvm/Linker/Linker.h"
 #include "llvm/Passes/PassBuilder.h"
 #include "llvm/Transforms/AggressiveInstCombine/AggressiveInstCombine.h"
 #include "llvm/Transforms/InstCombine/InstCombine.h"
@@ -29,13 +35,35 @@
 
 using namespace innative;
 
-IN_ERROR innative::OptimizeModules(const Environment* env)
+namespace innative {
+  // Each module owns its own context and target machine, so every module also gets its own pass and analysis managers,
+  // which allows modules to be optimized on separate threads.
+  IN_ERROR OptimizeModule(const Environment* env, Compiler& context, const std::string& profile)
+  {
+    if(context.fromcache) // Object files from the object cache have already been optimized
+      return ERR_SUCCESS;
+
+    OptimizeModule(*context.mod, context.machine, env->optimize, env->loglevel, env->log,
+                   profile.empty() ? nullptr : profile.c_str());
+    return ERR_SUCCESS;
+  }
+}
+
+void innative::OptimizeModule(llvm::Module& mod, llvm::TargetMachine* machine, uint64_t optimize, int loglevel,
+                              FILE* log, const char* profile)
 {
-  llvm::PassBuilder passBuilder;
-  llvm::LoopAnalysisManager loopAnalysisManager(env->loglevel >= LOG_DEBUG);
-  llvm::FunctionAnalysisManager functionAnalysisManager(env->loglevel >= LOG_DEBUG);
-  llvm::CGSCCAnalysisManager cGSCCAnalysisManager(env->loglevel >= LOG_DEBUG);
-  llvm::ModuleAnalysisManager moduleAnalysisManager(env->loglevel >= LOG_DEBUG);
+  // The profile is either where the instrumented program writes its counters, or the merged profile we optimize with
+  llvm::Optional<llvm::PGOOptions> pgo;
+  if(profile)
+    pgo = llvm::PGOOptions(profile, "", "",
+                           (optimize & ENV_OPTIMIZE_PROFILE_GENERATE) ? llvm::PGOOptions::IRInstr :
+                                                                        llvm::PGOOptions::IRUse);
+
+  llvm::PassBuilder passBuilder(machine, llvm::PipelineTuningOptions(), pgo);
+  llvm::LoopAnalysisManager loopAnalysisManager(loglevel >= LOG_DEBUG);
+  llvm::FunctionAnalysisManager functionAnalysisManager(loglevel >= LOG_DEBUG);
+  llvm::CGSCCAnalysisManager cGSCCAnalysisManager(loglevel >= LOG_DEBUG);
+  llvm::ModuleAnalysisManager moduleAnalysisManager(loglevel >= LOG_DEBUG);
 
   // Pass debugging
   /*llvm::PassInstrumentationCallbacks PIC;
@@ -65,7 +93,7 @@ IN_ERROR innative::OptimizeModules(const Environment* env)
 
   llvm::PassBuilder::OptimizationLevel optlevel = llvm::PassBuilder::OptimizationLevel::O0;
 
-  switch(env->optimize & ENV_OPTIMIZE_OMASK)
+  switch(optimize & ENV_OPTIMIZE_OMASK)
   {
   case ENV_OPTIMIZE_O1: optlevel = llvm::PassBuilder::OptimizationLevel::O1; break;
   case ENV_OPTIMIZE_O2: optlevel = llvm::PassBuilder::OptimizationLevel::O2; break;
@@ -74,12 +102,104 @@ IN_ERROR innative::OptimizeModules(const Environment* env)
   default: assert(false);
   }
 
-  llvm::ModulePassManager modulePassManager =
-    passBuilder.buildPerModuleDefaultPipeline(optlevel, env->loglevel >= LOG_DEBUG);
+  // The bounds check pass has to run before the loop passes, because some of them, like loop idiom recognition, will move
+  // stores past a check marker that hasn't been lowered into a branch yet. The peephole extension point is the earliest
+  // one that sees promoted locals, and later invocations simply find no markers left.
+  BoundsCheckStats stats = { 0, 0 };
+  if(mod.getFunction(BOUNDS_CHECK_MARKER) != nullptr)
+  {
+    bool hoist = (optimize & ENV_OPTIMIZE_OMASK) != ENV_OPTIMIZE_Os;
+    passBuilder.registerPeepholeEPCallback(
+      [&stats, hoist](llvm::FunctionPassManager& functionPassManager, llvm::PassBuilder::OptimizationLevel) {
+        functionPassManager.addPass(BoundsCheckPass(stats, hoist));
+      });
+  }
+
+  llvm::ModulePassManager modulePassManager = passBuilder.buildPerModuleDefaultPipeline(optlevel, loglevel >= LOG_DEBUG);
+
+  modulePassManager.run(mod, moduleAnalysisManager);
+  LowerBoundsChecks(mod);
+
+  if(stats.total > 0 && loglevel >= LOG_NOTICE)
+    fprintf(log, "Eliminated %zu of %zu memory bounds checks in %s.\n", stats.eliminated, stats.total,
+            mod.getName().str().c_str());
+}
+
+bool innative::UseLTO(const Environment* env)
+{
+  return (env->optimize & ENV_OPTIMIZE_LTO) && (env->optimize & ENV_OPTIMIZE_OMASK) && !(env->flags & ENV_DEBUG) &&
+         env->n_modules > 1;
+}
+
+IN_ERROR innative::MergeModules(const Environment* env)
+{
+  Compiler& root = *env->modules[0].cache;
+
+  for(varuint32 i = 1; i < env->n_modules; ++i)
+  {
+    Compiler& compiler = *env->modules[i].cache;
+
+    // Every module has its own context, so the IR has to be copied through bitcode before it can be linked into the first
+    // one. The linker renames any private symbols that collide, and resolves the declarations that cross-module imports
+    // generated against the definitions they refer to.
+    llvm::SmallVector<char, 0> bitcode;
+    {
+      llvm::raw_svector_ostream stream(bitcode);
+      llvm::WriteBitcodeToFile(*compiler.mod, stream);
+    }
+
+    auto mod = llvm::parseBitcodeFile(
+      llvm::MemoryBufferRef(llvm::StringRef(bitcode.data(), bitcode.size()), compiler.mod->getName()), root.ctx);
+    if(!mod)
+    {
+      llvm::consumeError(mod.takeError());
+      return ERR_FATAL_INVALID_MODULE;
+    }
+
+    if(llvm::Linker::linkModules(*root.mod, std::move(*mod)))
+      return ERR_FATAL_LINK_ERROR;
+
+    // The module is kept around, empty, so the rest of the pipeline can still emit an object file for it
+    llvm::Module& empty = *compiler.mod;
+    empty.dropAllReferences();
+    auto erase = [](llvm::GlobalValue& v) {
+      v.removeDeadConstantUsers();
+      v.eraseFromParent();
+    };
+    while(!empty.alias_empty())
+      erase(*empty.alias_begin());
+    while(!empty.empty())
+      erase(*empty.begin());
+    while(!empty.global_empty())
+      erase(*empty.global_begin());
+  }
+
+  if(env->loglevel >= LOG_NOTICE)
+    fprintf(env->log, "Merged %u modules into %s for link-time optimization.\n", env->n_modules,
+            root.mod->getName().str().c_str());
+  return ERR_SUCCESS;
+}
+
+IN_ERROR innative::OptimizeModules(const Environment* env, const path& file, ThreadPool& pool)
+{
+  std::string profile;
+  if(env->optimize & ENV_OPTIMIZE_PROFILE_GENERATE)
+    profile = path(file.filename()).replace_extension(".profraw").u8string();
+  else if(env->profile)
+  {
+    // LLVM treats a missing profile as a fatal error and exits the process, so we have to check for it ourselves
+    if(!exists(utility::GetPath(env->profile)))
+    {
+      if(env->loglevel >= LOG_ERROR)
+        fprintf(env->log, "ERROR: Profile %s does not exist!\n", env->profile);
+      return ERR_FATAL_FILE_ERROR;
+    }
+    profile = env->profile;
+  }
 
   // Optimize all modules
-  for(size_t i = 0; i < env->n_modules; ++i)
-    modulePassManager.run(*env->modules[i].cache->mod, moduleAnalysisManager);
+  IN_ERROR err = pool.Map(env->n_modules,
+                          [env, &profile](size_t i) { return OptimizeModule(env, *env->modules[i].cache, profile); });
 
   /*{
     auto manager = llvm::make_unique<llvm::legacy::FunctionPassManager>(context[i].llvm);
@@ -152,5 +272,5 @@ IN_ERROR innative::OptimizeModules(const Environment* env)
   }*/
 
   // fclose(aux);
-  return ERR_SUCCESS;
+  return err;
 }
\ No newline at end of file
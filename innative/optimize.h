@@ -6,9 +6,16 @@
 
 #include "llvm.h"
 #include "innative/schema.h"
+#include "filesys.h"
 
 namespace innative {
-  IN_ERROR OptimizeModules(const Environment* env);
+  class ThreadPool;
+
+  IN_ERROR OptimizeModules(const Environment* env, const path& file, ThreadPool& pool);
+  IN_ERROR MergeModules(const Environment* env);
+  bool UseLTO(const Environment* env);
+  void OptimizeModule(llvm::Module& mod, llvm::TargetMachine* machine, uint64_t optimize, int loglevel, FILE* log,
+                      const char* profile = nullptr);
 }
 
 #endif
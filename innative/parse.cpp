@@ -8,6 +8,8 @@
 #include "dwarf_parser.h"
 #include "serialize.h"
 #include "atomic_instructions.h"
+#include "simd_instructions.h"
+#include "instruction_stream.h"
 #include <assert.h>
 #include <algorithm>
 #include <fstream>
@@ -96,6 +98,18 @@ IN_ERROR innative::ParseByteArray(Stream& s, ByteArray& section, bool terminator
   if(err < 0)
     return err;
 
+  if(!terminator && s.persistent && n > 0) // Zero-copy path: the byte array becomes a view into the source buffer
+  {
+    if(n > s.size - s.pos)
+    {
+      s.pos = s.size;
+      return ERR_PARSE_UNEXPECTED_EOF;
+    }
+    section = ByteArray(const_cast<uint8_t*>(s.data + s.pos), n);
+    s.pos += n;
+    return ERR_SUCCESS;
+  }
+
   section.resize(n, terminator, env);
   if(n > 0)
   {
@@ -277,7 +291,8 @@ IN_ERROR innative::ParseInstruction(Stream& s, Instruction& ins, const Environme
   case OP_local_tee:
   case OP_global_get:
   case OP_global_set:
-  case OP_call: ins.immediates[0]._varuint32 = s.ReadVarUInt32(err); break;
+  case OP_call:
+  case OP_return_call: ins.immediates[0]._varuint32 = s.ReadVarUInt32(err); break;
   case OP_i32_const: ins.immediates[0]._varsint32 = s.ReadVarInt32(err); break;
   case OP_i64_const: ins.immediates[0]._varsint64 = s.ReadVarInt64(err); break;
   case OP_f32_const: ins.immediates[0]._float32 = s.ReadFloat32(err); break;
@@ -298,6 +313,7 @@ IN_ERROR innative::ParseInstruction(Stream& s, Instruction& ins, const Environme
       ins.immediates[1]._varuint32 = s.ReadVarUInt32(err);
     break;
   case OP_call_indirect:
+  case OP_return_call_indirect:
     ins.immediates[0]._varuint32 = s.ReadVarUInt32(err);
 
     if(err >= 0)
@@ -478,9 +494,16 @@ IN_ERROR innative::ParseInstruction(Stream& s, Instruction& ins, const Environme
   case OP_i32_reinterpret_f32:
   case OP_i64_reinterpret_f64:
   case OP_f32_reinterpret_i32:
-  case OP_f64_reinterpret_i64: break;
+  case OP_f64_reinterpret_i64:
+  case OP_i32_extend8_s:
+  case OP_i32_extend16_s:
+  case OP_i64_extend8_s:
+  case OP_i64_extend16_s:
+  case OP_i64_extend32_s: break;
 
   case OP_atomic_prefix: err = ParseAtomicInstruction(s, ins, env); break;
+  case OP_simd_prefix: err = ParseSIMDInstruction(s, ins, env); break;
+  case OP_misc_prefix: err = ParseMiscInstruction(s, ins, env); break;
 
   default: err = ERR_FATAL_UNKNOWN_INSTRUCTION;
   }
@@ -491,16 +514,35 @@ IN_ERROR innative::ParseInstruction(Stream& s, Instruction& ins, const Environme
 IN_ERROR innative::ParseTableInit(Stream& s, TableInit& init, Module& m, const Environment& env)
 {
   IN_ERROR err = ParseVarUInt32(s, init.index);
+  init.flags   = WASM_SEGMENT_ACTIVE;
 
-  if(err >= 0)
+  // With bulk memory, the leading value becomes a flag field. The legacy encoding is identical to flag 0.
+  if(err >= 0 && (env.features & ENV_FEATURE_BULK_MEMORY))
+  {
+    if(init.index > WASM_SEGMENT_DECLARATIVE) // Expression-based element segments require reference types
+      return ERR_FATAL_BAD_ELEMENT_TYPE;
+    init.flags = static_cast<varuint7>(init.index);
+    init.index = 0;
+    if(init.flags == WASM_SEGMENT_EXPLICIT_INDEX)
+      err = ParseVarUInt32(s, init.index);
+  }
+
+  if(err >= 0 && (init.flags == WASM_SEGMENT_ACTIVE || init.flags == WASM_SEGMENT_EXPLICIT_INDEX))
     err = ParseInitializer(s, init.offset, env);
 
+  if(err >= 0 && init.flags != WASM_SEGMENT_ACTIVE)
+  {
+    // Every other form has an elemkind byte, which can only be 0x00 (funcref) without reference types
+    if(s.ReadByte(err) != 0 && err >= 0)
+      err = ERR_FATAL_BAD_ELEMENT_TYPE;
+  }
+
   if(err >= 0)
   {
     TableDesc* desc = ModuleTable(m, init.index);
-    if(!desc)
+    if(!desc && (init.flags == WASM_SEGMENT_ACTIVE || init.flags == WASM_SEGMENT_EXPLICIT_INDEX))
       err = ERR_INVALID_TABLE_INDEX;
-    else if(desc->element_type == TE_funcref)
+    else if(!desc || desc->element_type == TE_funcref)
       err = Parse<varuint32>::template Array<&ParseVarUInt32>(s, init.elements, init.n_elements, env);
     else
       err = ERR_FATAL_BAD_ELEMENT_TYPE;
@@ -536,15 +578,25 @@ IN_ERROR innative::ParseFunctionBody(Stream& s, FunctionBody& f, Module& m, cons
     }
   }
 
-  f.body = 0;
+  f.code      = 0;
+  f.code_size = 0;
+  f.n_body    = 0;
+  f.locations = 0;
   if(err >= 0 && f.body_size > 0)
   {
-    f.body = tmalloc<Instruction>(env, f.body_size); // Overallocate maximum number of possible instructions we might have
-    if(!f.body)
-      return ERR_FATAL_OUT_OF_MEMORY;
+    // Instructions are parsed one at a time and packed into a compact stream. Locations are only kept for debug builds.
+    InstructionWriter writer((env.flags & ENV_DEBUG) != 0);
+    Instruction ins;
+    while(s.pos < end && err >= 0)
+    {
+      ins = Instruction{ 0 };
+      if((err = ParseInstruction(s, ins, env)) >= 0)
+        writer.Write(ins);
+    }
 
-    for(f.n_body = 0; s.pos < end && err >= 0; ++f.n_body)
-      err = ParseInstruction(s, f.body[f.n_body], env);
+    IN_ERROR finish = writer.Finish(f, env);
+    if(finish < 0)
+      return finish;
   }
 
   return err;
@@ -553,8 +605,20 @@ IN_ERROR innative::ParseFunctionBody(Stream& s, FunctionBody& f, Module& m, cons
 IN_ERROR innative::ParseDataInit(Stream& s, DataInit& data, const Environment& env)
 {
   IN_ERROR err = ParseVarUInt32(s, data.index);
+  data.flags   = WASM_SEGMENT_ACTIVE;
 
-  if(err >= 0)
+  // With bulk memory, the leading value becomes a flag field. The legacy encoding is identical to flag 0.
+  if(err >= 0 && (env.features & ENV_FEATURE_BULK_MEMORY))
+  {
+    if(data.index > WASM_SEGMENT_EXPLICIT_INDEX)
+      return ERR_FATAL_INVALID_ENCODING;
+    data.flags = static_cast<varuint7>(data.index);
+    data.index = 0;
+    if(data.flags == WASM_SEGMENT_EXPLICIT_INDEX)
+      err = ParseVarUInt32(s, data.index);
+  }
+
+  if(err >= 0 && data.flags != WASM_SEGMENT_PASSIVE)
     err = ParseInitializer(s, data.offset, env);
 
   if(err >= 0)
@@ -743,7 +807,7 @@ IN_ERROR innative::ParseModule(Stream& s, const char* file, const Environment& e
     if(err < 0)
       return err;
 
-    if(op > WASM_SECTION_DATA) // require valid opcode to continue
+    if(op > WASM_SECTION_DATA_COUNT) // require valid opcode to continue
       return ERR_FATAL_UNKNOWN_SECTION;
     if(op == WASM_SECTION_CUSTOM)
       ++m.n_custom;
@@ -846,6 +910,7 @@ IN_ERROR innative::ParseModule(Stream& s, const char* file, const Environment& e
                                                                                                  m.code.n_funcbody, env, m,
                                                                                                  env);
       break;
+    case WASM_SECTION_DATA_COUNT: m.data.datacount = s.ReadVarUInt32(err); break;
     case WASM_SECTION_DATA:
       err = Parse<DataInit, const Environment&>::template Array<&ParseDataInit>(s, m.data.data, m.data.n_data, env, env);
       break;
@@ -1012,3 +1077,104 @@ IN_ERROR innative::ParseAtomicInstruction(utility::Stream& s, Instruction& ins,
 
   return err;
 }
+
+IN_ERROR innative::ParseSIMDInstruction(utility::Stream& s, Instruction& ins, const Environment& env)
+{
+  namespace sd = innative::simd_details;
+
+  IN_ERROR err = ERR_SUCCESS;
+
+  // Unlike the atomic prefix, SIMD opcodes are encoded as a varuint32, but all of them currently fit in one byte
+  varuint32 op = s.ReadVarUInt32(err);
+  if(err < 0)
+    return err;
+  if(op > 0xFF)
+    return ERR_FATAL_UNKNOWN_INSTRUCTION;
+  ins.opcode[1] = static_cast<uint8_t>(op);
+
+  auto info = sd::GetOpInfo(ins.opcode[1]);
+  switch(info.kind)
+  {
+  case sd::OpKind::INVALID: return ERR_FATAL_UNKNOWN_INSTRUCTION;
+  case sd::OpKind::Const:
+  case sd::OpKind::Shuffle: // Both store 16 raw bytes, little-endian, across the first two immediates
+    ins.immediates[0]._varuint64 = s.ReadPrimitive<uint64_t>(err);
+    if(err >= 0)
+      ins.immediates[1]._varuint64 = s.ReadPrimitive<uint64_t>(err);
+    return err;
+  case sd::OpKind::ExtractLane:
+  case sd::OpKind::ReplaceLane: ins.immediates[0]._varuint32 = s.ReadByte(err); return err;
+  default:
+    if(!sd::IsMemoryOp(info.kind))
+      return ERR_SUCCESS;
+  }
+
+  varuint32 alignValue = s.ReadVarUInt32(err);
+  if(err < 0)
+    return err;
+
+  // Only the bottom 3 bits are actually allowed to hold alignment value via the multi-memory proposal
+  ins.immediates[0]._varuint32 = alignValue & 0b111;
+  ins.immediates[1]._varuint32 = s.ReadVarUInt32(err);
+  if(err < 0)
+    return err;
+
+  // (multi-memory proposal) if bit 6 is set, there's a memidx value to read
+  if(alignValue & 0b1000000)
+  {
+    ins.immediates[2]._varuint32 = s.ReadVarUInt32(err);
+    if(err < 0)
+      return err;
+  }
+
+  // Lane memory ops need a fourth immediate, so the lane is stored where the memidx would be and only memory 0 is allowed
+  if(sd::HasLaneImmediate(info.kind))
+  {
+    if(ins.immediates[2]._varuint32 != 0)
+      return ERR_INVALID_MEMORY_INDEX;
+    ins.immediates[2]._varuint32 = s.ReadByte(err);
+  }
+
+  return err;
+}
+
+IN_ERROR innative::ParseMiscInstruction(utility::Stream& s, Instruction& ins, const Environment& env)
+{
+  IN_ERROR err = ERR_SUCCESS;
+
+  // Like SIMD, the misc prefix is followed by a varuint32 opcode
+  varuint32 op = s.ReadVarUInt32(err);
+  if(err < 0)
+    return err;
+  if(op > 0xFF)
+    return ERR_FATAL_UNKNOWN_INSTRUCTION;
+  ins.opcode[1] = static_cast<uint8_t>(op);
+
+  // The memory and table indices are reserved zero bytes in the bulk memory proposal, but we read them as varuint32
+  // indices to be consistent with the multi-memory proposal. Validation rejects anything we don't support.
+  switch(ins.opcode[1])
+  {
+  case OP_memory_init: // segment, memory
+  case OP_table_init:  // segment, table
+  case OP_memory_copy: // destination, source
+  case OP_table_copy:  // destination, source
+    ins.immediates[0]._varuint32 = s.ReadVarUInt32(err);
+    if(err >= 0)
+      ins.immediates[1]._varuint32 = s.ReadVarUInt32(err);
+    break;
+  case OP_data_drop:
+  case OP_elem_drop:
+  case OP_memory_fill: ins.immediates[0]._varuint32 = s.ReadVarUInt32(err); break;
+  case OP_i32_trunc_sat_f32_s:
+  case OP_i32_trunc_sat_f32_u:
+  case OP_i32_trunc_sat_f64_s:
+  case OP_i32_trunc_sat_f64_u:
+  case OP_i64_trunc_sat_f32_s:
+  case OP_i64_trunc_sat_f32_u:
+  case OP_i64_trunc_sat_f64_s:
+  case OP_i64_trunc_sat_f64_u: break;
+  default: err = ERR_FATAL_UNKNOWN_INSTRUCTION;
+  }
+
+  return err;
+}
@@ -31,6 +31,8 @@ namespace innative {
                        ValidationError*& errors);
   IN_ERROR ParseExportFixup(Module& module, ValidationError*& errors, const Environment& env);
   IN_ERROR ParseAtomicInstruction(utility::Stream& s, Instruction& ins, const Environment& env);
+  IN_ERROR ParseSIMDInstruction(utility::Stream& s, Instruction& ins, const Environment& env);
+  IN_ERROR ParseMiscInstruction(utility::Stream& s, Instruction& ins, const Environment& env);
 }
 
 #endif
\ No newline at end of file
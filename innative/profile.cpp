@@ -0,0 +1,56 @@
+// Copyright (c)2020 Black Sphere Studios
+// For conditions of distribution and use, see copyright notice in innative.h
+
+#include "llvm.h"
+#include "innative/export.h"
+#pragma warning(push)
+#pragma warning(disable : 4146 4267 4141 4244 4624)
+#include "llvm/ProfileData/InstrProfReader.h"
+#include "llvm/ProfileData/InstrProfWriter.h"
+#pragma warning(pop)
+
+// Merges raw profiles written by instrumented programs into a single indexed profile, the same way llvm-profdata does
+int innative_merge_profiles(const char** files, size_t n, const char* out, FILE* log)
+{
+  llvm::InstrProfWriter writer;
+
+  for(size_t i = 0; i < n; ++i)
+  {
+    auto reader = llvm::InstrProfReader::create(files[i]);
+    if(!reader)
+    {
+      fprintf(log, "Failed to read profile %s: %s\n", files[i], llvm::toString(reader.takeError()).c_str());
+      return ERR_FATAL_FILE_ERROR;
+    }
+
+    if(auto e = writer.setIsIRLevelProfile((*reader)->isIRLevelProfile(), (*reader)->hasCSIRLevelProfile()))
+    {
+      fprintf(log, "Profile %s is incompatible with the other profiles: %s\n", files[i],
+              llvm::toString(std::move(e)).c_str());
+      return ERR_FATAL_INVALID_ENCODING;
+    }
+
+    // Functions whose counters don't match, usually because the program changed, are skipped instead of failing
+    for(auto& record : **reader)
+      writer.addRecord(std::move(record), [&](llvm::Error e) {
+        fprintf(log, "WARNING: Failed to merge a function from %s: %s\n", files[i], llvm::toString(std::move(e)).c_str());
+      });
+
+    if((*reader)->hasError())
+    {
+      fprintf(log, "Failed to read profile %s: %s\n", files[i], llvm::toString((*reader)->getError()).c_str());
+      return ERR_FATAL_INVALID_ENCODING;
+    }
+  }
+
+  std::error_code EC;
+  llvm::raw_fd_ostream dest(out, EC, llvm::sys::fs::F_None);
+  if(EC)
+  {
+    fprintf(log, "Could not open file: %s\n", EC.message().c_str());
+    return ERR_FATAL_FILE_ERROR;
+  }
+
+  writer.write(dest);
+  return ERR_SUCCESS;
+}
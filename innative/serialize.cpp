@@ -2,6 +2,8 @@
 // For conditions of distribution and use, see copyright notice in innative.h
 
 #include "serialize.h"
+#include "simd_instructions.h"
+#include "instruction_stream.h"
 #include <stdarg.h>
 #include <ostream>
 
@@ -21,6 +23,7 @@ WatTokens Serializer::TypeEncodingToken(varsint7 type_encoding)
   case TE_i64: return WatTokens::i64;
   case TE_f32: return WatTokens::f32;
   case TE_f64: return WatTokens::f64;
+  case TE_v128: return WatTokens::v128;
   case TE_funcref: return WatTokens::FUNCREF;
   case TE_func: return WatTokens::FUNC;
   case TE_void: return WatTokens::NONE;
@@ -187,8 +190,10 @@ void Serializer::TokenizeInstruction(Instruction& ins, const FunctionBody* body,
 
     PushBlockToken(ins.immediates[1]._varuint32);
     break;
-  case OP_call: PushFunctionName(ins.immediates[0]._varuint32); break;
+  case OP_call:
+  case OP_return_call: PushFunctionName(ins.immediates[0]._varuint32); break;
   case OP_call_indirect:
+  case OP_return_call_indirect:
     if(ins.immediates[0]._varuint32 < m.type.n_functypes)
     {
       tokens.Push(WatToken{ WatTokens::OPEN, 0 });
@@ -211,6 +216,27 @@ void Serializer::TokenizeInstruction(Instruction& ins, const FunctionBody* body,
     if(blocktokens.Size())
       blocktokens.Pop();
     break;
+  case OP_simd_prefix: TokenizeSIMDImmediates(ins); break;
+  case OP_misc_prefix:
+    switch(ins.opcode[1])
+    {
+    case OP_table_init:
+      if(ins.immediates[1]._varuint32 != 0)
+        tokens.Push(WatToken{ WatTokens::INTEGER, 0, 0, 0, (int64_t)ins.immediates[1]._varuint32 });
+      tokens.Push(WatToken{ WatTokens::INTEGER, 0, 0, 0, (int64_t)ins.immediates[0]._varuint32 });
+      break;
+    case OP_memory_init:
+    case OP_data_drop:
+    case OP_elem_drop: tokens.Push(WatToken{ WatTokens::INTEGER, 0, 0, 0, (int64_t)ins.immediates[0]._varuint32 }); break;
+    case OP_table_copy:
+      if(ins.immediates[0]._varuint32 != 0 || ins.immediates[1]._varuint32 != 0)
+      {
+        tokens.Push(WatToken{ WatTokens::INTEGER, 0, 0, 0, (int64_t)ins.immediates[0]._varuint32 });
+        tokens.Push(WatToken{ WatTokens::INTEGER, 0, 0, 0, (int64_t)ins.immediates[1]._varuint32 });
+      }
+      break;
+    }
+    break;
   case OP_i32_load:
   case OP_i64_load:
   case OP_f32_load:
@@ -290,6 +316,57 @@ void Serializer::TokenizeInstruction(Instruction& ins, const FunctionBody* body,
   }
 }
 
+void Serializer::TokenizeSIMDImmediates(const Instruction& ins)
+{
+  namespace sd = innative::simd_details;
+
+  auto info = sd::GetOpInfo(ins.opcode[1]);
+  switch(info.kind)
+  {
+  case sd::OpKind::Const: // Always written as i32x4, which round-trips every bit pattern exactly
+    tokens.Push(WatToken{ WatTokens::i32x4 });
+    for(int i = 0; i < 4; ++i)
+      tokens.Push(
+        WatToken{ WatTokens::INTEGER, 0, 0, 0, (int32_t)(ins.immediates[i / 2]._varuint64 >> ((i % 2) * 32)) });
+    break;
+  case sd::OpKind::Shuffle:
+    for(int i = 0; i < 16; ++i)
+      tokens.Push(
+        WatToken{ WatTokens::INTEGER, 0, 0, 0, (int64_t)((ins.immediates[i / 8]._varuint64 >> ((i % 8) * 8)) & 0xFF) });
+    break;
+  case sd::OpKind::ExtractLane:
+  case sd::OpKind::ReplaceLane:
+    tokens.Push(WatToken{ WatTokens::INTEGER, 0, 0, 0, (int64_t)ins.immediates[0]._varuint32 });
+    break;
+  default:
+    if(!sd::IsMemoryOp(info.kind))
+      break;
+
+    // Lane memory ops store their lane in place of the memidx
+    if(!sd::HasLaneImmediate(info.kind) && ins.immediates[2]._varuint32 != 0)
+    {
+      tokens.Push(WatToken{ WatTokens::MEMIDX });
+      tokens.Push(WatToken{ WatTokens::INTEGER, 0, 0, 0, (int64_t)ins.immediates[2]._varuint32 });
+    }
+
+    if(ins.immediates[1]._varuint32 != 0)
+    {
+      tokens.Push(WatToken{ WatTokens::OFFSET });
+      tokens.Push(WatToken{ WatTokens::INTEGER, 0, 0, 0, (int64_t)ins.immediates[1]._varuint32 });
+    }
+
+    if(ins.immediates[0]._varuint32 != info.access)
+    {
+      tokens.Push(WatToken{ WatTokens::ALIGN });
+      tokens.Push(WatToken{ WatTokens::INTEGER, 0, 0, 0, (1LL << (int64_t)ins.immediates[0]._varuint32) });
+    }
+
+    if(sd::HasLaneImmediate(info.kind))
+      tokens.Push(WatToken{ WatTokens::INTEGER, 0, 0, 0, (int64_t)ins.immediates[2]._varuint32 });
+    break;
+  }
+}
+
 void Serializer::PushExportToken(varuint7 kind, varuint32 index, bool outside)
 {
   if(m.knownsections & (1 << WASM_SECTION_EXPORT))
@@ -547,9 +624,9 @@ void Serializer::TokenizeModule(bool emitdebug)
     }
 
     size_t block = 0;
-    for(varuint32 j = 0; j < m.code.funcbody[i].n_body; ++j)
+    for(Instruction& ins : Instructions(m.code.funcbody[i]))
     {
-      TokenizeInstruction(m.code.funcbody[i].body[j], &m.code.funcbody[i], &decl, block, emitdebug);
+      TokenizeInstruction(ins, &m.code.funcbody[i], &decl, block, emitdebug);
     }
     tokens.Push(WatToken{ WatTokens::CLOSE });
   }
@@ -614,13 +691,24 @@ void Serializer::TokenizeModule(bool emitdebug)
     {
       tokens.Push(WatToken{ WatTokens::OPEN });
       tokens.Push(WatToken{ WatTokens::ELEM });
-      tokens.Push(WatToken{ WatTokens::INTEGER, 0, 0, 0, m.element.elements[i].index });
 
-      tokens.Push(WatToken{ WatTokens::OPEN });
-      tokens.Push(WatToken{ WatTokens::OFFSET });
-      size_t block = 0;
-      TokenizeInstruction(m.element.elements[i].offset, 0, 0, block, emitdebug);
-      tokens.Push(WatToken{ WatTokens::CLOSE });
+      // Passive and declarative segments have no table or offset, and must specify their element kind instead
+      if(m.element.elements[i].flags == WASM_SEGMENT_PASSIVE || m.element.elements[i].flags == WASM_SEGMENT_DECLARATIVE)
+      {
+        if(m.element.elements[i].flags == WASM_SEGMENT_DECLARATIVE)
+          tokens.Push(WatToken{ WatTokens::DECLARE });
+        tokens.Push(WatToken{ WatTokens::FUNC });
+      }
+      else
+      {
+        tokens.Push(WatToken{ WatTokens::INTEGER, 0, 0, 0, m.element.elements[i].index });
+
+        tokens.Push(WatToken{ WatTokens::OPEN });
+        tokens.Push(WatToken{ WatTokens::OFFSET });
+        size_t block = 0;
+        TokenizeInstruction(m.element.elements[i].offset, 0, 0, block, emitdebug);
+        tokens.Push(WatToken{ WatTokens::CLOSE });
+      }
 
       for(varuint32 j = 0; j < m.element.elements[i].n_elements; ++j)
         tokens.Push(WatToken{ WatTokens::INTEGER, 0, 0, 0, m.element.elements[i].elements[j] });
@@ -633,13 +721,17 @@ void Serializer::TokenizeModule(bool emitdebug)
     {
       tokens.Push(WatToken{ WatTokens::OPEN });
       tokens.Push(WatToken{ WatTokens::DATA });
-      tokens.Push(WatToken{ WatTokens::INTEGER, 0, 0, 0, m.data.data[i].index });
 
-      tokens.Push(WatToken{ WatTokens::OPEN });
-      tokens.Push(WatToken{ WatTokens::OFFSET });
-      size_t block = 0;
-      TokenizeInstruction(m.data.data[i].offset, 0, 0, block, emitdebug);
-      tokens.Push(WatToken{ WatTokens::CLOSE });
+      if(m.data.data[i].flags != WASM_SEGMENT_PASSIVE) // Passive segments have no memory or offset
+      {
+        tokens.Push(WatToken{ WatTokens::INTEGER, 0, 0, 0, m.data.data[i].index });
+
+        tokens.Push(WatToken{ WatTokens::OPEN });
+        tokens.Push(WatToken{ WatTokens::OFFSET });
+        size_t block = 0;
+        TokenizeInstruction(m.data.data[i].offset, 0, 0, block, emitdebug);
+        tokens.Push(WatToken{ WatTokens::CLOSE });
+      }
 
       tokens.Push(WatToken{ WatTokens::STRING, m.data.data[i].data.str(), 0, 0, m.data.data[i].data.size() });
       tokens.Push(WatToken{ WatTokens::CLOSE });
@@ -19,6 +19,7 @@ namespace innative {
     void PushIdentifierToken(const ByteArray& id, WatTokens token = WatTokens::STRING);
     void TokenizeInstruction(Instruction& ins, const FunctionBody* body, const FunctionDesc* desc, size_t& block,
                              bool emitdebug);
+    void TokenizeSIMDImmediates(const Instruction& ins);
     void PushExportToken(varuint7 kind, varuint32 index, bool outside);
     void TokenizeModule(bool emitdebug);
     void WriteTokens(std::ostream& out);
@@ -0,0 +1,728 @@
+// Copyright (c)2020 Black Sphere Studios
+// For conditions of distribution and use, see copyright notice in innative.h
+
+#include "llvm.h"
+#include "compile.h"
+#include "utility.h"
+#include "validate.h"
+#include "simd_instructions.h"
+
+using namespace innative;
+using namespace utility;
+using namespace innative::simd_details;
+
+using Func    = llvm::Function;
+using FuncTy  = llvm::FunctionType;
+using llvmTy  = llvm::Type;
+using llvmVal = llvm::Value;
+using llvm::ConstantFP;
+
+// Integer shapes are selected by their lane count, so TE_i32 with 16 lanes is i8x16 and TE_i32 with 8 lanes is i16x8
+llvm::VectorType* Compiler::GetSIMDShape(WASM_TYPE_ENCODING scalar, unsigned lanes)
+{
+  llvmTy* lane = (scalar == TE_i32) ? builder.getIntNTy(128 / lanes) : GetLLVMType(scalar);
+  return llvm::VectorType::get(lane, lanes);
+}
+
+// Gets the lane interpretation of the v128 operands of a unary or binary op, which is not always the result shape
+llvm::VectorType* Compiler::GetSIMDOperandShape(uint8_t op)
+{
+  auto i8x16 = GetSIMDShape(TE_i32, 16);
+  auto i16x8 = GetSIMDShape(TE_i32, 8);
+  auto i32x4 = GetSIMDShape(TE_i32, 4);
+  auto i64x2 = GetSIMDShape(TE_i64, 2);
+  auto f32x4 = GetSIMDShape(TE_f32, 4);
+  auto f64x2 = GetSIMDShape(TE_f64, 2);
+
+  switch(op)
+  {
+  case OP_f32x4_demote_f64x2_zero:
+  case OP_f64x2_ceil:
+  case OP_f64x2_floor:
+  case OP_f64x2_trunc:
+  case OP_f64x2_nearest:
+  case OP_i32x4_trunc_sat_f64x2_s_zero:
+  case OP_i32x4_trunc_sat_f64x2_u_zero: return f64x2;
+  case OP_f64x2_promote_low_f32x4:
+  case OP_f32x4_ceil:
+  case OP_f32x4_floor:
+  case OP_f32x4_trunc:
+  case OP_f32x4_nearest:
+  case OP_i32x4_trunc_sat_f32x4_s:
+  case OP_i32x4_trunc_sat_f32x4_u: return f32x4;
+  case OP_i16x8_extadd_pairwise_i8x16_s:
+  case OP_i16x8_extadd_pairwise_i8x16_u:
+  case OP_i16x8_extend_low_i8x16_s:
+  case OP_i16x8_extend_high_i8x16_s:
+  case OP_i16x8_extend_low_i8x16_u:
+  case OP_i16x8_extend_high_i8x16_u:
+  case OP_i16x8_extmul_low_i8x16_s:
+  case OP_i16x8_extmul_high_i8x16_s:
+  case OP_i16x8_extmul_low_i8x16_u:
+  case OP_i16x8_extmul_high_i8x16_u: return i8x16;
+  case OP_i8x16_narrow_i16x8_s:
+  case OP_i8x16_narrow_i16x8_u:
+  case OP_i32x4_extadd_pairwise_i16x8_s:
+  case OP_i32x4_extadd_pairwise_i16x8_u:
+  case OP_i32x4_extend_low_i16x8_s:
+  case OP_i32x4_extend_high_i16x8_s:
+  case OP_i32x4_extend_low_i16x8_u:
+  case OP_i32x4_extend_high_i16x8_u:
+  case OP_i32x4_dot_i16x8_s:
+  case OP_i32x4_extmul_low_i16x8_s:
+  case OP_i32x4_extmul_high_i16x8_s:
+  case OP_i32x4_extmul_low_i16x8_u:
+  case OP_i32x4_extmul_high_i16x8_u: return i16x8;
+  case OP_i16x8_narrow_i32x4_s:
+  case OP_i16x8_narrow_i32x4_u:
+  case OP_i64x2_extend_low_i32x4_s:
+  case OP_i64x2_extend_high_i32x4_s:
+  case OP_i64x2_extend_low_i32x4_u:
+  case OP_i64x2_extend_high_i32x4_u:
+  case OP_i64x2_extmul_low_i32x4_s:
+  case OP_i64x2_extmul_high_i32x4_s:
+  case OP_i64x2_extmul_low_i32x4_u:
+  case OP_i64x2_extmul_high_i32x4_u: return i32x4;
+  }
+
+  // Otherwise, the opcodes are grouped by shape
+  if(op >= OP_i8x16_eq && op <= OP_i8x16_ge_u)
+    return i8x16;
+  if(op >= OP_i16x8_eq && op <= OP_i16x8_ge_u)
+    return i16x8;
+  if(op >= OP_i32x4_eq && op <= OP_i32x4_ge_u)
+    return i32x4;
+  if(op >= OP_f32x4_eq && op <= OP_f32x4_ge)
+    return f32x4;
+  if(op >= OP_f64x2_eq && op <= OP_f64x2_ge)
+    return f64x2;
+  if(op == OP_i8x16_swizzle || (op >= OP_i8x16_abs && op <= OP_i8x16_avgr_u))
+    return i8x16;
+  if(op >= OP_i16x8_abs && op <= OP_i16x8_extmul_high_i8x16_u)
+    return i16x8;
+  if(op >= OP_i32x4_abs && op <= OP_i32x4_extmul_high_i16x8_u)
+    return i32x4;
+  if(op >= OP_i64x2_abs && op <= OP_i64x2_extmul_high_i32x4_u)
+    return i64x2;
+  if(op >= OP_f32x4_abs && op <= OP_f32x4_pmax)
+    return f32x4;
+  if(op >= OP_f64x2_abs && op <= OP_f64x2_pmax)
+    return f64x2;
+  if(op == OP_f32x4_convert_i32x4_s || op == OP_f32x4_convert_i32x4_u || op == OP_f64x2_convert_low_i32x4_s ||
+     op == OP_f64x2_convert_low_i32x4_u)
+    return i32x4;
+
+  return llvm::cast<llvm::VectorType>(GetLLVMType(TE_v128)); // Bitwise ops don't care about lanes
+}
+
+IN_ERROR Compiler::PopSIMD(llvmTy* shape, llvmVal*& v)
+{
+  IN_ERROR err = PopType(TE_v128, v);
+  if(!err)
+    v = builder.CreateBitCast(v, shape);
+  return err;
+}
+
+// All v128 values are pushed in their canonical type, so that block results and locals always agree on it
+IN_ERROR Compiler::PushSIMD(llvmVal* v) { return PushReturn(builder.CreateBitCast(v, GetLLVMType(TE_v128))); }
+
+// Builds a shuffle that takes count lanes from the concatenation of a and b, starting at first
+llvmVal* Compiler::CompileShuffleRange(llvmVal* a, llvmVal* b, unsigned first, unsigned count, unsigned stride)
+{
+  std::vector<uint32_t> mask(count);
+  for(unsigned i = 0; i < count; ++i)
+    mask[i] = first + (i * stride);
+
+  return builder.CreateShuffleVector(a, !b ? llvm::UndefValue::get(a->getType()) : b, mask);
+}
+
+// LLVM 10 has no saturating float to int conversion, so NaN becomes 0 and out of range values are clamped manually.
+// Values that fptosi can't represent produce poison, but the selects below never choose them.
+llvmVal* Compiler::CompileTruncSat(llvmVal* v, llvmTy* ty, bool sign, const llvm::Twine& name)
+{
+  unsigned bits = ty->getScalarSizeInBits();
+  llvmTy* fty   = v->getType();
+
+  if(sign)
+  {
+    auto max    = ConstantFP::get(fty, std::ldexp(1.0, bits - 1));
+    auto min    = ConstantFP::get(fty, -std::ldexp(1.0, bits - 1));
+    llvmVal* r  = builder.CreateFPToSI(v, ty);
+    r           = builder.CreateSelect(builder.CreateFCmpOGE(v, max), CInt::get(ty, llvm::APInt::getSignedMaxValue(bits)), r);
+    r           = builder.CreateSelect(builder.CreateFCmpOLT(v, min), CInt::get(ty, llvm::APInt::getSignedMinValue(bits)), r);
+    return builder.CreateSelect(builder.CreateFCmpUNO(v, v), llvm::Constant::getNullValue(ty), r, name);
+  }
+
+  auto max   = ConstantFP::get(fty, std::ldexp(1.0, bits));
+  llvmVal* r = builder.CreateFPToUI(v, ty);
+  r          = builder.CreateSelect(builder.CreateFCmpOGE(v, max), CInt::get(ty, llvm::APInt::getMaxValue(bits)), r);
+
+  // Anything that isn't greater than -1, including NaN, truncates to 0 or is out of range on the low end
+  return builder.CreateSelect(builder.CreateFCmpULE(v, ConstantFP::get(fty, -1.0)), llvm::Constant::getNullValue(ty), r,
+                              name);
+}
+
+IN_ERROR Compiler::CompileSIMDMemory(Instruction& ins, const char* name)
+{
+  auto op   = ins.opcode[1];
+  auto info = GetOpInfo(op);
+
+  // Lane memory ops store their lane in place of the memidx, see ParseSIMDInstruction
+  varuint32 memflags = ins.immediates[0]._varuint32;
+  varuint32 offset   = ins.immediates[1]._varuint32;
+  varuint32 memory   = HasLaneImmediate(info.kind) ? 0 : ins.immediates[2]._varuint32;
+  unsigned align     = 1u << memflags;
+  if(memory >= memories.size())
+    return ERR_INVALID_MEMORY_INDEX;
+
+  IN_ERROR err;
+  llvmVal *base, *value = nullptr;
+  llvmTy* access = builder.getIntNTy(8 << info.access);
+  if(info.kind != OpKind::Load) // v128.store doesn't care about lanes, so it gets the canonical shape
+  {
+    llvmTy* shape = (info.kind == OpKind::Store) ? GetLLVMType(TE_v128) : GetSIMDShape(TE_i32, info.lanes);
+    if(err = PopSIMD(shape, value))
+      return err;
+  }
+
+  if(err = PopType(TE_i32, base))
+    return err;
+
+  switch(op)
+  {
+  case OP_v128_load:
+  {
+    llvmTy* ty = GetLLVMType(TE_v128);
+    return PushReturn(TagAccess(
+      builder.CreateAlignedLoad(GetMemPointer(base, ty->getPointerTo(0), memory, offset), align, false, name),
+      tbaa.memory));
+  }
+  case OP_v128_store:
+  {
+    llvmVal* ptr = GetMemPointer(base, value->getType()->getPointerTo(0), memory, offset);
+    TagAccess(builder.CreateAlignedStore(value, ptr, align, false), tbaa.memory);
+    return ERR_SUCCESS;
+  }
+  case OP_v128_load8x8_s:
+  case OP_v128_load8x8_u:
+  case OP_v128_load16x4_s:
+  case OP_v128_load16x4_u:
+  case OP_v128_load32x2_s:
+  case OP_v128_load32x2_u:
+  {
+    // Each pair of opcodes loads 8 bytes as 8, 4 or 2 lanes and extends them to twice their width
+    unsigned lanes    = 8 >> ((op - OP_v128_load8x8_s) / 2);
+    bool sign         = !((op - OP_v128_load8x8_s) % 2);
+    auto narrow       = GetSIMDShape(TE_i32, lanes * 2);
+    llvmTy* ty        = llvm::VectorType::get(narrow->getElementType(), lanes);
+    llvmVal* ptr      = GetMemPointer(base, ty->getPointerTo(0), memory, offset);
+    llvmVal* result   = TagAccess(builder.CreateAlignedLoad(ptr, align, false), tbaa.memory);
+    llvmTy* extended  = GetSIMDShape(lanes == 2 ? TE_i64 : TE_i32, lanes);
+    return PushSIMD(sign ? builder.CreateSExt(result, extended, name) : builder.CreateZExt(result, extended, name));
+  }
+  case OP_v128_load8_splat:
+  case OP_v128_load16_splat:
+  case OP_v128_load32_splat:
+  case OP_v128_load64_splat:
+  {
+    llvmVal* ptr    = GetMemPointer(base, access->getPointerTo(0), memory, offset);
+    llvmVal* result = TagAccess(builder.CreateAlignedLoad(ptr, align, false), tbaa.memory);
+    return PushSIMD(builder.CreateVectorSplat(16 >> info.access, result, name));
+  }
+  case OP_v128_load32_zero:
+  case OP_v128_load64_zero:
+  {
+    llvmVal* ptr    = GetMemPointer(base, access->getPointerTo(0), memory, offset);
+    llvmVal* result = TagAccess(builder.CreateAlignedLoad(ptr, align, false), tbaa.memory);
+    llvmTy* ty      = llvm::VectorType::get(access, 16 >> info.access);
+    return PushSIMD(builder.CreateInsertElement(llvm::Constant::getNullValue(ty), result, builder.getInt32(0), name));
+  }
+  }
+
+  // Lane loads and stores only touch a single lane of the vector
+  llvmVal* lane = builder.getInt32(ins.immediates[2]._varuint32);
+  llvmVal* ptr  = GetMemPointer(base, access->getPointerTo(0), memory, offset);
+  if(info.kind == OpKind::LoadLane)
+    return PushSIMD(
+      builder.CreateInsertElement(value, TagAccess(builder.CreateAlignedLoad(ptr, align, false), tbaa.memory), lane, name));
+
+  TagAccess(builder.CreateAlignedStore(builder.CreateExtractElement(value, lane), ptr, align, false), tbaa.memory);
+  return ERR_SUCCESS;
+}
+
+// Handles splat, extract_lane and replace_lane
+IN_ERROR Compiler::CompileSIMDLane(Instruction& ins, const char* name)
+{
+  auto op    = ins.opcode[1];
+  auto info  = GetOpInfo(op);
+  auto shape = GetSIMDShape(info.scalar, info.lanes);
+  auto lane  = builder.getInt32(ins.immediates[0]._varuint32);
+
+  IN_ERROR err;
+  llvmVal *scalar, *vector;
+  switch(info.kind)
+  {
+  case OpKind::Splat:
+    if(err = PopType(info.scalar, scalar))
+      return err;
+    return PushSIMD(builder.CreateVectorSplat(
+      info.lanes, builder.CreateTruncOrBitCast(scalar, shape->getElementType()), name));
+  case OpKind::ExtractLane:
+    if(err = PopSIMD(shape, vector))
+      return err;
+    scalar = builder.CreateExtractElement(vector, lane);
+    switch(op)
+    {
+    case OP_i8x16_extract_lane_s:
+    case OP_i16x8_extract_lane_s: return PushReturn(builder.CreateSExt(scalar, builder.getInt32Ty(), name));
+    case OP_i8x16_extract_lane_u:
+    case OP_i16x8_extract_lane_u: return PushReturn(builder.CreateZExt(scalar, builder.getInt32Ty(), name));
+    }
+    return PushReturn(scalar);
+  case OpKind::ReplaceLane:
+    if(err = PopType(info.scalar, scalar))
+      return err;
+    if(err = PopSIMD(shape, vector))
+      return err;
+    return PushSIMD(builder.CreateInsertElement(
+      vector, builder.CreateTruncOrBitCast(scalar, shape->getElementType()), lane, name));
+  }
+
+  return ERR_FATAL_UNKNOWN_INSTRUCTION;
+}
+
+// Handles any_true, all_true and bitmask, which reduce a vector to an i32
+IN_ERROR Compiler::CompileSIMDTest(Instruction& ins, const char* name)
+{
+  IN_ERROR err;
+  llvmVal* v;
+  auto op = ins.opcode[1];
+
+  if(op == OP_v128_any_true)
+  {
+    if(err = PopSIMD(builder.getIntNTy(128), v))
+      return err;
+    return PushReturn(builder.CreateZExt(builder.CreateICmpNE(v, builder.getIntN(128, 0)), builder.getInt32Ty(), name));
+  }
+
+  unsigned lanes;
+  switch(op)
+  {
+  case OP_i8x16_all_true:
+  case OP_i8x16_bitmask: lanes = 16; break;
+  case OP_i16x8_all_true:
+  case OP_i16x8_bitmask: lanes = 8; break;
+  case OP_i32x4_all_true:
+  case OP_i32x4_bitmask: lanes = 4; break;
+  default: lanes = 2; break;
+  }
+
+  auto shape = GetSIMDShape(lanes == 2 ? TE_i64 : TE_i32, lanes);
+  if(err = PopSIMD(shape, v))
+    return err;
+
+  auto zero = llvm::Constant::getNullValue(shape);
+  switch(op)
+  {
+  case OP_i8x16_all_true:
+  case OP_i16x8_all_true:
+  case OP_i32x4_all_true:
+  case OP_i64x2_all_true:
+  {
+    // Packs the per-lane results into an integer mask, which is all ones only if every lane was nonzero
+    auto mask = builder.CreateBitCast(builder.CreateICmpNE(v, zero), builder.getIntNTy(lanes));
+    auto cond = builder.CreateICmpEQ(mask, llvm::Constant::getAllOnesValue(mask->getType()));
+    return PushReturn(builder.CreateZExt(cond, builder.getInt32Ty(), name));
+  }
+  }
+
+  // bitmask collects the sign bit of every lane
+  auto mask = builder.CreateBitCast(builder.CreateICmpSLT(v, zero), builder.getIntNTy(lanes));
+  return PushReturn(builder.CreateZExt(mask, builder.getInt32Ty(), name));
+}
+
+IN_ERROR Compiler::CompileSIMDShift(Instruction& ins, const char* name)
+{
+  auto op = ins.opcode[1];
+  uint8_t first; // Every integer shape has shl, shr_s and shr_u in that order
+  unsigned lanes;
+  switch(op)
+  {
+  case OP_i8x16_shl:
+  case OP_i8x16_shr_s:
+  case OP_i8x16_shr_u:
+    first = OP_i8x16_shl;
+    lanes = 16;
+    break;
+  case OP_i16x8_shl:
+  case OP_i16x8_shr_s:
+  case OP_i16x8_shr_u:
+    first = OP_i16x8_shl;
+    lanes = 8;
+    break;
+  case OP_i32x4_shl:
+  case OP_i32x4_shr_s:
+  case OP_i32x4_shr_u:
+    first = OP_i32x4_shl;
+    lanes = 4;
+    break;
+  default:
+    first = OP_i64x2_shl;
+    lanes = 2;
+    break;
+  }
+
+  IN_ERROR err;
+  llvmVal *v, *count;
+  auto shape = GetSIMDShape(lanes == 2 ? TE_i64 : TE_i32, lanes);
+  if(err = PopType(TE_i32, count))
+    return err;
+  if(err = PopSIMD(shape, v))
+    return err;
+
+  // WebAssembly takes the shift count modulo the lane width
+  auto bits = shape->getScalarSizeInBits();
+  count     = builder.CreateAnd(count, builder.getInt32(bits - 1));
+  count     = builder.CreateVectorSplat(lanes, builder.CreateZExtOrTrunc(count, shape->getElementType()));
+
+  switch(op - first)
+  {
+  case 0: return PushSIMD(builder.CreateShl(v, count, name));
+  case 1: return PushSIMD(builder.CreateAShr(v, count, name));
+  }
+  return PushSIMD(builder.CreateLShr(v, count, name));
+}
+
+IN_ERROR Compiler::CompileSIMDUnary(Instruction& ins, const char* name)
+{
+  auto op    = ins.opcode[1];
+  auto shape = GetSIMDOperandShape(op);
+  unsigned n = shape->getNumElements();
+
+  IN_ERROR err;
+  llvmVal* v;
+  if(err = PopSIMD(shape, v))
+    return err;
+
+  auto intrinsic = [&](llvm::Intrinsic::ID id) {
+    Func* fn = llvm::Intrinsic::getDeclaration(mod, id, { v->getType() });
+    return PushSIMD(builder.CreateCall(fn, { v }, name));
+  };
+  auto wide   = llvm::VectorType::get(builder.getIntNTy(shape->getScalarSizeInBits() * 2), n / 2);
+  auto extend = [&](llvmVal* half, bool sign) {
+    return sign ? builder.CreateSExt(half, wide) : builder.CreateZExt(half, wide);
+  };
+
+  switch(op)
+  {
+  case OP_v128_not: return PushSIMD(builder.CreateNot(v, name));
+  case OP_i8x16_abs:
+  case OP_i16x8_abs:
+  case OP_i32x4_abs:
+  case OP_i64x2_abs: // LLVM 10 has no abs intrinsic
+    return PushSIMD(builder.CreateSelect(builder.CreateICmpSLT(v, llvm::Constant::getNullValue(shape)),
+                                         builder.CreateNeg(v), v, name));
+  case OP_i8x16_neg:
+  case OP_i16x8_neg:
+  case OP_i32x4_neg:
+  case OP_i64x2_neg: return PushSIMD(builder.CreateNeg(v, name));
+  case OP_i8x16_popcnt: return intrinsic(llvm::Intrinsic::ctpop);
+  case OP_f32x4_abs:
+  case OP_f64x2_abs: return intrinsic(llvm::Intrinsic::fabs);
+  case OP_f32x4_neg:
+  case OP_f64x2_neg: return PushSIMD(builder.CreateFNeg(v, name));
+  case OP_f32x4_sqrt:
+  case OP_f64x2_sqrt: return intrinsic(llvm::Intrinsic::sqrt);
+  case OP_f32x4_ceil:
+  case OP_f64x2_ceil: return intrinsic(llvm::Intrinsic::ceil);
+  case OP_f32x4_floor:
+  case OP_f64x2_floor: return intrinsic(llvm::Intrinsic::floor);
+  case OP_f32x4_trunc:
+  case OP_f64x2_trunc: return intrinsic(llvm::Intrinsic::trunc);
+  case OP_f32x4_nearest:
+  case OP_f64x2_nearest: return intrinsic(llvm::Intrinsic::nearbyint);
+  case OP_i16x8_extadd_pairwise_i8x16_s:
+  case OP_i32x4_extadd_pairwise_i16x8_s:
+    return PushSIMD(builder.CreateAdd(extend(CompileShuffleRange(v, nullptr, 0, n / 2, 2), true),
+                                      extend(CompileShuffleRange(v, nullptr, 1, n / 2, 2), true), name));
+  case OP_i16x8_extadd_pairwise_i8x16_u:
+  case OP_i32x4_extadd_pairwise_i16x8_u:
+    return PushSIMD(builder.CreateAdd(extend(CompileShuffleRange(v, nullptr, 0, n / 2, 2), false),
+                                      extend(CompileShuffleRange(v, nullptr, 1, n / 2, 2), false), name));
+  case OP_i16x8_extend_low_i8x16_s:
+  case OP_i32x4_extend_low_i16x8_s:
+  case OP_i64x2_extend_low_i32x4_s: return PushSIMD(extend(CompileShuffleRange(v, nullptr, 0, n / 2), true));
+  case OP_i16x8_extend_high_i8x16_s:
+  case OP_i32x4_extend_high_i16x8_s:
+  case OP_i64x2_extend_high_i32x4_s: return PushSIMD(extend(CompileShuffleRange(v, nullptr, n / 2, n / 2), true));
+  case OP_i16x8_extend_low_i8x16_u:
+  case OP_i32x4_extend_low_i16x8_u:
+  case OP_i64x2_extend_low_i32x4_u: return PushSIMD(extend(CompileShuffleRange(v, nullptr, 0, n / 2), false));
+  case OP_i16x8_extend_high_i8x16_u:
+  case OP_i32x4_extend_high_i16x8_u:
+  case OP_i64x2_extend_high_i32x4_u: return PushSIMD(extend(CompileShuffleRange(v, nullptr, n / 2, n / 2), false));
+  case OP_i32x4_trunc_sat_f32x4_s:
+  case OP_i32x4_trunc_sat_f32x4_u:
+    return PushSIMD(CompileTruncSat(v, GetSIMDShape(TE_i32, 4), op == OP_i32x4_trunc_sat_f32x4_s, name));
+  case OP_i32x4_trunc_sat_f64x2_s_zero:
+  case OP_i32x4_trunc_sat_f64x2_u_zero:
+  {
+    auto i32x2 = llvm::VectorType::get(builder.getInt32Ty(), 2);
+    v          = CompileTruncSat(v, i32x2, op == OP_i32x4_trunc_sat_f64x2_s_zero, "");
+    return PushSIMD(CompileShuffleRange(v, llvm::Constant::getNullValue(i32x2), 0, 4));
+  }
+  case OP_f32x4_convert_i32x4_s: return PushSIMD(builder.CreateSIToFP(v, GetSIMDShape(TE_f32, 4), name));
+  case OP_f32x4_convert_i32x4_u: return PushSIMD(builder.CreateUIToFP(v, GetSIMDShape(TE_f32, 4), name));
+  case OP_f64x2_convert_low_i32x4_s:
+    return PushSIMD(builder.CreateSIToFP(CompileShuffleRange(v, nullptr, 0, 2), GetSIMDShape(TE_f64, 2), name));
+  case OP_f64x2_convert_low_i32x4_u:
+    return PushSIMD(builder.CreateUIToFP(CompileShuffleRange(v, nullptr, 0, 2), GetSIMDShape(TE_f64, 2), name));
+  case OP_f32x4_demote_f64x2_zero:
+  {
+    auto f32x2 = llvm::VectorType::get(builder.getFloatTy(), 2);
+    v          = builder.CreateFPTrunc(v, f32x2);
+    return PushSIMD(CompileShuffleRange(v, llvm::Constant::getNullValue(f32x2), 0, 4));
+  }
+  case OP_f64x2_promote_low_f32x4:
+    return PushSIMD(builder.CreateFPExt(CompileShuffleRange(v, nullptr, 0, 2), GetSIMDShape(TE_f64, 2), name));
+  }
+
+  return ERR_FATAL_UNKNOWN_INSTRUCTION;
+}
+
+IN_ERROR Compiler::CompileSIMDBinary(Instruction& ins, const char* name)
+{
+  using Pred = llvm::CmpInst::Predicate;
+
+  auto op    = ins.opcode[1];
+  auto shape = GetSIMDOperandShape(op);
+  unsigned n = shape->getNumElements();
+
+  // Pop in reverse order
+  IN_ERROR err;
+  llvmVal *a, *b;
+  if(err = PopSIMD(shape, b))
+    return err;
+  if(err = PopSIMD(shape, a))
+    return err;
+
+  // Integer comparisons come in groups of eq, ne, lt_s, lt_u, gt_s, gt_u, le_s, le_u, ge_s, ge_u
+  static const Pred icmp[] = { Pred::ICMP_EQ,  Pred::ICMP_NE,  Pred::ICMP_SLT, Pred::ICMP_ULT, Pred::ICMP_SGT,
+                               Pred::ICMP_UGT, Pred::ICMP_SLE, Pred::ICMP_ULE, Pred::ICMP_SGE, Pred::ICMP_UGE };
+  // Float and i64x2 comparisons only have eq, ne, lt, gt, le, ge
+  static const Pred fcmp[] = { Pred::FCMP_OEQ, Pred::FCMP_UNE, Pred::FCMP_OLT,
+                               Pred::FCMP_OGT, Pred::FCMP_OLE, Pred::FCMP_OGE };
+  static const Pred i64cmp[] = { Pred::ICMP_EQ, Pred::ICMP_NE, Pred::ICMP_SLT, Pred::ICMP_SGT, Pred::ICMP_SLE, Pred::ICMP_SGE };
+
+  auto compare = [&](Pred pred) {
+    auto cmp = llvm::CmpInst::isFPPredicate(pred) ? builder.CreateFCmp(pred, a, b) : builder.CreateICmp(pred, a, b);
+    return PushSIMD(builder.CreateSExt(cmp, llvm::VectorType::getInteger(shape), name));
+  };
+  auto select = [&](Pred pred) { return PushSIMD(builder.CreateSelect(builder.CreateICmp(pred, a, b), a, b, name)); };
+  auto intrinsic = [&](llvm::Intrinsic::ID id) { return PushSIMD(builder.CreateBinaryIntrinsic(id, a, b, nullptr, name)); };
+  auto wide      = llvm::VectorType::get(builder.getIntNTy(shape->getScalarSizeInBits() * 2), n / 2);
+  auto extmul    = [&](unsigned first, bool sign) {
+    auto x = CompileShuffleRange(a, nullptr, first, n / 2);
+    auto y = CompileShuffleRange(b, nullptr, first, n / 2);
+    x      = sign ? builder.CreateSExt(x, wide) : builder.CreateZExt(x, wide);
+    y      = sign ? builder.CreateSExt(y, wide) : builder.CreateZExt(y, wide);
+    return PushSIMD(builder.CreateMul(x, y, name));
+  };
+  auto narrow = [&](bool sign) {
+    // Saturates both operands to the narrower lane type as signed values, then concatenates them
+    unsigned bits = shape->getScalarSizeInBits() / 2;
+    auto narrowty = llvm::VectorType::get(builder.getIntNTy(bits), n);
+    auto min = CInt::get(shape, sign ? llvm::APInt::getSignedMinValue(bits).sext(bits * 2) : llvm::APInt(bits * 2, 0));
+    auto max = CInt::get(shape, sign ? llvm::APInt::getSignedMaxValue(bits).sext(bits * 2) :
+                                       llvm::APInt::getMaxValue(bits).zext(bits * 2));
+    auto clamp = [&](llvmVal* x) {
+      x = builder.CreateSelect(builder.CreateICmpSLT(x, min), min, x);
+      x = builder.CreateSelect(builder.CreateICmpSGT(x, max), max, x);
+      return builder.CreateTrunc(x, narrowty);
+    };
+    return PushSIMD(CompileShuffleRange(clamp(a), clamp(b), 0, n * 2));
+  };
+  auto fminmax = [&](llvm::Intrinsic::ID id) {
+    // WASM requires we return an NaN if either operand is NaN
+    auto nancheck = builder.CreateFCmpUNO(a, b);
+    auto result   = builder.CreateBinaryIntrinsic(id, a, b, nullptr, name);
+    return PushSIMD(builder.CreateSelect(nancheck, ConstantFP::getNaN(shape), result));
+  };
+
+  if(op >= OP_i8x16_eq && op <= OP_i32x4_ge_u)
+    return compare(icmp[(op - OP_i8x16_eq) % 10]);
+  if(op >= OP_f32x4_eq && op <= OP_f64x2_ge)
+    return compare(fcmp[(op - OP_f32x4_eq) % 6]);
+  if(op >= OP_i64x2_eq && op <= OP_i64x2_ge_s)
+    return compare(i64cmp[op - OP_i64x2_eq]);
+
+  switch(op)
+  {
+  case OP_i8x16_swizzle:
+  {
+    // Indices that are out of range select 0 instead of a lane
+    llvmVal* result = llvm::Constant::getNullValue(shape);
+    for(unsigned i = 0; i < 16; ++i)
+    {
+      auto idx  = builder.CreateExtractElement(b, builder.getInt32(i));
+      auto lane = builder.CreateExtractElement(a, builder.CreateAnd(idx, builder.getInt8(15)));
+      lane      = builder.CreateSelect(builder.CreateICmpULT(idx, builder.getInt8(16)), lane, builder.getInt8(0));
+      result    = builder.CreateInsertElement(result, lane, builder.getInt32(i));
+    }
+    return PushSIMD(result);
+  }
+  case OP_v128_and: return PushSIMD(builder.CreateAnd(a, b, name));
+  case OP_v128_andnot: return PushSIMD(builder.CreateAnd(a, builder.CreateNot(b), name));
+  case OP_v128_or: return PushSIMD(builder.CreateOr(a, b, name));
+  case OP_v128_xor: return PushSIMD(builder.CreateXor(a, b, name));
+  case OP_i8x16_narrow_i16x8_s:
+  case OP_i16x8_narrow_i32x4_s: return narrow(true);
+  case OP_i8x16_narrow_i16x8_u:
+  case OP_i16x8_narrow_i32x4_u: return narrow(false);
+  case OP_i8x16_add:
+  case OP_i16x8_add:
+  case OP_i32x4_add:
+  case OP_i64x2_add: return PushSIMD(builder.CreateAdd(a, b, name));
+  case OP_i8x16_sub:
+  case OP_i16x8_sub:
+  case OP_i32x4_sub:
+  case OP_i64x2_sub: return PushSIMD(builder.CreateSub(a, b, name));
+  case OP_i16x8_mul:
+  case OP_i32x4_mul:
+  case OP_i64x2_mul: return PushSIMD(builder.CreateMul(a, b, name));
+  case OP_i8x16_add_sat_s:
+  case OP_i16x8_add_sat_s: return intrinsic(llvm::Intrinsic::sadd_sat);
+  case OP_i8x16_add_sat_u:
+  case OP_i16x8_add_sat_u: return intrinsic(llvm::Intrinsic::uadd_sat);
+  case OP_i8x16_sub_sat_s:
+  case OP_i16x8_sub_sat_s: return intrinsic(llvm::Intrinsic::ssub_sat);
+  case OP_i8x16_sub_sat_u:
+  case OP_i16x8_sub_sat_u: return intrinsic(llvm::Intrinsic::usub_sat);
+  case OP_i8x16_min_s:
+  case OP_i16x8_min_s:
+  case OP_i32x4_min_s: return select(Pred::ICMP_SLT);
+  case OP_i8x16_min_u:
+  case OP_i16x8_min_u:
+  case OP_i32x4_min_u: return select(Pred::ICMP_ULT);
+  case OP_i8x16_max_s:
+  case OP_i16x8_max_s:
+  case OP_i32x4_max_s: return select(Pred::ICMP_SGT);
+  case OP_i8x16_max_u:
+  case OP_i16x8_max_u:
+  case OP_i32x4_max_u: return select(Pred::ICMP_UGT);
+  case OP_i8x16_avgr_u:
+  case OP_i16x8_avgr_u:
+  {
+    // (a + b + 1) / 2, computed in wider lanes so the carry isn't lost
+    auto ty = llvm::VectorType::getExtendedElementVectorType(shape);
+    auto x  = builder.CreateAdd(builder.CreateZExt(a, ty), builder.CreateZExt(b, ty));
+    x       = builder.CreateLShr(builder.CreateAdd(x, CInt::get(ty, 1)), CInt::get(ty, 1));
+    return PushSIMD(builder.CreateTrunc(x, shape, name));
+  }
+  case OP_i16x8_q15mulr_sat_s:
+  {
+    // Only -32768 * -32768 can overflow, so only the upper bound needs to be saturated
+    auto ty = llvm::VectorType::getExtendedElementVectorType(shape);
+    auto x  = builder.CreateMul(builder.CreateSExt(a, ty), builder.CreateSExt(b, ty));
+    x       = builder.CreateAShr(builder.CreateAdd(x, CInt::get(ty, 0x4000)), CInt::get(ty, 15));
+    x       = builder.CreateSelect(builder.CreateICmpSGT(x, CInt::get(ty, 0x7FFF)), CInt::get(ty, 0x7FFF), x);
+    return PushSIMD(builder.CreateTrunc(x, shape, name));
+  }
+  case OP_i32x4_dot_i16x8_s:
+  {
+    auto ty = llvm::VectorType::getExtendedElementVectorType(shape);
+    auto x  = builder.CreateMul(builder.CreateSExt(a, ty), builder.CreateSExt(b, ty));
+    return PushSIMD(builder.CreateAdd(CompileShuffleRange(x, nullptr, 0, n / 2, 2),
+                                      CompileShuffleRange(x, nullptr, 1, n / 2, 2), name));
+  }
+  case OP_i16x8_extmul_low_i8x16_s:
+  case OP_i32x4_extmul_low_i16x8_s:
+  case OP_i64x2_extmul_low_i32x4_s: return extmul(0, true);
+  case OP_i16x8_extmul_high_i8x16_s:
+  case OP_i32x4_extmul_high_i16x8_s:
+  case OP_i64x2_extmul_high_i32x4_s: return extmul(n / 2, true);
+  case OP_i16x8_extmul_low_i8x16_u:
+  case OP_i32x4_extmul_low_i16x8_u:
+  case OP_i64x2_extmul_low_i32x4_u: return extmul(0, false);
+  case OP_i16x8_extmul_high_i8x16_u:
+  case OP_i32x4_extmul_high_i16x8_u:
+  case OP_i64x2_extmul_high_i32x4_u: return extmul(n / 2, false);
+  case OP_f32x4_add:
+  case OP_f64x2_add: return PushSIMD(builder.CreateFAdd(a, b, name));
+  case OP_f32x4_sub:
+  case OP_f64x2_sub: return PushSIMD(builder.CreateFSub(a, b, name));
+  case OP_f32x4_mul:
+  case OP_f64x2_mul: return PushSIMD(builder.CreateFMul(a, b, name));
+  case OP_f32x4_div:
+  case OP_f64x2_div: return PushSIMD(builder.CreateFDiv(a, b, name));
+  case OP_f32x4_min:
+  case OP_f64x2_min: return fminmax(llvm::Intrinsic::minnum);
+  case OP_f32x4_max:
+  case OP_f64x2_max: return fminmax(llvm::Intrinsic::maxnum);
+  case OP_f32x4_pmin: // Pseudo-min is defined as b < a ? b : a
+  case OP_f64x2_pmin: return PushSIMD(builder.CreateSelect(builder.CreateFCmpOLT(b, a), b, a, name));
+  case OP_f32x4_pmax: // Pseudo-max is defined as a < b ? b : a
+  case OP_f64x2_pmax: return PushSIMD(builder.CreateSelect(builder.CreateFCmpOLT(a, b), b, a, name));
+  }
+
+  return ERR_FATAL_UNKNOWN_INSTRUCTION;
+}
+
+IN_ERROR Compiler::CompileSIMDInstruction(Instruction& ins)
+{
+  auto name = OP::NAMES[ins.opcode];
+  auto info = GetOpInfo(ins.opcode[1]);
+
+  IN_ERROR err;
+  switch(info.kind)
+  {
+  case OpKind::Load:
+  case OpKind::Store:
+  case OpKind::LoadLane:
+  case OpKind::StoreLane: return CompileSIMDMemory(ins, name);
+  case OpKind::Const:
+  {
+    llvm::Constant* constant;
+    if(!(err = CompileConstant(ins, constant)))
+      PushReturn(constant);
+    return err;
+  }
+  case OpKind::Shuffle:
+  {
+    llvmVal *a, *b;
+    auto i8x16 = GetSIMDShape(TE_i32, 16);
+    if(err = PopSIMD(i8x16, b))
+      return err;
+    if(err = PopSIMD(i8x16, a))
+      return err;
+
+    uint32_t mask[16];
+    for(int i = 0; i < 16; ++i)
+      mask[i] = static_cast<uint8_t>(ins.immediates[i / 8]._varuint64 >> ((i % 8) * 8));
+    return PushSIMD(builder.CreateShuffleVector(a, b, mask, name));
+  }
+  case OpKind::Splat:
+  case OpKind::ExtractLane:
+  case OpKind::ReplaceLane: return CompileSIMDLane(ins, name);
+  case OpKind::Unary: return CompileSIMDUnary(ins, name);
+  case OpKind::Binary: return CompileSIMDBinary(ins, name);
+  case OpKind::Ternary:
+  {
+    // v128.bitselect takes bits from the first operand where the mask is set, and the second operand otherwise
+    llvmVal *a, *b, *mask;
+    auto ty = GetLLVMType(TE_v128);
+    if(err = PopSIMD(ty, mask))
+      return err;
+    if(err = PopSIMD(ty, b))
+      return err;
+    if(err = PopSIMD(ty, a))
+      return err;
+    return PushSIMD(
+      builder.CreateOr(builder.CreateAnd(a, mask), builder.CreateAnd(b, builder.CreateNot(mask)), name));
+  }
+  case OpKind::Test: return CompileSIMDTest(ins, name);
+  case OpKind::Shift: return CompileSIMDShift(ins, name);
+  }
+
+  return ERR_FATAL_UNKNOWN_INSTRUCTION;
+}
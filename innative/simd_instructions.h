@@ -0,0 +1,227 @@
+// Copyright (c)2020 Black Sphere Studios
+// For conditions of distribution and use, see copyright notice in innative.h
+
+#ifndef IN__SIMD_INSTRUCTIONS_H
+#define IN__SIMD_INSTRUCTIONS_H
+
+#include "innative/schema.h"
+
+namespace innative::simd_details {
+  // Groups SIMD instructions by the immediates they take and the shape of their stack signature
+  enum class OpKind
+  {
+    Load,        // [i32] -> [v128], memarg
+    Store,       // [i32 v128] -> [], memarg
+    LoadLane,    // [i32 v128] -> [v128], memarg lane
+    StoreLane,   // [i32 v128] -> [], memarg lane
+    Const,       // [] -> [v128], 16 byte immediate
+    Shuffle,     // [v128 v128] -> [v128], 16 lane immediates
+    Splat,       // [scalar] -> [v128]
+    ExtractLane, // [v128] -> [scalar], lane
+    ReplaceLane, // [v128 scalar] -> [v128], lane
+    Unary,       // [v128] -> [v128]
+    Binary,      // [v128 v128] -> [v128]
+    Ternary,     // [v128 v128 v128] -> [v128]
+    Test,        // [v128] -> [i32]
+    Shift,       // [v128 i32] -> [v128]
+
+    INVALID,
+  };
+
+  struct OpInfo
+  {
+    OpKind kind;
+    WASM_TYPE_ENCODING scalar; // Scalar operand or result of splat, extract_lane and replace_lane
+    uint8_t lanes;             // Number of lanes in the vector shape, which bounds any lane immediates
+    uint8_t access;            // log2 of the number of bytes accessed by a memory instruction (its natural alignment)
+  };
+
+  constexpr OpInfo Info(OpKind kind, WASM_TYPE_ENCODING scalar = TE_void, uint8_t lanes = 0, uint8_t access = 0)
+  {
+    return OpInfo{ kind, scalar, lanes, access };
+  }
+
+  // Returns everything the parser, validator and serializer need to know about a SIMD opcode[1]
+  constexpr OpInfo GetOpInfo(uint8_t op)
+  {
+    switch(op)
+    {
+    case OP_v128_load: return Info(OpKind::Load, TE_void, 0, 4);
+    case OP_v128_load8x8_s:
+    case OP_v128_load8x8_u:
+    case OP_v128_load16x4_s:
+    case OP_v128_load16x4_u:
+    case OP_v128_load32x2_s:
+    case OP_v128_load32x2_u:
+    case OP_v128_load64_splat:
+    case OP_v128_load64_zero: return Info(OpKind::Load, TE_void, 0, 3);
+    case OP_v128_load8_splat: return Info(OpKind::Load, TE_void, 0, 0);
+    case OP_v128_load16_splat: return Info(OpKind::Load, TE_void, 0, 1);
+    case OP_v128_load32_splat:
+    case OP_v128_load32_zero: return Info(OpKind::Load, TE_void, 0, 2);
+    case OP_v128_store: return Info(OpKind::Store, TE_void, 0, 4);
+    case OP_v128_load8_lane: return Info(OpKind::LoadLane, TE_void, 16, 0);
+    case OP_v128_load16_lane: return Info(OpKind::LoadLane, TE_void, 8, 1);
+    case OP_v128_load32_lane: return Info(OpKind::LoadLane, TE_void, 4, 2);
+    case OP_v128_load64_lane: return Info(OpKind::LoadLane, TE_void, 2, 3);
+    case OP_v128_store8_lane: return Info(OpKind::StoreLane, TE_void, 16, 0);
+    case OP_v128_store16_lane: return Info(OpKind::StoreLane, TE_void, 8, 1);
+    case OP_v128_store32_lane: return Info(OpKind::StoreLane, TE_void, 4, 2);
+    case OP_v128_store64_lane: return Info(OpKind::StoreLane, TE_void, 2, 3);
+
+    case OP_v128_const: return Info(OpKind::Const);
+    case OP_i8x16_shuffle: return Info(OpKind::Shuffle, TE_void, 32);
+
+    case OP_i8x16_splat: return Info(OpKind::Splat, TE_i32, 16);
+    case OP_i16x8_splat: return Info(OpKind::Splat, TE_i32, 8);
+    case OP_i32x4_splat: return Info(OpKind::Splat, TE_i32, 4);
+    case OP_i64x2_splat: return Info(OpKind::Splat, TE_i64, 2);
+    case OP_f32x4_splat: return Info(OpKind::Splat, TE_f32, 4);
+    case OP_f64x2_splat: return Info(OpKind::Splat, TE_f64, 2);
+
+    case OP_i8x16_extract_lane_s:
+    case OP_i8x16_extract_lane_u: return Info(OpKind::ExtractLane, TE_i32, 16);
+    case OP_i16x8_extract_lane_s:
+    case OP_i16x8_extract_lane_u: return Info(OpKind::ExtractLane, TE_i32, 8);
+    case OP_i32x4_extract_lane: return Info(OpKind::ExtractLane, TE_i32, 4);
+    case OP_i64x2_extract_lane: return Info(OpKind::ExtractLane, TE_i64, 2);
+    case OP_f32x4_extract_lane: return Info(OpKind::ExtractLane, TE_f32, 4);
+    case OP_f64x2_extract_lane: return Info(OpKind::ExtractLane, TE_f64, 2);
+    case OP_i8x16_replace_lane: return Info(OpKind::ReplaceLane, TE_i32, 16);
+    case OP_i16x8_replace_lane: return Info(OpKind::ReplaceLane, TE_i32, 8);
+    case OP_i32x4_replace_lane: return Info(OpKind::ReplaceLane, TE_i32, 4);
+    case OP_i64x2_replace_lane: return Info(OpKind::ReplaceLane, TE_i64, 2);
+    case OP_f32x4_replace_lane: return Info(OpKind::ReplaceLane, TE_f32, 4);
+    case OP_f64x2_replace_lane: return Info(OpKind::ReplaceLane, TE_f64, 2);
+
+    case OP_v128_bitselect: return Info(OpKind::Ternary);
+
+    case OP_v128_any_true:
+    case OP_i8x16_all_true:
+    case OP_i8x16_bitmask:
+    case OP_i16x8_all_true:
+    case OP_i16x8_bitmask:
+    case OP_i32x4_all_true:
+    case OP_i32x4_bitmask:
+    case OP_i64x2_all_true:
+    case OP_i64x2_bitmask: return Info(OpKind::Test);
+
+    case OP_i8x16_shl:
+    case OP_i8x16_shr_s:
+    case OP_i8x16_shr_u:
+    case OP_i16x8_shl:
+    case OP_i16x8_shr_s:
+    case OP_i16x8_shr_u:
+    case OP_i32x4_shl:
+    case OP_i32x4_shr_s:
+    case OP_i32x4_shr_u:
+    case OP_i64x2_shl:
+    case OP_i64x2_shr_s:
+    case OP_i64x2_shr_u: return Info(OpKind::Shift);
+
+    case OP_v128_not:
+    case OP_f32x4_demote_f64x2_zero:
+    case OP_f64x2_promote_low_f32x4:
+    case OP_i8x16_abs:
+    case OP_i8x16_neg:
+    case OP_i8x16_popcnt:
+    case OP_f32x4_ceil:
+    case OP_f32x4_floor:
+    case OP_f32x4_trunc:
+    case OP_f32x4_nearest:
+    case OP_f64x2_ceil:
+    case OP_f64x2_floor:
+    case OP_f64x2_trunc:
+    case OP_f64x2_nearest:
+    case OP_i16x8_extadd_pairwise_i8x16_s:
+    case OP_i16x8_extadd_pairwise_i8x16_u:
+    case OP_i32x4_extadd_pairwise_i16x8_s:
+    case OP_i32x4_extadd_pairwise_i16x8_u:
+    case OP_i16x8_abs:
+    case OP_i16x8_neg:
+    case OP_i16x8_extend_low_i8x16_s:
+    case OP_i16x8_extend_high_i8x16_s:
+    case OP_i16x8_extend_low_i8x16_u:
+    case OP_i16x8_extend_high_i8x16_u:
+    case OP_i32x4_abs:
+    case OP_i32x4_neg:
+    case OP_i32x4_extend_low_i16x8_s:
+    case OP_i32x4_extend_high_i16x8_s:
+    case OP_i32x4_extend_low_i16x8_u:
+    case OP_i32x4_extend_high_i16x8_u:
+    case OP_i64x2_abs:
+    case OP_i64x2_neg:
+    case OP_i64x2_extend_low_i32x4_s:
+    case OP_i64x2_extend_high_i32x4_s:
+    case OP_i64x2_extend_low_i32x4_u:
+    case OP_i64x2_extend_high_i32x4_u:
+    case OP_f32x4_abs:
+    case OP_f32x4_neg:
+    case OP_f32x4_sqrt:
+    case OP_f64x2_abs:
+    case OP_f64x2_neg:
+    case OP_f64x2_sqrt:
+    case OP_i32x4_trunc_sat_f32x4_s:
+    case OP_i32x4_trunc_sat_f32x4_u:
+    case OP_f32x4_convert_i32x4_s:
+    case OP_f32x4_convert_i32x4_u:
+    case OP_i32x4_trunc_sat_f64x2_s_zero:
+    case OP_i32x4_trunc_sat_f64x2_u_zero:
+    case OP_f64x2_convert_low_i32x4_s:
+    case OP_f64x2_convert_low_i32x4_u: return Info(OpKind::Unary);
+    }
+
+    // Every remaining opcode between swizzle and the last f64x2 arithmetic op is a binary op, except for the gaps the
+    // proposal left reserved.
+    if(op < OP_i8x16_swizzle || op > OP_f64x2_pmax)
+      return Info(OpKind::INVALID);
+    switch(op)
+    {
+    case 0x9a:
+    case 0xa2:
+    case 0xa5:
+    case 0xa6:
+    case 0xaf:
+    case 0xb0:
+    case 0xb2:
+    case 0xb3:
+    case 0xb4:
+    case 0xbb:
+    case 0xc2:
+    case 0xc5:
+    case 0xc6:
+    case 0xcf:
+    case 0xd0:
+    case 0xd2:
+    case 0xd3:
+    case 0xd4:
+    case 0xe2:
+    case 0xee: return Info(OpKind::INVALID);
+    }
+    return Info(OpKind::Binary);
+  }
+
+  constexpr bool IsMemoryOp(OpKind kind)
+  {
+    return kind == OpKind::Load || kind == OpKind::Store || kind == OpKind::LoadLane || kind == OpKind::StoreLane;
+  }
+
+  constexpr bool HasLaneImmediate(OpKind kind)
+  {
+    return kind == OpKind::LoadLane || kind == OpKind::StoreLane || kind == OpKind::ExtractLane ||
+           kind == OpKind::ReplaceLane;
+  }
+
+  // Make sure the opcode grouping holds
+  static_assert(GetOpInfo(OP_i8x16_swizzle).kind == OpKind::Binary);
+  static_assert(GetOpInfo(OP_i8x16_eq).kind == OpKind::Binary);
+  static_assert(GetOpInfo(OP_v128_andnot).kind == OpKind::Binary);
+  static_assert(GetOpInfo(OP_i32x4_dot_i16x8_s).kind == OpKind::Binary);
+  static_assert(GetOpInfo(OP_f64x2_pmax).kind == OpKind::Binary);
+  static_assert(GetOpInfo(OP_v128_load32_zero).kind == OpKind::Load);
+  static_assert(GetOpInfo(OP_v128_store64_lane).lanes == 2);
+  static_assert(GetOpInfo(0x9a).kind == OpKind::INVALID);
+  static_assert(GetOpInfo(OP_f64x2_convert_low_i32x4_u).kind == OpKind::Unary);
+}
+
+#endif
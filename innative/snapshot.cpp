@@ -0,0 +1,265 @@
+// Copyright (c)2020 Black Sphere Studios
+// For conditions of distribution and use, see copyright notice in innative.h
+
+#include "snapshot.h"
+#include "jit.h"
+#include "tools.h"
+#include "utility.h"
+#include <unordered_map>
+#include <vector>
+
+using namespace innative;
+using namespace utility;
+
+namespace innative {
+  namespace snapshot {
+    // Pages that are entirely zero are left out of the snapshot, because a new linear memory already starts out zeroed
+    static constexpr uint64_t PAGE_SIZE = 4096;
+
+    Instruction Constant(uint8_t opcode)
+    {
+      Instruction ins = { 0 };
+      ins.opcode[0]   = opcode;
+      return ins;
+    }
+
+    bool IsZeroPage(const uint8_t* bytes, uint64_t size)
+    {
+      for(uint64_t i = 0; i < size; ++i)
+        if(bytes[i] != 0)
+          return false;
+      return true;
+    }
+
+    // Replaces every active segment of the given kind that targets index with an empty one, which keeps the index of every
+    // passive segment intact. An empty segment at offset 0 is always in bounds, so it never traps.
+    template<class T, class F> void ClearSegments(T* segments, varuint32 n_segments, varuint32 index, F clear)
+    {
+      for(varuint32 i = 0; i < n_segments; ++i)
+        if((segments[i].flags == WASM_SEGMENT_ACTIVE || segments[i].flags == WASM_SEGMENT_EXPLICIT_INDEX) &&
+           segments[i].index == index)
+        {
+          clear(segments[i]);
+          segments[i].offset                          = Constant(OP_i32_const);
+          segments[i].offset.immediates[0]._varsint32 = 0;
+        }
+    }
+
+    template<class T>
+    T* AppendSegments(const Environment& env, T* segments, varuint32& n_segments, const std::vector<T>& add)
+    {
+      if(add.empty())
+        return segments;
+
+      T* n = tmalloc<T>(env, n_segments + add.size());
+      if(!n)
+        return nullptr;
+
+      tmemcpy<T>(n, n_segments + add.size(), segments, n_segments);
+      tmemcpy<T>(n + n_segments, add.size(), add.data(), add.size());
+      n_segments += static_cast<varuint32>(add.size());
+      return n;
+    }
+
+    IN_ERROR SnapshotMemory(const Environment& env, Module& m, varuint32 index, const INMemory& memory,
+                            std::vector<DataInit>& data)
+    {
+      ClearSegments(m.data.data, m.data.n_data, index, [](DataInit& d) { d.data = ByteArray(); });
+
+      // Each run of consecutive pages with something in them becomes one active data segment
+      auto bytes = reinterpret_cast<const uint8_t*>(memory.bytes);
+      for(uint64_t i = 0; i < memory.size;)
+      {
+        uint64_t end = std::min(i + PAGE_SIZE, memory.size);
+        if(IsZeroPage(bytes + i, end - i))
+        {
+          i = end;
+          continue;
+        }
+
+        uint64_t begin = i;
+        while(end < memory.size && !IsZeroPage(bytes + end, std::min(end + PAGE_SIZE, memory.size) - end))
+          end = std::min(end + PAGE_SIZE, memory.size);
+
+        uint8_t* copy = tmalloc<uint8_t>(env, end - begin);
+        if(!copy)
+          return ERR_FATAL_OUT_OF_MEMORY;
+        memcpy(copy, bytes + begin, end - begin);
+
+        DataInit d                        = { 0 };
+        d.index                           = index;
+        d.flags                           = !index ? WASM_SEGMENT_ACTIVE : WASM_SEGMENT_EXPLICIT_INDEX;
+        d.offset                          = Constant(OP_i32_const);
+        d.offset.immediates[0]._varsint32 = static_cast<varsint32>(begin);
+        d.data                            = ByteArray(copy, static_cast<varuint32>(end - begin));
+        data.push_back(d);
+        i = end;
+      }
+
+      return ERR_SUCCESS;
+    }
+
+    IN_ERROR SnapshotTable(const Environment& env, Module& m, varuint32 index, const INTable& table,
+                           const std::unordered_map<IN_Entrypoint, varuint32>& functions, std::vector<TableInit>& elements)
+    {
+      ClearSegments(m.element.elements, m.element.n_elements, index, [](TableInit& e) { e.n_elements = 0; });
+
+      // Each run of consecutive entries that hold a function becomes one active element segment
+      uint64_t n_entries = table.size / sizeof(INTableEntry);
+      for(uint64_t i = 0; i < n_entries;)
+      {
+        if(!table.entries[i].func)
+        {
+          ++i;
+          continue;
+        }
+
+        uint64_t end = i;
+        while(end < n_entries && table.entries[end].func)
+          ++end;
+
+        varuint32* indices = tmalloc<varuint32>(env, end - i);
+        if(!indices)
+          return ERR_FATAL_OUT_OF_MEMORY;
+
+        for(uint64_t j = i; j < end; ++j)
+        {
+          auto f = functions.find(table.entries[j].func);
+          if(f == functions.end()) // Only functions from an element segment of this module can be reproduced
+            return ERR_FATAL_SNAPSHOT_FAILED;
+          indices[j - i] = f->second;
+        }
+
+        TableInit e                       = { 0 };
+        e.index                           = index;
+        e.flags                           = !index ? WASM_SEGMENT_ACTIVE : WASM_SEGMENT_EXPLICIT_INDEX;
+        e.offset                          = Constant(OP_i32_const);
+        e.offset.immediates[0]._varsint32 = static_cast<varsint32>(i);
+        e.n_elements                      = static_cast<varuint32>(end - i);
+        e.elements                        = indices;
+        elements.push_back(e);
+        i = end;
+      }
+
+      return ERR_SUCCESS;
+    }
+
+    void SnapshotGlobal(GlobalDecl& global, const INGlobal& value)
+    {
+      switch(global.desc.type)
+      {
+      case TE_i32:
+        global.init                          = Constant(OP_i32_const);
+        global.init.immediates[0]._varsint32 = static_cast<varsint32>(value.i32);
+        break;
+      case TE_i64:
+        global.init                          = Constant(OP_i64_const);
+        global.init.immediates[0]._varsint64 = static_cast<varsint64>(value.i64);
+        break;
+      case TE_f32:
+        global.init                        = Constant(OP_f32_const);
+        global.init.immediates[0]._float32 = value.f32;
+        break;
+      case TE_f64:
+        global.init                        = Constant(OP_f64_const);
+        global.init.immediates[0]._float64 = value.f64;
+        break;
+      default: break; // A reference can't be written as a constant initializer, so it keeps its original one
+      }
+    }
+
+    IN_ERROR SnapshotModule(const Environment& env, Module& m, const INModuleMetadata* metadata)
+    {
+      if(!metadata)
+        return ERR_FATAL_SNAPSHOT_FAILED;
+
+      // The metadata lists the table functions in the order they first appear in the element segments
+      std::unordered_map<IN_Entrypoint, varuint32> functions;
+      std::vector<bool> seen(metadata->n_functions, false);
+      varuint32 k = 0;
+      for(varuint32 i = 0; i < m.element.n_elements; ++i)
+        for(varuint32 j = 0; j < m.element.elements[i].n_elements; ++j)
+        {
+          varuint32 index = m.element.elements[i].elements[j];
+          if(index >= metadata->n_functions || seen[index])
+            continue;
+
+          seen[index] = true;
+          if(k >= metadata->n_table_functions)
+            return ERR_FATAL_SNAPSHOT_FAILED;
+          functions[metadata->table_functions[k++].internal] = index;
+        }
+
+      // Imported state belongs to the module that defines it, which takes its own snapshot
+      varuint32 tables   = m.importsection.tables - m.importsection.functions;
+      varuint32 memories = m.importsection.memories - m.importsection.tables;
+      varuint32 globals  = m.importsection.globals - m.importsection.memories;
+      std::vector<DataInit> data;
+      std::vector<TableInit> elements;
+      IN_ERROR err;
+
+      for(varuint32 i = 0; i < m.memory.n_memories; ++i)
+      {
+        const INMemory& memory = *metadata->memories[memories + i];
+        if((err = SnapshotMemory(env, m, memories + i, memory, data)) < 0)
+          return err;
+        m.memory.memories[i].limits.minimum = static_cast<varuint32>(memory.size >> 16);
+      }
+
+      for(varuint32 i = 0; i < m.table.n_tables; ++i)
+      {
+        const INTable& table = *metadata->tables[tables + i];
+        if((err = SnapshotTable(env, m, tables + i, table, functions, elements)) < 0)
+          return err;
+        m.table.tables[i].resizable.minimum = static_cast<varuint32>(table.size / sizeof(INTableEntry));
+      }
+
+      for(varuint32 i = 0; i < m.global.n_globals; ++i)
+        if(m.global.globals[i].desc.mutability)
+          SnapshotGlobal(m.global.globals[i], *metadata->globals[globals + i]);
+
+      if(!(m.data.data = AppendSegments(env, m.data.data, m.data.n_data, data)) ||
+         !(m.element.elements = AppendSegments(env, m.element.elements, m.element.n_elements, elements)))
+        return ERR_FATAL_OUT_OF_MEMORY;
+
+      if(!data.empty())
+        m.knownsections |= (1 << WASM_SECTION_DATA);
+      if(!elements.empty())
+        m.knownsections |= (1 << WASM_SECTION_ELEMENT);
+      if(m.knownsections & (1 << WASM_SECTION_DATA_COUNT))
+        m.data.datacount = m.data.n_data;
+
+      // The start function already ran, and the module no longer matches its source, so it can't use the object cache
+      m.knownsections &= ~(1 << WASM_SECTION_START);
+      memset(m.digest, 0, sizeof(m.digest));
+      return ERR_SUCCESS;
+    }
+  }
+}
+
+IN_ERROR innative::SnapshotEnvironment(Environment* env)
+{
+  if(!env)
+    return ERR_FATAL_NULL_POINTER;
+
+  // The snapshot is the state of a single instance right after it was loaded. Tiering is disabled, because it swaps out the
+  // functions in the table metadata, which are used to map table entries back to function indices.
+  auto flags    = env->flags;
+  auto optimize = env->optimize;
+  env->flags &= ~(ENV_NO_INIT | ENV_MULTI_INSTANCE | ENV_SNAPSHOT);
+  env->optimize &= ~ENV_OPTIMIZE_TIERED;
+
+  int err;
+  void* assembly = CompileJIT(env, &err);
+  env->flags     = flags;
+  env->optimize  = optimize;
+  if(!assembly)
+    return err < 0 ? static_cast<IN_ERROR>(err) : ERR_FATAL_SNAPSHOT_FAILED;
+
+  IN_ERROR result = ERR_SUCCESS;
+  for(varuint32 i = 0; i < env->n_modules && result >= 0; ++i)
+    result = snapshot::SnapshotModule(*env, env->modules[i], GetModuleMetadata(assembly, i));
+
+  FreeAssembly(assembly);
+  return result;
+}
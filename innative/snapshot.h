@@ -0,0 +1,16 @@
+// Copyright (c)2020 Black Sphere Studios
+// For conditions of distribution and use, see copyright notice in innative.h
+
+#ifndef IN__SNAPSHOT_H
+#define IN__SNAPSHOT_H
+
+#include "innative/schema.h"
+
+namespace innative {
+  // Compiles the environment with the JIT, runs its init function, and rewrites every module so that its data segments,
+  // element segments and mutable global initializers reproduce the resulting state, without a start function. The
+  // environment must already be finalized, and it consumes the compilation cache just like CompileJIT.
+  IN_ERROR SnapshotEnvironment(Environment* env);
+}
+
+#endif
@@ -17,6 +17,7 @@ namespace innative {
       const uint8_t* data;
       size_t size;
       size_t pos;
+      bool persistent; // If true, data outlives the environment, so parsed byte arrays can point directly into it
 
       // Attempts to read num bytes from the stream, returns actual number of bytes read
       inline size_t ReadBytes(uint8_t* target, size_t num) noexcept
@@ -0,0 +1,104 @@
+// Copyright (c)2020 Black Sphere Studios
+// For conditions of distribution and use, see copyright notice in innative.h
+
+#include "threadpool.h"
+#include <atomic>
+
+using namespace innative;
+
+ThreadPool::ThreadPool(unsigned int threads, size_t limit) : _pending(0), _limit(limit), _shutdown(false)
+{
+  _workers.reserve(threads);
+  for(unsigned int i = 0; i < threads; ++i)
+    _workers.emplace_back(&ThreadPool::Run, this);
+}
+
+ThreadPool::~ThreadPool()
+{
+  {
+    std::unique_lock<std::mutex> lock(_lock);
+    _shutdown = true;
+  }
+  _signal.notify_all();
+
+  for(auto& worker : _workers)
+    worker.join();
+}
+
+void ThreadPool::Push(std::function<void()> job)
+{
+  if(_workers.empty()) // No workers means we are running serially
+  {
+    job();
+    return;
+  }
+
+  {
+    std::unique_lock<std::mutex> lock(_lock);
+    if(_limit > 0)
+      _space.wait(lock, [this]() { return _jobs.size() < _limit; });
+    _jobs.push_back(std::move(job));
+    ++_pending;
+  }
+  _signal.notify_one();
+}
+
+void ThreadPool::Wait()
+{
+  std::unique_lock<std::mutex> lock(_lock);
+  _idle.wait(lock, [this]() { return !_pending; });
+}
+
+IN_ERROR ThreadPool::Map(size_t n, const std::function<IN_ERROR(size_t)>& fn)
+{
+  std::atomic<size_t> first(n); // Lowest index that returned an error
+  std::vector<IN_ERROR> errors(n, ERR_SUCCESS);
+
+  for(size_t i = 0; i < n; ++i)
+    Push([&, i]() {
+      if((errors[i] = fn(i)) < 0)
+      {
+        size_t cur = first.load(std::memory_order_relaxed);
+        while(i < cur && !first.compare_exchange_weak(cur, i, std::memory_order_relaxed))
+          ;
+      }
+    });
+
+  Wait();
+  return first.load(std::memory_order_relaxed) < n ? errors[first.load(std::memory_order_relaxed)] : ERR_SUCCESS;
+}
+
+unsigned int ThreadPool::Concurrency(const Environment& env)
+{
+  if(!(env.flags & ENV_MULTITHREADED))
+    return 0;
+  if(env.maxthreads > 0)
+    return env.maxthreads;
+
+  unsigned int cores = std::thread::hardware_concurrency();
+  return !cores ? 1 : cores;
+}
+
+void ThreadPool::Run()
+{
+  for(;;)
+  {
+    std::function<void()> job;
+    {
+      std::unique_lock<std::mutex> lock(_lock);
+      _signal.wait(lock, [this]() { return _shutdown || !_jobs.empty(); });
+      if(_jobs.empty()) // Only exit once the queue has been drained
+        return;
+      job = std::move(_jobs.front());
+      _jobs.pop_front();
+    }
+    if(_limit > 0)
+      _space.notify_one();
+
+    job();
+
+    std::unique_lock<std::mutex> lock(_lock);
+    if(!--_pending)
+      _idle.notify_all();
+  }
+}
@@ -0,0 +1,50 @@
+// Copyright (c)2020 Black Sphere Studios
+// For conditions of distribution and use, see copyright notice in innative.h
+
+#ifndef IN__THREADPOOL_H
+#define IN__THREADPOOL_H
+
+#include "innative/schema.h"
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+namespace innative {
+  // Implements a bounded pool of worker threads that pull jobs off a shared queue. A pool with zero threads simply runs
+  // every job inline on the calling thread, which lets callers use the same code path for serial and parallel work. If
+  // limit is nonzero, Push() blocks while that many jobs are already waiting in the queue.
+  class ThreadPool
+  {
+  public:
+    explicit ThreadPool(unsigned int threads, size_t limit = 0);
+    ~ThreadPool();
+    void Push(std::function<void()> job);
+    void Wait(); // Blocks until every job pushed so far has finished running
+
+    // Runs fn(i) for every i in [0, n) and returns the error of the lowest index that failed, so the result does not
+    // depend on which thread happened to finish first.
+    IN_ERROR Map(size_t n, const std::function<IN_ERROR(size_t)>& fn);
+    inline size_t Size() const { return _workers.size(); }
+
+    // Returns how many worker threads an environment is allowed to use, or 0 if it isn't multithreaded
+    static unsigned int Concurrency(const Environment& env);
+
+  protected:
+    void Run();
+
+    std::vector<std::thread> _workers;
+    std::deque<std::function<void()>> _jobs;
+    std::mutex _lock;
+    std::condition_variable _signal; // Notified when a job is queued or the pool is shutting down
+    std::condition_variable _idle;   // Notified when the last pending job finishes
+    std::condition_variable _space;  // Notified when a job leaves a bounded queue
+    size_t _pending;
+    size_t _limit;
+    bool _shutdown;
+  };
+}
+
+#endif
@@ -4,9 +4,12 @@
 #include "parse.h"
 #include "validate.h"
 #include "link.h"
+#include "cache.h"
 #include "tools.h"
 #include "wast.h"
 #include "serialize.h"
+#include "instruction_stream.h"
+#include "jit.h"
 #include <atomic>
 #include <thread>
 #include <fstream>
@@ -49,9 +52,13 @@ Environment* innative::CreateEnvironment(unsigned int modules, unsigned int maxt
       return nullptr;
     }
 
-    env->objpath  = 0;
-    env->system   = "";
-    env->wasthook = 0;
+    env->objpath     = 0;
+    env->system      = "";
+    env->wasthook    = 0;
+    env->cachelimit  = IN_OBJECT_CACHE_LIMIT;
+    env->profile     = 0;
+    env->cpu         = 0;
+    env->cpufeatures = 0;
   }
   return env;
 }
@@ -72,6 +79,7 @@ void innative::DestroyEnvironment(Environment* env)
   if(!env)
     return;
 
+  delete env->loader; // Finishes any pending module loads before we tear anything down
   ClearEnvironmentCache(env, 0);
   for(varuint32 i = 0; i < env->n_modules; ++i)
   {
@@ -79,6 +87,10 @@ void innative::DestroyEnvironment(Environment* env)
     assert(!env->modules[i].cache);
   }
 
+  // Modules loaded from a file can point into its mapping, so these must stay alive until the modules are gone
+  for(FileMapping* mapping = env->mappings; mapping != nullptr; mapping = mapping->next)
+    UnmapFile(mapping->data, mapping->size);
+
   delete env->alloc;
   kh_destroy_modulepair(env->whitelist);
   kh_destroy_modules(env->modulemap);
@@ -88,9 +100,9 @@ void innative::DestroyEnvironment(Environment* env)
 }
 
 void innative::LoadModule(Environment* env, size_t index, const void* data, size_t size, const char* name, const char* file,
-                          int* err)
+                          bool persistent, int* err)
 {
-  Stream s = { reinterpret_cast<const uint8_t*>(data), size, 0 };
+  Stream s = { reinterpret_cast<const uint8_t*>(data), size, 0, persistent };
   std::string fallback;
   if(!name)
   {
@@ -98,43 +110,59 @@ void innative::LoadModule(Environment* env, size_t index, const void* data, size
     name     = fallback.data();
   }
 
+  // We parse into our own module so other threads can grow the module array while we work
+  Module m = { 0 };
   if((env->flags & ENV_ENABLE_WAT) && size > 0 && s.data[0] != 0)
-  {
-    env->modules[index] = { 0 };
-    *err = innative::ParseWatModule(*env, file, env->modules[index], s.data, size, StringSpan{ name, strlen(name) });
-  }
+    *err = innative::ParseWatModule(*env, file, m, s.data, size, StringSpan{ name, strlen(name) });
   else
-    *err = ParseModule(s, file, *env, env->modules[index], ByteArray::Identifier(name, strlen(name)), env->errors);
+    *err = ParseModule(s, file, *env, m, ByteArray::Identifier(name, strlen(name)), env->errors);
+
+  if(*err >= 0 && env->cachelimit > 0)
+    HashModuleSource(m, data, size);
 
+  {
+    std::unique_lock<std::mutex> lock(env->loader->lock);
+    env->modules[index] = m;
+  }
   ((std::atomic<size_t>&)env->n_modules).fetch_add(1, std::memory_order_release);
 }
 
+// Returns the environment's module loader, creating it if this is the first module we've added
+static IN_WASM_LOADER* GetLoader(Environment* env)
+{
+  IN_WASM_LOADER* loader = ((std::atomic<IN_WASM_LOADER*>&)env->loader).load(std::memory_order_acquire);
+  if(loader)
+    return loader;
+
+  IN_WASM_LOADER* created = new IN_WASM_LOADER(ThreadPool::Concurrency(*env));
+  if(((std::atomic<IN_WASM_LOADER*>&)env->loader)
+       .compare_exchange_strong(loader, created, std::memory_order_acq_rel, std::memory_order_acquire))
+    return created;
+
+  delete created; // Another thread beat us to it
+  return loader;
+}
+
 size_t innative::ReserveModule(Environment* env, int* err)
 {
-  if((env->flags & ENV_MULTITHREADED) != 0 && env->maxthreads > 0)
-  {
-    while(((std::atomic<size_t>&)env->size).load(std::memory_order_relaxed) -
-            ((std::atomic<size_t>&)env->n_modules).load(std::memory_order_relaxed) >=
-          env->maxthreads)
-      std::this_thread::sleep_for(std::chrono::milliseconds(
-        2)); // If we're using maxthreads, block until one finishes (we must block up here or we risk a deadlock)
-  }
+  // Loads only take this lock to publish a finished module, so growing the array never waits for a load to finish
+  std::unique_lock<std::mutex> lock(GetLoader(env)->lock);
 
-  size_t index = ((std::atomic<size_t>&)env->size).fetch_add(1, std::memory_order_acq_rel);
-  if(index >= ((std::atomic<size_t>&)env->capacity).load(std::memory_order_acquire))
+  size_t index = env->size;
+  if(index >= env->capacity)
   {
-    while(((std::atomic<size_t>&)env->n_modules).load(std::memory_order_relaxed) != index)
-      std::this_thread::sleep_for(
-        std::chrono::milliseconds(5)); // If we've exceeded our capacity, block until all other threads have finished
-
-    env->modules = trealloc<Module>(env->modules, index * 2);
-    if(!env->modules)
+    size_t capacity = !index ? 1 : index * 2;
+    Module* modules = trealloc<Module>(env->modules, capacity);
+    if(!modules)
     {
       *err = ERR_FATAL_OUT_OF_MEMORY;
       return (size_t)~0;
     }
-    ((std::atomic<size_t>&)env->capacity).store(index * 2, std::memory_order_release);
+    env->modules  = modules;
+    env->capacity = capacity;
   }
+
+  ((std::atomic<size_t>&)env->size).store(index + 1, std::memory_order_release);
   return index;
 }
 
@@ -148,27 +176,53 @@ void innative::AddModule(Environment* env, const void* data, size_t size, const
   }
 
   const char* file = nullptr;
-  std::unique_ptr<uint8_t[]> data_module;
+  bool persistent  = false;
+  std::shared_ptr<uint8_t[]> data_module; // Shared with the load job, which may outlive this call
   if(!size)
   {
-    file        = reinterpret_cast<const char*>(data);
-    data_module = LoadFile(file, size);
-    if(data_module.get() == nullptr)
+    file = reinterpret_cast<const char*>(data);
+
+    // Map the file instead of reading it so data segments and custom sections can be left in place. The mapping is owned
+    // by the environment, so it outlives both the modules and any thread parsing them.
+    FileMapping* mapping = tmalloc<FileMapping>(*env, 1);
+    if(!mapping)
     {
-      *err = ERR_FATAL_FILE_ERROR;
+      *err = ERR_FATAL_OUT_OF_MEMORY;
       return;
     }
-    data = data_module.get();
+    mapping->data = MapFile(file, mapping->size);
+
+    if(mapping->data != nullptr)
+    {
+      mapping->next = ((std::atomic<FileMapping*>&)env->mappings).load(std::memory_order_relaxed);
+      while(!((std::atomic<FileMapping*>&)env->mappings)
+               .compare_exchange_weak(mapping->next, mapping, std::memory_order_release, std::memory_order_relaxed))
+        ;
+      data       = mapping->data;
+      size       = mapping->size;
+      persistent = true;
+    }
+    else // Fall back to reading the file if it can't be mapped
+    {
+      data_module = LoadFile(file, size);
+      if(data_module.get() == nullptr)
+      {
+        *err = ERR_FATAL_FILE_ERROR;
+        return;
+      }
+      data = data_module.get();
+    }
   }
 
   size_t index = ReserveModule(env, err);
   if(*err < 0)
     return;
 
-  if(env->flags & ENV_MULTITHREADED)
-    std::thread(LoadModule, env, index, data, size, name, file, err).detach();
-  else
-    LoadModule(env, index, data, size, name, file, err);
+  // Without ENV_MULTITHREADED the pool has no workers, so this runs the load immediately. The job holds a reference to
+  // any buffer we read the file into, so it stays alive until the load finishes.
+  env->loader->pool.Push([=, buffer = std::move(data_module)]() {
+    LoadModule(env, index, data, size, name, file, persistent, err);
+  });
 }
 
 int innative::AddModuleObject(Environment* env, const Module* m)
@@ -181,8 +235,10 @@ int innative::AddModuleObject(Environment* env, const Module* m)
   if(err < 0)
     return err;
 
-  env->modules[index] = *m;
-
+  {
+    std::unique_lock<std::mutex> lock(env->loader->lock);
+    env->modules[index] = *m;
+  }
   ((std::atomic<size_t>&)env->n_modules).fetch_add(1, std::memory_order_release);
   return ERR_SUCCESS;
 }
@@ -338,9 +394,8 @@ IN_ERROR innative::FinalizeEnvironment(Environment* env)
     }
   }
 
-  while(((std::atomic<size_t>&)env->size).load(std::memory_order_relaxed) >
-        ((std::atomic<size_t>&)env->n_modules).load(std::memory_order_relaxed))
-    std::this_thread::sleep_for(std::chrono::milliseconds(5)); // Spin until all modules have loaded
+  if(env->loader)
+    env->loader->pool.Wait(); // Block until all modules have loaded
 
   return ERR_SUCCESS;
 }
@@ -385,22 +440,40 @@ IN_ERROR innative::Compile(Environment* env, const char* file)
 IN_Entrypoint innative::LoadFunction(void* assembly, const char* module_name, const char* function)
 {
   auto canonical = CanonicalName(StringSpan::From(module_name), StringSpan::From(function));
-  return (IN_Entrypoint)LoadDLLFunction(assembly, !function ? IN_INIT_FUNCTION : canonical.c_str());
+  return (IN_Entrypoint)LoadAssemblySymbol(assembly, !function ? IN_INIT_FUNCTION : canonical.c_str());
+}
+
+// Tables store functions in the internal calling convention, so they're swapped with their C wrappers at the boundary.
+// A table can hold functions from any module, so every module's list is searched.
+static IN_Entrypoint MapTableFunction(void* assembly, IN_Entrypoint func, bool external)
+{
+  INModuleMetadata* metadata;
+  for(uint32_t i = 0; func != nullptr && (metadata = GetModuleMetadata(assembly, i)) != nullptr; ++i)
+  {
+    for(varuint32 j = 0; j < metadata->n_table_functions; ++j)
+    {
+      INTableFunction& pair = metadata->table_functions[j];
+      if((external ? pair.internal : pair.external) == func)
+        return external ? pair.external : pair.internal;
+    }
+  }
+
+  return func;
 }
 
 IN_Entrypoint innative::LoadTable(void* assembly, const char* module_name, const char* table, varuint32 index)
 {
   INGlobal* ref = reinterpret_cast<INGlobal*>(
-    LoadDLLFunction(assembly, CanonicalName(StringSpan::From(module_name), StringSpan::From(table)).c_str()));
+    LoadAssemblySymbol(assembly, CanonicalName(StringSpan::From(module_name), StringSpan::From(table)).c_str()));
   if(ref != nullptr && index < (ref->table.size / sizeof(INTableEntry)))
-    return ref->table.entries[index].func;
+    return MapTableFunction(assembly, ref->table.entries[index].func, true);
   return nullptr;
 }
 
 INGlobal* innative::LoadGlobal(void* assembly, const char* module_name, const char* export_name)
 {
   return reinterpret_cast<INGlobal*>(
-    LoadDLLFunction(assembly, CanonicalName(StringSpan::From(module_name), StringSpan::From(export_name)).c_str()));
+    LoadAssemblySymbol(assembly, CanonicalName(StringSpan::From(module_name), StringSpan::From(export_name)).c_str()));
 }
 
 void* innative::LoadAssembly(const char* file)
@@ -413,7 +486,11 @@ void* innative::LoadAssembly(const char* file)
   return envpath.is_absolute() ? LoadDLL(envpath) : LoadDLL(GetWorkingDir() / envpath);
 }
 
-void innative::FreeAssembly(void* assembly) { FreeDLL(assembly); }
+void innative::FreeAssembly(void* assembly)
+{
+  if(!FreeJIT(assembly))
+    FreeDLL(assembly);
+}
 
 const char* innative::GetTypeEncodingString(int type_encoding)
 {
@@ -620,8 +697,12 @@ int innative::InsertModuleSection(Environment* env, Module* m, enum WASM_MODULE_
     m->knownsections |= (1 << WASM_SECTION_CODE);
     return InsertModuleType<FunctionBody>(env, m->code.funcbody, m->code.n_funcbody, index, { 0 });
   case WASM_MODULE_DATA:
+  {
     m->knownsections |= (1 << WASM_SECTION_DATA);
-    return InsertModuleType<DataInit>(env, m->data.data, m->data.n_data, index, { 0 });
+    int err           = InsertModuleType<DataInit>(env, m->data.data, m->data.n_data, index, { 0 });
+    m->data.datacount = m->data.n_data; // Keep the data count section consistent with the data section
+    return err;
+  }
   case WASM_MODULE_CUSTOM: return InsertModuleType<CustomSection>(env, m->custom, m->n_custom, (size_t)index, { 0 });
   }
 
@@ -672,7 +753,12 @@ int innative::DeleteModuleSection(Environment* env, Module* m, enum WASM_MODULE_
   case WASM_MODULE_EXPORT: return DeleteModuleType(env, m->exportsection.exports, m->exportsection.n_exports, index);
   case WASM_MODULE_ELEMENT: return DeleteModuleType<TableInit>(env, m->element.elements, m->element.n_elements, index);
   case WASM_MODULE_CODE: return DeleteModuleType<FunctionBody>(env, m->code.funcbody, m->code.n_funcbody, index);
-  case WASM_MODULE_DATA: return DeleteModuleType<DataInit>(env, m->data.data, m->data.n_data, index);
+  case WASM_MODULE_DATA:
+  {
+    int err           = DeleteModuleType<DataInit>(env, m->data.data, m->data.n_data, index);
+    m->data.datacount = m->data.n_data;
+    return err;
+  }
   case WASM_MODULE_CUSTOM: return DeleteModuleType<CustomSection>(env, m->custom, m->n_custom, (size_t)index);
   }
 
@@ -721,16 +807,36 @@ int innative::RemoveModuleLocal(Environment* env, FunctionBody* body, varuint32
 
 int innative::InsertModuleInstruction(Environment* env, FunctionBody* body, varuint32 index, Instruction* ins)
 {
-  if(!body || !ins)
+  if(!env || !body || !ins)
     return ERR_FATAL_NULL_POINTER;
-  return InsertModuleType(env, body->body, body->n_body, index, *ins);
+  if(index > body->n_body)
+    return ERR_FATAL_INVALID_INDEX;
+
+  // The instruction stream is variable-length, so we rebuild it with the new instruction spliced in
+  InstructionWriter writer(body->locations != nullptr || ins->line != 0 || ins->column != 0);
+  for(InstructionIterator cur(*body); cur.Index() < body->n_body; ++cur)
+  {
+    if(cur.Index() == index)
+      writer.Write(*ins);
+    writer.Write(*cur);
+  }
+  if(index == body->n_body)
+    writer.Write(*ins);
+  return writer.Finish(*body, *env);
 }
 
 int innative::RemoveModuleInstruction(Environment* env, FunctionBody* body, varuint32 index)
 {
-  if(!body)
+  if(!env || !body)
     return ERR_FATAL_NULL_POINTER;
-  return DeleteModuleType(env, body->body, body->n_body, index);
+  if(index >= body->n_body)
+    return ERR_FATAL_INVALID_INDEX;
+
+  InstructionWriter writer(body->locations != nullptr);
+  for(InstructionIterator cur(*body); cur.Index() < body->n_body; ++cur)
+    if(cur.Index() != index)
+      writer.Write(*cur);
+  return writer.Finish(*body, *env);
 }
 
 int innative::InsertModuleParam(Environment* env, FunctionType* func, FunctionDesc* desc, varuint32 index, varsint7 param,
@@ -778,49 +884,191 @@ int innative::RemoveModuleReturn(Environment* env, FunctionType* func, varuint32
 
 INModuleMetadata* innative::GetModuleMetadata(void* assembly, uint32_t module_index)
 {
-  return reinterpret_cast<INModuleMetadata*>(
-    LoadDLLFunction(assembly, CanonicalName(StringSpan(), StringSpan::From(IN_METADATA_PREFIX), module_index).c_str()));
+  return reinterpret_cast<INModuleMetadata*>(LoadAssemblySymbol(
+    assembly, CanonicalName(StringSpan(), StringSpan::From(IN_METADATA_PREFIX), module_index).c_str()));
+}
+const INTrapInfo* innative::GetLastTrap(void* assembly)
+{
+  return reinterpret_cast<const INTrapInfo*>(LoadAssemblySymbol(assembly, IN_TRAP_INFO));
+}
+
+// An instance is a word that records whether it was initialized, followed by a pointer to the block of each module, then
+// the blocks themselves. Compiled code is handed a pointer to the block pointers, so the header sits right before it.
+static const size_t INSTANCE_ALIGNMENT = 16;
+
+static size_t AlignInstanceSize(uint64_t size)
+{
+  return static_cast<size_t>((size + INSTANCE_ALIGNMENT - 1) & ~uint64_t(INSTANCE_ALIGNMENT - 1));
+}
+
+void* innative::CreateInstance(void* assembly)
+{
+  auto layout = reinterpret_cast<const INInstanceLayout*>(LoadAssemblySymbol(assembly, IN_INSTANCE_LAYOUT));
+  if(!layout)
+    return nullptr;
+
+  size_t header = AlignInstanceSize((layout->n_modules + 1) * sizeof(void*));
+  size_t total  = header;
+  for(varuint32 i = 0; i < layout->n_modules; ++i)
+    total += AlignInstanceSize(*layout->sizes[i]);
+
+  auto base = reinterpret_cast<char*>(calloc(1, total));
+  if(!base)
+    return nullptr;
+
+  auto blocks = reinterpret_cast<void**>(base) + 1;
+  for(varuint32 i = 0; i < layout->n_modules; ++i)
+  {
+    blocks[i] = base + header;
+    header += AlignInstanceSize(*layout->sizes[i]);
+  }
+  return blocks;
+}
+
+int innative::InitInstance(void* assembly, void* instance)
+{
+  auto init = reinterpret_cast<void (*)(void*)>(LoadAssemblySymbol(assembly, IN_INIT_FUNCTION));
+  if(!init || !instance)
+    return ERR_FATAL_NULL_POINTER;
+
+  auto initialized = reinterpret_cast<uintptr_t*>(instance) - 1;
+  if(*initialized)
+    return ERR_FATAL_INVALID_MODULE;
+
+  (*init)(instance);
+  *initialized = 1;
+  return ERR_SUCCESS;
+}
+
+void innative::DestroyInstance(void* assembly, void* instance)
+{
+  if(!instance)
+    return;
+
+  auto initialized = reinterpret_cast<uintptr_t*>(instance) - 1;
+  if(*initialized)
+  {
+    if(auto exit = reinterpret_cast<void (*)(void*)>(LoadAssemblySymbol(assembly, IN_EXIT_FUNCTION)))
+      (*exit)(instance);
+  }
+  free(initialized);
+}
+
+void* innative::GetInstanceData(void* assembly, void* instance, uint32_t module_index, const void* offset)
+{
+  auto layout = reinterpret_cast<const INInstanceLayout*>(LoadAssemblySymbol(assembly, IN_INSTANCE_LAYOUT));
+  if(!layout || !instance || module_index >= layout->n_modules)
+    return nullptr;
+  return reinterpret_cast<char*>(reinterpret_cast<void**>(instance)[module_index]) + reinterpret_cast<uintptr_t>(offset);
 }
+
+int innative::ConfigurePool(void* assembly, uint32_t memory_slots, uint64_t memory_slot_size, uint32_t table_slots,
+                            uint64_t table_slot_size)
+{
+  auto configure = reinterpret_cast<int (*)(uint32_t, uint64_t, uint32_t, uint64_t)>(
+    LoadAssemblySymbol(assembly, IN_POOL_CONFIGURE_FUNCTION));
+  if(!configure)
+    return ERR_FATAL_NULL_POINTER;
+
+  // The slots are reserved as soon as the first one is needed, after which they can't be changed
+  return (*configure)(memory_slots, memory_slot_size, table_slots, table_slot_size) ? ERR_SUCCESS :
+                                                                                      ERR_FATAL_RESOURCE_ERROR;
+}
+
+int innative::GetPoolStats(void* assembly, INPoolStats* memories, INPoolStats* tables)
+{
+  auto stats =
+    reinterpret_cast<void (*)(INPoolStats*, INPoolStats*)>(LoadAssemblySymbol(assembly, IN_POOL_STATS_FUNCTION));
+  if(!stats)
+    return ERR_FATAL_NULL_POINTER;
+
+  (*stats)(memories, tables);
+  return ERR_SUCCESS;
+}
+
+// An assembly compiled with ENV_MULTI_INSTANCE stores the offset of each table, memory and mutable global it defines
+// within the block of an instance in its metadata, instead of an address. Offsets are always smaller than the block, while
+// an address never is, because the first page of the address space is never mapped. Returns null if the pointer is an
+// offset but there is no instance to resolve it with.
+template<class T> static T* ResolveMetadataPointer(void* assembly, void* instance, uint32_t module_index, T* p)
+{
+  auto layout = reinterpret_cast<const INInstanceLayout*>(LoadAssemblySymbol(assembly, IN_INSTANCE_LAYOUT));
+  if(!layout || module_index >= layout->n_modules || reinterpret_cast<uintptr_t>(p) >= *layout->sizes[module_index])
+    return p;
+  return reinterpret_cast<T*>(GetInstanceData(assembly, instance, module_index, p));
+}
+
 IN_Entrypoint innative::LoadTableIndex(void* assembly, uint32_t module_index, uint32_t table_index,
                                        varuint32 function_index)
+{
+  return LoadInstanceTableIndex(assembly, nullptr, module_index, table_index, function_index);
+}
+INGlobal* innative::LoadGlobalIndex(void* assembly, uint32_t module_index, uint32_t global_index)
+{
+  return LoadInstanceGlobalIndex(assembly, nullptr, module_index, global_index);
+}
+INGlobal* innative::LoadMemoryIndex(void* assembly, uint32_t module_index, uint32_t memory_index)
+{
+  return LoadInstanceMemoryIndex(assembly, nullptr, module_index, memory_index);
+}
+int innative::ReplaceTableFuncPtr(void* assembly, uint32_t module_index, uint32_t table_index, const char* function,
+                                  IN_Entrypoint replace)
+{
+  return ReplaceInstanceTableFuncPtr(assembly, nullptr, module_index, table_index, function, replace);
+}
+IN_Entrypoint innative::LoadInstanceTableIndex(void* assembly, void* instance, uint32_t module_index,
+                                               uint32_t table_index, varuint32 function_index)
 {
   auto metadata = GetModuleMetadata(assembly, module_index);
   if(!metadata || table_index >= metadata->n_tables)
     return nullptr;
-  INGlobal* table = reinterpret_cast<INGlobal*>(metadata->tables[table_index]);
-  if(function_index < (table->table.size / sizeof(INTableEntry)))
-    return table->table.entries[function_index].func;
+  INTable* table = ResolveMetadataPointer(assembly, instance, module_index, metadata->tables[table_index]);
+  if(table != nullptr && function_index < (table->size / sizeof(INTableEntry)))
+    return MapTableFunction(assembly, table->entries[function_index].func, true);
   return nullptr;
 }
-INGlobal* innative::LoadGlobalIndex(void* assembly, uint32_t module_index, uint32_t global_index)
+INGlobal* innative::LoadInstanceGlobalIndex(void* assembly, void* instance, uint32_t module_index,
+                                            uint32_t global_index)
 {
   auto metadata = GetModuleMetadata(assembly, module_index);
   if(!metadata || global_index >= metadata->n_globals)
     return nullptr;
-  return metadata->globals[global_index];
+  return ResolveMetadataPointer(assembly, instance, module_index, metadata->globals[global_index]);
 }
-INGlobal* innative::LoadMemoryIndex(void* assembly, uint32_t module_index, uint32_t memory_index)
+INGlobal* innative::LoadInstanceMemoryIndex(void* assembly, void* instance, uint32_t module_index,
+                                            uint32_t memory_index)
 {
   auto metadata = GetModuleMetadata(assembly, module_index);
   if(!metadata || memory_index >= metadata->n_memories)
     return nullptr;
-  return reinterpret_cast<INGlobal*>(metadata->memories[memory_index]);
+  return reinterpret_cast<INGlobal*>(
+    ResolveMetadataPointer(assembly, instance, module_index, metadata->memories[memory_index]));
 }
-int innative::ReplaceTableFuncPtr(void* assembly, uint32_t module_index, uint32_t table_index, const char* function,
-                                  IN_Entrypoint replace)
+int innative::ReplaceInstanceTableFuncPtr(void* assembly, void* instance, uint32_t module_index, uint32_t table_index,
+                                          const char* function, IN_Entrypoint replace)
 {
   auto metadata = GetModuleMetadata(assembly, module_index);
   if(!metadata)
     return ERR_FATAL_INVALID_MODULE;
   if(table_index >= metadata->n_tables)
     return ERR_INVALID_TABLE_INDEX;
+  INTable* table = ResolveMetadataPointer(assembly, instance, module_index, metadata->tables[table_index]);
+  if(!table)
+    return ERR_FATAL_NULL_POINTER;
   auto target =
-    (IN_Entrypoint)LoadDLLFunction(assembly,
-                                   CanonicalName(StringSpan::From(metadata->name), StringSpan::From(function)).c_str());
+    (IN_Entrypoint)LoadAssemblySymbol(assembly,
+                                      CanonicalName(StringSpan::From(metadata->name), StringSpan::From(function)).c_str());
   if(!target)
     return ERR_INVALID_FUNCTION_INDEX;
-  auto& table = metadata->tables[table_index];
-  for(uint64_t i = 0; i < table->size; ++i)
+  target = MapTableFunction(assembly, target, false);
+
+  // Webassembly calls the replacement with the internal convention, which a C function can only handle without stack
+  // arguments
+  for(varuint32 i = 0; i < metadata->n_table_functions; ++i)
+    if(metadata->table_functions[i].internal == target && !metadata->table_functions[i].replaceable)
+      return ERR_INVALID_FUNCTION_SIG;
+
+  for(uint64_t i = 0; i < table->size / sizeof(INTableEntry); ++i)
     if(table->entries[i].func == target)
     {
       table->entries[i].func = replace;
@@ -5,15 +5,25 @@
 #define IN__TOOLS_H
 
 #include "innative/export.h"
+#include "threadpool.h"
 #include <stdint.h>
 #include <ostream>
 
+// Holds the worker pool that loads modules added to an environment, which persists until the environment is destroyed
+struct IN_WASM_LOADER
+{
+  explicit IN_WASM_LOADER(unsigned int threads) : pool(threads, threads * 4) {}
+
+  innative::ThreadPool pool;
+  std::mutex lock; // Guards growing the module array and publishing loaded modules into it
+};
+
 namespace innative {
   Environment* CreateEnvironment(unsigned int modules, unsigned int maxthreads, const char* arg0);
   void ClearEnvironmentCache(Environment* env, Module* m);
   void DestroyEnvironment(Environment* env);
   void LoadModule(Environment* env, size_t index, const void* data, size_t size, const char* name, const char* file,
-                  int* err);
+                  bool persistent, int* err);
   void AddModule(Environment* env, const void* data, size_t size, const char* name, int* err);
   int AddModuleObject(Environment* env, const Module* m);
   enum IN_ERROR AddWhitelist(Environment* env, const char* module_name, const char* export_name);
@@ -31,6 +41,12 @@ namespace innative {
   INGlobal* LoadMemoryIndex(void* assembly, uint32_t module_index, uint32_t memory_index);
   int ReplaceTableFuncPtr(void* assembly, uint32_t module_index, uint32_t table_index, const char* function,
                           IN_Entrypoint replace);
+  IN_Entrypoint LoadInstanceTableIndex(void* assembly, void* instance, uint32_t module_index, uint32_t table_index,
+                                       varuint32 function_index);
+  INGlobal* LoadInstanceGlobalIndex(void* assembly, void* instance, uint32_t module_index, uint32_t global_index);
+  INGlobal* LoadInstanceMemoryIndex(void* assembly, void* instance, uint32_t module_index, uint32_t memory_index);
+  int ReplaceInstanceTableFuncPtr(void* assembly, void* instance, uint32_t module_index, uint32_t table_index,
+                                  const char* function, IN_Entrypoint replace);
   void* LoadAssembly(const char* file);
   void FreeAssembly(void* assembly);
   const char* GetTypeEncodingString(int type_encoding);
@@ -52,6 +68,14 @@ namespace innative {
   int RemoveModuleParam(Environment* env, FunctionType* func, FunctionDesc* desc, varuint32 index);
   int InsertModuleReturn(Environment* env, FunctionType* func, varuint32 index, varsint7 result);
   int RemoveModuleReturn(Environment* env, FunctionType* func, varuint32 index);
+  const INTrapInfo* GetLastTrap(void* assembly);
+  void* CreateInstance(void* assembly);
+  int InitInstance(void* assembly, void* instance);
+  void DestroyInstance(void* assembly, void* instance);
+  void* GetInstanceData(void* assembly, void* instance, uint32_t module_index, const void* offset);
+  int ConfigurePool(void* assembly, uint32_t memory_slots, uint64_t memory_slot_size, uint32_t table_slots,
+                    uint64_t table_slot_size);
+  int GetPoolStats(void* assembly, INPoolStats* memories, INPoolStats* tables);
   size_t ReserveModule(Environment* env, int* err);
 }
 
@@ -17,6 +17,8 @@
   #include <limits.h>
   #include <dlfcn.h>
   #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <fcntl.h>
   #include <dirent.h>
 #else
   #error unknown platform
@@ -122,7 +124,15 @@ namespace innative {
         { "i32.reinterpret/f32", "i32.reinterpret_f32" }, // 0xbc
         { "i64.reinterpret/f64", "i64.reinterpret_f64" }, // 0xbd
         { "f32.reinterpret/i32", "f32.reinterpret_i32" }, // 0xbe
-        { "f64.reinterpret/i64", "f64.reinterpret_i64" }  // 0xbf
+        { "f64.reinterpret/i64", "f64.reinterpret_i64" }, // 0xbf
+        { "i32.trunc_s:sat/f32", "i32.trunc_sat_f32_s" }, // 0xfc 0x00
+        { "i32.trunc_u:sat/f32", "i32.trunc_sat_f32_u" }, // 0xfc 0x01
+        { "i32.trunc_s:sat/f64", "i32.trunc_sat_f64_s" }, // 0xfc 0x02
+        { "i32.trunc_u:sat/f64", "i32.trunc_sat_f64_u" }, // 0xfc 0x03
+        { "i64.trunc_s:sat/f32", "i64.trunc_sat_f32_s" }, // 0xfc 0x04
+        { "i64.trunc_u:sat/f32", "i64.trunc_sat_f32_u" }, // 0xfc 0x05
+        { "i64.trunc_s:sat/f64", "i64.trunc_sat_f64_s" }, // 0xfc 0x06
+        { "i64.trunc_u:sat/f64", "i64.trunc_sat_f64_u" }  // 0xfc 0x07
       };
 
       for(auto& i : legacy)
@@ -365,6 +375,28 @@ namespace innative {
     void* LoadDLL(const path& path) { return LoadLibraryW(path.c_str()); }
     void* LoadDLLFunction(void* dll, const char* name) { return GetProcAddress((HMODULE)dll, name); }
     void FreeDLL(void* dll) { FreeLibrary((HMODULE)dll); }
+
+    void* MapFile(const path& file, size_t& sz)
+    {
+      HANDLE f = CreateFileW(file.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+      if(f == INVALID_HANDLE_VALUE)
+        return nullptr;
+
+      LARGE_INTEGER len;
+      HANDLE mapping = NULL;
+      if(GetFileSizeEx(f, &len) && len.QuadPart > 0)
+        mapping = CreateFileMappingW(f, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+      CloseHandle(f);
+      if(!mapping)
+        return nullptr;
+
+      // The view keeps the mapping object alive, so both handles can be closed immediately
+      void* data = MapViewOfFile(mapping, FILE_MAP_COPY, 0, 0, 0);
+      CloseHandle(mapping);
+      sz = static_cast<size_t>(len.QuadPart);
+      return data;
+    }
+    void UnmapFile(void* data, size_t sz) { UnmapViewOfFile(data); }
 #elif defined(IN_PLATFORM_POSIX)
     void* LoadDLL(const path& path)
     {
@@ -372,6 +404,25 @@ namespace innative {
     } // We MUST load and initialize WASM dlls immediately for init function testing
     void* LoadDLLFunction(void* dll, const char* name) { return dlsym(dll, name); }
     void FreeDLL(void* dll) { dlclose(dll); }
+
+    void* MapFile(const path& file, size_t& sz)
+    {
+      int fd = open(file.c_str(), O_RDONLY);
+      if(fd < 0)
+        return nullptr;
+
+      struct stat st;
+      void* data = MAP_FAILED;
+      if(!fstat(fd, &st) && st.st_size > 0)
+        data = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+      close(fd);
+      if(data == MAP_FAILED)
+        return nullptr;
+
+      sz = static_cast<size_t>(st.st_size);
+      return data;
+    }
+    void UnmapFile(void* data, size_t sz) { munmap(data, sz); }
 #endif
   }
 }
\ No newline at end of file
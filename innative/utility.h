@@ -219,6 +219,8 @@ namespace innative {
     void* LoadDLL(const path& path);
     void* LoadDLLFunction(void* dll, const char* name);
     void FreeDLL(void* dll);
+    void* MapFile(const path& file, size_t& sz); // Returns a private, copy-on-write mapping of the file, or nullptr
+    void UnmapFile(void* data, size_t sz);
     int Install(const char* arg0, bool full);
     int Uninstall();
     IN_COMPILER_DLLEXPORT int AddCImport(const Environment& env, const char* id);
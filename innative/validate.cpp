@@ -6,10 +6,14 @@
 #include "stack.h"
 #include "link.h"
 #include "atomic_instructions.h"
+#include "simd_instructions.h"
+#include "instruction_stream.h"
+#include "tools.h"
 #include <stdio.h>
 #include <stdarg.h>
 #include <atomic>
 #include <limits>
+#include <algorithm>
 
 using namespace innative;
 using namespace utility;
@@ -22,6 +26,10 @@ namespace innative {
       varsint7 sig; // Block signature
       uint8_t type; // instruction that pushed this label
     };
+
+    // Function bodies are validated in batches of this size, which keeps the per-job overhead small for modules made of
+    // many tiny functions
+    static constexpr varuint32 FUNCTION_BATCH = 64;
   }
 }
 
@@ -249,6 +257,12 @@ void innative::ValidateImport(const Import& imp, Environment& env, Module* m)
     AppendError(env, env.errors, m, ERR_IMPORT_EXPORT_MISMATCH, "export name (%s) does not match import name (%s)",
                 exp.name.str(), imp.export_name.str());
 
+  // Imports between modules go through C symbols, which don't know which instance they belong to
+  if(env.flags & ENV_MULTI_INSTANCE)
+    AppendError(env, env.errors, m, ERR_MULTI_INSTANCE_IMPORT,
+                "%s:%s can't be imported from another module when compiling with ENV_MULTI_INSTANCE.",
+                imp.module_name.str(), imp.export_name.str());
+
   switch(imp.kind)
   {
   case WASM_KIND_FUNCTION:
@@ -386,6 +400,7 @@ void innative::ValidateBlockSignature(const Instruction& ins, varsint7 sig, Envi
   case TE_i64:
   case TE_f32:
   case TE_f64:
+  case TE_v128:
   case TE_void: break;
   default:
     AppendError(env, env.errors, m, ERR_INVALID_BLOCK_SIGNATURE, "[%u] %s is not a valid block signature type.", ins.line,
@@ -533,6 +548,16 @@ namespace innative {
     values.Push(RESULT);
   }
 
+  template<WASM_TYPE_ENCODING TYPE>
+  void ValidateSignExtendOp(const Instruction& ins, Stack<varsint7>& values, Environment& env, Module* m)
+  {
+    if(!(env.features & ENV_FEATURE_SIGN_EXTENSION))
+      AppendError(env, env.errors, m, ERR_FATAL_UNKNOWN_INSTRUCTION, "[%u] Unknown instruction code %hhu", ins.line,
+                  ins.opcode[0]);
+    else
+      ValidateUnaryOp<TYPE, TYPE>(ins, values, env, m);
+  }
+
   template<WASM_TYPE_ENCODING ARG1, WASM_TYPE_ENCODING ARG2, WASM_TYPE_ENCODING RESULT>
   void ValidateBinaryOp(const Instruction& ins, Stack<varsint7>& values, Environment& env, Module* m)
   {
@@ -554,6 +579,29 @@ namespace innative {
       values.Push(sig.returns[i]);
   }
 
+  // A tail call returns whatever the callee returns, so the callee must have the same result type as the calling function
+  void ValidateTailCall(const Instruction& ins, Stack<varsint7>& values, FunctionType* sig,
+                        Stack<internal::ControlBlock>& control, Environment& env, Module* m)
+  {
+    if(!(env.features & ENV_FEATURE_TAIL_CALL))
+      AppendError(env, env.errors, m, ERR_FATAL_UNKNOWN_INSTRUCTION, "[%u] Unknown instruction opcode %hhu", ins.line,
+                  ins.opcode[0]);
+    else if(control.Size() < 1)
+      AppendError(env, env.errors, m, ERR_INVALID_FUNCTION_BODY, "[%u] Empty control stack at %s statement.", ins.line,
+                  OP::NAMES[ins.opcode]);
+    else if(sig && (!sig->n_returns ? TE_void : sig->returns[0]) != control[control.Size() - 1].sig)
+    {
+      char buf[10];
+      char buf2[10];
+      AppendError(env, env.errors, m, ERR_INVALID_TYPE, "[%u] %s callee returns %s, but the function returns %s.",
+                  ins.line, OP::NAMES[ins.opcode],
+                  EnumToString(TYPE_ENCODING_MAP, !sig->n_returns ? TE_void : sig->returns[0], buf, 10),
+                  EnumToString(TYPE_ENCODING_MAP, control[control.Size() - 1].sig, buf2, 10));
+    }
+
+    PolymorphStack(values);
+  }
+
   void ValidateIndirectCall(const Instruction& ins, Stack<varsint7>& values, varuint32 sig, Environment& env, Module* m)
   {
     if(!ModuleTable(*m, 0))
@@ -655,6 +703,174 @@ namespace innative {
       values.Push(returnTy);
   }
 
+  void ValidateSIMDOp(const Instruction& ins, Stack<varsint7>& values, Environment& env, Module* m)
+  {
+    namespace sd = innative::simd_details;
+
+    auto info = sd::GetOpInfo(ins.opcode[1]);
+    if(info.kind == sd::OpKind::INVALID || !(env.features & ENV_FEATURE_SIMD))
+    {
+      AppendError(env, env.errors, m, ERR_FATAL_UNKNOWN_INSTRUCTION, "[%u] Unknown SIMD instruction opcode %hhu%hhu",
+                  ins.line, ins.opcode[0], ins.opcode[1]);
+      return; // The rest of our checks don't make sense for an unknown instruction
+    }
+
+    if(sd::IsMemoryOp(info.kind))
+    {
+      // Lane memory ops store their lane in place of the memidx, which is always 0 for them
+      varuint32 memory = sd::HasLaneImmediate(info.kind) ? 0 : ins.immediates[2]._varuint32;
+      if(!ModuleMemory(*m, memory))
+        AppendError(env, env.errors, m, ERR_INVALID_MEMORY_INDEX, "[%u] No default linear memory in module.", ins.line);
+      if(ins.immediates[0]._varuint32 > info.access)
+        AppendError(env, env.errors, m, ERR_INVALID_MEMORY_ALIGNMENT,
+                    "[%u] Alignment of %u exceeds number of accessed bytes %i", ins.line,
+                    (1 << ins.immediates[0]._varuint32), (1 << info.access));
+    }
+
+    if(sd::HasLaneImmediate(info.kind))
+    {
+      varuint32 lane = sd::IsMemoryOp(info.kind) ? ins.immediates[2]._varuint32 : ins.immediates[0]._varuint32;
+      if(lane >= info.lanes)
+        AppendError(env, env.errors, m, ERR_INVALID_LANE_INDEX, "[%u] Lane index %u is out of range for %s", ins.line,
+                    lane, OP::NAMES[ins.opcode]);
+    }
+
+    switch(info.kind)
+    {
+    case sd::OpKind::Load: ValidateUnaryOp<TE_i32, TE_v128>(ins, values, env, m); break;
+    case sd::OpKind::Store:
+      ValidatePopType(ins, values, TE_v128, env, m);
+      ValidatePopType(ins, values, TE_i32, env, m);
+      break;
+    case sd::OpKind::LoadLane: ValidateBinaryOp<TE_i32, TE_v128, TE_v128>(ins, values, env, m); break;
+    case sd::OpKind::StoreLane:
+      ValidatePopType(ins, values, TE_v128, env, m);
+      ValidatePopType(ins, values, TE_i32, env, m);
+      break;
+    case sd::OpKind::Const: values.Push(TE_v128); break;
+    case sd::OpKind::Shuffle:
+      for(int i = 0; i < 16; ++i)
+      {
+        auto lane = static_cast<uint8_t>(ins.immediates[i / 8]._varuint64 >> ((i % 8) * 8));
+        if(lane >= info.lanes)
+          AppendError(env, env.errors, m, ERR_INVALID_LANE_INDEX, "[%u] Lane index %u is out of range for %s", ins.line,
+                      lane, OP::NAMES[ins.opcode]);
+      }
+      ValidateBinaryOp<TE_v128, TE_v128, TE_v128>(ins, values, env, m);
+      break;
+    case sd::OpKind::Splat:
+      ValidatePopType(ins, values, info.scalar, env, m);
+      values.Push(TE_v128);
+      break;
+    case sd::OpKind::ExtractLane:
+      ValidatePopType(ins, values, TE_v128, env, m);
+      values.Push(info.scalar);
+      break;
+    case sd::OpKind::ReplaceLane:
+      ValidatePopType(ins, values, info.scalar, env, m);
+      ValidatePopType(ins, values, TE_v128, env, m);
+      values.Push(TE_v128);
+      break;
+    case sd::OpKind::Unary: ValidateUnaryOp<TE_v128, TE_v128>(ins, values, env, m); break;
+    case sd::OpKind::Binary: ValidateBinaryOp<TE_v128, TE_v128, TE_v128>(ins, values, env, m); break;
+    case sd::OpKind::Ternary:
+      ValidatePopType(ins, values, TE_v128, env, m);
+      ValidateBinaryOp<TE_v128, TE_v128, TE_v128>(ins, values, env, m);
+      break;
+    case sd::OpKind::Test: ValidateUnaryOp<TE_v128, TE_i32>(ins, values, env, m); break;
+    case sd::OpKind::Shift: ValidateBinaryOp<TE_v128, TE_i32, TE_v128>(ins, values, env, m); break;
+    }
+  }
+
+  void ValidateMiscOp(const Instruction& ins, Stack<varsint7>& values, Environment& env, Module* m)
+  {
+    // The non-trapping conversions share the misc prefix with bulk memory, but belong to a separate proposal
+    if(ins.opcode[1] <= OP_i64_trunc_sat_f64_u)
+    {
+      if(!(env.features & ENV_FEATURE_NONTRAPPING_FPTOINT))
+      {
+        AppendError(env, env.errors, m, ERR_FATAL_UNKNOWN_INSTRUCTION, "[%u] Unknown instruction opcode %hhu%hhu",
+                    ins.line, ins.opcode[0], ins.opcode[1]);
+        return;
+      }
+
+      switch(ins.opcode[1])
+      {
+      case OP_i32_trunc_sat_f32_s:
+      case OP_i32_trunc_sat_f32_u: ValidateUnaryOp<TE_f32, TE_i32>(ins, values, env, m); break;
+      case OP_i32_trunc_sat_f64_s:
+      case OP_i32_trunc_sat_f64_u: ValidateUnaryOp<TE_f64, TE_i32>(ins, values, env, m); break;
+      case OP_i64_trunc_sat_f32_s:
+      case OP_i64_trunc_sat_f32_u: ValidateUnaryOp<TE_f32, TE_i64>(ins, values, env, m); break;
+      case OP_i64_trunc_sat_f64_s:
+      case OP_i64_trunc_sat_f64_u: ValidateUnaryOp<TE_f64, TE_i64>(ins, values, env, m); break;
+      }
+      return;
+    }
+
+    if(!(env.features & ENV_FEATURE_BULK_MEMORY))
+    {
+      AppendError(env, env.errors, m, ERR_FATAL_UNKNOWN_INSTRUCTION, "[%u] Unknown instruction opcode %hhu%hhu",
+                  ins.line, ins.opcode[0], ins.opcode[1]);
+      return;
+    }
+
+    // Data segment instructions require a data count section so that single-pass validation knows the segment count
+    if(ins.opcode[1] == OP_memory_init || ins.opcode[1] == OP_data_drop)
+    {
+      if(!(m->knownsections & (1 << WASM_SECTION_DATA_COUNT)))
+        AppendError(env, env.errors, m, ERR_MISSING_DATA_COUNT, "[%u] %s requires a data count section.", ins.line,
+                    OP::NAMES[ins.opcode]);
+      else if(ins.immediates[0]._varuint32 >= m->data.datacount)
+        AppendError(env, env.errors, m, ERR_INVALID_DATA_INDEX, "[%u] Invalid data segment index %u", ins.line,
+                    ins.immediates[0]._varuint32);
+    }
+
+    if(ins.opcode[1] == OP_table_init || ins.opcode[1] == OP_elem_drop)
+    {
+      if(ins.immediates[0]._varuint32 >= m->element.n_elements)
+        AppendError(env, env.errors, m, ERR_INVALID_ELEMENT_INDEX, "[%u] Invalid element segment index %u", ins.line,
+                    ins.immediates[0]._varuint32);
+    }
+
+    switch(ins.opcode[1])
+    {
+    case OP_memory_init:
+      if(!ModuleMemory(*m, ins.immediates[1]._varuint32))
+        AppendError(env, env.errors, m, ERR_INVALID_MEMORY_INDEX, "[%u] No default linear memory in module.", ins.line);
+      break;
+    case OP_memory_copy:
+      if(!ModuleMemory(*m, ins.immediates[0]._varuint32) || !ModuleMemory(*m, ins.immediates[1]._varuint32))
+        AppendError(env, env.errors, m, ERR_INVALID_MEMORY_INDEX, "[%u] No default linear memory in module.", ins.line);
+      break;
+    case OP_memory_fill:
+      if(!ModuleMemory(*m, ins.immediates[0]._varuint32))
+        AppendError(env, env.errors, m, ERR_INVALID_MEMORY_INDEX, "[%u] No default linear memory in module.", ins.line);
+      break;
+    case OP_table_init:
+      if(!ModuleTable(*m, ins.immediates[1]._varuint32))
+        AppendError(env, env.errors, m, ERR_INVALID_TABLE_INDEX, "[%u] Invalid table index %u", ins.line,
+                    ins.immediates[1]._varuint32);
+      break;
+    case OP_table_copy:
+      if(!ModuleTable(*m, ins.immediates[0]._varuint32) || !ModuleTable(*m, ins.immediates[1]._varuint32))
+        AppendError(env, env.errors, m, ERR_INVALID_TABLE_INDEX, "[%u] Invalid table index %u or %u", ins.line,
+                    ins.immediates[0]._varuint32, ins.immediates[1]._varuint32);
+      break;
+    case OP_data_drop:
+    case OP_elem_drop: return; // No operands
+    default:
+      AppendError(env, env.errors, m, ERR_FATAL_UNKNOWN_INSTRUCTION, "[%u] Unknown instruction opcode %hhu%hhu",
+                  ins.line, ins.opcode[0], ins.opcode[1]);
+      return;
+    }
+
+    // Every remaining operation takes [i32 i32 i32] -> []
+    ValidatePopType(ins, values, TE_i32, env, m);
+    ValidatePopType(ins, values, TE_i32, env, m);
+    ValidatePopType(ins, values, TE_i32, env, m);
+  }
+
   void ValidateInstruction(const Instruction& ins, Stack<varsint7>& values, Stack<internal::ControlBlock>& control,
                            varuint32 n_locals, varsint7* locals, Environment& env, Module* m)
   {
@@ -703,6 +919,18 @@ namespace innative {
     case OP_call_indirect:
       ValidateIndirectCall(ins, values, ins.immediates[0]._varuint32, env, m);
       break;
+    case OP_return_call:
+      ValidateCall(ins, values, ins.immediates[0]._varuint32, env, m);
+      ValidateTailCall(ins, values, ModuleFunction(*m, ins.immediates[0]._varuint32), control, env, m);
+      break;
+    case OP_return_call_indirect:
+      ValidateIndirectCall(ins, values, ins.immediates[0]._varuint32, env, m);
+      ValidateTailCall(ins, values,
+                       (ins.immediates[0]._varuint32 < m->type.n_functypes) ?
+                         &m->type.functypes[ins.immediates[0]._varuint32] :
+                         nullptr,
+                       control, env, m);
+      break;
 
       // Parametric operators
     case OP_drop: ValidatePopType(ins, values, 0, env, m); break;
@@ -960,8 +1188,19 @@ namespace innative {
       ValidateUnaryOp<TE_i64, TE_f64>(ins, values, env, m);
       break;
 
+      // Sign extension
+    case OP_i32_extend8_s:
+    case OP_i32_extend16_s: ValidateSignExtendOp<TE_i32>(ins, values, env, m); break;
+    case OP_i64_extend8_s:
+    case OP_i64_extend16_s:
+    case OP_i64_extend32_s:
+      ValidateSignExtendOp<TE_i64>(ins, values, env, m);
+      break;
+
       // Atomics
     case OP_atomic_prefix: ValidateAtomicOp(ins, values, env, m); break;
+    case OP_simd_prefix: ValidateSIMDOp(ins, values, env, m); break;
+    case OP_misc_prefix: ValidateMiscOp(ins, values, env, m); break;
 
     default:
       AppendError(env, env.errors, m, ERR_FATAL_UNKNOWN_INSTRUCTION, "[%u] Unknown instruction code %hhu", ins.line,
@@ -1008,6 +1247,10 @@ varsint7 innative::ValidateInitializer(const Instruction& ins, Environment& env,
   case OP_i64_const: return TE_i64;
   case OP_f32_const: return TE_f32;
   case OP_f64_const: return TE_f64;
+  case OP_simd_prefix:
+    if(ins.opcode[1] != OP_v128_const)
+      break;
+    return TE_v128;
   case OP_global_get:
     if(!ModuleGlobal(*m, ins.immediates[0]._varuint32))
       AppendError(env, env.errors, m, ERR_INVALID_LOCAL_INDEX, "[%u] Invalid global index for get_global.", ins.line);
@@ -1116,6 +1359,16 @@ varsint32 innative::EvalInitializerI32(const Instruction& ins, Environment& env,
 
 void innative::ValidateTableOffset(const TableInit& init, Environment& env, Module* m)
 {
+  // Passive and declarative segments have no offset or table, so only their function indices can be checked
+  if(init.flags == WASM_SEGMENT_PASSIVE || init.flags == WASM_SEGMENT_DECLARATIVE)
+  {
+    for(varuint32 i = 0; i < init.n_elements; ++i)
+      if(!ModuleFunction(*m, init.elements[i]))
+        AppendError(env, env.errors, m, ERR_INVALID_FUNCTION_INDEX, "Invalid element initializer %u function index: %u", i,
+                    init.elements[i]);
+    return;
+  }
+
   varsint7 type = ValidateInitializer(init.offset, env, m);
   if(type != TE_NONE && type != TE_i32)
   {
@@ -1163,7 +1416,6 @@ void innative::ValidateTableOffset(const TableInit& init, Environment& env, Modu
 
 void innative::ValidateFunctionBody(const FunctionType& sig, const FunctionBody& body, Environment& env, Module* m)
 {
-  Instruction* cur = body.body;
   Stack<internal::ControlBlock> control; // control-flow stack that must be closed by end instructions
   Stack<varsint7> values;                // Current stack of value types
   varsint7 ret = TE_void;
@@ -1197,21 +1449,25 @@ void innative::ValidateFunctionBody(const FunctionType& sig, const FunctionBody&
   if(!body.n_body)
     return AppendError(env, env.errors, m, ERR_INVALID_FUNCTION_BODY, "Cannot have an empty function body!");
 
-  for(varuint32 i = 0; i < body.n_body; ++i)
+  uint8_t last = 0;
+  for(InstructionIterator cur(body); cur.Index() < body.n_body; ++cur)
   {
-    ValidateInstruction(cur[i], values, control, n_local, locals, env, m);
+    Instruction& ins = *cur;
+    last             = ins.opcode[0];
+    ValidateInstruction(ins, values, control, n_local, locals, env, m);
 
-    switch(cur[i].opcode[0])
+    switch(ins.opcode[0])
     {
     case OP_block:
     case OP_loop:
     case OP_if:
-      control.Push({ values.Limit(), cur[i].immediates[0]._varsint7, cur[i].opcode[0] });
+      control.Push({ values.Limit(), ins.immediates[0]._varsint7, ins.opcode[0] });
       values.SetLimit(values.Size() + values.Limit());
       break;
     case OP_end:
       if(!control.Size())
-        AppendError(env, env.errors, m, ERR_INVALID_FUNCTION_BODY, "Mismatched end instruction at index %u!", i);
+        AppendError(env, env.errors, m, ERR_INVALID_FUNCTION_BODY, "Mismatched end instruction at index %u!",
+                    cur.Index());
       else
       {
         char buf[10];
@@ -1219,12 +1475,13 @@ void innative::ValidateFunctionBody(const FunctionType& sig, const FunctionBody&
           AppendError(env, env.errors, m, ERR_INVALID_BLOCK_SIGNATURE,
                       "If statement without else cannot have a non-void block signature, had %s.",
                       EnumToString(TYPE_ENCODING_MAP, control.Peek().sig, buf, 10));
-        ValidateEndBlock(cur[i], control.Pop(), values, env, m, true);
+        ValidateEndBlock(ins, control.Pop(), values, env, m, true);
       }
       break;
     case OP_else:
       if(!control.Size())
-        AppendError(env, env.errors, m, ERR_INVALID_FUNCTION_BODY, "Mismatched else instruction at index %u!", i);
+        AppendError(env, env.errors, m, ERR_INVALID_FUNCTION_BODY, "Mismatched else instruction at index %u!",
+                    cur.Index());
       else
       {
         char buf[10];
@@ -1233,7 +1490,7 @@ void innative::ValidateFunctionBody(const FunctionType& sig, const FunctionBody&
           AppendError(env, env.errors, m, ERR_INVALID_FUNCTION_BODY,
                       "Expected else instruction to terminate if block, but found %s instead.",
                       EnumToString(TYPE_ENCODING_MAP, block.type, buf, 10));
-        ValidateEndBlock(cur[i], block, values, env, m, false);
+        ValidateEndBlock(ins, block, values, env, m, false);
         control.Push(
           { values.Limit(), block.sig, OP_else }); // Push a new else block that must be terminated by an end instruction
         values.SetLimit(values.Size() + values.Limit());
@@ -1252,13 +1509,16 @@ void innative::ValidateFunctionBody(const FunctionType& sig, const FunctionBody&
     AppendError(env, env.errors, m, ERR_INVALID_VALUE_STACK, "Value stack not fully empty, off by %zu",
                 values.Size() + values.Limit());
 
-  if(cur[body.n_body - 1].opcode[0] != OP_end)
+  if(last != OP_end)
     AppendError(env, env.errors, m, ERR_INVALID_FUNCTION_BODY,
-                "Expected end instruction to terminate function body, got %hhu instead.", cur[body.n_body - 1].opcode);
+                "Expected end instruction to terminate function body, got %hhu instead.", last);
 }
 
 void innative::ValidateDataOffset(const DataInit& init, Environment& env, Module* m)
 {
+  if(init.flags == WASM_SEGMENT_PASSIVE) // Passive segments are only bounds checked when memory.init executes
+    return;
+
   varsint7 type = ValidateInitializer(init.offset, env, m);
   if(type != TE_NONE && type != TE_i32)
   {
@@ -1369,15 +1629,49 @@ void innative::ValidateModule(Environment& env, Module& m)
 
   if(m.knownsections & (1 << WASM_SECTION_CODE))
   {
-    for(varuint32 j = 0; j < m.code.n_funcbody; ++j)
+    // Each batch of function bodies collects errors into its own list. These are merged in function index order
+    // afterwards, so the output never depends on which thread finished first.
+    size_t n_batches = (m.code.n_funcbody + internal::FUNCTION_BATCH - 1) / internal::FUNCTION_BATCH;
+    std::vector<ValidationError*> errors(n_batches, nullptr);
+    ThreadPool serial(0);
+    ThreadPool& pool = env.loader ? env.loader->pool : serial;
+
+    pool.Map(n_batches, [&](size_t batch) -> IN_ERROR {
+      Environment local = env; // Shares everything except the error list
+      local.errors      = nullptr;
+
+      varuint32 begin = static_cast<varuint32>(batch * internal::FUNCTION_BATCH);
+      varuint32 end   = std::min<varuint32>(m.code.n_funcbody, begin + internal::FUNCTION_BATCH);
+      for(varuint32 j = begin; j < end; ++j)
+      {
+        if(m.function.funcdecl[j].type_index < m.type.n_functypes)
+          ValidateFunctionBody(m.type.functypes[m.function.funcdecl[j].type_index], m.code.funcbody[j], local, &m);
+      }
+
+      errors[batch] = local.errors;
+      return ERR_SUCCESS;
+    });
+
+    // Every list is newest-first, just like env.errors, so each one is spliced onto the front in order
+    for(ValidationError* list : errors)
     {
-      if(m.function.funcdecl[j].type_index < m.type.n_functypes)
-        ValidateFunctionBody(m.type.functypes[m.function.funcdecl[j].type_index], m.code.funcbody[j], env, &m);
+      if(!list)
+        continue;
+      ValidationError* last = list;
+      while(last->next)
+        last = last->next;
+      last->next = env.errors;
+      env.errors = list;
     }
   }
 
   if(m.knownsections & (1 << WASM_SECTION_DATA))
     ValidateSection<DataInit, &ValidateDataOffset>(m.data.data, m.data.n_data, env, &m);
+
+  if((m.knownsections & (1 << WASM_SECTION_DATA_COUNT)) && m.data.datacount != m.data.n_data)
+    AppendError(env, env.errors, &m, ERR_DATA_COUNT_MISMATCH,
+                "The data count section (%u) does not equal the number of data segments (%u)", m.data.datacount,
+                m.data.n_data);
 }
 
 // Performs all post-load validation that couldn't be done during parsing
@@ -1389,4 +1683,12 @@ void innative::ValidateEnvironment(Environment& env)
     ValidateModule(env, env.modules[i]);
 }
 
-bool innative::ValidateSectionOrder(const uint32& sections, varuint7 opcode) { return (sections & ((~0) << opcode)) == 0; }
+bool innative::ValidateSectionOrder(const uint32& sections, varuint7 opcode)
+{
+  // The data count section has the highest id but must appear after the element section and before the code section
+  if(opcode == WASM_SECTION_DATA_COUNT)
+    return (sections & ((~0) << WASM_SECTION_CODE)) == 0;
+  if(opcode < WASM_SECTION_CODE && (sections & (1 << WASM_SECTION_DATA_COUNT)))
+    return false;
+  return (sections & ((~0) << opcode) & ~(1 << WASM_SECTION_DATA_COUNT)) == 0;
+}
@@ -6,6 +6,8 @@
 #include "parse.h"
 #include "validate.h"
 #include "atomic_instructions.h"
+#include "simd_instructions.h"
+#include "instruction_stream.h"
 #include <limits>
 
 using std::numeric_limits;
@@ -28,6 +30,8 @@ WatParser::WatParser(Environment& e, Module& mod) : m(mod), env(e)
   tablehash  = kh_init_indexname();
   memoryhash = kh_init_indexname();
   globalhash = kh_init_indexname();
+  datahash   = kh_init_indexname();
+  elemhash   = kh_init_indexname();
 }
 WatParser::~WatParser()
 {
@@ -36,6 +40,8 @@ WatParser::~WatParser()
   kh_destroy_indexname(tablehash);
   kh_destroy_indexname(memoryhash);
   kh_destroy_indexname(globalhash);
+  kh_destroy_indexname(datahash);
+  kh_destroy_indexname(elemhash);
 }
 
 varuint32 WatParser::GetJump(WatToken var)
@@ -181,6 +187,7 @@ varsint7 WatParser::WatValType(WatTokens id)
   case WatTokens::i64: return TE_i64;
   case WatTokens::f32: return TE_f32;
   case WatTokens::f64: return TE_f64;
+  case WatTokens::v128: return TE_v128;
   case WatTokens::CREF: return TE_cref;
   }
 
@@ -501,7 +508,8 @@ int WatParser::ParseOperator(Queue<WatToken>& tokens, Instruction& op, FunctionB
       break;
     }
   case OP_global_set:
-  case OP_call: defer = WatParser::DeferWatAction{ op.opcode[0], tokens.Pop(), 0, 0 }; break;
+  case OP_call:
+  case OP_return_call: defer = WatParser::DeferWatAction{ op.opcode[0], tokens.Pop(), 0, 0 }; break;
   case OP_i32_const:
   case OP_i64_const:
   case OP_f32_const:
@@ -524,6 +532,7 @@ int WatParser::ParseOperator(Queue<WatToken>& tokens, Instruction& op, FunctionB
       op.immediates[0].table[--op.immediates[0].n_table]; // Remove last jump from table and make it the default
     break;
   case OP_call_indirect:
+  case OP_return_call_indirect:
     if(err = ParseTypeUse(tokens, op.immediates[0]._varuint32, 0, 0, true))
       return err;
     break;
@@ -563,6 +572,61 @@ int WatParser::ParseOperator(Queue<WatToken>& tokens, Instruction& op, FunctionB
     if(err = ParseMemarg(tokens, op))
       return err;
     break;
+
+  case OP_simd_prefix:
+    if(err = ParseSIMDOperator(tokens, op))
+      return err;
+    break;
+
+  case OP_misc_prefix:
+    if(err = ParseMiscOperator(tokens, op, defer))
+      return err;
+    break;
+  }
+
+  return ERR_SUCCESS;
+}
+
+int WatParser::ParseMiscOperator(Queue<WatToken>& tokens, Instruction& op, WatParser::DeferWatAction& defer)
+{
+  auto isvar = [](const WatToken& t) { return t.id == WatTokens::NAME || t.id == WatTokens::NUMBER; };
+
+  switch(op.opcode[1])
+  {
+  case OP_table_init: // The table is optional and comes before the segment
+    if(tokens.Size() > 1 && isvar(tokens[0]) && isvar(tokens[1]))
+    {
+      op.immediates[1]._varuint32 = GetFromHash(tablehash, tokens.Pop());
+      if(op.immediates[1]._varuint32 == (varuint32)~0)
+        return ERR_WAT_INVALID_VAR;
+    }
+  case OP_memory_init:
+  case OP_data_drop:
+  case OP_elem_drop: // Segments are declared after functions, so they are resolved once the whole module is parsed
+    if(!isvar(tokens.Peek()))
+      return ERR_WAT_EXPECTED_VAR;
+    defer = WatParser::DeferWatAction{ op.opcode[0] | (op.opcode[1] << 8), tokens.Pop(), 0, 0 };
+    break;
+  case OP_table_copy: // Either both tables are specified or neither is
+    if(tokens.Size() > 1 && isvar(tokens[0]) && isvar(tokens[1]))
+    {
+      op.immediates[0]._varuint32 = GetFromHash(tablehash, tokens.Pop());
+      op.immediates[1]._varuint32 = GetFromHash(tablehash, tokens.Pop());
+      if(op.immediates[0]._varuint32 == (varuint32)~0 || op.immediates[1]._varuint32 == (varuint32)~0)
+        return ERR_WAT_INVALID_VAR;
+    }
+    break;
+  case OP_memory_copy:
+  case OP_memory_fill:
+  case OP_i32_trunc_sat_f32_s:
+  case OP_i32_trunc_sat_f32_u:
+  case OP_i32_trunc_sat_f64_s:
+  case OP_i32_trunc_sat_f64_u:
+  case OP_i64_trunc_sat_f32_s:
+  case OP_i64_trunc_sat_f32_u:
+  case OP_i64_trunc_sat_f64_s:
+  case OP_i64_trunc_sat_f64_u: break;
+  default: return ERR_FATAL_UNKNOWN_INSTRUCTION;
   }
 
   return ERR_SUCCESS;
@@ -604,6 +668,123 @@ int innative::WatParser::ParseMemarg(Queue<WatToken>& tokens, Instruction& op)
   return ERR_SUCCESS;
 }
 
+// Writes a little-endian lane of the given byte width into the 16 byte immediate of a v128.const or i8x16.shuffle
+static void SetV128Lane(Instruction& op, int offset, uint64_t value, int width)
+{
+  for(int i = 0; i < width; ++i, ++offset)
+    op.immediates[offset / 8]._varuint64 |= ((value >> (i * 8)) & 0xFF) << ((offset % 8) * 8);
+}
+
+int WatParser::ParseSIMDOperator(Queue<WatToken>& tokens, Instruction& op)
+{
+  namespace sd = innative::simd_details;
+
+  int err;
+  varuint32 lane;
+  auto info = sd::GetOpInfo(op.opcode[1]);
+  switch(info.kind)
+  {
+  case sd::OpKind::INVALID: return ERR_FATAL_UNKNOWN_INSTRUCTION;
+  case sd::OpKind::Const: return ParseV128Constant(tokens, op);
+  case sd::OpKind::Shuffle:
+    for(int i = 0; i < 16; ++i)
+    {
+      if(err = ResolveTokenu32(tokens.Pop(), numbuf, lane))
+        return err;
+      if(lane > 0xFF)
+        return ERR_WAT_OUT_OF_RANGE;
+      SetV128Lane(op, i, lane, 1);
+    }
+    break;
+  case sd::OpKind::ExtractLane:
+  case sd::OpKind::ReplaceLane:
+    if(err = ResolveTokenu32(tokens.Pop(), numbuf, op.immediates[0]._varuint32))
+      return err;
+    if(op.immediates[0]._varuint32 > 0xFF)
+      return ERR_WAT_OUT_OF_RANGE;
+    break;
+  default:
+    if(!sd::IsMemoryOp(info.kind))
+      break;
+
+    // Set the default memargs for when they aren't specified
+    op.immediates[0]._varuint32 = info.access;
+    op.immediates[1]._varuint32 = 0;
+    if(err = ParseMemarg(tokens, op))
+      return err;
+
+    if(sd::HasLaneImmediate(info.kind)) // The lane is stored in place of the memidx, see ParseSIMDInstruction
+    {
+      if(op.immediates[2]._varuint32 != 0)
+        return ERR_INVALID_MEMORY_INDEX;
+      if(err = ResolveTokenu32(tokens.Pop(), numbuf, op.immediates[2]._varuint32))
+        return err;
+      if(op.immediates[2]._varuint32 > 0xFF)
+        return ERR_WAT_OUT_OF_RANGE;
+    }
+    break;
+  }
+
+  return ERR_SUCCESS;
+}
+
+int WatParser::ParseV128Constant(Queue<WatToken>& tokens, Instruction& op)
+{
+  int err;
+  WatTokens shape = tokens.Pop().id;
+  switch(shape)
+  {
+  case WatTokens::i8x16:
+  case WatTokens::i16x8:
+  {
+    int width = (shape == WatTokens::i8x16) ? 1 : 2;
+    for(int i = 0; i < 16; i += width)
+    {
+      varsint32 v;
+      if(err = ResolveTokeni32(tokens.Pop(), numbuf, v))
+        return err;
+      if(v < -(1 << (width * 8 - 1)) || v >= (1 << (width * 8))) // Lanes can be written as signed or unsigned
+        return ERR_WAT_OUT_OF_RANGE;
+      SetV128Lane(op, i, static_cast<uint64_t>(v), width);
+    }
+    break;
+  }
+  case WatTokens::i32x4:
+    for(int i = 0; i < 16; i += 4)
+    {
+      varsint32 v;
+      if(err = ResolveTokeni32(tokens.Pop(), numbuf, v))
+        return err;
+      SetV128Lane(op, i, static_cast<uint32_t>(v), 4);
+    }
+    break;
+  case WatTokens::i64x2:
+    for(int i = 0; i < 2; ++i)
+      if(err = ResolveTokeni64(tokens.Pop(), numbuf, op.immediates[i]._varsint64))
+        return err;
+    break;
+  case WatTokens::f32x4:
+    for(int i = 0; i < 16; i += 4)
+    {
+      float32 f;
+      uint32_t bits;
+      if(err = ResolveTokenf32(tokens.Pop(), numbuf, f))
+        return err;
+      memcpy(&bits, &f, sizeof(bits));
+      SetV128Lane(op, i, bits, 4);
+    }
+    break;
+  case WatTokens::f64x2:
+    for(int i = 0; i < 2; ++i)
+      if(err = ResolveTokenf64(tokens.Pop(), numbuf, op.immediates[i]._float64))
+        return err;
+    break;
+  default: return ERR_WAT_EXPECTED_TOKEN;
+  }
+
+  return ERR_SUCCESS;
+}
+
 void WatParser::ParseLabel(Queue<WatToken>& tokens)
 {
   if(tokens.Peek().id == WatTokens::NAME)
@@ -674,8 +855,7 @@ int WatParser::ParseExpression(Queue<WatToken>& tokens, FunctionBody& f, Functio
       op.immediates[0]._varsint7 = blocktype;
       op.line                    = t.line;
       op.column                  = t.column;
-      if(err = AppendArray<Instruction>(env, op, f.body, f.n_body))
-        return err;
+      AppendInstruction(op);
     }
 
     while(tokens.Peek().id != WatTokens::CLOSE)
@@ -685,8 +865,7 @@ int WatParser::ParseExpression(Queue<WatToken>& tokens, FunctionBody& f, Functio
     Instruction op = { OP_end };
     op.line        = tokens.Peek().line;
     op.column      = tokens.Peek().column;
-    if(err = AppendArray<Instruction>(env, op, f.body, f.n_body))
-      return err;
+    AppendInstruction(op);
 
     stack.Pop();
     break;
@@ -708,9 +887,7 @@ int WatParser::ParseExpression(Queue<WatToken>& tokens, FunctionBody& f, Functio
       op.immediates[0]._varsint7 = blocktype;
       op.line                    = t.line;
       op.column                  = t.column;
-      if(err = AppendArray<Instruction>(env, op, f.body,
-                                        f.n_body)) // We append the if instruction _after_ the optional condition expression
-        return err;
+      AppendInstruction(op); // We append the if instruction _after_ the optional condition expression
     }
   }
 
@@ -733,8 +910,7 @@ int WatParser::ParseExpression(Queue<WatToken>& tokens, FunctionBody& f, Functio
 
       op.line   = t.line;
       op.column = t.column;
-      if(err = AppendArray<Instruction>(env, op, f.body, f.n_body))
-        return err;
+      AppendInstruction(op);
 
       while(tokens.Peek().id != WatTokens::CLOSE)
         if(err = ParseInstruction(tokens, f, desc, sig, index))
@@ -748,8 +924,7 @@ int WatParser::ParseExpression(Queue<WatToken>& tokens, FunctionBody& f, Functio
 
       op.line   = tokens.Peek().line;
       op.column = tokens.Peek().column;
-      if(err = AppendArray<Instruction>(env, op, f.body, f.n_body))
-        return err;
+      AppendInstruction(op);
     }
 
     stack.Pop();
@@ -766,10 +941,9 @@ int WatParser::ParseExpression(Queue<WatToken>& tokens, FunctionBody& f, Functio
       if(err = ParseExpression(tokens, f, desc, sig, index))
         return err;
 
-    if(defer.id) // Only perform the defer after we evaluate the folded instructions, so f.n_body is correct
-      deferred.Push(WatParser::DeferWatAction{ defer.id, defer.t, index, f.n_body });
-    if(err = AppendArray<Instruction>(env, op, f.body, f.n_body)) // Now we append the operator
-      return err;
+    if(defer.id) // Only perform the defer after we evaluate the folded instructions, so the index is correct
+      deferred.Push(WatParser::DeferWatAction{ defer.id, defer.t, index, code.back().size() });
+    AppendInstruction(op); // Now we append the operator
     break;
   }
   }
@@ -801,8 +975,7 @@ int WatParser::ParseInstruction(Queue<WatToken>& tokens, FunctionBody& f, Functi
       op.immediates[0]._varsint7 = blocktype;
       op.line                    = t.line;
       op.column                  = t.column;
-      if(err = AppendArray<Instruction>(env, op, f.body, f.n_body))
-        return err;
+      AppendInstruction(op);
     }
 
     while(tokens.Peek().id != WatTokens::END)
@@ -819,8 +992,7 @@ int WatParser::ParseInstruction(Queue<WatToken>& tokens, FunctionBody& f, Functi
 
       op.line   = tokens.Peek().line;
       op.column = tokens.Peek().column;
-      if(err = AppendArray<Instruction>(env, op, f.body, f.n_body))
-        return err;
+      AppendInstruction(op);
     }
 
     stack.Pop();
@@ -839,9 +1011,7 @@ int WatParser::ParseInstruction(Queue<WatToken>& tokens, FunctionBody& f, Functi
       op.immediates[0]._varsint7 = blocktype;
       op.line                    = t.line;
       op.column                  = t.column;
-      if(err = AppendArray<Instruction>(env, op, f.body,
-                                        f.n_body)) // We append the if instruction _after_ the optional condition expression
-        return err;
+      AppendInstruction(op); // We append the if instruction _after_ the optional condition expression
     }
 
     while(tokens.Peek().id != WatTokens::ELSE && tokens.Peek().id != WatTokens::END)
@@ -858,8 +1028,7 @@ int WatParser::ParseInstruction(Queue<WatToken>& tokens, FunctionBody& f, Functi
 
       op.line   = t.line;
       op.column = t.column;
-      if(err = AppendArray<Instruction>(env, op, f.body, f.n_body))
-        return err;
+      AppendInstruction(op);
 
       while(tokens.Peek().id != WatTokens::END)
         if(err = ParseInstruction(tokens, f, desc, sig, index))
@@ -877,8 +1046,7 @@ int WatParser::ParseInstruction(Queue<WatToken>& tokens, FunctionBody& f, Functi
 
       op.line   = tokens.Peek().line;
       op.column = tokens.Peek().column;
-      if(err = AppendArray<Instruction>(env, op, f.body, f.n_body))
-        return err;
+      AppendInstruction(op);
     }
 
     stack.Pop();
@@ -891,8 +1059,9 @@ int WatParser::ParseInstruction(Queue<WatToken>& tokens, FunctionBody& f, Functi
       return err;
 
     if(defer.id)
-      deferred.Push(WatParser::DeferWatAction{ defer.id, defer.t, index, f.n_body });
-    return AppendArray<Instruction>(env, op, f.body, f.n_body);
+      deferred.Push(WatParser::DeferWatAction{ defer.id, defer.t, index, code.back().size() });
+    AppendInstruction(op);
+    break;
   }
   }
 
@@ -1023,6 +1192,7 @@ int WatParser::ParseFunction(Queue<WatToken>& tokens, varuint32* index, StringSp
 
   // Read in all instructions
   assert(stack.Size() == 0);
+  code.emplace_back();
   while(tokens.Peek().id != WatTokens::CLOSE)
   {
     if(err = ParseInstruction(tokens, body, desc, functy, *index))
@@ -1032,8 +1202,7 @@ int WatParser::ParseFunction(Queue<WatToken>& tokens, varuint32* index, StringSp
   Instruction op = { OP_end };
   op.line        = tokens.Peek().line;
   op.column      = tokens.Peek().column;
-  if(err = AppendArray(env, op, body.body, body.n_body))
-    return err;
+  AppendInstruction(op);
 
   m.knownsections |= (1 << WASM_SECTION_FUNCTION);
   if(err = AppendArray(env, desc, m.function.funcdecl, m.function.n_funcdecl))
@@ -1116,6 +1285,7 @@ int WatParser::ParseInitializerInstruction(Queue<WatToken>& tokens, Instruction&
   FunctionBody blank     = { 0 };
   FunctionDesc descblank = { 0 };
   FunctionType typeblank = { 0 };
+  code.emplace_back(); // The initializer is parsed like a function body, which we then throw away
 
   if(expr)
   {
@@ -1131,16 +1301,19 @@ int WatParser::ParseInitializerInstruction(Queue<WatToken>& tokens, Instruction&
     }
   }
 
-  if(blank.n_body == 0)
+  std::vector<Instruction> body = std::move(code.back());
+  code.pop_back();
+
+  if(body.size() == 0)
     AppendError(env, env.errors, 0, ERR_INVALID_INITIALIZER_TYPE, "Only one instruction is allowed as an initializer");
 
-  if(blank.n_body > 1)
+  if(body.size() > 1)
   {
-    varuint32 i = 0; // For some reason, webassembly wants a type mismatch error if there are multiple constant
-                     // instructions that would otherwise be valid.
-    for(; i < blank.n_body; ++i)
+    size_t i = 0; // For some reason, webassembly wants a type mismatch error if there are multiple constant
+                  // instructions that would otherwise be valid.
+    for(; i < body.size(); ++i)
     {
-      switch(blank.body[i].opcode[0])
+      switch(body[i].opcode[0])
       {
       case OP_i32_const:
       case OP_i64_const:
@@ -1150,12 +1323,12 @@ int WatParser::ParseInitializerInstruction(Queue<WatToken>& tokens, Instruction&
       }
       break;
     }
-    AppendError(env, env.errors, 0, (i == blank.n_body) ? ERR_INVALID_INITIALIZER_TYPE : ERR_INVALID_INITIALIZER,
+    AppendError(env, env.errors, 0, (i == body.size()) ? ERR_INVALID_INITIALIZER_TYPE : ERR_INVALID_INITIALIZER,
                 "Only one instruction is allowed as an initializer");
   }
 
-  if(blank.n_body > 0)
-    op = blank.body[0];
+  if(body.size() > 0)
+    op = body[0];
 
   return ERR_SUCCESS;
 }
@@ -1364,15 +1537,37 @@ int WatParser::ParseExport(Queue<WatToken>& tokens)
   return AppendArray(env, e, m.exportsection.exports, m.exportsection.n_exports);
 }
 
-int WatParser::ParseElemData(Queue<WatToken>& tokens, varuint32& index, Instruction& op, kh_indexname_t* hash)
+int WatParser::ParseElemData(Queue<WatToken>& tokens, varuint32& index, Instruction& op, varuint7& flags,
+                             WatTokens kind, kh_indexname_t* hash, kh_indexname_t* segmenthash, varuint32 segment)
 {
-  if(tokens[0].id == WatTokens::NUMBER || tokens[0].id == WatTokens::NAME)
+  int err;
+
+  // A number, or a name from the index space followed by an offset, is the legacy index. Any other name is a segment id.
+  if(tokens[0].id == WatTokens::NUMBER ||
+     (tokens[0].id == WatTokens::NAME && tokens.Size() > 1 && tokens[1].id == WatTokens::OPEN &&
+      GetFromHash(hash, tokens[0]) != (varuint32)~0))
     index = GetFromHash(hash, tokens.Pop());
+  else if(tokens[0].id == WatTokens::NAME && (err = AddName(segmenthash, tokens.Pop(), segment)))
+    return err;
 
   if(index == (varuint32)~0)
     return ERR_WAT_INVALID_VAR;
 
-  if(tokens[0].id == WatTokens::OPEN)
+  // An explicit (memory x) or (table x) comes before the offset
+  if(tokens.Size() > 1 && tokens[0].id == WatTokens::OPEN && tokens[1].id == kind)
+  {
+    tokens.Pop();
+    tokens.Pop();
+    index = GetFromHash(hash, tokens.Pop());
+    if(index == (varuint32)~0)
+      return ERR_WAT_INVALID_VAR;
+    EXPECTED(tokens, WatTokens::CLOSE, ERR_WAT_EXPECTED_CLOSE);
+    flags = !index ? WASM_SEGMENT_ACTIVE : WASM_SEGMENT_EXPLICIT_INDEX;
+  }
+
+  if(tokens[0].id != WatTokens::OPEN) // A segment without an offset is passive
+    flags = WASM_SEGMENT_PASSIVE;
+  else
   {
     bool offset = tokens.Size() > 1 && tokens[0].id == WatTokens::OPEN && tokens[1].id == WatTokens::OFFSET;
     if(offset)
@@ -1381,7 +1576,7 @@ int WatParser::ParseElemData(Queue<WatToken>& tokens, varuint32& index, Instruct
       EXPECTED(tokens, WatTokens::OFFSET, ERR_WAT_EXPECTED_TOKEN);
     }
 
-    int err = ParseInitializerInstruction(tokens, op, !offset); // Without an offset wrapper, only an expression is allowed
+    err = ParseInitializerInstruction(tokens, op, !offset); // Without an offset wrapper, only an expression is allowed
     if(err < 0)
       return err;
 
@@ -1394,6 +1589,14 @@ int WatParser::ParseElemData(Queue<WatToken>& tokens, varuint32& index, Instruct
 
 int WatParser::ParseElem(TableInit& e, Queue<WatToken>& tokens)
 {
+  if(tokens[0].id == WatTokens::DECLARE)
+  {
+    tokens.Pop();
+    e.flags = WASM_SEGMENT_DECLARATIVE;
+  }
+  if(tokens[0].id == WatTokens::FUNC) // The elemlist may be prefixed with its kind, which can only be func
+    tokens.Pop();
+
   while(tokens[0].id != WatTokens::CLOSE)
   {
     int err = AppendArray(env, GetFromHash(funchash, tokens.Pop()), e.elements, e.n_elements);
@@ -1411,7 +1614,7 @@ int WatParser::ParseData(Queue<WatToken>& tokens)
 {
   DataInit d = { 0 };
   int err;
-  if(err = ParseElemData(tokens, d.index, d.offset, memoryhash))
+  if(err = ParseElemData(tokens, d.index, d.offset, d.flags, WatTokens::MEMORY, memoryhash, datahash, m.data.n_data))
     return err;
 
   while(tokens[0].id != WatTokens::CLOSE)
@@ -1552,7 +1755,8 @@ int WatParser::ParseModule(Environment& env, Module& m, const char* file, Queue<
     case WatTokens::ELEM:
     {
       TableInit init = { 0 };
-      if(err = state.ParseElemData(tokens, init.index, init.offset, state.tablehash))
+      if(err = state.ParseElemData(tokens, init.index, init.offset, init.flags, WatTokens::TABLE, state.tablehash,
+                                   state.elemhash, m.element.n_elements))
         return err;
       if(err = state.ParseElem(init, tokens))
         return err;
@@ -1580,10 +1784,10 @@ int WatParser::ParseModule(Environment& env, Module& m, const char* file, Queue<
     if(s.deferred[0].func < mod.importsection.functions ||
        s.deferred[0].func >= mod.code.n_funcbody + mod.importsection.functions)
       return ERR_INVALID_FUNCTION_INDEX;
-    auto& f = mod.code.funcbody[s.deferred[0].func - mod.importsection.functions];
-    if(s.deferred[0].index >= f.n_body)
+    auto& f = s.code[s.deferred[0].func - mod.importsection.functions];
+    if(s.deferred[0].index >= f.size())
       return ERR_INVALID_FUNCTION_BODY;
-    f.body[s.deferred[0].index].immediates[0]._varuint32 = e;
+    f[s.deferred[0].index].immediates[0]._varuint32 = e;
     return ERR_SUCCESS;
   };
 
@@ -1612,7 +1816,16 @@ int WatParser::ParseModule(Environment& env, Module& m, const char* file, Queue<
     break;
     case OP_global_get:
     case OP_global_set: err = procRef(state, m, state.GetFromHash(state.globalhash, state.deferred[0].t)); break;
-    case OP_call: err = procRef(state, m, state.GetFromHash(state.funchash, state.deferred[0].t)); break;
+    case OP_call:
+    case OP_return_call: err = procRef(state, m, state.GetFromHash(state.funchash, state.deferred[0].t)); break;
+    case OP_misc_prefix | (OP_memory_init << 8):
+    case OP_misc_prefix | (OP_data_drop << 8):
+      err = procRef(state, m, state.GetFromHash(state.datahash, state.deferred[0].t));
+      break;
+    case OP_misc_prefix | (OP_table_init << 8):
+    case OP_misc_prefix | (OP_elem_drop << 8):
+      err = procRef(state, m, state.GetFromHash(state.elemhash, state.deferred[0].t));
+      break;
     default: return ERR_WAT_INVALID_TOKEN;
     }
     if(err)
@@ -1620,6 +1833,21 @@ int WatParser::ParseModule(Environment& env, Module& m, const char* file, Queue<
     state.deferred.Pop();
   }
 
+  // Now that every index is resolved, pack each function body into its compact instruction stream
+  for(varuint32 i = 0; i < m.code.n_funcbody; ++i)
+  {
+    InstructionWriter writer(true);
+    for(auto& ins : state.code[i])
+      writer.Write(ins);
+    if(err = writer.Finish(m.code.funcbody[i], env))
+      return err;
+  }
+
+  // The text format has no data count section, so we always behave as if there was one in case an instruction references
+  // a data segment
+  m.data.datacount = m.data.n_data;
+  m.knownsections |= (1 << WASM_SECTION_DATA_COUNT);
+
   m.filepath = utility::AllocString(env, file);
   m.exports  = kh_init_exports();
   assert(m.name.get());
@@ -6,6 +6,7 @@
 
 #include "lexer.h"
 #include "stack.h"
+#include <vector>
 
 namespace innative {
   namespace wat {
@@ -37,6 +38,9 @@ namespace innative {
     int ParseOperator(Queue<WatToken>& tokens, Instruction& op, FunctionBody& f, FunctionDesc& desc, FunctionType& sig,
                       DeferWatAction& defer);
     int ParseMemarg(Queue<WatToken>& tokens, Instruction& op);
+    int ParseSIMDOperator(Queue<WatToken>& tokens, Instruction& op);
+    int ParseMiscOperator(Queue<WatToken>& tokens, Instruction& op, DeferWatAction& defer);
+    int ParseV128Constant(Queue<WatToken>& tokens, Instruction& op);
     void ParseLabel(Queue<WatToken>& tokens);
     bool CheckLabel(Queue<WatToken>& tokens);
     int ParseInstruction(Queue<WatToken>& tokens, FunctionBody& f, FunctionDesc& desc, FunctionType& sig, varuint32 index);
@@ -52,7 +56,8 @@ namespace innative {
     int ParseMemory(Queue<WatToken>& tokens, varuint32* index);
     int ParseImport(Queue<WatToken>& tokens);
     int ParseExport(Queue<WatToken>& tokens);
-    int ParseElemData(Queue<WatToken>& tokens, varuint32& index, Instruction& op, wat::kh_indexname_t* hash);
+    int ParseElemData(Queue<WatToken>& tokens, varuint32& index, Instruction& op, varuint7& flags, WatTokens kind,
+                      wat::kh_indexname_t* hash, wat::kh_indexname_t* segmenthash, varuint32 segment);
     int ParseElem(TableInit& e, Queue<WatToken>& tokens);
     int ParseData(Queue<WatToken>& tokens);
     int AppendImport(Module& m, const Import& i, varuint32* index);
@@ -91,6 +96,9 @@ namespace innative {
       return ERR_SUCCESS;
     }
 
+    // Instructions are kept uncompressed until the whole module is parsed, because deferred actions patch their immediates
+    inline void AppendInstruction(const Instruction& op) { code.back().push_back(op); }
+
     template<int (WatParser::*F)(Queue<WatToken>&, varuint32*)>
     inline int ParseIndexProcess(Queue<WatToken>& tokens, wat::kh_indexname_t* hash)
     {
@@ -121,7 +129,10 @@ namespace innative {
     wat::kh_indexname_t* tablehash;
     wat::kh_indexname_t* memoryhash;
     wat::kh_indexname_t* globalhash;
+    wat::kh_indexname_t* datahash;
+    wat::kh_indexname_t* elemhash;
     std::string numbuf;
+    std::vector<std::vector<Instruction>> code; // Instructions of each function body, in the same order as m.code
   };
 
 #define EXPECTED(t, e, err)                  \
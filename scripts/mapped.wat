@@ -0,0 +1,8 @@
+(module $mapped
+  (memory 4)
+  (data (i32.const 16) "\01\02\03\04")
+  (data (i32.const 18) "\05")
+  (data (i32.const 0x30000) "\07")
+  (func (export "load") (param i32) (result i32) (i32.load8_u (local.get 0)))
+  (func (export "store") (param i32 i32) (i32.store8 (local.get 0) (local.get 1)))
+  (func (export "grow") (param i32) (result i32) (memory.grow (local.get 0))))
@@ -0,0 +1,23 @@
+(module $snapshot
+  (type $t (func (result i32)))
+  (memory 1)
+  (table 4 funcref)
+  (global $counter (mut i32) (i32.const 0))
+  (global $big (mut i64) (i64.const 0))
+  (data (i32.const 16) "\01\02")
+  (elem (i32.const 0) $seven)
+  (elem $later func $nine)
+  (func $seven (result i32) (i32.const 7))
+  (func $nine (result i32) (i32.const 9))
+  (func $start
+    (global.set $counter (i32.add (global.get $counter) (i32.const 1)))
+    (global.set $big (i64.const 0x123456789))
+    (drop (memory.grow (i32.const 1)))
+    (i32.store (i32.const 0x18000) (i32.const 12345))
+    (table.init $later (i32.const 2) (i32.const 0) (i32.const 1)))
+  (start $start)
+  (func (export "counter") (result i32) (global.get $counter))
+  (func (export "big") (result i64) (global.get $big))
+  (func (export "load") (param i32) (result i32) (i32.load (local.get 0)))
+  (func (export "size") (result i32) (memory.size))
+  (func (export "call") (param i32) (result i32) (call_indirect (type $t) (local.get 0))))